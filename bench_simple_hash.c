@@ -0,0 +1,1045 @@
+/* benchmarks for simple_hash, see `make bench`
+ *
+ * each run builds a table, drives a workload through it and prints a single
+ * line of JSON describing the run, its throughput and latency percentiles
+ *
+ * every run is performed twice over the same sequence of operations,
+ * once untimed for throughput and once timing each operation for latency,
+ * the latencies include the cost of reading the clock which is reported
+ * alongside as timer_ns
+ *
+ * with -t the same workloads are instead shared between 1, 2, 4, ... up to
+ * the given number of threads, each taking an equal slice of the operations,
+ * against a table shared in one of the ways in `shared_names`
+ *
+ * usage: bench_sh [-w workload] [-d distribution] [-k keys] [-b backend]
+ *                 [-n size]... [-o ops] [-t threads [-c table] [-s shards]]
+ *
+ * any of -w, -d, -k, -b and -c may be `all`, -n may be given more than once
+ * run with -h for the accepted values
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h> /* printf, fprintf */
+#include <stdlib.h> /* malloc, free, qsort, strtoul */
+#include <string.h> /* strcmp, strlen, sprintf */
+#include <stdint.h> /* uint32_t, uint64_t */
+#include <math.h> /* pow */
+#include <time.h> /* clock_gettime */
+#include <unistd.h> /* getopt */
+#include <pthread.h> /* pthread_create, pthread_join, pthread_mutex_t */
+
+#include "simple_hash.h"
+
+/* the sizes used when no -n is given
+ * chosen to fit in L1, in L2, and to fall well beyond the LLC
+ */
+static const size_t default_sizes[] = { 256, 16384, 1048576 };
+
+/* maximum number of -n options */
+#define BENCH_MAX_SIZES 16
+
+/* default number of operations per run, insert runs always do `size` */
+#define BENCH_DEFAULT_OPS 1000000
+
+/* the zipfian skew, as used by YCSB */
+#define BENCH_ZIPF_THETA 0.99
+
+enum bench_workload {
+    /* insert `size` new keys into an empty table */
+    BENCH_INSERT = 0,
+    /* 95% sh_get and 5% sh_set of existing keys */
+    BENCH_READ,
+    /* sh_set of keys drawn from twice as many keys as are present,
+     * so roughly half update and half insert
+     */
+    BENCH_UPSERT,
+    /* delete a key then insert it again */
+    BENCH_CHURN,
+    /* sh_get of keys which are not present */
+    BENCH_MISS,
+    BENCH_N_WORKLOADS
+};
+
+static const char *workload_names[] = { "insert", "read", "upsert", "churn", "miss" };
+
+enum bench_dist {
+    /* every key equally likely */
+    BENCH_UNIFORM = 0,
+    /* a few keys very likely, see BENCH_ZIPF_THETA */
+    BENCH_ZIPF,
+    /* keys in the order they were created, wrapping around */
+    BENCH_SEQUENTIAL,
+    BENCH_N_DISTS
+};
+
+static const char *dist_names[] = { "uniform", "zipf", "sequential" };
+
+/* short keys are up to 9 bytes, long keys are 64 bytes */
+static const char *key_names[] = { "short", "long" };
+
+static const char *backend_names[] = { "chaining", "robin_hood", "swiss" };
+
+/* default number of shards for BENCH_SHARDED */
+#define BENCH_DEFAULT_SHARDS 64
+
+/* the ways a table may be shared between threads, see -t */
+enum bench_shared {
+    /* a single sh_table behind one mutex */
+    BENCH_GLOBAL = 0,
+    /* a sh_sharded */
+    BENCH_SHARDED,
+    /* a sh_rcu, chaining only */
+    BENCH_RCU,
+    /* a sh_lf, chaining only */
+    BENCH_LOCKFREE,
+    /* a sh_fc */
+    BENCH_COMBINING,
+    BENCH_N_SHARED
+};
+
+static const char *shared_names[] = { "global", "sharded", "rcu", "lockfree", "combining" };
+
+/* the kinds of operation a workload is made up of */
+enum bench_kind {
+    BENCH_OP_GET = 0,
+    BENCH_OP_SET,
+    BENCH_OP_INSERT,
+    BENCH_OP_DELETE
+};
+
+struct bench_op {
+    enum bench_kind kind;
+    /* index into struct bench_keys */
+    size_t key;
+};
+
+/* every key a run may use, key i is at buffer + i * stride */
+struct bench_keys {
+    char *buffer;
+    size_t stride;
+    size_t *lens;
+    size_t n;
+};
+
+/* a single run */
+struct bench_config {
+    enum bench_workload workload;
+    enum bench_dist dist;
+    unsigned int long_keys;
+    enum sh_backend backend;
+    /* number of keys present in the table, or inserted by BENCH_INSERT */
+    size_t size;
+    /* number of operations, ignored by BENCH_INSERT */
+    size_t n_ops;
+    /* number of threads sharing the table, 0 for an unshared table */
+    unsigned int n_threads;
+    /* how the table is shared, and the shards for BENCH_SHARDED */
+    enum bench_shared shared;
+    size_t n_shards;
+};
+
+/* a table shared between threads */
+struct bench_table_shared {
+    enum bench_shared shared;
+    /* for BENCH_GLOBAL */
+    struct sh_table *table;
+    pthread_mutex_t lock;
+    /* for BENCH_SHARDED */
+    struct sh_sharded *sharded;
+    /* for BENCH_RCU */
+    struct sh_rcu *rcu;
+    /* for BENCH_LOCKFREE */
+    struct sh_lf *lf;
+    /* for BENCH_COMBINING */
+    struct sh_fc *fc;
+};
+
+/* one thread of a shared run */
+struct bench_thread {
+    struct bench_table_shared *table;
+    const struct bench_keys *keys;
+    /* our slice of the operations */
+    const struct bench_op *ops;
+    size_t n_ops;
+    /* latency of each of our operations, or 0 when not timing */
+    uint32_t *latencies;
+    /* results are accumulated here so they are not optimised away */
+    size_t sink;
+};
+
+/* state for drawing keys from a distribution */
+struct bench_draw {
+    enum bench_dist dist;
+    /* our random state, see bench_rand */
+    uint64_t rng;
+    /* next key for BENCH_SEQUENTIAL */
+    size_t next;
+    /* cumulative probability of each rank for BENCH_ZIPF */
+    double *cdf;
+    size_t n;
+};
+
+/* xorshift64*, good enough to drive a benchmark
+ *
+ * returns the next 64 random bits
+ */
+uint64_t bench_rand(uint64_t *state){
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return *state * UINT64_C(2685821657736338717);
+}
+
+/* the current time in nanoseconds from an arbitrary start */
+uint64_t bench_now(void){
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* prepare `draw` to pick from `n` keys following `dist`
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int bench_draw_init(struct bench_draw *draw, enum bench_dist dist, size_t n){
+    /* iterator through ranks */
+    size_t i = 0;
+    /* running total of weights */
+    double total = 0;
+
+    draw->dist = dist;
+    draw->rng = UINT64_C(0x9e3779b97f4a7c15);
+    draw->next = 0;
+    draw->cdf = 0;
+    draw->n = n;
+
+    if( dist != BENCH_ZIPF ){
+        return 1;
+    }
+
+    draw->cdf = malloc(n * sizeof(double));
+    if( ! draw->cdf ){
+        puts("bench_draw_init: call to malloc failed");
+        return 0;
+    }
+
+    for( i=0; i<n; ++i ){
+        total += 1.0 / pow(i + 1, BENCH_ZIPF_THETA);
+        draw->cdf[i] = total;
+    }
+
+    for( i=0; i<n; ++i ){
+        draw->cdf[i] /= total;
+    }
+
+    return 1;
+}
+
+/* pick the next key from `draw`
+ *
+ * returns an index in [0, n)
+ */
+size_t bench_draw_next(struct bench_draw *draw){
+    /* a uniform value in [0, 1) */
+    double u = 0;
+    /* binary search bounds */
+    size_t lo = 0;
+    size_t hi = 0;
+    size_t mid = 0;
+
+    switch( draw->dist ){
+        case BENCH_SEQUENTIAL:
+            return draw->next++ % draw->n;
+
+        case BENCH_ZIPF:
+            u = (bench_rand(&(draw->rng)) >> 11) * (1.0 / 9007199254740992.0);
+            hi = draw->n - 1;
+            while( lo < hi ){
+                mid = lo + (hi - lo) / 2;
+                if( draw->cdf[mid] <= u ){
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            return lo;
+
+        default:
+            return bench_rand(&(draw->rng)) % draw->n;
+    }
+}
+
+/* create `n` keys, short or long
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int bench_keys_init(struct bench_keys *keys, size_t n, unsigned int long_keys){
+    /* iterator through keys */
+    size_t i = 0;
+    /* the current key */
+    char *key = 0;
+    /* scrambled key number */
+    uint64_t id = 0;
+
+    keys->stride = long_keys ? 80 : 24;
+    keys->n = n;
+    keys->buffer = malloc(n * keys->stride);
+    keys->lens = malloc(n * sizeof(size_t));
+    if( ! keys->buffer || ! keys->lens ){
+        puts("bench_keys_init: call to malloc failed");
+        free(keys->buffer);
+        free(keys->lens);
+        return 0;
+    }
+
+    for( i=0; i<n; ++i ){
+        key = keys->buffer + i * keys->stride;
+        /* scramble so keys are not in hash order */
+        id = (uint64_t) i * UINT64_C(0x9e3779b97f4a7c15);
+
+        if( long_keys ){
+            sprintf(key, "user:%08lx:session:%016lx:resource/%08lx/obj",
+                    (unsigned long) (id >> 32), (unsigned long) i, (unsigned long) (id & 0xffffffff));
+        } else {
+            /* all 64 bits, multiplying by an odd constant keeps keys unique */
+            sprintf(key, "k%08lx%08lx", (unsigned long) (id >> 32), (unsigned long) (id & 0xffffffff));
+        }
+        keys->lens[i] = strlen(key);
+    }
+
+    return 1;
+}
+
+/* build the sequence of operations for `config`
+ * keys [0, size) are present before the run, keys [size, 2 * size) are not
+ *
+ * returns the operations on success, with their number in `n_ops`
+ * returns 0 on failure
+ */
+struct bench_op * bench_ops_init(const struct bench_config *config, size_t *n_ops){
+    /* our operations */
+    struct bench_op *ops = 0;
+    /* iterator through operations */
+    size_t i = 0;
+    /* our distribution */
+    struct bench_draw draw;
+    /* random state for choosing between operations */
+    uint64_t rng = 12345;
+    /* for shuffling */
+    size_t j = 0;
+    struct bench_op swap;
+
+    *n_ops = config->workload == BENCH_INSERT ? config->size : config->n_ops;
+    if( config->workload == BENCH_CHURN ){
+        /* operations come in pairs */
+        *n_ops -= *n_ops % 2;
+    }
+
+    ops = malloc(*n_ops * sizeof(struct bench_op));
+    if( ! ops ){
+        puts("bench_ops_init: call to malloc failed");
+        return 0;
+    }
+
+    if( ! bench_draw_init(&draw, config->dist, config->workload == BENCH_UPSERT ? config->size * 2 : config->size) ){
+        puts("bench_ops_init: call to bench_draw_init failed");
+        free(ops);
+        return 0;
+    }
+
+    for( i=0; i<*n_ops; ++i ){
+        switch( config->workload ){
+            case BENCH_INSERT:
+                ops[i].kind = BENCH_OP_INSERT;
+                ops[i].key = i;
+                break;
+
+            case BENCH_READ:
+                ops[i].kind = bench_rand(&rng) % 100 < 95 ? BENCH_OP_GET : BENCH_OP_SET;
+                ops[i].key = bench_draw_next(&draw);
+                break;
+
+            case BENCH_UPSERT:
+                ops[i].kind = BENCH_OP_SET;
+                ops[i].key = bench_draw_next(&draw);
+                break;
+
+            case BENCH_CHURN:
+                ops[i].kind = i % 2 ? BENCH_OP_INSERT : BENCH_OP_DELETE;
+                ops[i].key = i % 2 ? ops[i - 1].key : bench_draw_next(&draw);
+                break;
+
+            default:
+                ops[i].kind = BENCH_OP_GET;
+                ops[i].key = config->size + bench_draw_next(&draw);
+                break;
+        }
+    }
+
+    /* only the order of inserts is affected by the distribution,
+     * anything but sequential inserts in a random order
+     */
+    if( config->workload == BENCH_INSERT && config->dist != BENCH_SEQUENTIAL ){
+        for( i=*n_ops - 1; i>0; --i ){
+            j = bench_rand(&rng) % (i + 1);
+            swap = ops[i];
+            ops[i] = ops[j];
+            ops[j] = swap;
+        }
+    }
+
+    free(draw.cdf);
+
+    return ops;
+}
+
+/* perform a single operation on `table`
+ *
+ * returns a value that depends on the result, so it cannot be optimised away
+ */
+size_t bench_op(struct sh_table *table, const struct bench_keys *keys, const struct bench_op *op){
+    /* the key to operate on */
+    const char *key = keys->buffer + op->key * keys->stride;
+    size_t key_len = keys->lens[op->key];
+
+    switch( op->kind ){
+        case BENCH_OP_GET:
+            return (size_t) sh_get_n(table, key, key_len);
+
+        case BENCH_OP_SET:
+            return sh_set_n(table, key, key_len, table);
+
+        case BENCH_OP_INSERT:
+            return sh_insert_n(table, key, key_len, table);
+
+        default:
+            return (size_t) sh_delete_n(table, key, key_len);
+    }
+}
+
+/* build a table for `config` and fill it with the keys that
+ * should be present before the run
+ *
+ * returns the table on success
+ * returns 0 on failure
+ */
+struct sh_table * bench_table(const struct bench_config *config, const struct bench_keys *keys){
+    /* our table */
+    struct sh_table *table = 0;
+    /* options to create it with */
+    struct sh_opts opts;
+    /* iterator through keys */
+    size_t i = 0;
+
+    memset(&opts, 0, sizeof opts);
+    opts.backend = config->backend;
+
+    table = sh_new_opts(16, &opts);
+    if( ! table ){
+        puts("bench_table: call to sh_new_opts failed");
+        return 0;
+    }
+
+    if( config->workload == BENCH_INSERT ){
+        return table;
+    }
+
+    for( i=0; i<config->size; ++i ){
+        if( ! sh_insert_n(table, keys->buffer + i * keys->stride, keys->lens[i], table) ){
+            puts("bench_table: call to sh_insert_n failed");
+            sh_destroy(table, 1, 0);
+            return 0;
+        }
+    }
+
+    return table;
+}
+
+/* perform a single operation on a shared table
+ *
+ * returns a value that depends on the result, so it cannot be optimised away
+ */
+size_t bench_op_shared(struct bench_table_shared *table, const struct bench_keys *keys, const struct bench_op *op){
+    /* the key to operate on */
+    const char *key = keys->buffer + op->key * keys->stride;
+    size_t key_len = keys->lens[op->key];
+    /* our result */
+    size_t result = 0;
+
+    if( table->shared == BENCH_GLOBAL ){
+        pthread_mutex_lock(&(table->lock));
+        result = bench_op(table->table, keys, op);
+        pthread_mutex_unlock(&(table->lock));
+        return result;
+    }
+
+    if( table->shared == BENCH_RCU ){
+        switch( op->kind ){
+            case BENCH_OP_GET:
+                return (size_t) sh_rcu_get_n(table->rcu, key, key_len);
+
+            case BENCH_OP_SET:
+                return sh_rcu_set_n(table->rcu, key, key_len, table);
+
+            case BENCH_OP_INSERT:
+                return sh_rcu_insert_n(table->rcu, key, key_len, table);
+
+            default:
+                return (size_t) sh_rcu_delete_n(table->rcu, key, key_len);
+        }
+    }
+
+    if( table->shared == BENCH_LOCKFREE ){
+        switch( op->kind ){
+            case BENCH_OP_GET:
+                return (size_t) sh_lf_get_n(table->lf, key, key_len);
+
+            case BENCH_OP_SET:
+                return sh_lf_set_n(table->lf, key, key_len, table);
+
+            case BENCH_OP_INSERT:
+                return sh_lf_insert_n(table->lf, key, key_len, table);
+
+            default:
+                return (size_t) sh_lf_delete_n(table->lf, key, key_len);
+        }
+    }
+
+    if( table->shared == BENCH_COMBINING ){
+        switch( op->kind ){
+            case BENCH_OP_GET:
+                return (size_t) sh_fc_get_n(table->fc, key, key_len);
+
+            case BENCH_OP_SET:
+                return sh_fc_set_n(table->fc, key, key_len, table);
+
+            case BENCH_OP_INSERT:
+                return sh_fc_insert_n(table->fc, key, key_len, table);
+
+            default:
+                return (size_t) sh_fc_delete_n(table->fc, key, key_len);
+        }
+    }
+
+    switch( op->kind ){
+        case BENCH_OP_GET:
+            return (size_t) sh_sharded_get_n(table->sharded, key, key_len);
+
+        case BENCH_OP_SET:
+            return sh_sharded_set_n(table->sharded, key, key_len, table);
+
+        case BENCH_OP_INSERT:
+            return sh_sharded_insert_n(table->sharded, key, key_len, table);
+
+        default:
+            return (size_t) sh_sharded_delete_n(table->sharded, key, key_len);
+    }
+}
+
+/* free a table made by bench_table_shared_init */
+void bench_table_shared_destroy(struct bench_table_shared *table){
+    if( table->shared == BENCH_GLOBAL ){
+        pthread_mutex_destroy(&(table->lock));
+        sh_destroy(table->table, 1, 0);
+    } else if( table->shared == BENCH_RCU ){
+        sh_rcu_destroy(table->rcu, 0);
+    } else if( table->shared == BENCH_LOCKFREE ){
+        sh_lf_destroy(table->lf, 0);
+    } else if( table->shared == BENCH_COMBINING ){
+        sh_fc_destroy(table->fc, 0);
+    } else {
+        sh_sharded_destroy(table->sharded, 0);
+    }
+}
+
+/* build a shared table for `config`, filled as for bench_table
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int bench_table_shared_init(struct bench_table_shared *table, const struct bench_config *config, const struct bench_keys *keys){
+    /* options to create it with */
+    struct sh_opts opts;
+    /* iterator through keys */
+    size_t i = 0;
+    /* each insert when filling */
+    struct bench_op op;
+
+    memset(table, 0, sizeof *table);
+    table->shared = config->shared;
+
+    if( config->shared == BENCH_GLOBAL ){
+        table->table = bench_table(config, keys);
+        if( ! table->table ){
+            return 0;
+        }
+        pthread_mutex_init(&(table->lock), 0);
+        return 1;
+    }
+
+    memset(&opts, 0, sizeof opts);
+    opts.backend = config->backend;
+
+    if( config->shared == BENCH_RCU ){
+        table->rcu = sh_rcu_new(16, 0, &opts);
+    } else if( config->shared == BENCH_LOCKFREE ){
+        table->lf = sh_lf_new(16, 0, &opts);
+    } else if( config->shared == BENCH_COMBINING ){
+        table->fc = sh_fc_new(16, 0, &opts);
+    } else {
+        table->sharded = sh_sharded_new(config->n_shards, 16 * config->n_shards, &opts);
+    }
+    if( ! table->rcu && ! table->lf && ! table->fc && ! table->sharded ){
+        puts("bench_table_shared_init: failed to create table");
+        return 0;
+    }
+
+    if( config->workload == BENCH_INSERT ){
+        return 1;
+    }
+
+    for( i=0; i<config->size; ++i ){
+        op.kind = BENCH_OP_INSERT;
+        op.key = i;
+        if( ! bench_op_shared(table, keys, &op) ){
+            puts("bench_table_shared_init: insert failed");
+            bench_table_shared_destroy(table);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* the body of each thread in a shared run */
+void * bench_thread_main(void *arg){
+    struct bench_thread *thread = arg;
+    /* iterator through operations */
+    size_t i = 0;
+    /* timing */
+    uint64_t start = 0;
+
+    if( ! thread->latencies ){
+        for( i=0; i<thread->n_ops; ++i ){
+            thread->sink += bench_op_shared(thread->table, thread->keys, &(thread->ops[i]));
+        }
+        return 0;
+    }
+
+    for( i=0; i<thread->n_ops; ++i ){
+        start = bench_now();
+        thread->sink += bench_op_shared(thread->table, thread->keys, &(thread->ops[i]));
+        thread->latencies[i] = bench_now() - start;
+    }
+
+    return 0;
+}
+
+/* run `ops` split evenly between config->n_threads threads
+ * recording latencies into `latencies` if it is non-null
+ *
+ * returns the elapsed nanoseconds on success
+ * returns 0 on failure
+ */
+uint64_t bench_threads(const struct bench_config *config, const struct bench_keys *keys, const struct bench_op *ops, size_t n_ops, uint32_t *latencies){
+    /* our table */
+    struct bench_table_shared table;
+    /* our threads */
+    struct bench_thread *threads = 0;
+    pthread_t *ids = 0;
+    /* iterator through threads */
+    unsigned int t = 0;
+    /* number of threads started */
+    unsigned int n_started = 0;
+    /* timing */
+    uint64_t start = 0;
+    uint64_t elapsed = 0;
+
+    threads = calloc(config->n_threads, sizeof(struct bench_thread));
+    ids = calloc(config->n_threads, sizeof(pthread_t));
+    if( ! threads || ! ids || ! bench_table_shared_init(&table, config, keys) ){
+        puts("bench_threads: setup failed");
+        free(threads);
+        free(ids);
+        return 0;
+    }
+
+    for( t=0; t<config->n_threads; ++t ){
+        threads[t].table = &table;
+        threads[t].keys = keys;
+        threads[t].ops = ops + n_ops / config->n_threads * t;
+        threads[t].n_ops = t + 1 == config->n_threads ? n_ops - n_ops / config->n_threads * t : n_ops / config->n_threads;
+        threads[t].latencies = latencies ? latencies + (threads[t].ops - ops) : 0;
+    }
+
+    start = bench_now();
+    for( t=0; t<config->n_threads; ++t ){
+        if( pthread_create(&(ids[t]), 0, bench_thread_main, &(threads[t])) ){
+            puts("bench_threads: call to pthread_create failed");
+            break;
+        }
+        ++n_started;
+    }
+    for( t=0; t<n_started; ++t ){
+        pthread_join(ids[t], 0);
+    }
+    elapsed = bench_now() - start;
+
+    bench_table_shared_destroy(&table);
+    free(threads);
+    free(ids);
+
+    if( n_started != config->n_threads ){
+        return 0;
+    }
+
+    return elapsed ? elapsed : 1;
+}
+
+/* compare two latencies for qsort */
+int bench_compare(const void *a, const void *b){
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* the median cost of reading the clock twice, in nanoseconds */
+uint32_t bench_timer_ns(void){
+    uint32_t samples[1001];
+    /* iterator through samples */
+    size_t i = 0;
+    uint64_t start = 0;
+
+    for( i=0; i<1001; ++i ){
+        start = bench_now();
+        samples[i] = bench_now() - start;
+    }
+
+    qsort(samples, 1001, sizeof(uint32_t), bench_compare);
+
+    return samples[500];
+}
+
+/* print the results of a run, sorting `latencies` */
+void bench_report(const struct bench_config *config, size_t n_ops, uint64_t elapsed, uint32_t *latencies){
+    qsort(latencies, n_ops, sizeof(uint32_t), bench_compare);
+
+    printf("{\"workload\":\"%s\",\"dist\":\"%s\",\"keys\":\"%s\",\"backend\":\"%s\",",
+           workload_names[config->workload],
+           dist_names[config->dist],
+           key_names[config->long_keys],
+           backend_names[config->backend]);
+
+    if( config->n_threads ){
+        printf("\"table\":\"%s\",\"threads\":%u,", shared_names[config->shared], config->n_threads);
+        if( config->shared == BENCH_SHARDED ){
+            printf("\"shards\":%lu,", (unsigned long) config->n_shards);
+        }
+    }
+
+    printf("\"size\":%lu,\"ops\":%lu,\"mops\":%.3f,"
+           "\"p50_ns\":%lu,\"p99_ns\":%lu,\"p999_ns\":%lu,\"timer_ns\":%lu}\n",
+           (unsigned long) config->size,
+           (unsigned long) n_ops,
+           elapsed ? n_ops * 1000.0 / elapsed : 0,
+           (unsigned long) latencies[n_ops * 50 / 100],
+           (unsigned long) latencies[n_ops * 99 / 100],
+           (unsigned long) latencies[n_ops * 999 / 1000],
+           (unsigned long) bench_timer_ns());
+    fflush(stdout);
+}
+
+/* perform the run described by `config`, printing its results
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int bench_run(const struct bench_config *config, const struct bench_keys *keys){
+    /* our table */
+    struct sh_table *table = 0;
+    /* our operations */
+    struct bench_op *ops = 0;
+    size_t n_ops = 0;
+    /* latency of each operation */
+    uint32_t *latencies = 0;
+    /* iterator through operations */
+    size_t i = 0;
+    /* timings */
+    uint64_t start = 0;
+    uint64_t elapsed = 0;
+    /* results are accumulated here so they are not optimised away */
+    volatile size_t sink = 0;
+
+    ops = bench_ops_init(config, &n_ops);
+    latencies = malloc((n_ops ? n_ops : 1) * sizeof(uint32_t));
+    if( ! ops || ! latencies ){
+        puts("bench_run: allocation failed");
+        free(ops);
+        free(latencies);
+        return 0;
+    }
+
+    if( config->n_threads ){
+        elapsed = bench_threads(config, keys, ops, n_ops, 0);
+        if( ! elapsed || ! bench_threads(config, keys, ops, n_ops, latencies) ){
+            free(ops);
+            free(latencies);
+            return 0;
+        }
+        bench_report(config, n_ops, elapsed, latencies);
+        free(ops);
+        free(latencies);
+        return 1;
+    }
+
+    /* throughput */
+    table = bench_table(config, keys);
+    if( ! table ){
+        free(ops);
+        free(latencies);
+        return 0;
+    }
+
+    start = bench_now();
+    for( i=0; i<n_ops; ++i ){
+        sink += bench_op(table, keys, &(ops[i]));
+    }
+    elapsed = bench_now() - start;
+    sh_destroy(table, 1, 0);
+
+    /* latency */
+    table = bench_table(config, keys);
+    if( ! table ){
+        free(ops);
+        free(latencies);
+        return 0;
+    }
+
+    for( i=0; i<n_ops; ++i ){
+        start = bench_now();
+        sink += bench_op(table, keys, &(ops[i]));
+        latencies[i] = bench_now() - start;
+    }
+    sh_destroy(table, 1, 0);
+
+    bench_report(config, n_ops, elapsed, latencies);
+
+    free(ops);
+    free(latencies);
+
+    return 1;
+}
+
+/* perform `config` shared between 1, 2, 4, ... and finally `max_threads`
+ * threads, for the given way of sharing or every way if `shared` is
+ * BENCH_N_SHARED
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int bench_run_threads(struct bench_config *config, const struct bench_keys *keys, unsigned int max_threads, size_t shared){
+    /* iterator through ways of sharing */
+    size_t c = 0;
+    /* number of threads */
+    unsigned int t = 0;
+
+    for( c=0; c<BENCH_N_SHARED; ++c ){
+        if( shared != BENCH_N_SHARED && shared != c ){
+            continue;
+        }
+
+        /* sh_rcu and sh_lf are always chained */
+        if( (c == BENCH_RCU || c == BENCH_LOCKFREE) && config->backend != SH_BACKEND_CHAINING ){
+            continue;
+        }
+
+        config->shared = c;
+        for( t=1; ; t*=2 ){
+            config->n_threads = t < max_threads ? t : max_threads;
+            if( ! bench_run(config, keys) ){
+                return 0;
+            }
+            if( t >= max_threads ){
+                break;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/* find `name` within `names`
+ *
+ * returns the index of `name` on success
+ * returns `n` if `name` is `all`
+ * returns `n + 1` if `name` is unknown
+ */
+size_t bench_lookup(const char *name, const char **names, size_t n){
+    /* iterator through names */
+    size_t i = 0;
+
+    if( ! strcmp(name, "all") ){
+        return n;
+    }
+
+    for( i=0; i<n; ++i ){
+        if( ! strcmp(name, names[i]) ){
+            return i;
+        }
+    }
+
+    return n + 1;
+}
+
+void bench_usage(void){
+    fprintf(stderr, "usage: bench_sh [-w workload] [-d distribution] [-k keys] [-b backend] [-n size]... [-o ops]\n"
+                    "                [-t threads [-c table] [-s shards]]\n"
+                    "  -w  insert, read, upsert, churn, miss or all (default all)\n"
+                    "  -d  uniform, zipf, sequential or all (default all)\n"
+                    "  -k  short, long or all (default short)\n"
+                    "  -b  chaining, robin_hood, swiss or all (default chaining)\n"
+                    "  -n  number of keys in the table, may be repeated (default 256 16384 1048576)\n"
+                    "  -o  operations per run, except insert which does `size` (default %d)\n"
+                    "  -t  share the table between 1, 2, 4, ... up to this many threads\n"
+                    "  -c  global, sharded, rcu, lockfree, combining or all,\n"
+                    "      how the table is shared (default all)\n"
+                    "  -s  number of shards for -c sharded (default %d)\n",
+                    BENCH_DEFAULT_OPS, BENCH_DEFAULT_SHARDS);
+}
+
+int main(int argc, char **argv){
+    /* what to run, each an index into the names above or `all` */
+    size_t workload = BENCH_N_WORKLOADS;
+    size_t dist = BENCH_N_DISTS;
+    size_t long_keys = 0;
+    size_t backend = 0;
+    size_t sizes[BENCH_MAX_SIZES];
+    size_t n_sizes = 0;
+    size_t n_ops = BENCH_DEFAULT_OPS;
+    unsigned int max_threads = 0;
+    size_t shared = BENCH_N_SHARED;
+    size_t n_shards = BENCH_DEFAULT_SHARDS;
+    /* iterators through each of the above */
+    size_t w = 0;
+    size_t d = 0;
+    size_t k = 0;
+    size_t b = 0;
+    size_t s = 0;
+    /* current option */
+    int opt = 0;
+    /* keys for the current size and length */
+    struct bench_keys keys;
+    /* the current run */
+    struct bench_config config;
+
+    while( (opt = getopt(argc, argv, "w:d:k:b:n:o:t:c:s:h")) != -1 ){
+        switch( opt ){
+            case 'w':
+                workload = bench_lookup(optarg, workload_names, BENCH_N_WORKLOADS);
+                break;
+            case 'd':
+                dist = bench_lookup(optarg, dist_names, BENCH_N_DISTS);
+                break;
+            case 'k':
+                long_keys = bench_lookup(optarg, key_names, 2);
+                break;
+            case 'b':
+                backend = bench_lookup(optarg, backend_names, 3);
+                break;
+            case 'n':
+                if( n_sizes == BENCH_MAX_SIZES ){
+                    bench_usage();
+                    return 1;
+                }
+                sizes[n_sizes++] = strtoul(optarg, 0, 10);
+                break;
+            case 'o':
+                n_ops = strtoul(optarg, 0, 10);
+                break;
+            case 't':
+                max_threads = strtoul(optarg, 0, 10);
+                break;
+            case 'c':
+                shared = bench_lookup(optarg, shared_names, BENCH_N_SHARED);
+                break;
+            case 's':
+                n_shards = strtoul(optarg, 0, 10);
+                break;
+            default:
+                bench_usage();
+                return 1;
+        }
+    }
+
+    if( workload > BENCH_N_WORKLOADS || dist > BENCH_N_DISTS || long_keys > 2 || backend > 3 ||
+        shared > BENCH_N_SHARED || ! n_shards ){
+        bench_usage();
+        return 1;
+    }
+
+    if( ! n_sizes ){
+        for( s=0; s<sizeof default_sizes / sizeof default_sizes[0]; ++s ){
+            sizes[n_sizes++] = default_sizes[s];
+        }
+    }
+
+    for( s=0; s<n_sizes; ++s ){
+        if( ! sizes[s] ){
+            bench_usage();
+            return 1;
+        }
+
+        for( k=0; k<2; ++k ){
+            if( long_keys != 2 && long_keys != k ){
+                continue;
+            }
+
+            /* twice as many keys as the table holds, see bench_ops_init */
+            if( ! bench_keys_init(&keys, sizes[s] * 2, k) ){
+                return 1;
+            }
+
+            for( w=0; w<BENCH_N_WORKLOADS; ++w ){
+                for( d=0; d<BENCH_N_DISTS; ++d ){
+                    for( b=0; b<3; ++b ){
+                        if( (workload != BENCH_N_WORKLOADS && workload != w) ||
+                            (dist != BENCH_N_DISTS && dist != d) ||
+                            (backend != 3 && backend != b) ){
+                            continue;
+                        }
+
+                        config.workload = w;
+                        config.dist = d;
+                        config.long_keys = k;
+                        config.backend = b;
+                        config.size = sizes[s];
+                        config.n_ops = n_ops;
+                        config.n_threads = 0;
+                        config.n_shards = n_shards;
+
+                        if( max_threads ){
+                            if( ! bench_run_threads(&config, &keys, max_threads, shared) ){
+                                return 1;
+                            }
+                        } else if( ! bench_run(&config, &keys) ){
+                            return 1;
+                        }
+                    }
+                }
+            }
+
+            free(keys.buffer);
+            free(keys.lens);
+        }
+    }
+
+    return 0;
+}
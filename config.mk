@@ -4,7 +4,7 @@ PREFIX = /usr
 MANPREFIX = ${PREFIX}/share/man
 
 INCS =
-LIBS =
+LIBS = -lpthread
 
 # NB: including  -fprofile-arcs -ftest-coverage for gcov
 # travis wasn't happy with -Wmaybe-uninitialized  so removed for now
@@ -19,3 +19,7 @@ LDFLAGS = -fprofile-arcs ${LIBS}
 # gcov free version
 #LDFLAGS = ${LIBS}
 
+# optimised and gcov free, used by `make bench`
+BENCHFLAGS = -std=c99 -pedantic -Werror -Wall -Wextra -Wshadow -Wdeclaration-after-statement -O2 -DNDEBUG ${INCS}
+BENCHLIBS = -lm ${LIBS}
+BENCHARGS =
@@ -29,6 +29,13 @@ int main(void){
     /* insert or update as need be */
     sh_set(t, "boop", &data_2);
 
+    /* fetch, distinguishing a missing key from stored 0 */
+    if( sh_lookup(t, "boop", (void **) &data) ){
+    }
+
+    /* fetch a slot to modify in place, inserting if missing */
+    *sh_get_or_insert(t, "counter", 0) = &data_1;
+
     /* check a key exists */
     if( sh_exists(t, "hello") ){
     }
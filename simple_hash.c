@@ -23,15 +23,112 @@
  * SOFTWARE.
  */
 
+/* clock_gettime for SH_TELEMETRY, pthread_rwlock_t for sh_sharded */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#ifdef DEBUG
 #include <stdio.h> /* puts, printf */
+#endif
 #include <limits.h> /* ULONG_MAX */
+#include <stdint.h> /* SIZE_MAX */
 
 #include <stdlib.h> /* calloc, free */
-#include <string.h> /* strcmp, strlen */
+#include <string.h> /* memcmp, memcpy, strlen */
 #include <stddef.h> /* size_t */
 
+#ifndef SH_NO_THREADS
+#include <pthread.h> /* pthread_create, pthread_join, pthread_rwlock_t */
+#endif
+
+#ifdef SH_TELEMETRY
+#include <time.h> /* clock_gettime */
+#endif
+
 #include "simple_hash.h"
 
+/* the swiss backend compares a group of 16 control bytes in one instruction
+ * when SSE2 is available, define SH_NO_SIMD to force the portable version
+ */
+#if defined(__SSE2__) && ! defined(SH_NO_SIMD)
+#include <emmintrin.h> /* _mm_cmpeq_epi8, _mm_movemask_epi8 */
+#define SH_SWISS_SSE2
+#endif
+
+/* number of slots in each group of the swiss backend,
+ * swiss tables are never smaller than a single group
+ */
+#define SH_SWISS_GROUP 16
+
+/* a hint to start loading `addr` into cache, used by the batch operations
+ * this never faults so `addr` need not be valid
+ */
+#if defined(__GNUC__)
+#define SH_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define SH_PREFETCH(addr) ((void) (addr))
+#endif
+
+/* storage for sh_last_error, one per thread where the compiler offers
+ * thread local storage, otherwise a single value shared by every thread
+ */
+#if defined(SH_NO_THREADS)
+#define SH_THREAD_LOCAL
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && ! defined(__STDC_NO_THREADS__)
+#define SH_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__)
+#define SH_THREAD_LOCAL __thread
+#else
+#define SH_THREAD_LOCAL
+#endif
+
+/* atomic accesses for the lock free parts of sh_rcu and sh_lf
+ *  SH_ACQUIRE(ptr) loads *ptr, seeing everything written before it was stored
+ *  SH_RELEASE(ptr, value) stores value, publishing everything written before
+ *  SH_FENCE() orders every earlier access before every later one
+ *  SH_CAS(ptr, expected, desired) stores desired if *ptr equals the lvalue
+ *   expected and is 1, otherwise loads *ptr into expected and is 0
+ *  SH_FETCH_ADD(ptr, n) adds n to *ptr and is the value before
+ * with SH_NO_THREADS, or without GCC style atomics, these are plain accesses
+ */
+#if defined(__GNUC__) && ! defined(SH_NO_THREADS)
+#define SH_ACQUIRE(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define SH_RELEASE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#define SH_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define SH_CAS(ptr, expected, desired) __atomic_compare_exchange_n((ptr), &(expected), (desired), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define SH_FETCH_ADD(ptr, n) __atomic_fetch_add((ptr), (n), __ATOMIC_ACQ_REL)
+#else
+#define SH_ACQUIRE(ptr) (*(ptr))
+#define SH_RELEASE(ptr, value) (*(ptr) = (value))
+#define SH_FENCE() ((void) 0)
+#define SH_CAS(ptr, expected, desired) (*(ptr) == (expected) ? (*(ptr) = (desired), 1) : ((expected) = *(ptr), 0))
+#define SH_FETCH_ADD(ptr, n) ((*(ptr) += (n)) - (n))
+#endif
+
+/* operational counters and latencies, see struct sh_telemetry
+ *
+ * these are compiled out entirely unless SH_TELEMETRY is defined:
+ *  SH_CLOCK() is the time an operation started, or 0
+ *  SH_RECORD counts an operation as a hit or miss, with its latency
+ *  SH_RESIZED counts a resize and the time it took
+ *  SH_VISIT counts an entry compared against while searching
+ *  SH_VISITS(table) is the counter SH_VISIT increments for `table`
+ */
+#ifdef SH_TELEMETRY
+#define SH_CLOCK() sh_telemetry_now()
+#define SH_RECORD(table, op, hit, started) sh_telemetry_record((table), (op), (hit), (started))
+#define SH_RESIZED(table, started) sh_telemetry_resized((table), (started))
+#define SH_VISIT(visits) sh_telemetry_add((visits), 1)
+#define SH_VISITS(table) ((table)->telemetry ? &((table)->telemetry->nodes_visited) : 0)
+#else
+#define SH_CLOCK() 0
+#define SH_RECORD(table, op, hit, started) ((void) (started))
+#define SH_RESIZED(table, started) ((void) (started))
+#define SH_VISIT(visits) ((void) (visits))
+#define SH_VISITS(table) 0
+#endif
+
 /* leaving this in place as we have some internal only helper functions
  * that we only exposed to allow for easy testing and extension
  */
@@ -50,39 +147,346 @@
  * or extension
  */
 
+/* the last failure on this thread, see sh_last_error */
+static SH_THREAD_LOCAL enum sh_error sh_error_last = SH_OK;
+
+/* the log installed by sh_set_log, if any */
+static void (*sh_error_log)(enum sh_error error, const char *message, void *data) = 0;
+static void *sh_error_log_data = 0;
+
+/* record a failure of kind `error` for sh_last_error
+ * and pass `message` to the log, if any
+ */
+void sh_fail(enum sh_error error, const char *message){
+    sh_error_last = error;
+
+    if( sh_error_log ){
+        sh_error_log(error, message, sh_error_log_data);
+    }
+}
+
+/* pass `message` to the log, if any, without recording a new failure
+ *
+ * used as a failure propagates up through its callers, and for warnings,
+ * the log is given the failure already recorded
+ */
+void sh_trace(const char *message){
+    if( sh_error_log ){
+        sh_error_log(sh_error_last, message, sh_error_log_data);
+    }
+}
+
+/* the slab allocator, see opts.slab
+ *
+ * allocations of up to SH_SLAB_CLASSES * SH_SLAB_ALIGN bytes are rounded up
+ * to a multiple of SH_SLAB_ALIGN and carved from SH_SLAB_BLOCK bytes blocks,
+ * freed chunks are pushed onto an intrusive free list for their size and
+ * reused before any new space is carved
+ *
+ * anything larger goes to malloc and is counted in `n_large`
+ */
+#define SH_SLAB_ALIGN 16
+#define SH_SLAB_BLOCK 65536
+
+/* allocate and initialise a new, empty, sh_slab
+ *
+ * returns pointer on success
+ * returns 0 on failure
+ */
+struct sh_slab * sh_slab_new(void){
+    /* our new slab */
+    struct sh_slab *slab = 0;
+
+    /* calloc leaves every list empty */
+    slab = calloc(1, sizeof(struct sh_slab));
+    if( ! slab ){
+        sh_fail(SH_ERR_NOMEM, "sh_slab_new: call to calloc failed");
+        return 0;
+    }
+
+    return slab;
+}
+
+/* the size class for an allocation of `size` bytes
+ * `size` must be at most SH_SLAB_CLASSES * SH_SLAB_ALIGN
+ */
+size_t sh_slab_class(size_t size){
+    if( ! size ){
+        return 0;
+    }
+
+    return (size - 1) / SH_SLAB_ALIGN;
+}
+
+/* return `ptr`, allocated by sh_slab_alloc with the same `size`, to `slab`
+ * a null `slab` frees to malloc
+ */
+void sh_slab_free(struct sh_slab *slab, void *ptr, size_t size){
+    /* our size class */
+    size_t class = 0;
+
+    if( ! ptr ){
+        return;
+    }
+
+    if( ! slab || size > SH_SLAB_CLASSES * SH_SLAB_ALIGN ){
+        if( slab ){
+            --slab->n_large;
+        }
+        free(ptr);
+        return;
+    }
+
+    class = sh_slab_class(size);
+    *(void **) ptr = slab->free_chunks[class];
+    slab->free_chunks[class] = ptr;
+}
+
+/* allocate `size` bytes from `slab`
+ * a null `slab` allocates from malloc
+ *
+ * the memory is not zeroed
+ *
+ * returns pointer on success
+ * returns 0 on failure
+ */
+void * sh_slab_alloc(struct sh_slab *slab, size_t size){
+    /* our size class */
+    size_t class = 0;
+    /* bytes in our size class */
+    size_t chunk_size = 0;
+    /* our chunk */
+    char *chunk = 0;
+    /* a new block */
+    char *block = 0;
+
+    if( ! slab || size > SH_SLAB_CLASSES * SH_SLAB_ALIGN ){
+        chunk = malloc(size ? size : 1);
+        if( ! chunk ){
+            sh_fail(SH_ERR_NOMEM, "sh_slab_alloc: call to malloc failed");
+            return 0;
+        }
+        if( slab ){
+            ++slab->n_large;
+        }
+        return chunk;
+    }
+
+    class = sh_slab_class(size);
+    chunk_size = (class + 1) * SH_SLAB_ALIGN;
+
+    /* reuse a freed chunk if we have one */
+    if( slab->free_chunks[class] ){
+        chunk = slab->free_chunks[class];
+        slab->free_chunks[class] = *(void **) chunk;
+        return chunk;
+    }
+
+    if( slab->remaining < chunk_size ){
+        block = malloc(SH_SLAB_BLOCK);
+        if( ! block ){
+            sh_fail(SH_ERR_NOMEM, "sh_slab_alloc: call to malloc failed");
+            return 0;
+        }
+
+        /* keep what is left of the old block for later */
+        if( slab->remaining ){
+            sh_slab_free(slab, slab->cursor, slab->remaining);
+        }
+
+        /* the first SH_SLAB_ALIGN bytes link the blocks together */
+        *(void **) block = slab->blocks;
+        slab->blocks = block;
+        slab->cursor = block + SH_SLAB_ALIGN;
+        slab->remaining = SH_SLAB_BLOCK - SH_SLAB_ALIGN;
+    }
+
+    chunk = slab->cursor;
+    slab->cursor += chunk_size;
+    slab->remaining -= chunk_size;
+
+    return chunk;
+}
+
+/* free every block in `slab`, and so every chunk allocated from it,
+ * along with the slab itself
+ *
+ * allocations that were too large for the slab are not freed
+ */
+void sh_slab_destroy(struct sh_slab *slab){
+    /* the block to free */
+    void *block = 0;
+
+    if( ! slab ){
+        return;
+    }
+
+    while( slab->blocks ){
+        block = slab->blocks;
+        slab->blocks = *(void **) block;
+        free(block);
+    }
+
+    free(slab);
+}
+
+/* move every block and free chunk in `src` into `dest`, then free `src`
+ * so that everything allocated from `src` is now released with `dest`
+ *
+ * the unused remainder of src's newest block is not reused,
+ * though it is still freed along with the block
+ */
+void sh_slab_merge(struct sh_slab *dest, struct sh_slab *src){
+    /* the last block, or chunk, in a list */
+    void **last = 0;
+    /* iterator through size classes */
+    size_t class = 0;
+
+    if( ! dest || ! src ){
+        return;
+    }
+
+    if( src->blocks ){
+        for( last = src->blocks; *last; last = *last ){
+        }
+        *last = dest->blocks;
+        dest->blocks = src->blocks;
+    }
+
+    for( class=0; class<SH_SLAB_CLASSES; ++class ){
+        if( ! src->free_chunks[class] ){
+            continue;
+        }
+
+        for( last = src->free_chunks[class]; *last; last = *last ){
+        }
+        *last = dest->free_chunks[class];
+        dest->free_chunks[class] = src->free_chunks[class];
+    }
+
+    dest->n_large += src->n_large;
+
+    free(src);
+}
+
+#ifdef SH_TELEMETRY
+/* the current time in nanoseconds from an arbitrary start
+ *
+ * returns the time, never 0
+ */
+uint64_t sh_telemetry_now(void){
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec + 1;
+}
+
+/* add `n` to `counter`, which may be 0
+ *
+ * counters may be written by several threads at once, such as readers
+ * sharing a shard of a struct sh_sharded, and read at any time by
+ * sh_telemetry_snapshot, so are added to atomically (without any ordering)
+ */
+void sh_telemetry_add(uint64_t *counter, uint64_t n){
+    if( ! counter ){
+        return;
+    }
+
+#if defined(__GNUC__)
+    (void) __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+#else
+    *counter += n;
+#endif
+}
+
+/* read `counter`, see sh_telemetry_add */
+uint64_t sh_telemetry_load(const uint64_t *counter){
+#if defined(__GNUC__)
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+#else
+    return *counter;
+#endif
+}
+
+/* count an operation of kind `op` on `table` as a hit or miss
+ * along with its latency, if `started` is non-zero
+ */
+void sh_telemetry_record(const struct sh_table *table, enum sh_op op, unsigned int hit, uint64_t started){
+    struct sh_telemetry *telemetry = table->telemetry;
+    /* nanoseconds taken */
+    uint64_t elapsed = 0;
+    /* our latency bucket */
+    size_t bucket = 0;
+
+    if( ! telemetry ){
+        return;
+    }
+
+    if( hit ){
+        sh_telemetry_add(&(telemetry->hits[op]), 1);
+    } else {
+        sh_telemetry_add(&(telemetry->misses[op]), 1);
+    }
+
+    if( ! started ){
+        return;
+    }
+
+    /* bucket i holds [2^i, 2^(i+1)) nanoseconds */
+    for( elapsed = sh_telemetry_now() - started;
+         elapsed > 1 && bucket < SH_LATENCY_BUCKETS - 1;
+         elapsed >>= 1 ){
+        ++bucket;
+    }
+
+    sh_telemetry_add(&(telemetry->latency[op][bucket]), 1);
+}
+
+/* count a resize of `table` that began at `started` */
+void sh_telemetry_resized(const struct sh_table *table, uint64_t started){
+    if( ! table->telemetry ){
+        return;
+    }
+
+    sh_telemetry_add(&(table->telemetry->resizes), 1);
+    sh_telemetry_add(&(table->telemetry->resize_ns), sh_telemetry_now() - started);
+}
+#endif
+
 /* internal strdup equivalent
  *
- * returns char* to new memory containing a strcpy on success
+ * copies exactly `len` bytes, which may include null bytes,
+ * and then null terminates the copy
+ *
+ * the copy is allocated from `slab`, or from malloc if `slab` is null,
+ * and must be released by sh_slab_free(slab, copy, len + 1)
+ *
+ * returns char* to new memory containing a copy on success
  * returns 0 on failure
  */
-char * sh_strdupn(const char *str, size_t len){
+char * sh_strdupn(struct sh_slab *slab, const char *str, size_t len){
     /* our new string */
     char *new_str = 0;
 
     if( ! str ){
-        puts("sh_strdupn: str undef");
+        sh_fail(SH_ERR_INVALID, "sh_strdupn: str undef");
         return 0;
     }
 
-    /* if len is 0 issue a warning and recalculate
-     * note that if strlen is still 0 then all is well
-     */
-    if( len == 0 ){
-        puts("sh_strdupn: provided len was 0, recalculating");
-        len = strlen(str);
-    }
-
     /* allocate our new string
      * len + 1 to fit null terminator
      */
-    new_str = calloc(len + 1, sizeof(char));
+    new_str = sh_slab_alloc(slab, len + 1);
     if( ! new_str ){
-        puts("sh_strdupn: call to calloc failed");
+        sh_trace("sh_strdupn: call to sh_slab_alloc failed");
         return 0;
     }
 
-    /* perform copy */
-    strncpy(new_str, str, len);
+    /* perform copy
+     * memcpy rather than strncpy as keys may contain null bytes
+     */
+    memcpy(new_str, str, len);
 
     /* ensure null terminator
      * do not rely on calloc as we may switch
@@ -94,24 +498,32 @@ char * sh_strdupn(const char *str, size_t len){
 }
 
 /* initialise an existing sh_entry
+ *
+ * the key is copied into memory from `slab`, see sh_strdupn,
+ * unless `borrow_key` is 1 in which case the caller's pointer is stored as is
+ *
+ * `hash` and `key_len` are used as given,
+ * 0 is a valid length (the empty key) and a valid hash
  *
  * returns 1 on success
  * returns 0 on failure
  */
-unsigned int sh_entry_init(struct sh_entry *entry,
+unsigned int sh_entry_init(struct sh_slab *slab,
+                                  struct sh_entry *entry,
                                   unsigned long int hash,
                                   const char *key,
                                   size_t key_len,
                                   void *data,
-                                  struct sh_entry *next){
+                                  struct sh_entry *next,
+                                  unsigned int borrow_key){
 
     if( ! entry ){
-        puts("sh_entry_init: entry was null");
+        sh_fail(SH_ERR_INVALID, "sh_entry_init: entry was null");
         return 0;
     }
 
     if( ! key ){
-        puts("sh_entry_init: key was null");
+        sh_fail(SH_ERR_INVALID, "sh_entry_init: key was null");
         return 0;
     }
 
@@ -119,28 +531,22 @@ unsigned int sh_entry_init(struct sh_entry *entry,
 
     /* we allow next to be null */
 
-    /* if key_len is 0 we issue a warning and recalcualte */
-    if( key_len == 0 ){
-        puts("warning sh_entry_init: provided key_len was 0, recalcuating");
-        key_len = strlen(key);
-    }
-
-    /* if hash is 0 we issue a warning and recalculate */
-    if( hash == 0 ){
-        puts("warning sh_entry_init: provided hash was 0, recalculating");
-        hash = sh_hash(key, key_len);
-    }
-
     /* setup our simple fields */
     entry->hash    = hash;
     entry->key_len = key_len;
     entry->data    = data;
     entry->next    = next;
 
-    /* we duplicate the string */
-    entry->key = sh_strdupn(key, key_len);
+    /* the caller guarantees a borrowed key outlives the entry */
+    if( borrow_key ){
+        entry->key = (char *) key;
+        return 1;
+    }
+
+    /* we duplicate the key */
+    entry->key = sh_strdupn(slab, key, key_len);
     if( ! entry->key ){
-        puts("sh_entry_init: call to sh_strdupn failed");
+        sh_trace("sh_entry_init: call to sh_strdupn failed");
         return 0;
     }
 
@@ -148,33 +554,75 @@ unsigned int sh_entry_init(struct sh_entry *entry,
     return 1;
 }
 
+/* the number of bytes allocated for an sh_entry from sh_entry_new
+ * holding a key of `key_len` bytes
+ */
+size_t sh_entry_size(size_t key_len){
+    return sizeof(struct sh_entry) + key_len + 1;
+}
+
+/* check if the key of `entry` is stored inline directly after it
+ * (see sh_entry_new) rather than in its own allocation (see sh_entry_init)
+ *
+ * returns 1 if the key is inline
+ * returns 0 otherwise
+ */
+unsigned int sh_entry_key_inline(const struct sh_entry *entry){
+    return entry->key == (const char *) (entry + 1);
+}
+
 /* allocate and initialise a new sh_entry
+ *
+ * the key is copied inline directly after the entry, within the same
+ * allocation from `slab`, so comparing against it does not have to
+ * visit a second heap object, see sh_entry_key_inline
+ *
+ * if `borrow_key` is 1 the caller's pointer is stored as is instead
  *
  * returns pointer on success
  * returns 0 on failure
  */
-struct sh_entry * sh_entry_new(unsigned long int hash,
+struct sh_entry * sh_entry_new(struct sh_slab *slab,
+                                      unsigned long int hash,
                                       const char *key,
                                       size_t key_len,
                                       void *data,
-                                      struct sh_entry *next){
+                                      struct sh_entry *next,
+                                      unsigned int borrow_key){
     struct sh_entry *she = 0;
 
-    /* alloc */
-    she = calloc(1, sizeof(struct sh_entry));
-    if( ! she ){
-        puts("sh_entry_new: call to calloc failed");
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_entry_new: key was null");
         return 0;
     }
 
-    /* init */
-    if( ! sh_entry_init(she, hash, key, key_len, data, next) ){
-        puts("sh_entry_new: call to sh_entry_init failed");
-        /* no leaking */
-        free(she);
+    /* alloc, room for the key and its null terminator after the entry
+     * unless we are borrowing the caller's key
+     */
+    she = sh_slab_alloc(slab, borrow_key ? sizeof(struct sh_entry) : sh_entry_size(key_len));
+    if( ! she ){
+        sh_trace("sh_entry_new: call to sh_slab_alloc failed");
         return 0;
     }
 
+    /* setup our simple fields */
+    she->hash    = hash;
+    she->key_len = key_len;
+    she->data    = data;
+    she->next    = next;
+
+    if( borrow_key ){
+        she->key = (char *) key;
+        return she;
+    }
+
+    /* copy the key into place
+     * memcpy rather than strncpy as keys may contain null bytes
+     */
+    she->key = (char *) (she + 1);
+    memcpy(she->key, key, key_len);
+    she->key[key_len] = '\0';
+
     return she;
 }
 
@@ -185,13 +633,19 @@ struct sh_entry * sh_entry_new(unsigned long int hash,
  * will free all other values
  *
  * will free provided *entry if `free_entry` is 1
+ * an inline key (see sh_entry_new) is freed along with its entry
+ *
+ * will only free *key if `free_key` is 1, it must be 0 for borrowed keys
+ *
+ * the key, and the entry if freed, are returned to `slab`
+ * which must be the slab they were allocated from
  *
  * returns 1 on success
  * returns 0 on failure
  */
-unsigned int sh_entry_destroy(struct sh_entry *entry, unsigned int free_entry, unsigned int free_data){
+unsigned int sh_entry_destroy(struct sh_slab *slab, struct sh_entry *entry, unsigned int free_entry, unsigned int free_data, unsigned int free_key){
     if( ! entry ){
-        puts("sh_entry_destroy: entry undef");
+        sh_fail(SH_ERR_INVALID, "sh_entry_destroy: entry undef");
         return 0;
     }
 
@@ -199,66 +653,72 @@ unsigned int sh_entry_destroy(struct sh_entry *entry, unsigned int free_entry, u
         free(entry->data);
     }
 
+    /* an inline key shares the allocation of its entry */
+    if( free_key && sh_entry_key_inline(entry) ){
+        if( free_entry ){
+            sh_slab_free(slab, entry, sh_entry_size(entry->key_len));
+        }
+        return 1;
+    }
+
     /* free key as strdup */
-    free(entry->key);
+    if( free_key ){
+        sh_slab_free(slab, entry->key, entry->key_len + 1);
+    }
 
     /* free entry if asked */
     if( free_entry ){
-        free(entry);
+        sh_slab_free(slab, entry, sizeof(struct sh_entry));
     }
 
     return 1;
 }
 
 
-/* find the sh_entry that should be holding this key
+/* find the link (pointer to an sh_entry) that is pointing at the entry
+ * holding this key within the chain starting at `head`
  *
- * returns a pointer to it on success
- * return 0 on failure
+ * this will either be `head` itself or the `next` field of the previous entry,
+ * which allows callers to both find and unlink an entry
+ *
+ * every entry compared against is counted in `visits`, if non-zero,
+ * see SH_VISIT
+ *
+ * returns a pointer to the link on success
+ * returns 0 on failure
  */
-struct sh_entry * sh_find_entry(const struct sh_table *table, const char *key){
+struct sh_entry ** sh_find_link(struct sh_entry **head, const void *key, size_t key_len, unsigned long int hash, uint64_t *visits){
+    /* the pointer where we store our next
+     * this will either be:
+     *      head
+     *      &( previous->next )
+     *
+     * where previous was the previous sh_entry we considered
+     */
+    struct sh_entry **prev = 0;
     /* our cur entry */
     struct sh_entry *cur = 0;
 
-    /* hash */
-    unsigned long int hash = 0;
-    /* position in hash table */
-    size_t pos = 0;
-    /* cached strlen */
-    size_t key_len = 0;
-
-
-    if( ! table ){
-        puts("sh_find_entry: table undef");
+    if( ! head ){
+        sh_fail(SH_ERR_INVALID, "sh_find_link: head undef");
         return 0;
     }
 
     if( ! key ){
-        puts("sh_find_entry: key undef");
+        sh_fail(SH_ERR_INVALID, "sh_find_link: key undef");
         return 0;
     }
 
-    /* cache strlen */
-    key_len = strlen(key);
-
-    /* calculate hash */
-    hash = sh_hash(key, key_len);
-
-    /* calculate pos
-     * we know table is defined here
-     * so sh_pos cannot fail
-     */
-    pos = sh_pos(hash, table->size);
-
-
     /* iterate through bucket considering each entry
      * the only tricky part here is the prev pointer
      * which is the position where we save our next
      * to ensure the linked list of entries remains intact
      */
-    for( cur = table->entries[pos];
+    for( prev = head, cur = *head;
          cur;
-         cur = cur->next ){
+         prev = &(cur->next), cur = cur->next ){
+
+        SH_VISIT(visits);
 
         if( cur->hash != hash ){
             continue;
@@ -268,689 +728,7417 @@ struct sh_entry * sh_find_entry(const struct sh_table *table, const char *key){
             continue;
         }
 
-        if( strncmp(key, cur->key, key_len) ){
+        if( memcmp(key, cur->key, key_len) ){
             continue;
         }
 
-        /* found it! return this entry */
-        return cur;
+        /* found it! return the link to this entry */
+        return prev;
     }
 
     /* failed to find element */
-#ifdef DEBUG
-    puts("sh_find_entry: failed to find key");
-#endif
     return 0;
 }
 
+/* mix `hash` by a multiplication with 2^64 / phi (fibonacci hashing)
+ *
+ * the low bits of a product only depend on the low bits of its inputs
+ * so the well mixed high half is folded back down,
+ * the top bits are left as they were and are also well mixed
+ *
+ * returns the mixed hash
+ */
+uint64_t sh_mix(unsigned long int hash){
+    /* our mixed hash */
+    uint64_t mixed = hash;
 
+    mixed *= UINT64_C(0x9e3779b97f4a7c15);
+    mixed ^= mixed >> 32;
 
-/**********************************************
- **********************************************
- **********************************************
- ******** simple_hash.h implementation ********
- **********************************************
- **********************************************
- ***********************************************/
+    return mixed;
+}
 
-/* function to return number of elements
+/* the bucket for `hash` within a bucket array of `size` belonging to `table`
  *
- * returns number on success
- * returns 0 on failure
+ * `size` is passed separately as it may be either table->size
+ * or table->old_size during an incremental resize
+ *
+ * returns the index into the bucket array
  */
-unsigned int sh_nelems(const struct sh_table *table){
-    if( ! table ){
-        puts("sh_nelems: table was null");
-        return 0;
+size_t sh_table_pos(const struct sh_table *table, unsigned long int hash, size_t size){
+    if( table->pow2 ){
+        return sh_pos_pow2(hash, size);
     }
 
-    return table->n_elems;
+    return sh_pos(hash, size);
 }
 
-/* takes a char* representing a string
+/* the bit this hash sets within a struct sh_bucket filter
  *
- * will recalculate key_len if 0
+ * taken from the top bits of the mixed hash, which neither sh_pos nor
+ * sh_pos_pow2 use to pick the bucket, so entries sharing a bucket
+ * still spread across the whole filter
  *
- * returns an unsigned long integer hash value on success
- * returns 0 on failure
+ * returns a uint64_t with exactly one bit set
  */
-unsigned long int sh_hash(const char *key, size_t key_len){
-    /* our hash value */
-    unsigned long int hash = 0;
-    /* our iterator through the key */
-    size_t i = 0;
+uint64_t sh_fingerprint(unsigned long int hash){
+    return UINT64_C(1) << (sh_mix(hash) >> 58);
+}
 
-    if( ! key ){
-        puts("sh_hash: key undef");
-        return 0;
-    }
+/* recalculate the filter of `bucket` from the entries in its chain
+ * used after an entry has been removed, as bits may be shared
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_bucket_refilter(struct sh_bucket *bucket){
+    /* current entry within bucket */
+    struct sh_entry *cur = 0;
 
-    /* we allow key_len to be 0
-     * we issue a warning and then recalculate
-     */
-    if( ! key_len ){
-        puts("sh_hash: key_len was 0, recalculating");
-        key_len = strlen(key);
+    if( ! bucket ){
+        sh_fail(SH_ERR_INVALID, "sh_bucket_refilter: bucket undef");
+        return 0;
     }
 
-#ifdef DEBUG
-    printf("sh_hash: hashing string '%s'\n", key);
-#endif
-
-    /* hashing time */
-    for( i=0; i < key_len; ++i ){
-
-#ifdef DEBUG
-    printf("sh_hash: looking at i '%zd', char '%c'\n", i, key[i]);
-#endif
-
-        /* we do not have to worry about overflow doing silly things:
-         *
-         * C99 section 6.2.5.9 page 34:
-         * A computation involving unsigned operands can never overﬂow,
-         * because a result that cannot be represented by the resulting
-         * unsigned integer type is reduced modulo the number that is one
-         * greater than the largest value that can be represented by the
-         * resulting type.
-         */
-
-        /* hash this character
-         * http://www.cse.yorku.ca/~oz/hash.html
-         * djb2
-         */
-        hash = ((hash << 5) + hash) + key[i];
+    bucket->filter = 0;
+    for( cur = bucket->head; cur; cur = cur->next ){
+        bucket->filter |= sh_fingerprint(cur->hash);
     }
 
-#ifdef DEBUG
-    puts("sh_hash: success");
-#endif
-    return hash;
+    return 1;
 }
 
-/* takes a table and a hash value
+/* find the link pointing at the entry holding this key within `bucket`
  *
- * returns the index into the table for this hash
- * returns 0 on failure (if table is null)
+ * the bucket filter is checked first so that most misses
+ * never have to walk the chain
  *
- * note the error value is indistinguishable from the 0th bucket
- * this function can only error if table is null
- * so the caller can distinguish these 2 cases
+ * every entry compared against is counted in `visits`, if non-zero
+ *
+ * returns a pointer to the link on success
+ * returns 0 on failure
  */
-size_t sh_pos(unsigned long int hash, size_t table_size){
+struct sh_entry ** sh_bucket_find(struct sh_bucket *bucket, const void *key, size_t key_len, unsigned long int hash, uint64_t *visits){
+    if( ! (bucket->filter & sh_fingerprint(hash)) ){
+        return 0;
+    }
 
-    /* force hash value into a bucket */
-    return hash % table_size;
+    return sh_find_link(&(bucket->head), key, key_len, hash, visits);
 }
 
-/* allocate and initialise a new sh_table of size size
+/* round `size` up as required by the table's mode
+ * a no-op unless the table is in power of two mode
  *
- * returns pointer on success
- * returns 0 on failure
+ * returns the rounded size on success
+ * returns 0 on failure (if the rounded size would not fit in a size_t)
  */
-struct sh_table * sh_new(size_t size){
-    struct sh_table *sht = 0;
+size_t sh_round_size(const struct sh_table *table, size_t size){
+    /* our rounded size */
+    size_t rounded = 1;
 
-    /* alloc */
-    sht = calloc(1, sizeof(struct sh_table));
-    if( ! sht ){
-        puts("sh_new: calloc failed");
-        return 0;
+    if( ! table->pow2 ){
+        return size;
     }
 
-    /* init */
-    if( ! sh_init(sht, size) ){
-        puts("sh_new: call to sh_init failed");
-        /* no leaking */
-        free(sht);
-        return 0;
+    if( table->backend == SH_BACKEND_SWISS ){
+        rounded = SH_SWISS_GROUP;
     }
 
-    return sht;
+    while( rounded < size ){
+        /* the next doubling would overflow */
+        if( rounded > SIZE_MAX / 2 ){
+            return 0;
+        }
+        rounded *= 2;
+    }
+
+    return rounded;
 }
 
-/* free an existing sh_table
- * this will free all the sh entries stored
- * this will free all the keys (as they are strdup-ed)
+/* whether sh_destroy has to visit every entry individually
  *
- * this will only free the *table pointer if `free_table` is set to 1
- * this will only free the *data pointers if `free_data` is set to 1
+ * with a slab every entry and key is released along with its blocks,
+ * so we only need to visit entries to free their data
+ * or any keys too large for the slab
  *
- * returns 1 on success
- * returns 0 on failure
+ * an open addressing table with borrowed keys has nothing
+ * allocated per entry at all
+ *
+ * returns 1 if every entry must be visited
+ * returns 0 if they can all be released at once
  */
-unsigned int sh_destroy(struct sh_table *table, unsigned int free_table, unsigned int free_data){
-    /* iterator through table */
-    size_t i = 0;
-    /* current entry */
-    struct sh_entry *cur_she = 0;
-    /* next entry to consider */
-    struct sh_entry *next_she = 0;
-
-    if( ! table ){
-        puts("sh_destroy: table undef");
-        return 0;
+unsigned int sh_destroy_walk(const struct sh_table *table, unsigned int free_data){
+    if( free_data ){
+        return 1;
     }
 
-    /* iterate through `entries` list
-     * and then iterate through each entry within it
-     * freeing them and their appropriate parts
-     */
-    for( i=0; i < table->size; ++i ){
-        next_she = table->entries[i];
-        while( next_she ){
-            cur_she = next_she;
-            next_she = next_she->next;
-
-            /* always free key as it is strdupn-ed */
-            free(cur_she->key);
-
-            /* only free data if we are asked to */
-            if( free_data ){
-                free(cur_she->data);
-            }
-        }
+    if( table->backend != SH_BACKEND_CHAINING && table->borrow_keys ){
+        return 0;
     }
 
-    /* free entires table */
-    free(table->entries);
-
-    /* finally free table if asked to */
-    if( free_table ){
-        free(table);
+    if( table->slab && ! table->slab->n_large ){
+        return 0;
     }
 
     return 1;
 }
 
-/* initialise an already allocated sh_table to size size
+/* find the link pointing at the entry holding this key within table
  *
- * returns 1 on success
+ * while an incremental resize is in progress an entry may live in either
+ * the new `entries` or in an old bucket that has not yet been migrated,
+ * so we may have to look in both
+ *
+ * if `bucket` is non-zero the bucket holding the entry is written to it
+ * so that the caller can update the bucket filter
+ *
+ * returns a pointer to the link on success
  * returns 0 on failure
  */
-unsigned int sh_init(struct sh_table *table, size_t size){
+struct sh_entry ** sh_locate(const struct sh_table *table, const void *key, size_t key_len, unsigned long int hash, struct sh_bucket **bucket){
+    /* our found link */
+    struct sh_entry **link = 0;
+    /* bucket we are searching */
+    struct sh_bucket *cur = 0;
+    /* position in old entries */
+    size_t old_pos = 0;
+
     if( ! table ){
-        puts("sh_init: table undef");
+        sh_fail(SH_ERR_INVALID, "sh_locate: table undef");
         return 0;
     }
 
-    if( size == 0 ){
-        puts("sh_init: specified size of 0, impossible");
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_locate: key undef");
         return 0;
     }
 
-    table->size    = size;
-    table->n_elems = 0;
+    /* calculate pos
+     * we know table is defined here
+     * so sh_table_pos cannot fail
+     */
+    cur = &(table->entries[sh_table_pos(table, hash, table->size)]);
+    link = sh_bucket_find(cur, key, key_len, hash, SH_VISITS(table));
+
+    /* buckets below migrate_pos have already been emptied */
+    if( ! link && table->old_entries ){
+        old_pos = sh_table_pos(table, hash, table->old_size);
+        if( old_pos >= table->migrate_pos ){
+            cur = &(table->old_entries[old_pos]);
+            link = sh_bucket_find(cur, key, key_len, hash, SH_VISITS(table));
+        }
+    }
 
-    /* calloc our buckets (pointer to sh_entry) */
-    table->entries = calloc(size, sizeof(struct sh_entry *));
-    if( ! table->entries ){
-        puts("sh_init: calloc failed");
-        return 0;
+    if( link && bucket ){
+        *bucket = cur;
     }
 
-    return 1;
+    return link;
 }
 
-/* resize an existing table to new_size
- * this will reshuffle all the buckets around
+/* the hash of the key in `handle` as used by `table`
  *
- * you can use this to make a hash larger or smaller
+ * this is the pre-computed hash if the handle was hashed with the same
+ * function and seed as the table, otherwise we have to hash again
+ *
+ * returns the hash
+ */
+unsigned long int sh_key_hash(const struct sh_table *table, const struct sh_key *handle){
+    if( handle->hash_fn == table->hash_fn &&
+        handle->seed[0] == table->seed[0] &&
+        handle->seed[1] == table->seed[1] ){
+        return handle->hash;
+    }
+
+    return table->hash_fn(handle->key, handle->key_len, table->seed);
+}
+
+/* move every entry in old bucket `pos` into its place in `entries`
  *
  * returns 1 on success
  * returns 0 on failure
  */
-unsigned int sh_resize(struct sh_table *table, size_t new_size){
-    /* our new data area */
-    struct sh_entry **new_entries = 0;
-    /* the current entry we are copying across */
+unsigned int sh_migrate_bucket(struct sh_table *table, size_t pos){
+    /* the current entry we are moving across */
     struct sh_entry *cur = 0;
     /* next entry, as we modify next pointers */
     struct sh_entry *next = 0;
-    /* our iterator through the old hash */
-    size_t i = 0;
-    /* our new position for each element */
-    size_t new_pos = 0;
+    /* the bucket each element moves to */
+    struct sh_bucket *dest = 0;
 
     if( ! table ){
-        puts("sh_resize: table was null");
-        return 0;
-    }
-
-    if( new_size == 0 ){
-        puts("sh_resize: asked for new_size of 0, impossible");
+        sh_fail(SH_ERR_INVALID, "sh_migrate_bucket: table undef");
         return 0;
     }
 
-    /* allocate a new array of pointers to sh_entry */
-    new_entries = calloc(new_size, sizeof(struct sh_entry *));
-    if( ! new_entries ){
-        puts("sh_resize: call to calloc failed");
+    if( ! table->old_entries || pos >= table->old_size ){
+        sh_fail(SH_ERR_INVALID, "sh_migrate_bucket: no such old bucket");
         return 0;
     }
 
-    /* iterate through old data */
-    for( i=0; i < table->size; ++i ){
-
-        /* we have to keep the current entry and the next
-         * as once we copy over the cur we will lose cur->next
-         */
-        for( cur = table->entries[i];
-             cur;
-             cur = next ){
-
-            /* make sure to track our next pointer */
-            next = cur->next;
+    /* we have to keep the current entry and the next
+     * as once we move the cur we will lose cur->next
+     */
+    for( cur = table->old_entries[pos].head;
+         cur;
+         cur = next ){
 
-            /* our position within new entries */
-            new_pos = sh_pos(cur->hash, new_size);
+        /* make sure to track our next pointer */
+        next = cur->next;
 
-            /* insert making sure to set next correctly */
-            cur->next = new_entries[new_pos];
-            new_entries[new_pos] = cur;
-        }
+        /* our bucket within new entries */
+        dest = &(table->entries[sh_table_pos(table, cur->hash, table->size)]);
 
+        /* insert making sure to set next correctly */
+        cur->next = dest->head;
+        dest->head = cur;
+        dest->filter |= sh_fingerprint(cur->hash);
     }
 
-    /* free old data */
-    free(table->entries);
-
-    /* swap */
-    table->size = new_size;
-    table->entries = new_entries;
+    table->old_entries[pos].head = 0;
+    table->old_entries[pos].filter = 0;
 
     return 1;
 }
 
-/* check if the supplied key already exists in this hash
+/* the highest fraction of slots an open addressing table may use,
+ * including deleted slots
  *
- * returns 1 on success (key exists)
- * returns 0 if key doesn't exist or on failure
+ * returns the load cap for open addressing backends
+ * returns 0 for SH_BACKEND_CHAINING, which has no cap
  */
-unsigned int sh_exists(const struct sh_table *table, const char *key){
-    struct sh_entry *she = 0;
+double sh_oa_max_load(const struct sh_table *table){
+    switch( table->backend ){
+        case SH_BACKEND_ROBIN_HOOD:
+            return SH_ROBIN_HOOD_MAX_LOAD;
 
-    if( ! table ){
-        puts("sh_exists: table undef");
-        return 0;
-    }
+        case SH_BACKEND_SWISS:
+            return SH_SWISS_MAX_LOAD;
 
-    if( ! key ){
-        puts("sh_exists: key undef");
-        return 0;
+        default:
+            return 0;
     }
+}
 
-#ifdef DEBUG
-    printf("sh_exist: called with key '%s', dispatching to sh_find_entry\n", key);
-#endif
-
-    /* find entry */
-    she = sh_find_entry(table, key);
-    if( ! she ){
-        /* not found */
-        return 0;
+/* the load `table` would grow at given a max_load of `max_load`,
+ * open addressing grows at its cap if `max_load` is 0 or above it
+ *
+ * returns the load, 0 if the table would never grow
+ */
+double sh_grow_load(const struct sh_table *table, double max_load){
+    if( table->backend != SH_BACKEND_CHAINING &&
+        (max_load == 0 || max_load > sh_oa_max_load(table)) ){
+        return sh_oa_max_load(table);
     }
 
-    /* found */
-    return 1;
+    return max_load;
 }
 
-/* insert `data` under `key`
- * this will only success if !sh_exists(table, key)
+/* recalculate the cached grow and shrink thresholds
+ * must be called whenever the size or load policy changes
  *
  * returns 1 on success
  * returns 0 on failure
  */
-unsigned int sh_insert(struct sh_table *table, const char *key, void *data){
-    /* our new entry */
-    struct sh_entry *she = 0;
-    /* hash */
-    unsigned long int hash = 0;
-    /* position in hash table */
-    size_t pos = 0;
-    /* cached strlen */
-    size_t key_len = 0;
+unsigned int sh_load_thresholds(struct sh_table *table){
+    /* the load we grow at */
+    double load = 0;
 
     if( ! table ){
-        puts("sh_insert: table undef");
-        return 0;
-    }
-
-    if( ! key ){
-        puts("sh_insert: key undef");
+        sh_fail(SH_ERR_INVALID, "sh_load_thresholds: table undef");
         return 0;
     }
 
-#ifdef DEBUG
-    printf("sh_insert: asked to insert for key '%s'\n", key);
-#endif
-
-    /* we allow data to be 0 */
-
-#ifdef DEBUG
-    puts("sh_insert: calling sh_exists");
-#endif
-
-    /* check for already existing key
-     * insert only works if the key is not already present
+    /* a max_load of 0 means never grow
+     * open addressing must always grow before it fills
      */
-    if( sh_exists(table, key) ){
-        puts("sh_insert: key already exists in table");
-        return 0;
+    load = sh_grow_load(table, table->max_load);
+    if( load > 0 && load * table->size < (double) SIZE_MAX ){
+        table->grow_at = load * table->size;
+    } else {
+        /* never grow, or a threshold too large to ever reach,
+         * converting which to a size_t would be undefined
+         */
+        table->grow_at = SIZE_MAX;
     }
 
-    /* cache strlen */
-    key_len = strlen(key);
-
-    /* calculate hash */
-    hash = sh_hash(key, key_len);
-
-    /* calculate pos
-     * we know table is defined here
-     * so sh_pos cannot fail
+    /* a min_load of 0 gives a threshold of 0
+     * which n_elems can never fall below
      */
-    pos = sh_pos(hash, table->size);
+    if( table->min_load * table->size < (double) SIZE_MAX ){
+        table->shrink_at = table->min_load * table->size;
+    } else {
+        table->shrink_at = SIZE_MAX;
+    }
 
-#ifdef DEBUG
-    puts("sh_insert: calling sh_entry_new");
-#endif
+    return 1;
+}
 
-    /* construct our new sh_entry
-     * sh_entry_new(unsigned long int hash,
-     *              char *key,
-     *              size_t key_len,
-     *              void *data,
-     *              struct sh_entry *next){
-     *
-     * only key needs to be defined
-     *
-     */
-    /*                (hash, key, key_len, data, next) */
-    she = sh_entry_new(hash, key, key_len, data, table->entries[pos]);
-    if( ! she ){
-        puts("sh_insert: call to sh_entry_new failed");
+/* grow the table if it is now above the load policy
+ * called after an element has been added
+ *
+ * a failure to grow is not fatal for the caller,
+ * the table is still perfectly usable just more loaded
+ *
+ * returns 1 on success (including when no resize was required)
+ * returns 0 on failure
+ */
+unsigned int sh_grow_check(struct sh_table *table){
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_grow_check: table undef");
         return 0;
     }
 
-    /* insert at front of bucket
-     * this is safe as we have already captures the current
-     * value in she->next
-     */
-    table->entries[pos] = she;
+    if( table->n_elems <= table->grow_at ){
+        return 1;
+    }
 
-    /* increment number of elements */
-    ++table->n_elems;
+    if( ! sh_resize(table, table->size * 2) ){
+        sh_trace("sh_grow_check: call to sh_resize failed");
+        return 0;
+    }
 
-    /* return success */
     return 1;
 }
 
-/* update `data` under `key`
+/* shrink the table if it is now below the load policy
+ * called after an element has been removed
  *
- * this will only succeed if sh_exists(table, key)
+ * we will never shrink below table->min_size
  *
- * returns old data on success
+ * returns 1 on success (including when no resize was required)
  * returns 0 on failure
  */
-void * sh_update(struct sh_table *table, const char *key, void *data){
-    struct sh_entry *she = 0;
-    void * old_data = 0;
+unsigned int sh_shrink_check(struct sh_table *table){
+    /* our new size */
+    size_t new_size = 0;
 
     if( ! table ){
-        puts("sh_update: table undef");
+        sh_fail(SH_ERR_INVALID, "sh_shrink_check: table undef");
         return 0;
     }
 
-    if( ! key ){
-        puts("sh_update: key undef");
-        return 0;
+    if( table->n_elems >= table->shrink_at ){
+        return 1;
     }
 
-    /* allow data to be null */
+    if( table->size <= table->min_size ){
+        return 1;
+    }
 
-    /* find entry */
-    she = sh_find_entry(table, key);
-    if( ! she ){
-        /* not found */
-        return 0;
+    new_size = table->size / 2;
+    if( new_size < table->min_size ){
+        new_size = table->min_size;
+    }
+
+    if( ! sh_resize(table, new_size) ){
+        sh_trace("sh_shrink_check: call to sh_resize failed");
+        return 0;
+    }
+
+    return 1;
+}
+
+/* call `each` on every entry within buckets [start, end) of `entries`
+ *
+ * returns 1 if every entry was visited
+ * returns 0 if `each` asked us to stop
+ */
+unsigned int sh_iterate_buckets(const struct sh_bucket *entries, size_t start, size_t end, void *state, unsigned int (*each)(void *state, const void *key, size_t key_len, void **data)){
+    /* current index into entries we are considering */
+    size_t i = 0;
+    /* current entry within bucket we are considering */
+    struct sh_entry *entry = 0;
+
+    for( i=start; i<end; ++i ){
+        /* go through each entry within bucket calling user supplied function */
+        for( entry = entries[i].head; entry; entry = entry->next ){
+            if( ! each(state, entry->key, entry->key_len, &(entry->data)) ){
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/* sh_iterate is implemented on top of sh_iterate_n
+ * this bundles the callers state and function together
+ */
+struct sh_iterate_adapter {
+    void *state;
+    unsigned int (*each)(void *state, const char *key, void **data);
+};
+
+/* sh_iterate_n function calling through to a sh_iterate function
+ * `state` is a struct sh_iterate_adapter
+ *
+ * returns the result of the adapted function
+ */
+unsigned int sh_iterate_adapt(void *state, const void *key, size_t key_len, void **data){
+    struct sh_iterate_adapter *adapter = state;
+
+    /* keys are stored null terminated, except borrowed keys
+     * which are only terminated if the caller's were, see sh_iterate
+     */
+    (void) key_len;
+
+    return adapter->each(adapter->state, key, data);
+}
+
+/* create a new entry for `key` and link it in at the front of its bucket
+ *
+ * the caller must have already checked that `key` is not present
+ *
+ * this may grow the table, which will not move the new entry
+ *
+ * returns the new entry on success
+ * returns 0 on failure
+ */
+struct sh_entry * sh_link_new(struct sh_table *table, const void *key, size_t key_len, unsigned long int hash, void *data){
+    /* our new entry */
+    struct sh_entry *she = 0;
+    /* bucket in hash table */
+    struct sh_bucket *bucket = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_link_new: table undef");
+        return 0;
+    }
+
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_link_new: key undef");
+        return 0;
+    }
+
+    /* calculate pos
+     * we know table is defined here
+     * so sh_table_pos cannot fail
+     */
+    bucket = &(table->entries[sh_table_pos(table, hash, table->size)]);
+
+#ifdef DEBUG
+    puts("sh_link_new: calling sh_entry_new");
+#endif
+
+    /* construct our new sh_entry
+     * sh_entry_new(struct sh_slab *slab,
+     *              unsigned long int hash,
+     *              char *key,
+     *              size_t key_len,
+     *              void *data,
+     *              struct sh_entry *next,
+     *              unsigned int borrow_key){
+     *
+     * only key needs to be defined
+     *
+     */
+    /*                (slab, hash, key, key_len, data, next, borrow_key) */
+    she = sh_entry_new(table->slab, hash, key, key_len, data, bucket->head, table->borrow_keys);
+    if( ! she ){
+        sh_trace("sh_link_new: call to sh_entry_new failed");
+        return 0;
+    }
+
+    /* insert at front of bucket
+     * this is safe as we have already captures the current
+     * value in she->next
+     */
+    bucket->head = she;
+    bucket->filter |= sh_fingerprint(hash);
+
+    /* increment number of elements */
+    ++table->n_elems;
+
+    /* grow if we are now too loaded
+     * the insert has already succeeded so failure here is only a warning
+     */
+    if( ! sh_grow_check(table) ){
+        sh_trace("sh_link_new: warning, call to sh_grow_check failed, continuing...");
+    }
+
+    return she;
+}
+
+/**********************************************
+ **********************************************
+ **********************************************
+ ******** open addressing *********************
+ **********************************************
+ **********************************************
+ ***********************************************/
+
+/* helpers shared by the open addressing backends
+ * every one of them keeps its entries in table->slots,
+ * where an empty (or deleted) slot has a key of 0
+ */
+
+/* make sure there is room for one more entry in an open addressing table
+ * growing it if we would otherwise exceed the load policy, or rebuilding
+ * it at the same size if deleted slots have used up the free ones
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_oa_reserve(struct sh_table *table){
+    /* the size to rebuild at, if we need to */
+    size_t new_size = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_oa_reserve: table undef");
+        return 0;
+    }
+
+    if( table->n_elems + 1 > table->grow_at ){
+        new_size = table->size * 2;
+    } else if( table->n_elems + table->n_deleted + 1 > sh_oa_max_load(table) * table->size ){
+        new_size = table->size;
+    } else {
+        return 1;
+    }
+
+    if( sh_resize(table, new_size) ){
+        return 1;
+    }
+
+    /* as for chaining a failure to grow is not fatal
+     * provided we can still leave an empty slot to end every probe
+     */
+    if( table->n_elems + table->n_deleted + 2 <= table->size ){
+        sh_trace("sh_oa_reserve: warning, call to sh_resize failed, continuing...");
+        return 1;
+    }
+
+    sh_fail(SH_ERR_FULL, "sh_oa_reserve: call to sh_resize failed and table is full");
+    return 0;
+}
+
+/* free every key (and data if `free_data` is 1) along with the slots
+ * of an open addressing table
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_oa_destroy(struct sh_table *table, unsigned int free_data){
+    /* iterator through slots */
+    size_t i = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_oa_destroy: table undef");
+        return 0;
+    }
+
+    for( i=0; sh_destroy_walk(table, free_data) && i < table->size; ++i ){
+        if( table->slots[i].key ){
+            sh_entry_destroy(table->slab, &(table->slots[i]), 0, free_data, ! table->borrow_keys);
+        }
+    }
+
+    free(table->slots);
+    table->slots = 0;
+
+    free(table->ctrl);
+    table->ctrl = 0;
+
+    return 1;
+}
+
+/* call `each` on every entry within slots [start, end)
+ * of an open addressing table
+ *
+ * returns 1 if every entry was visited
+ * returns 0 if `each` asked us to stop
+ */
+unsigned int sh_oa_iterate(struct sh_table *table, size_t start, size_t end, void *state, unsigned int (*each)(void *state, const void *key, size_t key_len, void **data)){
+    /* iterator through slots */
+    size_t i = 0;
+
+    for( i=start; i < end; ++i ){
+        if( ! table->slots[i].key ){
+            continue;
+        }
+
+        if( ! each(state, table->slots[i].key, table->slots[i].key_len, &(table->slots[i].data)) ){
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**********************************************
+ **********************************************
+ **********************************************
+ ******** robin hood backend ******************
+ **********************************************
+ **********************************************
+ ***********************************************/
+
+/* the number of slots between the entry in `slots[pos]` and its ideal slot
+ * within an array of `size` slots (a power of two)
+ *
+ * `slots[pos]` must not be empty
+ */
+size_t sh_rh_distance(const struct sh_entry *slots, size_t size, size_t pos){
+    return (pos - sh_pos_pow2(slots[pos].hash, size)) & (size - 1);
+}
+
+/* find the slot holding this key within a robin hood table
+ *
+ * returns a pointer to the slot on success
+ * returns 0 on failure
+ */
+struct sh_entry * sh_rh_find(const struct sh_table *table, const void *key, size_t key_len, unsigned long int hash){
+    /* our current slot */
+    size_t pos = 0;
+    /* distance of pos from the ideal slot for our key */
+    size_t dist = 0;
+    /* the slot at pos */
+    struct sh_entry *slot = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_rh_find: table undef");
+        return 0;
+    }
+
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_rh_find: key undef");
+        return 0;
+    }
+
+    /* the table always has a free slot so this will terminate */
+    for( pos = sh_pos_pow2(hash, table->size);
+         ;
+         pos = (pos + 1) & (table->size - 1), ++dist ){
+
+        slot = &(table->slots[pos]);
+
+        /* an empty slot ends the probe */
+        if( ! slot->key ){
+            return 0;
+        }
+
+        /* had our key been inserted it would have displaced
+         * any entry closer to its own ideal slot than we are to ours
+         */
+        if( sh_rh_distance(table->slots, table->size, pos) < dist ){
+            return 0;
+        }
+
+        SH_VISIT(SH_VISITS(table));
+
+        if( slot->hash == hash &&
+            slot->key_len == key_len &&
+            ! memcmp(key, slot->key, key_len) ){
+            return slot;
+        }
+    }
+}
+
+/* place a copy of `entry` within `slots`, an array of `size` slots
+ * (a power of two), entries further from their ideal slot than the one
+ * being placed keep their slot and the rest are shuffled along
+ *
+ * the key must not already be present and there must be a free slot
+ *
+ * returns a pointer to the slot now holding `entry`
+ */
+struct sh_entry * sh_rh_place(struct sh_entry *slots, size_t size, const struct sh_entry *entry){
+    /* the entry we are currently trying to place */
+    struct sh_entry cur = *entry;
+    /* used to swap cur with a slot */
+    struct sh_entry tmp;
+    /* our current slot */
+    size_t pos = 0;
+    /* distance of pos from the ideal slot for cur */
+    size_t dist = 0;
+    /* distance of the entry in pos from its own ideal slot */
+    size_t slot_dist = 0;
+    /* where `entry` ended up, once known */
+    struct sh_entry *placed = 0;
+
+    for( pos = sh_pos_pow2(cur.hash, size);
+         ;
+         pos = (pos + 1) & (size - 1), ++dist ){
+
+        if( ! slots[pos].key ){
+            slots[pos] = cur;
+            return placed ? placed : &(slots[pos]);
+        }
+
+        slot_dist = sh_rh_distance(slots, size, pos);
+        if( slot_dist < dist ){
+            /* the entry here is closer to home than we are
+             * so it gives up its slot and continues the probe instead
+             */
+            tmp = slots[pos];
+            slots[pos] = cur;
+            cur = tmp;
+            dist = slot_dist;
+
+            if( ! placed ){
+                placed = &(slots[pos]);
+            }
+        }
+    }
+}
+
+/* create a new entry in a robin hood table
+ * the key must not already be present
+ *
+ * this may grow the table before inserting
+ *
+ * returns a pointer to the new slot on success
+ * returns 0 on failure
+ */
+struct sh_entry * sh_rh_link_new(struct sh_table *table, const void *key, size_t key_len, unsigned long int hash, void *data){
+    /* our new entry, copied into place */
+    struct sh_entry entry;
+    /* where it was placed */
+    struct sh_entry *slot = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_rh_link_new: table undef");
+        return 0;
+    }
+
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_rh_link_new: key undef");
+        return 0;
+    }
+
+    /* grow first as that would move the slot we are about to return */
+    if( ! sh_oa_reserve(table) ){
+        sh_trace("sh_rh_link_new: call to sh_oa_reserve failed");
+        return 0;
+    }
+
+    if( ! sh_entry_init(table->slab, &entry, hash, key, key_len, data, 0, table->borrow_keys) ){
+        sh_trace("sh_rh_link_new: call to sh_entry_init failed");
+        return 0;
+    }
+
+    slot = sh_rh_place(table->slots, table->size, &entry);
+
+    ++table->n_elems;
+
+    return slot;
+}
+
+/* remove the entry in `slot` from a robin hood table
+ * every following entry not already in its ideal slot is shifted back by
+ * one, so no tombstones are needed and probe lengths shrink
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_rh_unlink(struct sh_table *table, struct sh_entry *slot){
+    /* position of the slot being vacated */
+    size_t pos = 0;
+    /* the slot after it */
+    size_t next = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_rh_unlink: table undef");
+        return 0;
+    }
+
+    if( ! slot || ! slot->key ){
+        sh_fail(SH_ERR_INVALID, "sh_rh_unlink: slot undef");
+        return 0;
+    }
+
+    /* free the key, do NOT free data, leave that up to caller */
+    if( ! sh_entry_destroy(table->slab, slot, 0, 0, ! table->borrow_keys) ){
+        sh_trace("sh_rh_unlink: warning, call to sh_entry_destroy failed, continuing...");
+    }
+
+    for( pos = slot - table->slots, next = (pos + 1) & (table->size - 1);
+         table->slots[next].key && sh_rh_distance(table->slots, table->size, next);
+         pos = next, next = (next + 1) & (table->size - 1) ){
+        table->slots[pos] = table->slots[next];
+    }
+
+    memset(&(table->slots[pos]), 0, sizeof(struct sh_entry));
+
+    --table->n_elems;
+
+    return 1;
+}
+
+/* move every entry of a robin hood table into a new array of `new_size` slots
+ * `new_size` must be a power of two
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_rh_resize(struct sh_table *table, size_t new_size){
+    /* our new slots */
+    struct sh_entry *new_slots = 0;
+    /* iterator through old slots */
+    size_t i = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_rh_resize: table undef");
+        return 0;
+    }
+
+    if( table->n_elems >= sh_oa_max_load(table) * new_size ){
+        sh_fail(SH_ERR_INVALID, "sh_rh_resize: new_size is too small to hold every entry");
+        return 0;
+    }
+
+    new_slots = calloc(new_size, sizeof(struct sh_entry));
+    if( ! new_slots ){
+        sh_fail(SH_ERR_NOMEM, "sh_rh_resize: call to calloc failed");
+        return 0;
+    }
+
+    /* entries are moved as is, no keys are copied */
+    for( i=0; i < table->size; ++i ){
+        if( table->slots[i].key ){
+            sh_rh_place(new_slots, new_size, &(table->slots[i]));
+        }
+    }
+
+    free(table->slots);
+    table->slots = new_slots;
+    table->size = new_size;
+
+    /* our thresholds are relative to size */
+    sh_load_thresholds(table);
+
+    return 1;
+}
+
+/**********************************************
+ **********************************************
+ **********************************************
+ ******** swiss backend ***********************
+ **********************************************
+ **********************************************
+ ***********************************************/
+
+/* slots are split into groups of SH_SWISS_GROUP, each slot has a control
+ * byte in table->ctrl which is one of
+ *  SH_SWISS_EMPTY      never used, ends any probe reaching this group
+ *  SH_SWISS_DELETED    used then deleted, probes continue past it
+ *  0 to 127            full, holding the top 7 bits of the mixed hash
+ *
+ * so a lookup compares its 7 bits against a whole group at once and only
+ * touches the slots (and their keys) that match
+ */
+#define SH_SWISS_EMPTY 0x80
+#define SH_SWISS_DELETED 0xfe
+
+/* the control byte stored for a full slot holding `hash` */
+unsigned char sh_sw_h2(unsigned long int hash){
+    return (unsigned char) (sh_mix(hash) >> 57);
+}
+
+/* the group to begin probing at for `hash` within `size` slots */
+size_t sh_sw_h1(unsigned long int hash, size_t size){
+    return sh_pos_pow2(hash, size) / SH_SWISS_GROUP;
+}
+
+/* compare every control byte within the group starting at `ctrl` to `byte`
+ *
+ * returns a bitmask with bit i set if ctrl[i] == byte
+ */
+unsigned int sh_sw_match(const unsigned char *ctrl, unsigned char byte){
+#ifdef SH_SWISS_SSE2
+    /* the whole group in one register */
+    __m128i group = _mm_loadu_si128((const __m128i *) ctrl);
+
+    return (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char) byte)));
+#else
+    /* our mask */
+    unsigned int mask = 0;
+    /* iterator through group */
+    unsigned int i = 0;
+
+    for( i=0; i < SH_SWISS_GROUP; ++i ){
+        mask |= (unsigned int) (ctrl[i] == byte) << i;
+    }
+
+    return mask;
+#endif
+}
+
+/* find the slots within the group starting at `ctrl` which can be
+ * inserted into, those either empty or deleted
+ *
+ * returns a bitmask with bit i set if ctrl[i] is free
+ */
+unsigned int sh_sw_match_free(const unsigned char *ctrl){
+#ifdef SH_SWISS_SSE2
+    /* only the free control bytes have their high bit set */
+    return (unsigned int) _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) ctrl));
+#else
+    /* our mask */
+    unsigned int mask = 0;
+    /* iterator through group */
+    unsigned int i = 0;
+
+    for( i=0; i < SH_SWISS_GROUP; ++i ){
+        mask |= (unsigned int) (ctrl[i] >> 7) << i;
+    }
+
+    return mask;
+#endif
+}
+
+/* the index of the lowest set bit in `mask`, which must not be 0 */
+unsigned int sh_sw_first(unsigned int mask){
+#ifdef __GNUC__
+    return (unsigned int) __builtin_ctz(mask);
+#else
+    /* our index */
+    unsigned int i = 0;
+
+    for( ; ! (mask & 1); mask >>= 1 ){
+        ++i;
+    }
+
+    return i;
+#endif
+}
+
+/* find the first free slot along the probe sequence for `hash`
+ * within `ctrl` of `size` slots, there must be one
+ *
+ * groups are probed triangularly (1, 2, 3... groups on from the last)
+ * which visits every group as the number of groups is a power of two
+ *
+ * returns the index of the slot
+ */
+size_t sh_sw_free_slot(const unsigned char *ctrl, size_t size, unsigned long int hash){
+    /* our current group */
+    size_t group = sh_sw_h1(hash, size);
+    /* number of groups probed so far */
+    size_t step = 0;
+    /* free slots within group */
+    unsigned int mask = 0;
+
+    for( ;; ){
+        mask = sh_sw_match_free(ctrl + group * SH_SWISS_GROUP);
+        if( mask ){
+            return group * SH_SWISS_GROUP + sh_sw_first(mask);
+        }
+
+        ++step;
+        group = (group + step) & (size / SH_SWISS_GROUP - 1);
+    }
+}
+
+/* find the slot holding this key within a swiss table
+ *
+ * returns a pointer to the slot on success
+ * returns 0 on failure
+ */
+struct sh_entry * sh_sw_find(const struct sh_table *table, const void *key, size_t key_len, unsigned long int hash){
+    /* the control byte we are looking for */
+    unsigned char h2 = 0;
+    /* our current group */
+    size_t group = 0;
+    /* number of groups probed so far */
+    size_t step = 0;
+    /* candidate slots within group */
+    unsigned int mask = 0;
+    /* a candidate slot */
+    struct sh_entry *slot = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_sw_find: table undef");
+        return 0;
+    }
+
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_sw_find: key undef");
+        return 0;
+    }
+
+    h2 = sh_sw_h2(hash);
+
+    /* the table always has an empty slot so this will terminate */
+    for( group = sh_sw_h1(hash, table->size);
+         ;
+         ++step, group = (group + step) & (table->size / SH_SWISS_GROUP - 1) ){
+
+        for( mask = sh_sw_match(table->ctrl + group * SH_SWISS_GROUP, h2);
+             mask;
+             mask &= mask - 1 ){
+
+            slot = &(table->slots[group * SH_SWISS_GROUP + sh_sw_first(mask)]);
+
+            SH_VISIT(SH_VISITS(table));
+
+            if( slot->hash == hash &&
+                slot->key_len == key_len &&
+                ! memcmp(key, slot->key, key_len) ){
+                return slot;
+            }
+        }
+
+        /* had our key been inserted it would be in this group or before */
+        if( sh_sw_match(table->ctrl + group * SH_SWISS_GROUP, SH_SWISS_EMPTY) ){
+            return 0;
+        }
+    }
+}
+
+/* create a new entry in a swiss table
+ * the key must not already be present
+ *
+ * this may grow the table before inserting
+ *
+ * returns a pointer to the new slot on success
+ * returns 0 on failure
+ */
+struct sh_entry * sh_sw_link_new(struct sh_table *table, const void *key, size_t key_len, unsigned long int hash, void *data){
+    /* position of our new slot */
+    size_t pos = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_sw_link_new: table undef");
+        return 0;
+    }
+
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_sw_link_new: key undef");
+        return 0;
+    }
+
+    /* grow first as that would move the slot we are about to return */
+    if( ! sh_oa_reserve(table) ){
+        sh_trace("sh_sw_link_new: call to sh_oa_reserve failed");
+        return 0;
+    }
+
+    pos = sh_sw_free_slot(table->ctrl, table->size, hash);
+
+    if( ! sh_entry_init(table->slab, &(table->slots[pos]), hash, key, key_len, data, 0, table->borrow_keys) ){
+        sh_trace("sh_sw_link_new: call to sh_entry_init failed");
+        return 0;
+    }
+
+    if( table->ctrl[pos] == SH_SWISS_DELETED ){
+        --table->n_deleted;
+    }
+    table->ctrl[pos] = sh_sw_h2(hash);
+
+    ++table->n_elems;
+
+    return &(table->slots[pos]);
+}
+
+/* remove the entry in `slot` from a swiss table
+ *
+ * probes only stop at a group containing an empty slot,
+ * so if this group already has one the slot can become empty,
+ * otherwise it must be marked deleted so probes continue past it
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_sw_unlink(struct sh_table *table, struct sh_entry *slot){
+    /* position of the slot being vacated */
+    size_t pos = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_sw_unlink: table undef");
+        return 0;
+    }
+
+    if( ! slot || ! slot->key ){
+        sh_fail(SH_ERR_INVALID, "sh_sw_unlink: slot undef");
+        return 0;
+    }
+
+    pos = slot - table->slots;
+
+    /* free the key, do NOT free data, leave that up to caller */
+    if( ! sh_entry_destroy(table->slab, slot, 0, 0, ! table->borrow_keys) ){
+        sh_trace("sh_sw_unlink: warning, call to sh_entry_destroy failed, continuing...");
+    }
+
+    memset(slot, 0, sizeof(struct sh_entry));
+
+    if( sh_sw_match(table->ctrl + (pos - pos % SH_SWISS_GROUP), SH_SWISS_EMPTY) ){
+        table->ctrl[pos] = SH_SWISS_EMPTY;
+    } else {
+        table->ctrl[pos] = SH_SWISS_DELETED;
+        ++table->n_deleted;
+    }
+
+    --table->n_elems;
+
+    return 1;
+}
+
+/* move every entry of a swiss table into a new array of `new_size` slots
+ * `new_size` must be a power of two and at least SH_SWISS_GROUP
+ *
+ * this also discards every deleted slot,
+ * so it is used at the same size to clean up after many deletions
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_sw_resize(struct sh_table *table, size_t new_size){
+    /* our new slots and control bytes */
+    struct sh_entry *new_slots = 0;
+    unsigned char *new_ctrl = 0;
+    /* iterator through old slots */
+    size_t i = 0;
+    /* position within new slots */
+    size_t pos = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_sw_resize: table undef");
+        return 0;
+    }
+
+    if( table->n_elems >= sh_oa_max_load(table) * new_size ){
+        sh_fail(SH_ERR_INVALID, "sh_sw_resize: new_size is too small to hold every entry");
+        return 0;
+    }
+
+    new_slots = calloc(new_size, sizeof(struct sh_entry));
+    if( ! new_slots ){
+        sh_fail(SH_ERR_NOMEM, "sh_sw_resize: call to calloc failed");
+        return 0;
+    }
+
+    new_ctrl = malloc(new_size);
+    if( ! new_ctrl ){
+        sh_fail(SH_ERR_NOMEM, "sh_sw_resize: call to malloc failed");
+        free(new_slots);
+        return 0;
+    }
+    memset(new_ctrl, SH_SWISS_EMPTY, new_size);
+
+    /* entries are moved as is, no keys are copied */
+    for( i=0; i < table->size; ++i ){
+        if( table->ctrl[i] & 0x80 ){
+            continue;
+        }
+
+        pos = sh_sw_free_slot(new_ctrl, new_size, table->slots[i].hash);
+        new_slots[pos] = table->slots[i];
+        new_ctrl[pos] = table->ctrl[i];
+    }
+
+    free(table->slots);
+    free(table->ctrl);
+    table->slots = new_slots;
+    table->ctrl = new_ctrl;
+    table->size = new_size;
+    table->n_deleted = 0;
+
+    /* our thresholds are relative to size */
+    sh_load_thresholds(table);
+
+    return 1;
+}
+
+/**********************************************
+ **********************************************
+ **********************************************
+ ******** backend dispatch ********************
+ **********************************************
+ **********************************************
+ ***********************************************/
+
+/* find the entry holding this key, whichever backend the table uses
+ *
+ * returns a pointer to the entry on success
+ * returns 0 on failure
+ */
+struct sh_entry * sh_find(const struct sh_table *table, const void *key, size_t key_len, unsigned long int hash){
+    /* link to our entry when chaining */
+    struct sh_entry **link = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_find: table undef");
+        return 0;
+    }
+
+    switch( table->backend ){
+        case SH_BACKEND_ROBIN_HOOD:
+            return sh_rh_find(table, key, key_len, hash);
+
+        case SH_BACKEND_SWISS:
+            return sh_sw_find(table, key, key_len, hash);
+
+        default:
+            link = sh_locate(table, key, key_len, hash, 0);
+            if( ! link ){
+                return 0;
+            }
+            return *link;
+    }
+}
+
+/* create a new entry for this key, whichever backend the table uses
+ * the key must not already be present
+ *
+ * this may grow the table, see sh_set_load_factors
+ *
+ * returns a pointer to the new entry on success
+ * returns 0 on failure
+ */
+struct sh_entry * sh_add(struct sh_table *table, const void *key, size_t key_len, unsigned long int hash, void *data){
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_add: table undef");
+        return 0;
+    }
+
+    switch( table->backend ){
+        case SH_BACKEND_ROBIN_HOOD:
+            return sh_rh_link_new(table, key, key_len, hash, data);
+
+        case SH_BACKEND_SWISS:
+            return sh_sw_link_new(table, key, key_len, hash, data);
+
+        default:
+            return sh_link_new(table, key, key_len, hash, data);
+    }
+}
+
+/* remove the entry for this key, whichever backend the table uses
+ * the removed entry's data is written to `data`
+ *
+ * this does not shrink the table
+ *
+ * returns 1 on success
+ * returns 0 on failure (including if the key was not found)
+ */
+unsigned int sh_remove(struct sh_table *table, const void *key, size_t key_len, unsigned long int hash, void **data){
+    /* our cur entry */
+    struct sh_entry *cur = 0;
+    /* the link pointing at our entry when chaining
+     * this will either be:
+     *      &( bucket->head )
+     *      &( previous->next )
+     *
+     * where previous was the previous sh_entry in the chain
+     */
+    struct sh_entry **prev = 0;
+    /* the bucket holding our entry when chaining */
+    struct sh_bucket *bucket = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_remove: table undef");
+        return 0;
+    }
+
+    if( ! data ){
+        sh_fail(SH_ERR_INVALID, "sh_remove: data undef");
+        return 0;
+    }
+
+    switch( table->backend ){
+        case SH_BACKEND_ROBIN_HOOD:
+            cur = sh_rh_find(table, key, key_len, hash);
+            if( ! cur ){
+                return 0;
+            }
+
+            *data = cur->data;
+            return sh_rh_unlink(table, cur);
+
+        case SH_BACKEND_SWISS:
+            cur = sh_sw_find(table, key, key_len, hash);
+            if( ! cur ){
+                return 0;
+            }
+
+            *data = cur->data;
+            return sh_sw_unlink(table, cur);
+
+        default:
+            break;
+    }
+
+    /* find the link pointing to our entry */
+    prev = sh_locate(table, key, key_len, hash, &bucket);
+    if( ! prev ){
+        return 0;
+    }
+
+    cur = *prev;
+
+    /* save old data pointer */
+    *data = cur->data;
+
+    /* decrement number of elements */
+    --table->n_elems;
+
+    /* capture next
+     * to ensure continuation of linked list
+     */
+    *prev = cur->next;
+
+    /* our fingerprint may be shared with another entry in this bucket */
+    sh_bucket_refilter(bucket);
+
+    /* free element and contents
+     * do NOT free data, leave that up to caller
+     */
+    if( ! sh_entry_destroy(table->slab, cur, 1, 0, ! table->borrow_keys) ){
+        sh_trace("sh_remove: warning, call to sh_entry_destroy failed, continuing...");
+    }
+
+    return 1;
+}
+
+/* find the sh_entry that should be holding this key
+ *
+ * returns a pointer to it on success
+ * return 0 on failure
+ */
+struct sh_entry * sh_find_entry(const struct sh_table *table, const char *key){
+    /* our entry */
+    struct sh_entry *entry = 0;
+
+    /* hash */
+    unsigned long int hash = 0;
+    /* cached strlen */
+    size_t key_len = 0;
+
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_find_entry: table undef");
+        return 0;
+    }
+
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_find_entry: key undef");
+        return 0;
+    }
+
+    /* cache strlen */
+    key_len = strlen(key);
+
+    /* calculate hash */
+    hash = table->hash_fn(key, key_len, table->seed);
+
+    entry = sh_find(table, key, key_len, hash);
+    if( ! entry ){
+        /* failed to find element */
+#ifdef DEBUG
+        puts("sh_find_entry: failed to find key");
+#endif
+        return 0;
+    }
+
+    /* found it! */
+    return entry;
+}
+
+/**********************************************
+ **********************************************
+ **********************************************
+ ******** batch operations ********************
+ **********************************************
+ **********************************************
+ ***********************************************/
+
+/* the batch operations (sh_get_many and friends) work through their keys
+ * SH_BATCH at a time in three passes, so that the cache misses for
+ * different keys overlap rather than being taken one after another:
+ *
+ *  1) hash every key and prefetch the bucket (or slot or control group)
+ *  2) prefetch the entry each bucket points us at
+ *  3) perform each lookup as normal, hopefully now from cache
+ */
+
+/* prefetch the first memory a lookup for `hash` within `table` will touch
+ *
+ * during an incremental resize only the new bucket is prefetched
+ */
+void sh_prefetch_bucket(const struct sh_table *table, unsigned long int hash){
+    switch( table->backend ){
+        case SH_BACKEND_ROBIN_HOOD:
+            SH_PREFETCH(&(table->slots[sh_pos_pow2(hash, table->size)]));
+            break;
+
+        case SH_BACKEND_SWISS:
+            SH_PREFETCH(table->ctrl + sh_sw_h1(hash, table->size) * SH_SWISS_GROUP);
+            break;
+
+        default:
+            SH_PREFETCH(&(table->entries[sh_table_pos(table, hash, table->size)]));
+            break;
+    }
+}
+
+/* prefetch the entry a lookup for `hash` within `table` will compare first
+ * this reads the memory prefetched by sh_prefetch_bucket
+ *
+ * for chaining this is the head of the bucket, unless the bucket filter
+ * already tells us the key is missing
+ *
+ * for robin hood this is the key of the ideal slot
+ *
+ * for swiss this is the first slot in the first group with a matching
+ * control byte
+ */
+void sh_prefetch_entry(const struct sh_table *table, unsigned long int hash){
+    /* the bucket to look in when chaining */
+    const struct sh_bucket *bucket = 0;
+    /* the group to look in for swiss */
+    size_t group = 0;
+    /* candidate slots within group */
+    unsigned int mask = 0;
+
+    switch( table->backend ){
+        case SH_BACKEND_ROBIN_HOOD:
+            SH_PREFETCH(table->slots[sh_pos_pow2(hash, table->size)].key);
+            break;
+
+        case SH_BACKEND_SWISS:
+            group = sh_sw_h1(hash, table->size);
+            mask = sh_sw_match(table->ctrl + group * SH_SWISS_GROUP, sh_sw_h2(hash));
+            if( mask ){
+                SH_PREFETCH(&(table->slots[group * SH_SWISS_GROUP + sh_sw_first(mask)]));
+            }
+            break;
+
+        default:
+            bucket = &(table->entries[sh_table_pos(table, hash, table->size)]);
+            if( bucket->filter & sh_fingerprint(hash) ){
+                SH_PREFETCH(bucket->head);
+            }
+            break;
+    }
+}
+
+/* passes 1 and 2 of a batch operation for the `count` keys in `keys`
+ * (at most SH_BATCH), see above
+ *
+ * `lens` may be 0 in which case every key is null terminated
+ *
+ * the length and hash of each key are written to `key_lens` and `hashes`
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_batch_prepare(const struct sh_table *table, const void * const *keys, const size_t *lens, size_t count, size_t *key_lens, unsigned long int *hashes){
+    /* iterator through keys */
+    size_t i = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_batch_prepare: table undef");
+        return 0;
+    }
+
+    if( count > SH_BATCH ){
+        sh_fail(SH_ERR_INVALID, "sh_batch_prepare: count larger than SH_BATCH");
+        return 0;
+    }
+
+    for( i=0; i<count; ++i ){
+        if( ! keys[i] ){
+            sh_fail(SH_ERR_INVALID, "sh_batch_prepare: key undef");
+            return 0;
+        }
+
+        key_lens[i] = lens ? lens[i] : strlen(keys[i]);
+        hashes[i] = table->hash_fn(keys[i], key_lens[i], table->seed);
+        sh_prefetch_bucket(table, hashes[i]);
+    }
+
+    for( i=0; i<count; ++i ){
+        sh_prefetch_entry(table, hashes[i]);
+    }
+
+    return 1;
+}
+
+/**********************************************
+ **********************************************
+ **********************************************
+ ******** bulk build **************************
+ **********************************************
+ **********************************************
+ ***********************************************/
+
+/* sh_build loads many keys at once in three phases, each spread across
+ * the requested number of workers:
+ *
+ *  1) hash, each worker hashes a range of the input and counts how many
+ *     of its keys fall into each partition of the bucket array
+ *  2) scatter, each worker writes the indices of its keys into `order`
+ *     grouped by partition, keeping them in input order within each group
+ *  3) link, each worker owns one partition of the bucket array and links
+ *     the keys for it, no other worker touches those buckets so no locks
+ *     are required
+ *
+ * only SH_BACKEND_CHAINING is linked in parallel, keys for the open
+ * addressing backends are hashed in parallel and then placed serially
+ * as their probe sequences may cross any partition boundary
+ */
+
+/* state for one worker in sh_build */
+struct sh_build_worker {
+    /* shared by every worker */
+    struct sh_table *table;
+    const void * const *keys;
+    const size_t *lens;
+    void * const *values;
+    unsigned int check_duplicates;
+    /* hash of each key */
+    unsigned long int *hashes;
+    /* indices of keys grouped by partition, 0 when there is one partition */
+    size_t *order;
+    /* number of partitions, and of buckets within each */
+    size_t n_parts;
+    size_t part_size;
+    /* counts[worker * n_parts + part] is the number of keys in our input
+     * range for each partition, turned into offsets into `order` before
+     * the scatter phase
+     */
+    size_t *counts;
+
+    /* our worker number */
+    size_t id;
+    /* our range of the input for the hash and scatter phases */
+    size_t lo;
+    size_t hi;
+    /* our range of `order` for the link phase */
+    size_t order_lo;
+    size_t order_hi;
+    /* where we allocate entries from during the link phase */
+    struct sh_slab *slab;
+
+    /* number of entries we created */
+    size_t n_inserted;
+    /* set if this worker failed */
+    unsigned int failed;
+    /* and why, as a worker thread's own sh_last_error is not the caller's */
+    enum sh_error error;
+};
+
+/* the length of key `i` given to sh_build */
+size_t sh_build_len(const struct sh_build_worker *worker, size_t i){
+    if( worker->lens ){
+        return worker->lens[i];
+    }
+
+    return strlen(worker->keys[i]);
+}
+
+/* the partition of the bucket array holding key `i` given to sh_build */
+size_t sh_build_part(const struct sh_build_worker *worker, size_t i){
+    return sh_table_pos(worker->table, worker->hashes[i], worker->table->size) / worker->part_size;
+}
+
+/* phase 1 of sh_build, `arg` is a struct sh_build_worker
+ *
+ * returns 0
+ */
+void * sh_build_hash(void *arg){
+    struct sh_build_worker *worker = arg;
+    /* iterator through our input */
+    size_t i = 0;
+
+    for( i=worker->lo; i<worker->hi; ++i ){
+        if( ! worker->keys[i] ){
+            sh_fail(SH_ERR_INVALID, "sh_build_hash: key undef");
+            worker->failed = 1;
+            worker->error = SH_ERR_INVALID;
+            return 0;
+        }
+
+        worker->hashes[i] = worker->table->hash_fn(worker->keys[i], sh_build_len(worker, i), worker->table->seed);
+
+        if( worker->order ){
+            ++worker->counts[worker->id * worker->n_parts + sh_build_part(worker, i)];
+        }
+    }
+
+    return 0;
+}
+
+/* phase 2 of sh_build, `arg` is a struct sh_build_worker
+ *
+ * returns 0
+ */
+void * sh_build_scatter(void *arg){
+    struct sh_build_worker *worker = arg;
+    /* iterator through our input */
+    size_t i = 0;
+    /* the next free index in `order` for each partition */
+    size_t *next = worker->counts + worker->id * worker->n_parts;
+
+    for( i=worker->lo; i<worker->hi; ++i ){
+        worker->order[next[sh_build_part(worker, i)]++] = i;
+    }
+
+    return 0;
+}
+
+/* phase 3 of sh_build, `arg` is a struct sh_build_worker
+ *
+ * returns 0
+ */
+void * sh_build_link(void *arg){
+    struct sh_build_worker *worker = arg;
+    struct sh_table *table = worker->table;
+    /* iterator through our range of `order` */
+    size_t k = 0;
+    /* the key we are linking */
+    size_t i = 0;
+    size_t key_len = 0;
+    /* its bucket */
+    struct sh_bucket *bucket = 0;
+    /* our new entry */
+    struct sh_entry *she = 0;
+
+    for( k=worker->order_lo; k<worker->order_hi; ++k ){
+        i = worker->order ? worker->order[k] : k;
+        key_len = sh_build_len(worker, i);
+        bucket = &(table->entries[sh_table_pos(table, worker->hashes[i], table->size)]);
+
+        if( worker->check_duplicates &&
+            sh_bucket_find(bucket, worker->keys[i], key_len, worker->hashes[i], 0) ){
+            continue;
+        }
+
+        /*                (slab, hash, key, key_len, data, next, borrow_key) */
+        she = sh_entry_new(worker->slab, worker->hashes[i], worker->keys[i], key_len, worker->values ? worker->values[i] : 0, bucket->head, table->borrow_keys);
+        if( ! she ){
+            sh_trace("sh_build_link: call to sh_entry_new failed");
+            worker->failed = 1;
+            worker->error = sh_last_error();
+            return 0;
+        }
+
+        bucket->head = she;
+        bucket->filter |= sh_fingerprint(she->hash);
+        ++worker->n_inserted;
+    }
+
+    return 0;
+}
+
+/* run `phase` once for each of the `n` workers in `workers`, an array of
+ * worker structs each `worker_size` bytes, as used by sh_build and
+ * sh_resize_parallel
+ *
+ * the first worker runs on the calling thread, each other on a thread of
+ * its own, any worker we fail to start a thread for is also run on the
+ * calling thread so this always completes
+ */
+void sh_build_run(void *workers, size_t worker_size, size_t n, void * (*phase)(void *arg)){
+    /* iterator through workers */
+    size_t w = 0;
+#ifndef SH_NO_THREADS
+    /* one thread per worker, except the first */
+    pthread_t *threads = 0;
+    /* whether each thread was started */
+    unsigned char *started = 0;
+
+    if( n > 1 ){
+        threads = calloc(n, sizeof(pthread_t));
+        started = calloc(n, 1);
+    }
+
+    for( w=1; threads && started && w<n; ++w ){
+        started[w] = ! pthread_create(&(threads[w]), 0, phase, (char *) workers + w * worker_size);
+    }
+#endif
+
+    phase(workers);
+
+    for( w=1; w<n; ++w ){
+#ifndef SH_NO_THREADS
+        if( threads && started && started[w] ){
+            pthread_join(threads[w], 0);
+            continue;
+        }
+#endif
+        phase((char *) workers + w * worker_size);
+    }
+
+#ifndef SH_NO_THREADS
+    free(threads);
+    free(started);
+#endif
+}
+
+/* place every key hashed by `worker` into an open addressing table,
+ * one at a time on the calling thread
+ *
+ * returns the number of keys inserted, setting worker->failed on failure
+ */
+size_t sh_build_place(struct sh_build_worker *worker, size_t n){
+    struct sh_table *table = worker->table;
+    /* iterator through keys */
+    size_t i = 0;
+    /* length of current key */
+    size_t key_len = 0;
+    /* number of keys inserted */
+    size_t n_inserted = 0;
+
+    for( i=0; i<n; ++i ){
+        key_len = sh_build_len(worker, i);
+
+        if( worker->check_duplicates &&
+            sh_find(table, worker->keys[i], key_len, worker->hashes[i]) ){
+            continue;
+        }
+
+        if( ! sh_add(table, worker->keys[i], key_len, worker->hashes[i], worker->values ? worker->values[i] : 0) ){
+            sh_trace("sh_build_place: call to sh_add failed");
+            worker->failed = 1;
+            worker->error = sh_last_error();
+            break;
+        }
+        ++n_inserted;
+    }
+
+    return n_inserted;
+}
+
+/* phases 2 and 3 of sh_build for a chaining table,
+ * once `workers` have all hashed their keys
+ *
+ * returns the number of keys inserted, setting workers[0].failed on failure
+ */
+size_t sh_build_chains(struct sh_build_worker *workers, size_t n_workers, size_t n){
+    struct sh_table *table = workers[0].table;
+    size_t n_parts = workers[0].n_parts;
+    size_t *counts = workers[0].counts;
+    /* iterators through workers and partitions */
+    size_t w = 0;
+    size_t p = 0;
+    /* running offset into order */
+    size_t offset = 0;
+    /* count we are turning into an offset */
+    size_t count = 0;
+    /* number of keys inserted */
+    size_t n_inserted = 0;
+    /* set if anything failed */
+    unsigned int failed = 0;
+    /* and why */
+    enum sh_error error = SH_OK;
+
+    if( n_parts == 1 ){
+        workers[0].order_lo = 0;
+        workers[0].order_hi = n;
+    } else {
+        /* turn the counts into offsets into order, partition by partition
+         * and within that worker by worker, so each partition keeps the
+         * order of the input
+         */
+        for( p=0; p<n_parts; ++p ){
+            workers[p].order_lo = offset;
+            for( w=0; w<n_workers; ++w ){
+                count = counts[w * n_parts + p];
+                counts[w * n_parts + p] = offset;
+                offset += count;
+            }
+            workers[p].order_hi = offset;
+        }
+
+        sh_build_run(workers, sizeof(struct sh_build_worker), n_workers, sh_build_scatter);
+    }
+
+    /* each partition allocates from its own slab, merged once done */
+    for( p=0; p<n_parts; ++p ){
+        workers[p].slab = table->slab;
+        if( table->slab && n_parts > 1 ){
+            workers[p].slab = sh_slab_new();
+            if( ! workers[p].slab ){
+                sh_trace("sh_build_chains: call to sh_slab_new failed");
+                failed = 1;
+                error = sh_last_error();
+            }
+        }
+    }
+
+    if( ! failed ){
+        sh_build_run(workers, sizeof(struct sh_build_worker), n_parts, sh_build_link);
+    }
+
+    for( p=0; p<n_parts; ++p ){
+        if( workers[p].failed ){
+            failed = 1;
+            error = workers[p].error;
+        }
+        n_inserted += workers[p].n_inserted;
+
+        if( workers[p].slab && workers[p].slab != table->slab ){
+            sh_slab_merge(table->slab, workers[p].slab);
+        }
+    }
+
+    table->n_elems += n_inserted;
+    workers[0].failed = failed;
+    workers[0].error = error;
+
+    return n_inserted;
+}
+
+/**********************************************
+ **********************************************
+ **********************************************
+ ******** parallel resize *********************
+ **********************************************
+ **********************************************
+ ***********************************************/
+
+/* sh_resize_parallel moves every entry of a chaining table into a new
+ * bucket array in two phases, each spread across the requested number of
+ * workers much as sh_build does:
+ *
+ *  1) split, each worker owns a range of the old buckets and unlinks their
+ *     entries into one list per partition of the new bucket array,
+ *     reusing the entries' own next pointers
+ *  2) link, each worker owns one partition of the new bucket array and
+ *     links every entry listed for it by any worker
+ *
+ * no two workers ever touch the same bucket in either phase so no locks or
+ * atomics are required, and no memory beyond a list head per worker per
+ * partition
+ */
+
+/* state for one worker in sh_resize_parallel */
+struct sh_resize_worker {
+    /* shared by every worker, the new buckets are already in place */
+    struct sh_table *table;
+    struct sh_bucket *old_entries;
+    /* number of workers, which is also the number of partitions,
+     * and of new buckets within each partition
+     */
+    size_t n_workers;
+    size_t part_size;
+    /* lists[worker * n_workers + part] is the list of entries from that
+     * worker's old buckets belonging in that partition
+     */
+    struct sh_entry **lists;
+
+    /* our worker number, and partition during the link phase */
+    size_t id;
+    /* our range of old buckets for the split phase */
+    size_t lo;
+    size_t hi;
+};
+
+/* phase 1 of sh_resize_parallel, `arg` is a struct sh_resize_worker
+ *
+ * returns 0
+ */
+void * sh_resize_split(void *arg){
+    struct sh_resize_worker *worker = arg;
+    struct sh_table *table = worker->table;
+    /* our list for each partition */
+    struct sh_entry **lists = worker->lists + worker->id * worker->n_workers;
+    /* iterators through old buckets and their chains */
+    size_t i = 0;
+    struct sh_entry *cur = 0;
+    struct sh_entry *next = 0;
+    /* partition each entry belongs in */
+    size_t part = 0;
+
+    for( i=worker->lo; i<worker->hi; ++i ){
+        for( cur=worker->old_entries[i].head; cur; cur=next ){
+            next = cur->next;
+            part = sh_table_pos(table, cur->hash, table->size) / worker->part_size;
+            cur->next = lists[part];
+            lists[part] = cur;
+        }
+    }
+
+    return 0;
+}
+
+/* phase 2 of sh_resize_parallel, `arg` is a struct sh_resize_worker
+ *
+ * returns 0
+ */
+void * sh_resize_link(void *arg){
+    struct sh_resize_worker *worker = arg;
+    struct sh_table *table = worker->table;
+    /* iterators through every worker's list for our partition */
+    size_t w = 0;
+    struct sh_entry *cur = 0;
+    struct sh_entry *next = 0;
+    /* the bucket each entry moves to */
+    struct sh_bucket *dest = 0;
+
+    for( w=0; w<worker->n_workers; ++w ){
+        for( cur=worker->lists[w * worker->n_workers + worker->id]; cur; cur=next ){
+            next = cur->next;
+            dest = &(table->entries[sh_table_pos(table, cur->hash, table->size)]);
+            cur->next = dest->head;
+            dest->head = cur;
+            dest->filter |= sh_fingerprint(cur->hash);
+        }
+    }
+
+    return 0;
+}
+
+/**********************************************
+ **********************************************
+ **********************************************
+ ******** parallel iteration ******************
+ **********************************************
+ **********************************************
+ ***********************************************/
+
+/* sh_iterate_parallel splits the buckets counted by sh_nbuckets into one
+ * contiguous range per worker, each visited by sh_iterate_range with a
+ * state of the worker's own, as every entry lives in exactly one bucket
+ * each is visited exactly once
+ *
+ * once every worker has finished their states are reduced in worker order
+ * on the calling thread
+ */
+
+/* state for one worker in sh_iterate_parallel */
+struct sh_iterate_worker {
+    /* shared by every worker */
+    struct sh_table *table;
+    unsigned int (*each)(void *state, const void *key, size_t key_len, void **data);
+    /* our range of buckets */
+    size_t start;
+    size_t end;
+    /* our own state, from the caller's state_init */
+    void *state;
+};
+
+/* visit the range of a struct sh_iterate_worker `arg`
+ *
+ * returns 0
+ */
+void * sh_iterate_work(void *arg){
+    struct sh_iterate_worker *worker = arg;
+
+    sh_iterate_range(worker->table, worker->start, worker->end, worker->state, worker->each);
+
+    return 0;
+}
+
+/**********************************************
+ **********************************************
+ **********************************************
+ ******** statistics **************************
+ **********************************************
+ **********************************************
+ ***********************************************/
+
+/* record a chain or probe sequence of `length` in `stats`
+ *
+ * mean_chain holds the running total until sh_stats divides it
+ */
+void sh_stats_record(struct sh_stats *stats, size_t length){
+    if( length > stats->max_chain ){
+        stats->max_chain = length;
+    }
+
+    stats->mean_chain += length;
+
+    if( length >= SH_STATS_HISTOGRAM ){
+        length = SH_STATS_HISTOGRAM - 1;
+    }
+
+    ++stats->histogram[length];
+}
+
+/* the number of bytes `table` has allocated for the key of `entry` */
+size_t sh_stats_key_bytes(const struct sh_table *table, const struct sh_entry *entry){
+    if( table->borrow_keys ){
+        return 0;
+    }
+
+    return entry->key_len + 1;
+}
+
+/* add every chain within buckets [start, end) of `buckets` to `stats`
+ * also accounting for every entry and key
+ */
+void sh_stats_chains(const struct sh_table *table, const struct sh_bucket *buckets, size_t start, size_t end, struct sh_stats *stats){
+    /* iterator through buckets */
+    size_t i = 0;
+    /* current entry within bucket */
+    const struct sh_entry *cur = 0;
+    /* length of current chain */
+    size_t length = 0;
+
+    for( i=start; i<end; ++i ){
+        length = 0;
+        for( cur = buckets[i].head; cur; cur = cur->next ){
+            ++length;
+            stats->entry_bytes += sizeof(struct sh_entry);
+            stats->key_bytes += sh_stats_key_bytes(table, cur);
+        }
+
+        ++stats->n_buckets;
+        if( ! length ){
+            ++stats->n_empty;
+        }
+        sh_stats_record(stats, length);
+    }
+
+    stats->bucket_bytes += (end - start) * sizeof(struct sh_bucket);
+}
+
+/* the number of groups a swiss lookup for `hash` has to probe
+ * to reach `group`, counting `group` itself
+ */
+size_t sh_stats_sw_probes(const struct sh_table *table, unsigned long int hash, size_t group){
+    /* the group we are probing */
+    size_t probe = 0;
+    /* number of groups probed so far */
+    size_t step = 0;
+
+    /* triangular probing visits every group so this will terminate */
+    for( probe = sh_sw_h1(hash, table->size);
+         probe != group;
+         ++step, probe = (probe + step) & (table->size / SH_SWISS_GROUP - 1) ){
+    }
+
+    return step + 1;
+}
+
+/* add every slot of an open addressing `table` to `stats`
+ * each entry's probe sequence is recorded as its chain
+ */
+void sh_stats_slots(const struct sh_table *table, struct sh_stats *stats){
+    /* iterator through slots */
+    size_t i = 0;
+
+    for( i=0; i<table->size; ++i ){
+        ++stats->n_buckets;
+
+        if( ! table->slots[i].key ){
+            ++stats->n_empty;
+            continue;
+        }
+
+        stats->key_bytes += sh_stats_key_bytes(table, &(table->slots[i]));
+
+        if( table->backend == SH_BACKEND_SWISS ){
+            sh_stats_record(stats, sh_stats_sw_probes(table, table->slots[i].hash, i / SH_SWISS_GROUP));
+        } else {
+            sh_stats_record(stats, sh_rh_distance(table->slots, table->size, i) + 1);
+        }
+    }
+
+    stats->bucket_bytes += table->size * sizeof(struct sh_entry);
+    if( table->ctrl ){
+        stats->bucket_bytes += table->size;
+    }
+}
+
+/**********************************************
+ **********************************************
+ **********************************************
+ ******** sharded tables **********************
+ **********************************************
+ **********************************************
+ ***********************************************/
+
+/* the most shards a sh_sharded may have, see sh_sharded_shard */
+#define SH_SHARDS_MAX 65536
+
+/* one shard of a sh_sharded, an independent table behind its own lock
+ *
+ * the padding keeps the lock of one shard off the cache lines holding
+ * the table of the shard before it, so threads working in different
+ * shards do not contend
+ */
+struct sh_shard {
+#ifndef SH_NO_THREADS
+    pthread_rwlock_t lock;
+#endif
+    struct sh_table table;
+    char padding[64];
+};
+
+struct sh_sharded {
+    /* array of n_shards shards */
+    struct sh_shard *shards;
+    /* number of shards, always a power of two */
+    size_t n_shards;
+};
+
+/* state for sh_sharded_each */
+struct sh_sharded_iteration {
+    /* the caller's state and function */
+    void *state;
+    unsigned int (*each)(void *state, const void *key, size_t key_len, void **data);
+    /* set once `each` asks to stop */
+    unsigned int stopped;
+};
+
+/* the shard holding `hash`
+ *
+ * shards are chosen by bits 40 and up of sh_mix(hash), buckets within a
+ * shard come from the low bits of the hash itself and the bucket filters
+ * and swiss control bytes use the top 7 bits of sh_mix(hash), so taking
+ * shards from either end would leave every table in a shard using only
+ * part of its buckets or fingerprints
+ */
+struct sh_shard * sh_sharded_shard(const struct sh_sharded *sharded, unsigned long int hash){
+    return &(sharded->shards[(sh_mix(hash) >> 40) & (sharded->n_shards - 1)]);
+}
+
+/* take `shard`'s lock for reading, a no-op with SH_NO_THREADS */
+void sh_shard_read(struct sh_shard *shard){
+#ifndef SH_NO_THREADS
+    pthread_rwlock_rdlock(&(shard->lock));
+#else
+    (void) shard;
+#endif
+}
+
+/* take `shard`'s lock for writing, a no-op with SH_NO_THREADS */
+void sh_shard_write(struct sh_shard *shard){
+#ifndef SH_NO_THREADS
+    pthread_rwlock_wrlock(&(shard->lock));
+#else
+    (void) shard;
+#endif
+}
+
+/* release either lock on `shard`, a no-op with SH_NO_THREADS */
+void sh_shard_unlock(struct sh_shard *shard){
+#ifndef SH_NO_THREADS
+    pthread_rwlock_unlock(&(shard->lock));
+#else
+    (void) shard;
+#endif
+}
+
+/* destroy the first `n_ready` shards of `sharded`, and then `sharded` itself
+ * if `free_data` is set then each shard's data is also freed
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_sharded_free(struct sh_sharded *sharded, size_t n_ready, unsigned int free_data){
+    /* iterator through shards */
+    size_t i = 0;
+    /* set if any shard failed to destroy */
+    unsigned int failed = 0;
+
+    for( i=0; i<n_ready; ++i ){
+        if( ! sh_destroy(&(sharded->shards[i].table), 0, free_data) ){
+            sh_trace("sh_sharded_free: call to sh_destroy failed");
+            failed = 1;
+        }
+#ifndef SH_NO_THREADS
+        pthread_rwlock_destroy(&(sharded->shards[i].lock));
+#endif
+    }
+
+    free(sharded->shards);
+    free(sharded);
+
+    return ! failed;
+}
+
+/* passes each entry of a shard on to the caller's function
+ * noting when it asks to stop, so later shards can be skipped
+ */
+unsigned int sh_sharded_each(void *state, const void *key, size_t key_len, void **data){
+    struct sh_sharded_iteration *iteration = state;
+
+    if( ! iteration->each(iteration->state, key, key_len, data) ){
+        iteration->stopped = 1;
+        return 0;
+    }
+
+    return 1;
+}
+
+/**********************************************
+ **********************************************
+ **********************************************
+ ******** epoch reclamation *******************
+ **********************************************
+ **********************************************
+ ***********************************************/
+
+/* default number of slots of a struct sh_epochs */
+#define SH_EPOCH_SLOTS 64
+
+/* a slot held by a thread while it may be looking at shared nodes,
+ * alone on its cache line
+ */
+struct sh_epoch_slot {
+    /* epoch the thread entered in, 0 if free */
+    uint64_t epoch;
+    char padding[56];
+};
+
+/* epoch based reclamation, shared by sh_rcu and sh_lf
+ *
+ * a thread about to look at nodes that others may unlink claims a slot,
+ * recording the current epoch, and releases it once done
+ *
+ * a node unlinked by a writer is retired with the epoch current at that time,
+ * later sh_epoch_advance moves the epoch on and reports the oldest epoch
+ * still held, anything retired before that can no longer be reached by any
+ * thread and may be freed
+ */
+struct sh_epochs {
+    /* the current epoch, starts at 1 */
+    uint64_t epoch;
+    /* a power of two of slots */
+    struct sh_epoch_slot *slots;
+    size_t n_slots;
+};
+
+/* the slot each thread tries first, so threads tend to keep to their own
+ * slot, 0 until first needed, see sh_epoch_thread
+ */
+static SH_THREAD_LOCAL size_t sh_epoch_hint = 0;
+
+/* number of threads given a hint so far */
+static size_t sh_epoch_threads = 0;
+
+/* initialise `epochs` with `n_slots` slots, 0 for SH_EPOCH_SLOTS,
+ * rounded up to a power of two
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_epochs_init(struct sh_epochs *epochs, size_t n_slots){
+    /* rounded number of slots */
+    size_t rounded = 1;
+
+    if( ! n_slots ){
+        n_slots = SH_EPOCH_SLOTS;
+    }
+
+    if( n_slots > SIZE_MAX / 2 ){
+        sh_fail(SH_ERR_INVALID, "sh_epochs_init: n_slots too large to round to a power of two");
+        return 0;
+    }
+
+    while( rounded < n_slots ){
+        rounded <<= 1;
+    }
+
+    epochs->epoch = 1;
+    epochs->n_slots = rounded;
+    epochs->slots = calloc(rounded, sizeof(struct sh_epoch_slot));
+    if( ! epochs->slots ){
+        sh_fail(SH_ERR_NOMEM, "sh_epochs_init: call to calloc failed");
+        return 0;
+    }
+
+    return 1;
+}
+
+/* claim `slot` for a thread in `epoch` if it is free
+ *
+ * the claim is a full barrier so the thread's loads that follow cannot be
+ * satisfied before a writer scanning the slots could see it
+ *
+ * returns 1 on success
+ * returns 0 if the slot was in use
+ */
+unsigned int sh_epoch_claim(struct sh_epoch_slot *slot, uint64_t epoch){
+#if defined(__GNUC__) && ! defined(SH_NO_THREADS)
+    /* the value we expect the slot to hold */
+    uint64_t expected = 0;
+
+    return __atomic_compare_exchange_n(&(slot->epoch), &expected, epoch, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+#else
+    if( slot->epoch ){
+        return 0;
+    }
+
+    slot->epoch = epoch;
+    return 1;
+#endif
+}
+
+/* the slot the calling thread tries first, distinct for each thread
+ * until there are more threads than slots
+ *
+ * also used to spread threads over the slots of a sh_fc
+ */
+size_t sh_epoch_thread(void){
+    if( ! sh_epoch_hint ){
+#if defined(__GNUC__) && ! defined(SH_NO_THREADS)
+        sh_epoch_hint = __atomic_add_fetch(&sh_epoch_threads, 1, __ATOMIC_RELAXED);
+#else
+        sh_epoch_hint = ++sh_epoch_threads;
+#endif
+    }
+
+    return sh_epoch_hint;
+}
+
+/* enter the current epoch, claiming a slot
+ *
+ * returns the slot claimed, to be passed to sh_epoch_exit
+ */
+struct sh_epoch_slot * sh_epoch_enter(const struct sh_epochs *epochs){
+    /* slot to try */
+    size_t i = 0;
+
+    /* only busy if there are more threads inside at once than slots */
+    for( i=sh_epoch_thread(); ; ++i ){
+        if( sh_epoch_claim(&(epochs->slots[i & (epochs->n_slots - 1)]), SH_ACQUIRE(&(epochs->epoch))) ){
+            return &(epochs->slots[i & (epochs->n_slots - 1)]);
+        }
+    }
+}
+
+/* release a slot claimed by sh_epoch_enter */
+void sh_epoch_exit(struct sh_epoch_slot *slot){
+    SH_RELEASE(&(slot->epoch), 0);
+}
+
+/* the epoch to retire a node unlinked now with
+ *
+ * the fence keeps the load from being satisfied before the unlink is
+ * visible, so any thread still able to reach the node holds this epoch
+ * or an earlier one
+ */
+uint64_t sh_epoch_now(const struct sh_epochs *epochs){
+    SH_FENCE();
+
+    return SH_ACQUIRE(&(epochs->epoch));
+}
+
+/* advance the epoch, only one thread may do so at a time
+ *
+ * if `wait` is set this first waits for every thread in an epoch before the
+ * new one to leave, the caller must not hold a slot itself
+ *
+ * returns the oldest epoch still held, anything retired before which may
+ * be freed
+ */
+uint64_t sh_epoch_advance(struct sh_epochs *epochs, unsigned int wait){
+    /* the epoch we advance from */
+    uint64_t epoch = SH_ACQUIRE(&(epochs->epoch));
+    /* oldest epoch still held */
+    uint64_t oldest = epoch + 1;
+    /* a slot's epoch */
+    uint64_t held = 0;
+    /* iterator through slots */
+    size_t i = 0;
+
+    SH_RELEASE(&(epochs->epoch), epoch + 1);
+
+    /* every unlink before here is visible to any thread claiming a slot
+     * after we read it as free below
+     */
+    SH_FENCE();
+
+    for( i=0; i<epochs->n_slots; ++i ){
+        held = SH_ACQUIRE(&(epochs->slots[i].epoch));
+        while( wait && held && held <= epoch ){
+            held = SH_ACQUIRE(&(epochs->slots[i].epoch));
+        }
+        if( held && held < oldest ){
+            oldest = held;
+        }
+    }
+
+    return oldest;
+}
+
+/**********************************************
+ **********************************************
+ **********************************************
+ ******** lock free readers *******************
+ **********************************************
+ **********************************************
+ ***********************************************/
+
+/* an sh_rcu is a chaining table whose readers take no locks
+ *
+ * readers load the bucket array, bucket heads and each `next` with
+ * SH_ACQUIRE, writers serialise on `lock` and publish every change with
+ * SH_RELEASE, so a reader always sees either the old or the new chain
+ *
+ * nothing a reader may be looking at is freed straight away: a deleted entry,
+ * or a bucket array (and its chains) replaced by a resize, is instead retired
+ * with the current epoch, and freed once every reader has moved past it
+ *
+ * each reader holds an epoch for the duration of a call (see sh_epochs),
+ * a writer retiring something advances the epoch and frees everything
+ * retired before the oldest epoch still held
+ *
+ * a resize copies every entry into a new bucket array rather than relinking
+ * them, so readers part way along an old chain are never diverted
+ */
+struct sh_rcu_buckets {
+    /* number of buckets, always a power of two */
+    size_t size;
+    /* the head of each chain */
+    struct sh_entry *heads[];
+};
+
+/* something retired by a writer, waiting for readers to move on */
+struct sh_rcu_retired {
+    /* the epoch it was retired in */
+    uint64_t epoch;
+    /* exactly one of these is set */
+    struct sh_entry *entry;
+    struct sh_rcu_buckets *buckets;
+    struct sh_rcu_retired *next;
+};
+
+struct sh_rcu {
+    /* the current buckets, replaced by each resize */
+    struct sh_rcu_buckets *buckets;
+    /* number of elements, only changed by writers */
+    size_t n_elems;
+    /* grow once there are more than this many elements per bucket */
+    double max_load;
+    /* hash function and seed, as for struct sh_table */
+    unsigned long int (*hash_fn)(const void *key, size_t key_len, const uint64_t seed[2]);
+    uint64_t seed[2];
+    /* as for opts.borrow_keys */
+    unsigned int borrow_keys;
+
+    /* the epochs readers hold */
+    struct sh_epochs epochs;
+    /* everything retired and not yet freed, newest first */
+    struct sh_rcu_retired *retired;
+
+#ifndef SH_NO_THREADS
+    /* held by writers */
+    pthread_mutex_t lock;
+#endif
+};
+
+/* find the entry for `key` in `buckets`, safe to call without the lock
+ * while holding a slot
+ *
+ * returns the entry on success
+ * returns 0 if the key is not present
+ */
+struct sh_entry * sh_rcu_find(const struct sh_rcu_buckets *buckets, const void *key, size_t key_len, unsigned long int hash){
+    /* iterator through chain */
+    struct sh_entry *entry = 0;
+
+    entry = SH_ACQUIRE(&(buckets->heads[sh_pos_pow2(hash, buckets->size)]));
+    for( ; entry; entry = SH_ACQUIRE(&(entry->next)) ){
+        if( entry->hash == hash &&
+            entry->key_len == key_len &&
+            ! memcmp(entry->key, key, key_len) ){
+            return entry;
+        }
+    }
+
+    return 0;
+}
+
+/* allocate a bucket array of `size` empty buckets
+ *
+ * returns pointer on success
+ * returns 0 on failure
+ */
+struct sh_rcu_buckets * sh_rcu_buckets_new(size_t size){
+    /* our new buckets */
+    struct sh_rcu_buckets *buckets = 0;
+
+    buckets = calloc(1, sizeof(struct sh_rcu_buckets) + size * sizeof(struct sh_entry *));
+    if( ! buckets ){
+        sh_fail(SH_ERR_NOMEM, "sh_rcu_buckets_new: call to calloc failed");
+        return 0;
+    }
+
+    buckets->size = size;
+
+    return buckets;
+}
+
+/* free `buckets` and every entry in its chains
+ * values are only freed if `free_data` is set
+ */
+void sh_rcu_buckets_destroy(const struct sh_rcu *table, struct sh_rcu_buckets *buckets, unsigned int free_data){
+    /* iterators through buckets and chains */
+    size_t i = 0;
+    struct sh_entry *entry = 0;
+    struct sh_entry *next = 0;
+
+    for( i=0; i<buckets->size; ++i ){
+        for( entry=buckets->heads[i]; entry; entry=next ){
+            next = entry->next;
+            sh_entry_destroy(0, entry, 1, free_data, ! table->borrow_keys);
+        }
+    }
+
+    free(buckets);
+}
+
+/* free a single retired item */
+void sh_rcu_free(const struct sh_rcu *table, struct sh_rcu_retired *retired){
+    if( retired->entry ){
+        sh_entry_destroy(0, retired->entry, 1, 0, ! table->borrow_keys);
+    } else {
+        sh_rcu_buckets_destroy(table, retired->buckets, 0);
+    }
+}
+
+/* advance the epoch and free everything retired before the oldest epoch a
+ * reader still holds, called by writers holding the lock
+ *
+ * if `wait` is set this waits for every reader in an epoch before the new
+ * one to finish, so everything retired so far can be freed
+ */
+void sh_rcu_reclaim(struct sh_rcu *table, unsigned int wait){
+    /* oldest epoch still held by a reader */
+    uint64_t oldest = sh_epoch_advance(&(table->epochs), wait);
+    /* iterator through retired items */
+    struct sh_rcu_retired **link = 0;
+    struct sh_rcu_retired *retired = 0;
+
+    /* anything retired before `oldest` is no longer reachable by any reader */
+    link = &(table->retired);
+    while( *link ){
+        retired = *link;
+        if( retired->epoch < oldest ){
+            *link = retired->next;
+            sh_rcu_free(table, retired);
+            free(retired);
+        } else {
+            link = &(retired->next);
+        }
+    }
+}
+
+/* retire `entry` or `buckets`, which must no longer be reachable from
+ * table->buckets, to be freed once no reader can still be looking at it
+ *
+ * should no memory be available to record it this waits for readers and
+ * frees it immediately
+ */
+void sh_rcu_retire(struct sh_rcu *table, struct sh_entry *entry, struct sh_rcu_buckets *buckets){
+    /* our record */
+    struct sh_rcu_retired *retired = 0;
+
+    retired = malloc(sizeof(struct sh_rcu_retired));
+    if( ! retired ){
+        sh_trace("sh_rcu_retire: warning, call to malloc failed, waiting for readers");
+        sh_rcu_reclaim(table, 1);
+        if( entry ){
+            sh_entry_destroy(0, entry, 1, 0, ! table->borrow_keys);
+        } else {
+            sh_rcu_buckets_destroy(table, buckets, 0);
+        }
+        return;
+    }
+
+    retired->epoch = sh_epoch_now(&(table->epochs));
+    retired->entry = entry;
+    retired->buckets = buckets;
+    retired->next = table->retired;
+    table->retired = retired;
+
+    sh_rcu_reclaim(table, 0);
+}
+
+/* double the number of buckets of `table` by copying every entry into a new
+ * bucket array, called by writers holding the lock
+ *
+ * returns 1 on success
+ * returns 0 on failure, leaving the table as it was
+ */
+unsigned int sh_rcu_grow(struct sh_rcu *table){
+    /* the current and new buckets */
+    struct sh_rcu_buckets *old = table->buckets;
+    struct sh_rcu_buckets *buckets = 0;
+    /* iterators through buckets and chains */
+    size_t i = 0;
+    struct sh_entry *entry = 0;
+    /* the copy of entry */
+    struct sh_entry *copy = 0;
+    /* the bucket it belongs in */
+    struct sh_entry **head = 0;
+
+    buckets = sh_rcu_buckets_new(old->size * 2);
+    if( ! buckets ){
+        sh_trace("sh_rcu_grow: call to sh_rcu_buckets_new failed");
+        return 0;
+    }
+
+    /* the new buckets are private until published, so plain stores will do */
+    for( i=0; i<old->size; ++i ){
+        for( entry=old->heads[i]; entry; entry=entry->next ){
+            head = &(buckets->heads[sh_pos_pow2(entry->hash, buckets->size)]);
+            copy = sh_entry_new(0, entry->hash, entry->key, entry->key_len, entry->data, *head, table->borrow_keys);
+            if( ! copy ){
+                sh_trace("sh_rcu_grow: call to sh_entry_new failed");
+                sh_rcu_buckets_destroy(table, buckets, 0);
+                return 0;
+            }
+            *head = copy;
+        }
+    }
+
+    SH_RELEASE(&(table->buckets), buckets);
+    sh_rcu_retire(table, 0, old);
+
+    return 1;
+}
+
+/* add a new entry for `key` to table, growing it first if needed,
+ * called by writers holding the lock
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_rcu_add(struct sh_rcu *table, const void *key, size_t key_len, unsigned long int hash, void *data){
+    /* our new entry */
+    struct sh_entry *entry = 0;
+    /* the bucket it belongs in */
+    struct sh_entry **head = 0;
+
+    if( table->n_elems + 1 > table->buckets->size * table->max_load ){
+        if( ! sh_rcu_grow(table) ){
+            sh_trace("sh_rcu_add: warning, call to sh_rcu_grow failed, continuing...");
+        }
+    }
+
+    head = &(table->buckets->heads[sh_pos_pow2(hash, table->buckets->size)]);
+    entry = sh_entry_new(0, hash, key, key_len, data, *head, table->borrow_keys);
+    if( ! entry ){
+        sh_trace("sh_rcu_add: call to sh_entry_new failed");
+        return 0;
+    }
+
+    /* publish the entry, its fields are visible to any reader that sees it */
+    SH_RELEASE(head, entry);
+    SH_RELEASE(&(table->n_elems), table->n_elems + 1);
+
+    return 1;
+}
+
+/* take the writer lock, a no-op with SH_NO_THREADS */
+void sh_rcu_lock(struct sh_rcu *table){
+#ifndef SH_NO_THREADS
+    pthread_mutex_lock(&(table->lock));
+#else
+    (void) table;
+#endif
+}
+
+/* release the writer lock, a no-op with SH_NO_THREADS */
+void sh_rcu_unlock(struct sh_rcu *table){
+#ifndef SH_NO_THREADS
+    pthread_mutex_unlock(&(table->lock));
+#else
+    (void) table;
+#endif
+}
+
+/**********************************************
+ **********************************************
+ **********************************************
+ ******** lock free tables ********************
+ **********************************************
+ **********************************************
+ ***********************************************/
+
+/* number of buckets in the first segment of a sh_lf bucket directory */
+#define SH_LF_SEGMENT 1024
+
+/* number of segments, allowing for SH_LF_SEGMENT << (SH_LF_SEGMENTS - 1)
+ * buckets in all
+ */
+#define SH_LF_SEGMENTS 32
+
+/* a sh_lf tries to free retired nodes every this many retirements */
+#define SH_LF_RECLAIM 64
+
+/* a node in the single sorted list holding every entry of a sh_lf
+ *
+ * the low bit of `next` is set once the node has been deleted, after which
+ * `next` never changes and the node is unlinked by whichever thread next
+ * walks past it
+ *
+ * bucket nodes (dummies) carry no key, see struct sh_lf
+ */
+struct sh_lf_node {
+    /* split order key, see sh_lf_so_key */
+    uint64_t so_key;
+    /* next node, with the deleted mark in the low bit */
+    uintptr_t next;
+    /* value, only ever replaced atomically, taken by a delete by
+     * swapping in the node's own address so a racing set sees it is gone
+     */
+    void *data;
+    size_t key_len;
+    /* next node retired, and the epoch this node was retired in */
+    struct sh_lf_node *retired;
+    uint64_t retired_epoch;
+    /* our own copy of the key */
+    char key[];
+};
+
+/* a table without any locks, a split ordered list (Shalev and Shavit)
+ *
+ * every entry lives in one lock free sorted list (Harris and Michael),
+ * ordered by the bit reversal of its mixed hash, so the entries of each
+ * bucket are contiguous and splitting a bucket in two never moves an entry
+ *
+ * each bucket points at a dummy node marking its place in the list, bucket
+ * i being split from bucket i without its highest set bit; buckets are
+ * only initialised when first used, by inserting their dummy after their
+ * parent's, so growing the table is just doubling `size`
+ *
+ * bucket pointers live in a directory of segments, each twice the size of
+ * the last after the first two, allocated on first use
+ *
+ * unlinked nodes are retired and freed once no thread can still be
+ * looking at them, every operation holds an epoch for its duration
+ */
+struct sh_lf {
+    /* segments of bucket pointers, allocated on first use */
+    struct sh_lf_node **segments[SH_LF_SEGMENTS];
+    /* number of buckets in use, always a power of two */
+    size_t size;
+    /* number of elements */
+    size_t n_elems;
+    /* grow once there are more than this many elements per bucket */
+    double max_load;
+    /* hash function and seed, as for struct sh_table */
+    unsigned long int (*hash_fn)(const void *key, size_t key_len, const uint64_t seed[2]);
+    uint64_t seed[2];
+
+    /* the epochs operations hold */
+    struct sh_epochs epochs;
+    /* unlinked nodes not yet freed, and how many have been retired */
+    struct sh_lf_node *retired;
+    size_t n_retired;
+    /* set while a thread is freeing retired nodes */
+    unsigned int reclaiming;
+};
+
+/* reverse the bits of `n` */
+uint64_t sh_lf_reverse(uint64_t n){
+    n = ((n >> 1) & UINT64_C(0x5555555555555555)) | ((n & UINT64_C(0x5555555555555555)) << 1);
+    n = ((n >> 2) & UINT64_C(0x3333333333333333)) | ((n & UINT64_C(0x3333333333333333)) << 2);
+    n = ((n >> 4) & UINT64_C(0x0f0f0f0f0f0f0f0f)) | ((n & UINT64_C(0x0f0f0f0f0f0f0f0f)) << 4);
+    n = ((n >> 8) & UINT64_C(0x00ff00ff00ff00ff)) | ((n & UINT64_C(0x00ff00ff00ff00ff)) << 8);
+    n = ((n >> 16) & UINT64_C(0x0000ffff0000ffff)) | ((n & UINT64_C(0x0000ffff0000ffff)) << 16);
+
+    return (n >> 32) | (n << 32);
+}
+
+/* the split order key of an entry with mixed hash `mixed`
+ *
+ * the top bit is set before reversing so an entry always sorts after the
+ * dummy of its bucket, whose split order key is the reversed bucket index
+ */
+uint64_t sh_lf_so_key(uint64_t mixed){
+    return sh_lf_reverse(mixed | (UINT64_C(1) << 63));
+}
+
+/* compare `node` against the position of an entry with split order key
+ * `so_key` and `key` of `key_len` bytes
+ *
+ * returns < 0 if node sorts before it, 0 if equal and > 0 if after
+ */
+int sh_lf_compare(const struct sh_lf_node *node, uint64_t so_key, const void *key, size_t key_len){
+    if( node->so_key != so_key ){
+        return node->so_key < so_key ? -1 : 1;
+    }
+
+    if( node->key_len != key_len ){
+        return node->key_len < key_len ? -1 : 1;
+    }
+
+    if( ! key_len ){
+        return 0;
+    }
+
+    return memcmp(node->key, key, key_len);
+}
+
+/* allocate a node holding a copy of `key`
+ *
+ * returns pointer on success
+ * returns 0 on failure
+ */
+struct sh_lf_node * sh_lf_node_new(uint64_t so_key, const void *key, size_t key_len, void *data){
+    /* our new node */
+    struct sh_lf_node *node = 0;
+
+    node = calloc(1, sizeof(struct sh_lf_node) + key_len);
+    if( ! node ){
+        sh_fail(SH_ERR_NOMEM, "sh_lf_node_new: call to calloc failed");
+        return 0;
+    }
+
+    node->so_key = so_key;
+    node->key_len = key_len;
+    node->data = data;
+    if( key_len ){
+        memcpy(node->key, key, key_len);
+    }
+
+    return node;
+}
+
+/* free retired nodes no thread can still be looking at, only one thread
+ * does so at a time, others return straight away
+ */
+void sh_lf_reclaim(struct sh_lf *table){
+    /* value expected by a compare and swap */
+    unsigned int idle = 0;
+    /* oldest epoch still held */
+    uint64_t oldest = 0;
+    /* iterators through retired nodes */
+    struct sh_lf_node *node = 0;
+    struct sh_lf_node *next = 0;
+    struct sh_lf_node *head = 0;
+
+    if( ! SH_CAS(&(table->reclaiming), idle, 1) ){
+        return;
+    }
+
+    /* take every node retired so far */
+    head = SH_ACQUIRE(&(table->retired));
+    while( ! SH_CAS(&(table->retired), head, (struct sh_lf_node *) 0) ){
+    }
+
+    oldest = sh_epoch_advance(&(table->epochs), 0);
+
+    for( node=head; node; node=next ){
+        next = node->retired;
+        if( node->retired_epoch < oldest ){
+            free(node);
+            continue;
+        }
+
+        /* still visible to someone, put it back for next time */
+        node->retired = SH_ACQUIRE(&(table->retired));
+        while( ! SH_CAS(&(table->retired), node->retired, node) ){
+        }
+    }
+
+    SH_RELEASE(&(table->reclaiming), 0);
+}
+
+/* retire `node` once it has been unlinked from the list,
+ * freeing it (and others) later when no thread can be looking at it
+ *
+ * every SH_LF_RECLAIM retirements the caller also tries to free what it can
+ */
+void sh_lf_retire(struct sh_lf *table, struct sh_lf_node *node){
+    node->retired_epoch = sh_epoch_now(&(table->epochs));
+
+    node->retired = SH_ACQUIRE(&(table->retired));
+    while( ! SH_CAS(&(table->retired), node->retired, node) ){
+    }
+
+    if( SH_FETCH_ADD(&(table->n_retired), 1) % SH_LF_RECLAIM == SH_LF_RECLAIM - 1 ){
+        sh_lf_reclaim(table);
+    }
+}
+
+/* find the position of the entry with `so_key` and `key` of `key_len` bytes
+ * in the list after `head`, unlinking any deleted nodes passed on the way
+ *
+ * on return `*prev` is the link to `*cur`, the first node not sorting
+ * before the entry, or 0 at the end of the list
+ *
+ * returns 1 if `*cur` is the entry
+ * returns 0 if it is not present
+ */
+unsigned int sh_lf_find(struct sh_lf *table, struct sh_lf_node *head, uint64_t so_key, const void *key, size_t key_len, uintptr_t **prev, struct sh_lf_node **cur){
+    /* the link we are looking at, its node and that node's next */
+    uintptr_t *link = 0;
+    uintptr_t node = 0;
+    uintptr_t next = 0;
+    /* value expected by a compare and swap */
+    uintptr_t expected = 0;
+    /* comparison against the entry */
+    int cmp = 0;
+
+    /* restarted from the head whenever a link changes under us */
+    for( ;; ){
+        link = &(head->next);
+        node = SH_ACQUIRE(link) & ~(uintptr_t) 1;
+
+        for( ;; ){
+            if( ! node ){
+                *prev = link;
+                *cur = 0;
+                return 0;
+            }
+
+            next = SH_ACQUIRE(&(((struct sh_lf_node *) node)->next));
+            if( SH_ACQUIRE(link) != node ){
+                break;
+            }
+
+            if( next & 1 ){
+                /* deleted, unlink it and carry on from the same link */
+                expected = node;
+                if( ! SH_CAS(link, expected, next & ~(uintptr_t) 1) ){
+                    break;
+                }
+                sh_lf_retire(table, (struct sh_lf_node *) node);
+                node = next & ~(uintptr_t) 1;
+                continue;
+            }
+
+            cmp = sh_lf_compare((struct sh_lf_node *) node, so_key, key, key_len);
+            if( cmp >= 0 ){
+                *prev = link;
+                *cur = (struct sh_lf_node *) node;
+                return cmp == 0;
+            }
+
+            link = &(((struct sh_lf_node *) node)->next);
+            node = next;
+        }
+    }
+}
+
+/* the link holding the dummy of `bucket`, allocating its segment if needed
+ *
+ * returns pointer on success
+ * returns 0 on failure
+ */
+struct sh_lf_node ** sh_lf_slot(struct sh_lf *table, size_t bucket){
+    /* the segment holding bucket, and bucket's offset within it */
+    size_t segment = 0;
+    size_t offset = bucket;
+    /* first bucket of the segment, and its number of buckets */
+    size_t first = SH_LF_SEGMENT;
+    size_t count = SH_LF_SEGMENT;
+    /* the segment's bucket pointers */
+    struct sh_lf_node **buckets = 0;
+    /* value expected by a compare and swap */
+    struct sh_lf_node **expected = 0;
+
+    if( bucket >= SH_LF_SEGMENT ){
+        segment = 1;
+        while( bucket >= first * 2 ){
+            first *= 2;
+            ++segment;
+        }
+        offset = bucket - first;
+        count = first;
+    }
+
+    buckets = SH_ACQUIRE(&(table->segments[segment]));
+    if( buckets ){
+        return &(buckets[offset]);
+    }
+
+    buckets = calloc(count, sizeof(struct sh_lf_node *));
+    if( ! buckets ){
+        sh_fail(SH_ERR_NOMEM, "sh_lf_slot: call to calloc failed");
+        return 0;
+    }
+
+    if( ! SH_CAS(&(table->segments[segment]), expected, buckets) ){
+        /* another thread got there first */
+        free(buckets);
+        buckets = expected;
+    }
+
+    return &(buckets[offset]);
+}
+
+/* the dummy of `bucket`, inserting it first if the bucket is new
+ *
+ * returns pointer on success
+ * returns 0 on failure
+ */
+struct sh_lf_node * sh_lf_bucket(struct sh_lf *table, size_t bucket){
+    /* the link holding the dummy */
+    struct sh_lf_node **slot = 0;
+    /* the dummy of the bucket, and of its parent */
+    struct sh_lf_node *dummy = 0;
+    struct sh_lf_node *parent = 0;
+    /* the parent bucket, bucket without its highest set bit */
+    size_t parent_bucket = bucket;
+    /* position in the list */
+    uintptr_t *prev = 0;
+    struct sh_lf_node *cur = 0;
+    /* value expected by a compare and swap */
+    struct sh_lf_node *expected = 0;
+    uintptr_t expected_link = 0;
+
+    slot = sh_lf_slot(table, bucket);
+    if( ! slot ){
+        sh_trace("sh_lf_bucket: call to sh_lf_slot failed");
+        return 0;
+    }
+
+    dummy = SH_ACQUIRE(slot);
+    if( dummy ){
+        return dummy;
+    }
+
+    /* bucket 0 always exists, so this terminates */
+    while( parent_bucket & (parent_bucket - 1) ){
+        parent_bucket &= parent_bucket - 1;
+    }
+    parent_bucket = bucket & ~parent_bucket;
+
+    parent = sh_lf_bucket(table, parent_bucket);
+    if( ! parent ){
+        sh_trace("sh_lf_bucket: call to sh_lf_bucket failed for parent");
+        return 0;
+    }
+
+    dummy = sh_lf_node_new(sh_lf_reverse(bucket), 0, 0, 0);
+    if( ! dummy ){
+        sh_trace("sh_lf_bucket: call to sh_lf_node_new failed");
+        return 0;
+    }
+
+    for( ;; ){
+        if( sh_lf_find(table, parent, dummy->so_key, 0, 0, &prev, &cur) ){
+            /* another thread inserted it first */
+            free(dummy);
+            dummy = cur;
+            break;
+        }
+
+        dummy->next = (uintptr_t) cur;
+        expected_link = (uintptr_t) cur;
+        if( SH_CAS(prev, expected_link, (uintptr_t) dummy) ){
+            break;
+        }
+    }
+
+    /* if this fails the slot already holds this same dummy */
+    (void) SH_CAS(slot, expected, dummy);
+
+    return dummy;
+}
+
+/* the dummy heading the bucket an entry with mixed hash `mixed` is in
+ *
+ * returns pointer on success
+ * returns 0 on failure
+ */
+struct sh_lf_node * sh_lf_head(struct sh_lf *table, uint64_t mixed){
+    return sh_lf_bucket(table, mixed & (SH_ACQUIRE(&(table->size)) - 1));
+}
+
+/* count an element added to the table, doubling the number of buckets
+ * when the load grows too high
+ */
+void sh_lf_added(struct sh_lf *table){
+    /* number of elements, including the one just added */
+    size_t n_elems = SH_FETCH_ADD(&(table->n_elems), 1) + 1;
+    /* number of buckets */
+    size_t size = SH_ACQUIRE(&(table->size));
+
+    if( n_elems > size * table->max_load &&
+        size < ((size_t) SH_LF_SEGMENT << (SH_LF_SEGMENTS - 1)) ){
+        /* if this fails another thread has already grown the table */
+        (void) SH_CAS(&(table->size), size, size * 2);
+    }
+}
+
+/* insert or set `key` of `key_len` bytes to `data`,
+ * only replacing an existing value if `replace` is set
+ *
+ * returns 1 on success
+ * returns 0 on failure, including if key exists and replace is not set
+ */
+unsigned int sh_lf_put(struct sh_lf *table, const void *key, size_t key_len, void *data, unsigned int replace){
+    /* mixed hash of key */
+    uint64_t mixed = 0;
+    /* our epoch slot */
+    struct sh_epoch_slot *slot = 0;
+    /* the dummy of our bucket */
+    struct sh_lf_node *head = 0;
+    /* our new node, if we need one */
+    struct sh_lf_node *node = 0;
+    /* position in the list */
+    uintptr_t *prev = 0;
+    struct sh_lf_node *cur = 0;
+    /* value expected by a compare and swap */
+    uintptr_t expected = 0;
+    void *expected_data = 0;
+
+    mixed = sh_mix(table->hash_fn(key, key_len, table->seed));
+
+    slot = sh_epoch_enter(&(table->epochs));
+
+    head = sh_lf_head(table, mixed);
+    if( ! head ){
+        sh_epoch_exit(slot);
+        sh_trace("sh_lf_put: call to sh_lf_head failed");
+        return 0;
+    }
+
+    for( ;; ){
+        if( sh_lf_find(table, head, sh_lf_so_key(mixed), key, key_len, &prev, &cur) ){
+            if( ! replace ){
+                sh_epoch_exit(slot);
+                free(node);
+                sh_fail(SH_ERR_EXISTS, "sh_lf_put: key already exists in table");
+                return 0;
+            }
+
+            /* replace the value unless a delete has already taken it,
+             * in which case the next find unlinks cur and we insert anew
+             */
+            expected_data = SH_ACQUIRE(&(cur->data));
+            while( expected_data != (void *) cur &&
+                   ! SH_CAS(&(cur->data), expected_data, data) ){
+            }
+            if( expected_data == (void *) cur ){
+                continue;
+            }
+
+            /* cur cannot be freed before we leave our epoch */
+            sh_epoch_exit(slot);
+            free(node);
+            return 1;
+        }
+
+        if( ! node ){
+            node = sh_lf_node_new(sh_lf_so_key(mixed), key, key_len, data);
+            if( ! node ){
+                sh_epoch_exit(slot);
+                sh_trace("sh_lf_put: call to sh_lf_node_new failed");
+                return 0;
+            }
+        }
+
+        node->next = (uintptr_t) cur;
+        expected = (uintptr_t) cur;
+        if( SH_CAS(prev, expected, (uintptr_t) node) ){
+            break;
+        }
+    }
+
+    sh_lf_added(table);
+    sh_epoch_exit(slot);
+
+    return 1;
+}
+
+/* find the node for `key`, the caller must hold an epoch slot
+ * and only look at the node while holding it
+ *
+ * returns the node on success
+ * returns 0 if the key is not present or on failure
+ */
+struct sh_lf_node * sh_lf_lookup(struct sh_lf *table, const void *key, size_t key_len){
+    /* mixed hash of key */
+    uint64_t mixed = 0;
+    /* the dummy of our bucket */
+    struct sh_lf_node *head = 0;
+    /* position in the list */
+    uintptr_t *prev = 0;
+    struct sh_lf_node *cur = 0;
+
+    mixed = sh_mix(table->hash_fn(key, key_len, table->seed));
+
+    head = sh_lf_head(table, mixed);
+    if( ! head ){
+        sh_trace("sh_lf_lookup: call to sh_lf_head failed");
+        return 0;
+    }
+
+    if( ! sh_lf_find(table, head, sh_lf_so_key(mixed), key, key_len, &prev, &cur) ){
+        return 0;
+    }
+
+    return cur;
+}
+
+/**********************************************
+ **********************************************
+ **********************************************
+ ******** flat combining **********************
+ **********************************************
+ **********************************************
+ ***********************************************/
+
+/* default number of slots of a sh_fc, see sh_fc_new */
+#define SH_FC_SLOTS 64
+
+/* times a waiting thread checks its slot before blocking on the lock */
+#define SH_FC_SPINS 1024
+
+/* most passes a combiner makes over the slots before handing over */
+#define SH_FC_PASSES 4
+
+/* the life of a struct sh_fc_slot */
+enum sh_fc_state {
+    /* not in use by any thread */
+    SH_FC_FREE = 0,
+    /* claimed by a thread filling in its request */
+    SH_FC_CLAIMED,
+    /* request published, waiting for a combiner */
+    SH_FC_PENDING,
+    /* request applied, result waiting for its thread */
+    SH_FC_DONE
+};
+
+/* the operations a thread may publish */
+enum sh_fc_op {
+    SH_FC_EXISTS,
+    SH_FC_GET,
+    SH_FC_INSERT,
+    SH_FC_SET,
+    SH_FC_DELETE
+};
+
+/* a request published by one thread, alone on its cache line(s) */
+struct sh_fc_slot {
+    /* an enum sh_fc_state */
+    unsigned int state;
+    /* the request */
+    enum sh_fc_op op;
+    const void *key;
+    size_t key_len;
+    void *data;
+    /* the result, data for SH_FC_GET and SH_FC_DELETE otherwise 1 or 0 */
+    void *result;
+    /* error recorded while applying it */
+    enum sh_error error;
+    char padding[64];
+};
+
+/* a sh_table shared between threads by flat combining
+ *
+ * rather than each thread taking the lock in turn, threads publish their
+ * request in a slot and wait; whichever thread holds the lock applies every
+ * published request in one pass and hands back the results, so the table
+ * stays in one core's cache and the lock changes hands once per batch
+ */
+struct sh_fc {
+    /* the table, only touched by the combiner */
+    struct sh_table table;
+    /* published requests, a power of two of them */
+    struct sh_fc_slot *slots;
+    size_t n_slots;
+    /* one past the highest slot ever claimed, so combiners only scan those */
+    size_t n_used;
+    /* table.n_elems, kept by the combiner for any thread to read */
+    size_t n_elems;
+
+#ifndef SH_NO_THREADS
+    /* held by the combiner */
+    pthread_mutex_t lock;
+#endif
+};
+
+/* apply the request in `slot` to `table`, recording its result and error */
+void sh_fc_apply(struct sh_table *table, struct sh_fc_slot *slot){
+    sh_error_last = SH_OK;
+
+    switch( slot->op ){
+        case SH_FC_EXISTS:
+            slot->result = sh_exists_n(table, slot->key, slot->key_len) ? table : 0;
+            break;
+
+        case SH_FC_GET:
+            slot->result = sh_get_n(table, slot->key, slot->key_len);
+            break;
+
+        case SH_FC_INSERT:
+            slot->result = sh_insert_n(table, slot->key, slot->key_len, slot->data) ? table : 0;
+            break;
+
+        case SH_FC_SET:
+            slot->result = sh_set_n(table, slot->key, slot->key_len, slot->data) ? table : 0;
+            break;
+
+        default:
+            slot->result = sh_delete_n(table, slot->key, slot->key_len);
+            break;
+    }
+
+    slot->error = sh_error_last;
+}
+
+/* as the combiner, apply every published request
+ *
+ * the combiner's own last error is kept, failures of the requests
+ * applied are handed back to the threads that made them
+ */
+void sh_fc_combine(struct sh_fc *fc){
+    /* the combiner's own last error */
+    enum sh_error error = sh_error_last;
+    /* iterators through passes and slots */
+    size_t pass = 0;
+    size_t i = 0;
+    /* requests applied this pass */
+    size_t applied = 0;
+
+    for( pass=0; pass<SH_FC_PASSES; ++pass ){
+        applied = 0;
+        for( i=0; i<SH_ACQUIRE(&(fc->n_used)); ++i ){
+            if( SH_ACQUIRE(&(fc->slots[i].state)) != SH_FC_PENDING ){
+                continue;
+            }
+            sh_fc_apply(&(fc->table), &(fc->slots[i]));
+            SH_RELEASE(&(fc->n_elems), fc->table.n_elems);
+            SH_RELEASE(&(fc->slots[i].state), SH_FC_DONE);
+            ++applied;
+        }
+
+        /* no one else is waiting */
+        if( applied <= 1 ){
+            break;
+        }
+    }
+
+    sh_error_last = error;
+}
+
+/* publish a request, wait for a combiner (perhaps ourselves) to apply it
+ *
+ * returns the result of the request
+ */
+void * sh_fc_call(struct sh_fc *fc, enum sh_fc_op op, const void *key, size_t key_len, void *data){
+    /* our slot */
+    struct sh_fc_slot *slot = 0;
+    /* slot to try */
+    size_t i = 0;
+    /* value expected by a compare and swap */
+    unsigned int expected = SH_FC_FREE;
+    /* slots in use before ours */
+    size_t used = 0;
+#ifndef SH_NO_THREADS
+    /* times we have checked our slot */
+    size_t spins = 0;
+#endif
+    /* our result */
+    void *result = 0;
+
+    /* only busy if there are more threads inside at once than slots */
+    for( i=sh_epoch_thread(); ; ++i ){
+        slot = &(fc->slots[i & (fc->n_slots - 1)]);
+        expected = SH_FC_FREE;
+        if( SH_CAS(&(slot->state), expected, SH_FC_CLAIMED) ){
+            break;
+        }
+    }
+
+    /* make sure combiners will look at our slot */
+    used = SH_ACQUIRE(&(fc->n_used));
+    while( used <= (size_t) (slot - fc->slots) &&
+           ! SH_CAS(&(fc->n_used), used, (size_t) (slot - fc->slots) + 1) ){
+    }
+
+    slot->op = op;
+    slot->key = key;
+    slot->key_len = key_len;
+    slot->data = data;
+    SH_RELEASE(&(slot->state), SH_FC_PENDING);
+
+#ifdef SH_NO_THREADS
+    sh_fc_combine(fc);
+#else
+    while( SH_ACQUIRE(&(slot->state)) != SH_FC_DONE ){
+        if( spins < SH_FC_SPINS ){
+            ++spins;
+            if( pthread_mutex_trylock(&(fc->lock)) ){
+                continue;
+            }
+        } else {
+            /* the combiner may not be running, stop spinning and wait */
+            pthread_mutex_lock(&(fc->lock));
+        }
+
+        /* our request may have been applied while taking the lock */
+        if( SH_ACQUIRE(&(slot->state)) != SH_FC_DONE ){
+            sh_fc_combine(fc);
+        }
+        pthread_mutex_unlock(&(fc->lock));
+    }
+#endif
+
+    result = slot->result;
+    if( slot->error != SH_OK ){
+        /* already logged by the combiner */
+        sh_error_last = slot->error;
+    }
+
+    SH_RELEASE(&(slot->state), SH_FC_FREE);
+
+    return result;
+}
+
+/**********************************************
+ **********************************************
+ **********************************************
+ ******** simple_hash.h implementation ********
+ **********************************************
+ **********************************************
+ ***********************************************/
+
+/* function to return number of elements
+ *
+ * returns number on success
+ * returns 0 on failure
+ */
+unsigned int sh_nelems(const struct sh_table *table){
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_nelems: table was null");
+        return 0;
+    }
+
+    return table->n_elems;
+}
+
+/* fill `stats` with a description of `table`, see struct sh_stats
+ *
+ * this visits every bucket and entry once
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_stats(const struct sh_table *table, struct sh_stats *stats){
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_stats: table undef");
+        return 0;
+    }
+
+    if( ! stats ){
+        sh_fail(SH_ERR_INVALID, "sh_stats: stats undef");
+        return 0;
+    }
+
+    memset(stats, 0, sizeof(struct sh_stats));
+
+    stats->n_elems = table->n_elems;
+    stats->load = (double) table->n_elems / table->size;
+
+    if( table->backend != SH_BACKEND_CHAINING ){
+        sh_stats_slots(table, stats);
+    } else {
+        sh_stats_chains(table, table->entries, 0, table->size, stats);
+
+        /* and any not yet moved by an incremental resize */
+        if( table->old_entries ){
+            sh_stats_chains(table, table->old_entries, table->migrate_pos, table->old_size, stats);
+            stats->bucket_bytes += table->migrate_pos * sizeof(struct sh_bucket);
+        }
+    }
+
+    /* every chain, or probe sequence, that is not empty */
+    if( stats->n_buckets > stats->n_empty ){
+        stats->mean_chain /= stats->n_buckets - stats->n_empty;
+    }
+
+    return 1;
+}
+
+/* copy the telemetry counters of `table` into `snapshot`
+ *
+ * this may be called from another thread while the table is in use,
+ * each counter is read atomically but they are not read all at once
+ *
+ * returns 1 on success
+ * returns 0 on failure (including when built without SH_TELEMETRY)
+ */
+unsigned int sh_telemetry_snapshot(const struct sh_table *table, struct sh_telemetry *snapshot){
+#ifdef SH_TELEMETRY
+    /* iterators through operations and latency buckets */
+    size_t op = 0;
+    size_t i = 0;
+#endif
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_telemetry_snapshot: table undef");
+        return 0;
+    }
+
+    if( ! snapshot ){
+        sh_fail(SH_ERR_INVALID, "sh_telemetry_snapshot: snapshot undef");
+        return 0;
+    }
+
+#ifdef SH_TELEMETRY
+    if( ! table->telemetry ){
+        sh_fail(SH_ERR_UNSUPPORTED, "sh_telemetry_snapshot: table has no telemetry");
+        return 0;
+    }
+
+    for( op=0; op<SH_OP_COUNT; ++op ){
+        snapshot->hits[op] = sh_telemetry_load(&(table->telemetry->hits[op]));
+        snapshot->misses[op] = sh_telemetry_load(&(table->telemetry->misses[op]));
+        for( i=0; i<SH_LATENCY_BUCKETS; ++i ){
+            snapshot->latency[op][i] = sh_telemetry_load(&(table->telemetry->latency[op][i]));
+        }
+    }
+    snapshot->nodes_visited = sh_telemetry_load(&(table->telemetry->nodes_visited));
+    snapshot->resizes = sh_telemetry_load(&(table->telemetry->resizes));
+    snapshot->resize_ns = sh_telemetry_load(&(table->telemetry->resize_ns));
+
+    return 1;
+#else
+    sh_fail(SH_ERR_UNSUPPORTED, "sh_telemetry_snapshot: built without SH_TELEMETRY");
+    return 0;
+#endif
+}
+
+/* set every telemetry counter of `table` back to 0
+ *
+ * unlike sh_telemetry_snapshot this must be called from the thread using
+ * the table, otherwise updates made at the same time may be lost
+ *
+ * returns 1 on success
+ * returns 0 on failure (including when built without SH_TELEMETRY)
+ */
+unsigned int sh_telemetry_reset(struct sh_table *table){
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_telemetry_reset: table undef");
+        return 0;
+    }
+
+#ifdef SH_TELEMETRY
+    if( ! table->telemetry ){
+        sh_fail(SH_ERR_UNSUPPORTED, "sh_telemetry_reset: table has no telemetry");
+        return 0;
+    }
+
+    memset(table->telemetry, 0, sizeof(struct sh_telemetry));
+
+    return 1;
+#else
+    sh_fail(SH_ERR_UNSUPPORTED, "sh_telemetry_reset: built without SH_TELEMETRY");
+    return 0;
+#endif
+}
+
+/* takes a char* representing a string
+ *
+ * will recalculate key_len if 0
+ *
+ * returns an unsigned long integer hash value on success
+ * returns 0 on failure
+ */
+unsigned long int sh_hash(const char *key, size_t key_len){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_hash: key undef");
+        return 0;
+    }
+
+    /* we allow key_len to be 0
+     * we issue a warning and then recalculate
+     */
+    if( ! key_len ){
+#ifdef DEBUG
+        puts("sh_hash: key_len was 0, recalculating");
+#endif
+        key_len = strlen(key);
+    }
+
+#ifdef DEBUG
+    printf("sh_hash: hashing string '%s'\n", key);
+#endif
+
+    return sh_hash_n(key, key_len);
+}
+
+/* takes a key of exactly `key_len` bytes, which may contain null bytes
+ *
+ * unlike sh_hash a `key_len` of 0 is the empty key
+ *
+ * this is sh_hash_djb2 with a seed of 0, the default hash for tables
+ *
+ * returns an unsigned long integer hash value
+ */
+unsigned long int sh_hash_n(const void *key, size_t key_len){
+    /* the default seed */
+    const uint64_t seed[2] = { 0, 0 };
+
+    return sh_hash_djb2(key, key_len, seed);
+}
+
+/* read 8 bytes as a little endian 64 bit word
+ * the shifts are recognised by compilers and turned into a single load
+ * on little endian machines, without any alignment requirement on p
+ */
+uint64_t sh_read64(const unsigned char *p){
+    return  (uint64_t) p[0]        | ((uint64_t) p[1] << 8)  |
+           ((uint64_t) p[2] << 16) | ((uint64_t) p[3] << 24) |
+           ((uint64_t) p[4] << 32) | ((uint64_t) p[5] << 40) |
+           ((uint64_t) p[6] << 48) | ((uint64_t) p[7] << 56);
+}
+
+/* read 4 bytes as a little endian 32 bit word */
+uint64_t sh_read32(const unsigned char *p){
+    return  (uint64_t) p[0]        | ((uint64_t) p[1] << 8)  |
+           ((uint64_t) p[2] << 16) | ((uint64_t) p[3] << 24);
+}
+
+/* rotate a 64 bit word left by `r` bits, 0 < r < 64 */
+uint64_t sh_rotl64(uint64_t x, unsigned int r){
+    return (x << r) | (x >> (64 - r));
+}
+
+/* djb2, one byte per step
+ * http://www.cse.yorku.ca/~oz/hash.html
+ *
+ * the starting value is seed[0] (0 by default, which is what sh_hash
+ * has always used) so seeding does not prevent collisions,
+ * use sh_hash_siphash if keys may be chosen by an attacker
+ *
+ * returns an unsigned long integer hash value
+ */
+unsigned long int sh_hash_djb2(const void *key, size_t key_len, const uint64_t seed[2]){
+    /* our hash value */
+    unsigned long int hash = seed[0];
+    /* our iterator through the key */
+    size_t i = 0;
+    /* treat key as chars, this keeps the hash values sh_hash has always given */
+    const char *str = key;
+
+    /* hashing time */
+    for( i=0; i < key_len; ++i ){
+
+#ifdef DEBUG
+    printf("sh_hash_djb2: looking at i '%zd', char '%c'\n", i, str[i]);
+#endif
+
+        /* we do not have to worry about overflow doing silly things:
+         *
+         * C99 section 6.2.5.9 page 34:
+         * A computation involving unsigned operands can never overﬂow,
+         * because a result that cannot be represented by the resulting
+         * unsigned integer type is reduced modulo the number that is one
+         * greater than the largest value that can be represented by the
+         * resulting type.
+         */
+
+        /* hash this character
+         * http://www.cse.yorku.ca/~oz/hash.html
+         * djb2
+         */
+        hash = ((hash << 5) + hash) + str[i];
+    }
+
+#ifdef DEBUG
+    puts("sh_hash_djb2: success");
+#endif
+    return hash;
+}
+
+/* xxh64 primes */
+#define SH_XXH_P1 UINT64_C(11400714785074694791)
+#define SH_XXH_P2 UINT64_C(14029467366897019727)
+#define SH_XXH_P3 UINT64_C(1609587929392839161)
+#define SH_XXH_P4 UINT64_C(9650029242287828579)
+#define SH_XXH_P5 UINT64_C(2870177450012600261)
+
+/* a single xxh64 accumulator round */
+uint64_t sh_xxh64_round(uint64_t acc, uint64_t input){
+    acc += input * SH_XXH_P2;
+    acc  = sh_rotl64(acc, 31);
+    acc *= SH_XXH_P1;
+    return acc;
+}
+
+/* fold an accumulator into the final xxh64 hash */
+uint64_t sh_xxh64_merge(uint64_t acc, uint64_t val){
+    acc ^= sh_xxh64_round(0, val);
+    acc  = acc * SH_XXH_P1 + SH_XXH_P4;
+    return acc;
+}
+
+/* xxh64, seeded by seed[0]
+ * https://github.com/Cyan4973/xxHash
+ *
+ * consumes 8 bytes per step, and for keys of 32 bytes or more runs
+ * 4 independent accumulators so the multiplies overlap
+ *
+ * the output is well mixed in every bit,
+ * but it is not keyed so should not be relied on against an attacker
+ *
+ * returns an unsigned long integer hash value
+ * (truncated on platforms where unsigned long is 32 bits)
+ */
+unsigned long int sh_hash_xxh64(const void *key, size_t key_len, const uint64_t seed[2]){
+    const unsigned char *p = key;
+    const unsigned char *end = p + key_len;
+    /* our hash value */
+    uint64_t hash = 0;
+    /* our 4 accumulators */
+    uint64_t v1 = 0, v2 = 0, v3 = 0, v4 = 0;
+
+    if( key_len >= 32 ){
+        v1 = seed[0] + SH_XXH_P1 + SH_XXH_P2;
+        v2 = seed[0] + SH_XXH_P2;
+        v3 = seed[0];
+        v4 = seed[0] - SH_XXH_P1;
+
+        for( ; end - p >= 32; p += 32 ){
+            v1 = sh_xxh64_round(v1, sh_read64(p));
+            v2 = sh_xxh64_round(v2, sh_read64(p + 8));
+            v3 = sh_xxh64_round(v3, sh_read64(p + 16));
+            v4 = sh_xxh64_round(v4, sh_read64(p + 24));
+        }
+
+        hash = sh_rotl64(v1, 1) + sh_rotl64(v2, 7) + sh_rotl64(v3, 12) + sh_rotl64(v4, 18);
+        hash = sh_xxh64_merge(hash, v1);
+        hash = sh_xxh64_merge(hash, v2);
+        hash = sh_xxh64_merge(hash, v3);
+        hash = sh_xxh64_merge(hash, v4);
+    } else {
+        hash = seed[0] + SH_XXH_P5;
+    }
+
+    hash += (uint64_t) key_len;
+
+    /* remaining whole words */
+    for( ; end - p >= 8; p += 8 ){
+        hash ^= sh_xxh64_round(0, sh_read64(p));
+        hash  = sh_rotl64(hash, 27) * SH_XXH_P1 + SH_XXH_P4;
+    }
+
+    if( end - p >= 4 ){
+        hash ^= sh_read32(p) * SH_XXH_P1;
+        hash  = sh_rotl64(hash, 23) * SH_XXH_P2 + SH_XXH_P3;
+        p += 4;
+    }
+
+    for( ; p < end; ++p ){
+        hash ^= (*p) * SH_XXH_P5;
+        hash  = sh_rotl64(hash, 11) * SH_XXH_P1;
+    }
+
+    /* final avalanche */
+    hash ^= hash >> 33;
+    hash *= SH_XXH_P2;
+    hash ^= hash >> 29;
+    hash *= SH_XXH_P3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+/* a single siphash round over our 4 words of state */
+#define SH_SIPROUND(v0, v1, v2, v3) \
+    do { \
+        v0 += v1; v1 = sh_rotl64(v1, 13); v1 ^= v0; v0 = sh_rotl64(v0, 32); \
+        v2 += v3; v3 = sh_rotl64(v3, 16); v3 ^= v2; \
+        v0 += v3; v3 = sh_rotl64(v3, 21); v3 ^= v0; \
+        v2 += v1; v1 = sh_rotl64(v1, 17); v1 ^= v2; v2 = sh_rotl64(v2, 32); \
+    } while(0)
+
+/* siphash-2-4 keyed by the 128 bits of seed[0] and seed[1]
+ * https://131002.net/siphash/
+ *
+ * slower than sh_hash_xxh64, but with a secret random seed an attacker
+ * cannot choose keys which collide, which would otherwise let them turn
+ * a bucket into one long chain
+ *
+ * returns an unsigned long integer hash value
+ * (truncated on platforms where unsigned long is 32 bits)
+ */
+unsigned long int sh_hash_siphash(const void *key, size_t key_len, const uint64_t seed[2]){
+    const unsigned char *p = key;
+    const unsigned char *end = p + (key_len - (key_len % 8));
+    /* our state */
+    uint64_t v0 = seed[0] ^ UINT64_C(0x736f6d6570736575);
+    uint64_t v1 = seed[1] ^ UINT64_C(0x646f72616e646f6d);
+    uint64_t v2 = seed[0] ^ UINT64_C(0x6c7967656e657261);
+    uint64_t v3 = seed[1] ^ UINT64_C(0x7465646279746573);
+    /* current message word */
+    uint64_t m = 0;
+    /* final word, holding the length and any trailing bytes */
+    uint64_t b = ((uint64_t) key_len) << 56;
+
+    for( ; p != end; p += 8 ){
+        m = sh_read64(p);
+        v3 ^= m;
+        SH_SIPROUND(v0, v1, v2, v3);
+        SH_SIPROUND(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+
+    /* deliberate fall through, collecting the trailing bytes */
+    switch( key_len % 8 ){
+        case 7: b |= ((uint64_t) p[6]) << 48; /* fall through */
+        case 6: b |= ((uint64_t) p[5]) << 40; /* fall through */
+        case 5: b |= ((uint64_t) p[4]) << 32; /* fall through */
+        case 4: b |= ((uint64_t) p[3]) << 24; /* fall through */
+        case 3: b |= ((uint64_t) p[2]) << 16; /* fall through */
+        case 2: b |= ((uint64_t) p[1]) << 8;  /* fall through */
+        case 1: b |= ((uint64_t) p[0]);       break;
+        case 0: break;
+    }
+
+    v3 ^= b;
+    SH_SIPROUND(v0, v1, v2, v3);
+    SH_SIPROUND(v0, v1, v2, v3);
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    SH_SIPROUND(v0, v1, v2, v3);
+    SH_SIPROUND(v0, v1, v2, v3);
+    SH_SIPROUND(v0, v1, v2, v3);
+    SH_SIPROUND(v0, v1, v2, v3);
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/* initialise a pre-hashed key handle for `key` of `key_len` bytes
+ * using the default hash (sh_hash_djb2 with a seed of 0)
+ *
+ * the handle does not copy the key, so `key` must remain valid
+ * for as long as the handle is in use
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_key_init(struct sh_key *handle, const void *key, size_t key_len){
+    if( ! handle ){
+        sh_fail(SH_ERR_INVALID, "sh_key_init: handle undef");
+        return 0;
+    }
+
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_key_init: key undef");
+        return 0;
+    }
+
+    handle->key = key;
+    handle->key_len = key_len;
+    handle->hash_fn = sh_hash_djb2;
+    handle->seed[0] = 0;
+    handle->seed[1] = 0;
+    handle->hash = sh_hash_n(key, key_len);
+
+    return 1;
+}
+
+/* initialise a pre-hashed key handle for `key` of `key_len` bytes
+ * using the hash function and seed of `table`
+ *
+ * the handle can be used with any table sharing that hash function and seed
+ * without being rehashed
+ *
+ * the handle does not copy the key, so `key` must remain valid
+ * for as long as the handle is in use
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_key_init_for(struct sh_key *handle, const struct sh_table *table, const void *key, size_t key_len){
+    if( ! handle ){
+        sh_fail(SH_ERR_INVALID, "sh_key_init_for: handle undef");
+        return 0;
+    }
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_key_init_for: table undef");
+        return 0;
+    }
+
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_key_init_for: key undef");
+        return 0;
+    }
+
+    handle->key = key;
+    handle->key_len = key_len;
+    handle->hash_fn = table->hash_fn;
+    handle->seed[0] = table->seed[0];
+    handle->seed[1] = table->seed[1];
+    handle->hash = table->hash_fn(key, key_len, table->seed);
+
+    return 1;
+}
+
+/* takes a table and a hash value
+ *
+ * returns the index into the table for this hash
+ * returns 0 on failure (if table is null)
+ *
+ * note the error value is indistinguishable from the 0th bucket
+ * this function can only error if table is null
+ * so the caller can distinguish these 2 cases
+ */
+size_t sh_pos(unsigned long int hash, size_t table_size){
+
+    /* force hash value into a bucket */
+    return hash % table_size;
+}
+
+/* takes a hash value and a power of two table size
+ *
+ * the hash is first mixed by a multiplication with 2^64 / phi (fibonacci
+ * hashing) so that weak hashes such as djb2, which differ mostly in their
+ * low bits, still spread across the table, and then masked
+ *
+ * returns the index into the table for this hash
+ * the result is meaningless if table_size is not a power of two
+ */
+size_t sh_pos_pow2(unsigned long int hash, size_t table_size){
+    return (size_t) sh_mix(hash) & (table_size - 1);
+}
+
+/* allocate and initialise a new sh_table of size size
+ *
+ * returns pointer on success
+ * returns 0 on failure
+ */
+struct sh_table * sh_new(size_t size){
+    return sh_new_opts(size, 0);
+}
+
+/* allocate and initialise a new sh_table of size size
+ * configured by `opts`, see struct sh_opts
+ *
+ * a null `opts` gives the defaults, as for sh_new
+ *
+ * returns pointer on success
+ * returns 0 on failure
+ */
+struct sh_table * sh_new_opts(size_t size, const struct sh_opts *opts){
+    struct sh_table *sht = 0;
+
+    /* alloc */
+    sht = calloc(1, sizeof(struct sh_table));
+    if( ! sht ){
+        sh_fail(SH_ERR_NOMEM, "sh_new_opts: calloc failed");
+        return 0;
+    }
+
+    /* init */
+    if( ! sh_init_opts(sht, size, opts) ){
+        sh_trace("sh_new_opts: call to sh_init_opts failed");
+        /* no leaking */
+        free(sht);
+        return 0;
+    }
+
+    return sht;
+}
+
+/* free an existing sh_table
+ * this will free all the sh entries stored
+ * this will free all the keys (as they are strdup-ed)
+ *
+ * this will only free the *table pointer if `free_table` is set to 1
+ * this will only free the *data pointers if `free_data` is set to 1
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_destroy(struct sh_table *table, unsigned int free_table, unsigned int free_data){
+    /* iterator through table */
+    size_t i = 0;
+    /* current entry */
+    struct sh_entry *cur_she = 0;
+    /* next entry to consider */
+    struct sh_entry *next_she = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_destroy: table undef");
+        return 0;
+    }
+
+    /* finish any incremental resize so we only have one array to walk */
+    if( ! sh_rehash_step(table, table->old_size) ){
+        sh_trace("sh_destroy: call to sh_rehash_step failed");
+        return 0;
+    }
+
+    if( table->backend != SH_BACKEND_CHAINING ){
+        sh_oa_destroy(table, free_data);
+    }
+
+    /* iterate through `entries` list
+     * and then iterate through each entry within it
+     * freeing them and their appropriate parts
+     */
+    for( i=0; table->entries && sh_destroy_walk(table, free_data) && i < table->size; ++i ){
+        next_she = table->entries[i].head;
+        while( next_she ){
+            cur_she = next_she;
+            next_she = next_she->next;
+
+            /* always free key as it is strdupn-ed
+             * only free data if we are asked to
+             */
+            sh_entry_destroy(table->slab, cur_she, 1, free_data, ! table->borrow_keys);
+        }
+    }
+
+    /* free entires table */
+    free(table->entries);
+
+    /* and every entry and key still in the slab */
+    sh_slab_destroy(table->slab);
+    table->slab = 0;
+
+    free(table->telemetry);
+    table->telemetry = 0;
+
+    /* finally free table if asked to */
+    if( free_table ){
+        free(table);
+    }
+
+    return 1;
+}
+
+/* initialise an already allocated sh_table to size size
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_init(struct sh_table *table, size_t size){
+    return sh_init_opts(table, size, 0);
+}
+
+/* initialise an already allocated sh_table to size size
+ * configured by `opts`, see struct sh_opts
+ *
+ * a null `opts` gives the defaults, as for sh_init
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_init_opts(struct sh_table *table, size_t size, const struct sh_opts *opts){
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_init_opts: table undef");
+        return 0;
+    }
+
+    if( size == 0 ){
+        sh_fail(SH_ERR_INVALID, "sh_init_opts: specified size of 0, impossible");
+        return 0;
+    }
+
+    /* storage, chaining unless told otherwise */
+    table->backend = SH_BACKEND_CHAINING;
+    if( opts ){
+        switch( opts->backend ){
+            case SH_BACKEND_CHAINING:
+            case SH_BACKEND_ROBIN_HOOD:
+            case SH_BACKEND_SWISS:
+                table->backend = opts->backend;
+                break;
+
+            default:
+                sh_fail(SH_ERR_INVALID, "sh_init_opts: unknown backend");
+                return 0;
+        }
+    }
+
+    /* bucket indexing, modulo unless told otherwise
+     * open addressing relies on power of two sizes
+     */
+    table->pow2 = 0;
+    if( (opts && opts->pow2) || table->backend != SH_BACKEND_CHAINING ){
+        table->pow2 = 1;
+    }
+
+    size = sh_round_size(table, size);
+    if( size == 0 ){
+        sh_fail(SH_ERR_INVALID, "sh_init_opts: specified size too large to round to a power of two");
+        return 0;
+    }
+
+    table->size     = size;
+    table->n_elems  = 0;
+    table->min_size = size;
+    table->max_load = SH_DEFAULT_MAX_LOAD;
+    table->min_load = SH_DEFAULT_MIN_LOAD;
+    sh_load_thresholds(table);
+
+    /* no resize in progress, and resizes are not incremental by default */
+    table->old_entries  = 0;
+    table->old_size     = 0;
+    table->migrate_pos  = 0;
+    table->migrate_step = 0;
+
+    /* hash function and seed, djb2 with a seed of 0 unless told otherwise */
+    table->hash_fn = sh_hash_djb2;
+    table->seed[0] = 0;
+    table->seed[1] = 0;
+    if( opts ){
+        if( opts->hash_fn ){
+            table->hash_fn = opts->hash_fn;
+        }
+        table->seed[0] = opts->seed[0];
+        table->seed[1] = opts->seed[1];
+    }
+
+    table->entries   = 0;
+    table->slots     = 0;
+    table->ctrl      = 0;
+    table->n_deleted = 0;
+
+    /* keys are copied unless the caller promises they outlive the table */
+    table->borrow_keys = 0;
+    if( opts && opts->borrow_keys ){
+        table->borrow_keys = 1;
+    }
+
+    /* counters are only kept when built with SH_TELEMETRY */
+    table->telemetry = 0;
+#ifdef SH_TELEMETRY
+    table->telemetry = calloc(1, sizeof(struct sh_telemetry));
+    if( ! table->telemetry ){
+        sh_fail(SH_ERR_NOMEM, "sh_init_opts: calloc failed");
+        return 0;
+    }
+#endif
+
+    /* entries and keys come from malloc unless asked for a slab */
+    table->slab = 0;
+    if( opts && opts->slab ){
+        table->slab = sh_slab_new();
+        if( ! table->slab ){
+            sh_trace("sh_init_opts: call to sh_slab_new failed");
+            free(table->telemetry);
+            return 0;
+        }
+    }
+
+    if( table->backend != SH_BACKEND_CHAINING ){
+        /* calloc our slots (sh_entry), all empty */
+        table->slots = calloc(size, sizeof(struct sh_entry));
+        if( ! table->slots ){
+            sh_fail(SH_ERR_NOMEM, "sh_init_opts: calloc failed");
+            sh_slab_destroy(table->slab);
+            free(table->telemetry);
+            return 0;
+        }
+    }
+
+    if( table->backend == SH_BACKEND_SWISS ){
+        /* and our control bytes, all empty */
+        table->ctrl = malloc(size);
+        if( ! table->ctrl ){
+            sh_fail(SH_ERR_NOMEM, "sh_init_opts: malloc failed");
+            free(table->slots);
+            sh_slab_destroy(table->slab);
+            free(table->telemetry);
+            return 0;
+        }
+        memset(table->ctrl, SH_SWISS_EMPTY, size);
+    }
+
+    if( table->backend != SH_BACKEND_CHAINING ){
+        return 1;
+    }
+
+    /* calloc our buckets, all empty with clear filters */
+    table->entries = calloc(size, sizeof(struct sh_bucket));
+    if( ! table->entries ){
+        sh_fail(SH_ERR_NOMEM, "sh_init_opts: calloc failed");
+        sh_slab_destroy(table->slab);
+        free(table->telemetry);
+        return 0;
+    }
+
+    return 1;
+}
+
+/* resize an existing table to new_size
+ * this will reshuffle all the buckets around
+ *
+ * you can use this to make a hash larger or smaller
+ *
+ * if the table was created with opts.pow2 then new_size is rounded up
+ * to the next power of two
+ *
+ * if incremental resizing is enabled (see sh_set_incremental)
+ * this will only begin moving entries across, the remainder are moved
+ * by subsequent modifications or calls to sh_rehash_step
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_resize(struct sh_table *table, size_t new_size){
+    /* our new data area */
+    struct sh_bucket *new_entries = 0;
+    /* when we started, for telemetry */
+    uint64_t started = SH_CLOCK();
+    /* result of resizing */
+    unsigned int ok = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_resize: table was null");
+        return 0;
+    }
+
+    if( new_size == 0 ){
+        sh_fail(SH_ERR_INVALID, "sh_resize: asked for new_size of 0, impossible");
+        return 0;
+    }
+
+    new_size = sh_round_size(table, new_size);
+    if( new_size == 0 ){
+        sh_fail(SH_ERR_INVALID, "sh_resize: new_size too large to round to a power of two");
+        return 0;
+    }
+
+    switch( table->backend ){
+        case SH_BACKEND_ROBIN_HOOD:
+            ok = sh_rh_resize(table, new_size);
+            SH_RESIZED(table, started);
+            return ok;
+
+        case SH_BACKEND_SWISS:
+            ok = sh_sw_resize(table, new_size);
+            SH_RESIZED(table, started);
+            return ok;
+
+        default:
+            break;
+    }
+
+    /* we can only track one migration at a time
+     * so any in progress must be completed first
+     */
+    if( ! sh_rehash_step(table, table->old_size) ){
+        sh_trace("sh_resize: call to sh_rehash_step failed");
+        return 0;
+    }
+
+    /* allocate a new array of empty buckets */
+    new_entries = calloc(new_size, sizeof(struct sh_bucket));
+    if( ! new_entries ){
+        sh_fail(SH_ERR_NOMEM, "sh_resize: call to calloc failed");
+        return 0;
+    }
+
+    /* our current entries become the source of the migration */
+    table->old_entries = table->entries;
+    table->old_size = table->size;
+    table->migrate_pos = 0;
+
+    /* swap */
+    table->size = new_size;
+    table->entries = new_entries;
+
+    /* our thresholds are relative to size */
+    sh_load_thresholds(table);
+
+    /* either move everything now
+     * or just the first step if we are incremental
+     */
+    if( table->migrate_step ){
+        ok = sh_rehash_step(table, table->migrate_step);
+    } else {
+        ok = sh_rehash_step(table, table->old_size);
+    }
+
+    SH_RESIZED(table, started);
+
+    return ok;
+}
+
+/* resize an existing table to new_size as sh_resize does, spreading the
+ * work across `n_threads` threads
+ *
+ * intended for growing a large table as quickly as possible while it is
+ * otherwise idle, the whole resize is completed before returning
+ * regardless of sh_set_incremental
+ *
+ * only SH_BACKEND_CHAINING resizes in parallel, the open addressing
+ * backends and an `n_threads` of 0 or 1 resize on the calling thread
+ * via sh_resize
+ *
+ * the table must not be used by any other thread during the resize,
+ * with SH_NO_THREADS `n_threads` is ignored
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_resize_parallel(struct sh_table *table, size_t new_size, unsigned int n_threads){
+    /* one per thread */
+    struct sh_resize_worker *workers = 0;
+    /* every worker's list for every partition */
+    struct sh_entry **lists = 0;
+    /* the buckets we are moving out of */
+    struct sh_bucket *old_entries = 0;
+    size_t old_size = 0;
+    /* number of workers */
+    size_t n_workers = n_threads;
+    /* iterator through workers */
+    size_t w = 0;
+    /* when we started, for telemetry */
+    uint64_t started = SH_CLOCK();
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_resize_parallel: table was null");
+        return 0;
+    }
+
+#ifdef SH_NO_THREADS
+    n_workers = 1;
+#endif
+
+    if( n_workers <= 1 || table->backend != SH_BACKEND_CHAINING ){
+        if( ! sh_resize(table, new_size) ){
+            sh_trace("sh_resize_parallel: call to sh_resize failed");
+            return 0;
+        }
+        return sh_rehash_step(table, table->old_size);
+    }
+
+    if( new_size == 0 ){
+        sh_fail(SH_ERR_INVALID, "sh_resize_parallel: asked for new_size of 0, impossible");
+        return 0;
+    }
+
+    new_size = sh_round_size(table, new_size);
+    if( new_size == 0 ){
+        sh_fail(SH_ERR_INVALID, "sh_resize_parallel: new_size too large to round to a power of two");
+        return 0;
+    }
+
+    /* finish any incremental resize so there is a single bucket array */
+    if( ! sh_rehash_step(table, table->old_size) ){
+        sh_trace("sh_resize_parallel: call to sh_rehash_step failed");
+        return 0;
+    }
+
+    /* a worker per partition, with at least one bucket in each */
+    if( n_workers > new_size ){
+        n_workers = new_size;
+    }
+    if( n_workers > table->size ){
+        n_workers = table->size;
+    }
+
+    workers = calloc(n_workers, sizeof(struct sh_resize_worker));
+    lists = calloc(n_workers * n_workers, sizeof(struct sh_entry *));
+    if( ! workers || ! lists ){
+        sh_fail(SH_ERR_NOMEM, "sh_resize_parallel: allocation failed");
+        free(workers);
+        free(lists);
+        return 0;
+    }
+
+    old_entries = table->entries;
+    old_size = table->size;
+
+    table->entries = calloc(new_size, sizeof(struct sh_bucket));
+    if( ! table->entries ){
+        sh_fail(SH_ERR_NOMEM, "sh_resize_parallel: call to calloc failed");
+        table->entries = old_entries;
+        free(workers);
+        free(lists);
+        return 0;
+    }
+    table->size = new_size;
+
+    for( w=0; w<n_workers; ++w ){
+        workers[w].table = table;
+        workers[w].old_entries = old_entries;
+        workers[w].n_workers = n_workers;
+        workers[w].part_size = (new_size + n_workers - 1) / n_workers;
+        workers[w].lists = lists;
+        workers[w].id = w;
+        workers[w].lo = old_size / n_workers * w;
+        workers[w].hi = w + 1 == n_workers ? old_size : old_size / n_workers * (w + 1);
+    }
+
+    sh_build_run(workers, sizeof(struct sh_resize_worker), n_workers, sh_resize_split);
+    sh_build_run(workers, sizeof(struct sh_resize_worker), n_workers, sh_resize_link);
+
+    /* our thresholds are relative to size */
+    sh_load_thresholds(table);
+
+    free(old_entries);
+    free(workers);
+    free(lists);
+
+    SH_RESIZED(table, started);
+
+    return 1;
+}
+
+/* enable or disable incremental resizing for this table
+ *
+ * when enabled, sh_resize (including automatic resizes) allocates the new
+ * bucket array but leaves the entries in the old one, then each
+ * sh_insert, sh_update, sh_set and sh_delete moves `step` old buckets across
+ *
+ * lookups (sh_get, sh_exists) never move entries as they do not modify
+ * the table, a read-only workload should drive sh_rehash_step instead
+ *
+ * a `step` of 0 disables incremental resizing,
+ * completing any migration currently in progress
+ *
+ * only SH_BACKEND_CHAINING resizes incrementally,
+ * the open addressing backends always resize in one go
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_set_incremental(struct sh_table *table, size_t step){
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_set_incremental: table undef");
+        return 0;
+    }
+
+    table->migrate_step = step;
+
+    if( ! step ){
+        return sh_rehash_step(table, table->old_size);
+    }
+
+    return 1;
+}
+
+/* move up to `n_buckets` old buckets across if an incremental resize is in
+ * progress, does nothing if there is no resize in progress
+ *
+ * this is intended to be driven from an idle loop so that
+ * the resize is complete before the next burst of work
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_rehash_step(struct sh_table *table, size_t n_buckets){
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_rehash_step: table undef");
+        return 0;
+    }
+
+    if( ! table->old_entries ){
+        /* nothing to do */
+        return 1;
+    }
+
+    for( ; n_buckets && table->migrate_pos < table->old_size; --n_buckets ){
+        if( ! sh_migrate_bucket(table, table->migrate_pos) ){
+            sh_trace("sh_rehash_step: call to sh_migrate_bucket failed");
+            return 0;
+        }
+        ++table->migrate_pos;
+    }
+
+    /* if we have moved everything we can free the old buckets */
+    if( table->migrate_pos == table->old_size ){
+        free(table->old_entries);
+        table->old_entries = 0;
+        table->old_size = 0;
+        table->migrate_pos = 0;
+    }
+
+    return 1;
+}
+
+/* check if an incremental resize is currently in progress
+ *
+ * returns 1 if a resize is in progress
+ * returns 0 if no resize is in progress or on failure
+ */
+unsigned int sh_rehashing(const struct sh_table *table){
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_rehashing: table undef");
+        return 0;
+    }
+
+    if( table->old_entries ){
+        return 1;
+    }
+
+    return 0;
+}
+
+/* set the load factor policy for this table
+ *
+ * after an insert, if the table holds more than `max_load` elements
+ * per bucket it will double in size
+ *
+ * after a delete, if the table holds fewer than `min_load` elements
+ * per bucket it will halve in size (but never below the size given to sh_init)
+ *
+ * a `max_load` of 0 disables automatic growth
+ * a `min_load` of 0 disables automatic shrinking
+ *
+ * to prevent alternating inserts and deletes near a threshold from
+ * repeatedly resizing the table, `min_load` must be at most `max_load / 4`
+ * (when growth is enabled), this leaves a table that has just grown or
+ * shrunk comfortably between the two thresholds
+ *
+ * open addressing tables grow at SH_ROBIN_HOOD_MAX_LOAD or SH_SWISS_MAX_LOAD
+ * when `max_load` is 0 or above it, and `min_load` is checked against that
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_set_load_factors(struct sh_table *table, double max_load, double min_load){
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_set_load_factors: table undef");
+        return 0;
+    }
+
+    /* written this way to also reject NaN */
+    if( ! (max_load >= 0) ){
+        sh_fail(SH_ERR_INVALID, "sh_set_load_factors: max_load must not be negative");
+        return 0;
+    }
+
+    if( ! (min_load >= 0) ){
+        sh_fail(SH_ERR_INVALID, "sh_set_load_factors: min_load must not be negative");
+        return 0;
+    }
+
+    /* hysteresis, see comment above, against the load we actually grow at */
+    if( sh_grow_load(table, max_load) > 0 && min_load > sh_grow_load(table, max_load) / 4 ){
+        sh_fail(SH_ERR_INVALID, "sh_set_load_factors: min_load must be at most max_load / 4");
+        return 0;
+    }
+
+    table->max_load = max_load;
+    table->min_load = min_load;
+    sh_load_thresholds(table);
+
+    return 1;
+}
+
+/* read the current load factor policy for this table
+ * either of `max_load` or `min_load` may be null
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_get_load_factors(const struct sh_table *table, double *max_load, double *min_load){
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_get_load_factors: table undef");
+        return 0;
+    }
+
+    if( max_load ){
+        *max_load = table->max_load;
+    }
+
+    if( min_load ){
+        *min_load = table->min_load;
+    }
+
+    return 1;
+}
+
+/* check if the supplied key already exists in this hash
+ *
+ * returns 1 on success (key exists)
+ * returns 0 if key doesn't exist or on failure
+ */
+unsigned int sh_exists(const struct sh_table *table, const char *key){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_exists: key undef");
+        return 0;
+    }
+
+#ifdef DEBUG
+    printf("sh_exist: called with key '%s', dispatching to sh_exists_n\n", key);
+#endif
+
+    return sh_exists_n(table, key, strlen(key));
+}
+
+/* check if the supplied key of `key_len` bytes already exists in this hash
+ *
+ * returns 1 on success (key exists)
+ * returns 0 if key doesn't exist or on failure
+ */
+unsigned int sh_exists_n(const struct sh_table *table, const void *key, size_t key_len){
+    /* our key handle */
+    struct sh_key handle;
+
+    if( ! sh_key_init_for(&handle, table, key, key_len) ){
+        sh_trace("sh_exists_n: call to sh_key_init_for failed");
+        return 0;
+    }
+
+    return sh_exists_k(table, &handle);
+}
+
+/* check if the pre-hashed key in `handle` already exists in this hash
+ *
+ * returns 1 on success (key exists)
+ * returns 0 if key doesn't exist or on failure
+ */
+unsigned int sh_exists_k(const struct sh_table *table, const struct sh_key *handle){
+    /* when we started, for telemetry */
+    uint64_t started = SH_CLOCK();
+    /* whether the key was found */
+    unsigned int found = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_exists_k: table undef");
+        return 0;
+    }
+
+    if( ! handle ){
+        sh_fail(SH_ERR_INVALID, "sh_exists_k: handle undef");
+        return 0;
+    }
+
+    /* find entry */
+    found = sh_find(table, handle->key, handle->key_len, sh_key_hash(table, handle)) ? 1 : 0;
+    SH_RECORD(table, SH_OP_GET, found, started);
+
+    return found;
+}
+
+/* insert `data` under `key`
+ * this will only success if !sh_exists(table, key)
+ *
+ * this may grow the table, see sh_set_load_factors
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_insert(struct sh_table *table, const char *key, void *data){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_insert: key undef");
+        return 0;
+    }
+
+#ifdef DEBUG
+    printf("sh_insert: asked to insert for key '%s'\n", key);
+#endif
+
+    return sh_insert_n(table, key, strlen(key), data);
+}
+
+/* insert `data` under `key` of `key_len` bytes
+ * this will only success if !sh_exists_n(table, key, key_len)
+ *
+ * this may grow the table, see sh_set_load_factors
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_insert_n(struct sh_table *table, const void *key, size_t key_len, void *data){
+    /* our key handle */
+    struct sh_key handle;
+
+    if( ! sh_key_init_for(&handle, table, key, key_len) ){
+        sh_trace("sh_insert_n: call to sh_key_init_for failed");
+        return 0;
+    }
+
+    return sh_insert_k(table, &handle, data);
+}
+
+/* insert `data` under the pre-hashed key in `handle`, see sh_key_init
+ * this will only success if !sh_exists_k(table, handle)
+ *
+ * this may grow the table, see sh_set_load_factors
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_insert_k(struct sh_table *table, const struct sh_key *handle, void *data){
+    /* when we started, for telemetry */
+    uint64_t started = SH_CLOCK();
+    /* hash for this table */
+    unsigned long int hash = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_insert_k: table undef");
+        return 0;
+    }
+
+    if( ! handle ){
+        sh_fail(SH_ERR_INVALID, "sh_insert_k: handle undef");
+        return 0;
+    }
+
+    /* we allow data to be 0 */
+
+    /* move some more of any incremental resize across */
+    if( ! sh_rehash_step(table, table->migrate_step) ){
+        sh_trace("sh_insert_k: call to sh_rehash_step failed");
+        return 0;
+    }
+
+    /* the handle may have been hashed for a different table */
+    hash = sh_key_hash(table, handle);
+
+    /* check for already existing key
+     * insert only works if the key is not already present
+     */
+    if( sh_find(table, handle->key, handle->key_len, hash) ){
+        SH_RECORD(table, SH_OP_INSERT, 0, started);
+        sh_fail(SH_ERR_EXISTS, "sh_insert_k: key already exists in table");
+        return 0;
+    }
+
+    if( ! sh_add(table, handle->key, handle->key_len, hash, data) ){
+        sh_trace("sh_insert_k: call to sh_add failed");
+        return 0;
+    }
+    SH_RECORD(table, SH_OP_INSERT, 1, started);
+
+    /* return success */
+    return 1;
+}
+
+/* update `data` under `key`
+ *
+ * this will only succeed if sh_exists(table, key)
+ *
+ * returns old data on success
+ * returns 0 on failure
+ */
+void * sh_update(struct sh_table *table, const char *key, void *data){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_update: key undef");
+        return 0;
+    }
+
+    return sh_update_n(table, key, strlen(key), data);
+}
+
+/* update `data` under `key` of `key_len` bytes
+ *
+ * this will only succeed if sh_exists_n(table, key, key_len)
+ *
+ * returns old data on success
+ * returns 0 on failure
+ */
+void * sh_update_n(struct sh_table *table, const void *key, size_t key_len, void *data){
+    /* our key handle */
+    struct sh_key handle;
+
+    if( ! sh_key_init_for(&handle, table, key, key_len) ){
+        sh_trace("sh_update_n: call to sh_key_init_for failed");
+        return 0;
+    }
+
+    return sh_update_k(table, &handle, data);
+}
+
+/* update `data` under the pre-hashed key in `handle`, see sh_key_init
+ *
+ * this will only succeed if sh_exists_k(table, handle)
+ *
+ * returns old data on success
+ * returns 0 on failure
+ */
+void * sh_update_k(struct sh_table *table, const struct sh_key *handle, void *data){
+    /* when we started, for telemetry */
+    uint64_t started = SH_CLOCK();
+    /* our entry */
+    struct sh_entry *entry = 0;
+    void * old_data = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_update_k: table undef");
+        return 0;
+    }
+
+    if( ! handle ){
+        sh_fail(SH_ERR_INVALID, "sh_update_k: handle undef");
+        return 0;
+    }
+
+    /* allow data to be null */
+
+    /* move some more of any incremental resize across */
+    if( ! sh_rehash_step(table, table->migrate_step) ){
+        sh_trace("sh_update_k: call to sh_rehash_step failed");
+        return 0;
+    }
+
+    /* find entry */
+    entry = sh_find(table, handle->key, handle->key_len, sh_key_hash(table, handle));
+    SH_RECORD(table, SH_OP_UPDATE, entry != 0, started);
+    if( ! entry ){
+        sh_fail(SH_ERR_NOT_FOUND, "sh_update_k: failed to find key");
+        return 0;
     }
 
     /* save old data */
-    old_data = she->data;
+    old_data = entry->data;
+
+    /* overwrite */
+    entry->data = data;
+
+    /* return old data */
+    return old_data;
+}
+
+/* set `data` under `key`
+ *
+ * this will perform either an insert or an update
+ * depending on if the key already exists
+ *
+ * this may grow the table, see sh_set_load_factors
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_set(struct sh_table *table, const char *key, void *data){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_set: key undef");
+        return 0;
+    }
+
+    return sh_set_n(table, key, strlen(key), data);
+}
+
+/* set `data` under `key` of `key_len` bytes
+ *
+ * this will perform either an insert or an update
+ * depending on if the key already exists
+ *
+ * this may grow the table, see sh_set_load_factors
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_set_n(struct sh_table *table, const void *key, size_t key_len, void *data){
+    /* our key handle */
+    struct sh_key handle;
+
+    if( ! sh_key_init_for(&handle, table, key, key_len) ){
+        sh_trace("sh_set_n: call to sh_key_init_for failed");
+        return 0;
+    }
+
+    return sh_set_k(table, &handle, data);
+}
+
+/* set `data` under the pre-hashed key in `handle`, see sh_key_init
+ *
+ * this will perform either an insert or an update
+ * depending on if the key already exists
+ *
+ * this may grow the table, see sh_set_load_factors
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_set_k(struct sh_table *table, const struct sh_key *handle, void *data){
+    /* when we started, for telemetry */
+    uint64_t started = SH_CLOCK();
+    /* any existing entry */
+    struct sh_entry *entry = 0;
+
+    /* hash for this table */
+    unsigned long int hash = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_set_k: table undef");
+        return 0;
+    }
+
+    if( ! handle ){
+        sh_fail(SH_ERR_INVALID, "sh_set_k: handle undef");
+        return 0;
+    }
+
+    /* move some more of any incremental resize across */
+    if( ! sh_rehash_step(table, table->migrate_step) ){
+        sh_trace("sh_set_k: call to sh_rehash_step failed");
+        return 0;
+    }
+
+    /* the handle may have been hashed for a different table */
+    hash = sh_key_hash(table, handle);
+
+    /* a single probe decides between update and insert */
+    entry = sh_find(table, handle->key, handle->key_len, hash);
+    if( entry ){
+        entry->data = data;
+        SH_RECORD(table, SH_OP_UPDATE, 1, started);
+        return 1;
+    }
+
+    if( ! sh_add(table, handle->key, handle->key_len, hash, data) ){
+        sh_trace("sh_set_k: call to sh_add failed");
+        return 0;
+    }
+    SH_RECORD(table, SH_OP_INSERT, 1, started);
+
+    return 1;
+}
+
+/* get `data` stored under `key`
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_get(const struct sh_table *table, const char *key){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_get: key undef");
+        return 0;
+    }
+
+    return sh_get_n(table, key, strlen(key));
+}
+
+/* get `data` stored under `key` of `key_len` bytes
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_get_n(const struct sh_table *table, const void *key, size_t key_len){
+    /* our key handle */
+    struct sh_key handle;
+
+    if( ! sh_key_init_for(&handle, table, key, key_len) ){
+        sh_trace("sh_get_n: call to sh_key_init_for failed");
+        return 0;
+    }
+
+    return sh_get_k(table, &handle);
+}
+
+/* get `data` stored under the pre-hashed key in `handle`, see sh_key_init
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_get_k(const struct sh_table *table, const struct sh_key *handle){
+    /* when we started, for telemetry */
+    uint64_t started = SH_CLOCK();
+    /* our entry */
+    struct sh_entry *entry = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_get_k: table undef");
+        return 0;
+    }
+
+    if( ! handle ){
+        sh_fail(SH_ERR_INVALID, "sh_get_k: handle undef");
+        return 0;
+    }
+
+    /* find entry */
+    entry = sh_find(table, handle->key, handle->key_len, sh_key_hash(table, handle));
+    SH_RECORD(table, SH_OP_GET, entry != 0, started);
+    if( ! entry ){
+        sh_fail(SH_ERR_NOT_FOUND, "sh_get_k: failed to find key");
+        return 0;
+    }
+
+    /* found */
+    return entry->data;
+}
+
+/* lookup the `data` stored under `key`
+ *
+ * unlike sh_get this can distinguish a missing key from a key
+ * storing 0 as its data
+ *
+ * if `data` is not null then the stored data is written to it
+ * when the key is found, it is not modified otherwise
+ *
+ * returns 1 if the key was found
+ * returns 0 if the key was not found or on failure
+ */
+unsigned int sh_lookup(const struct sh_table *table, const char *key, void **data){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_lookup: key undef");
+        return 0;
+    }
+
+    return sh_lookup_n(table, key, strlen(key), data);
+}
+
+/* lookup the `data` stored under `key` of `key_len` bytes
+ *
+ * see sh_lookup
+ *
+ * returns 1 if the key was found
+ * returns 0 if the key was not found or on failure
+ */
+unsigned int sh_lookup_n(const struct sh_table *table, const void *key, size_t key_len, void **data){
+    /* our key handle */
+    struct sh_key handle;
+
+    if( ! sh_key_init_for(&handle, table, key, key_len) ){
+        sh_trace("sh_lookup_n: call to sh_key_init_for failed");
+        return 0;
+    }
+
+    return sh_lookup_k(table, &handle, data);
+}
+
+/* lookup the `data` stored under the pre-hashed key in `handle`, see sh_key_init
+ *
+ * see sh_lookup
+ *
+ * returns 1 if the key was found
+ * returns 0 if the key was not found or on failure
+ */
+unsigned int sh_lookup_k(const struct sh_table *table, const struct sh_key *handle, void **data){
+    /* when we started, for telemetry */
+    uint64_t started = SH_CLOCK();
+    /* our entry */
+    struct sh_entry *entry = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_lookup_k: table undef");
+        return 0;
+    }
+
+    if( ! handle ){
+        sh_fail(SH_ERR_INVALID, "sh_lookup_k: handle undef");
+        return 0;
+    }
+
+    /* find entry */
+    entry = sh_find(table, handle->key, handle->key_len, sh_key_hash(table, handle));
+    SH_RECORD(table, SH_OP_GET, entry != 0, started);
+    if( ! entry ){
+        sh_fail(SH_ERR_NOT_FOUND, "sh_lookup_k: failed to find key");
+        return 0;
+    }
+
+    if( data ){
+        *data = entry->data;
+    }
+
+    /* found */
+    return 1;
+}
+
+/* get a pointer to the data slot for `key`, inserting it if needed
+ *
+ * if the key is not present a new entry is inserted with data of 0
+ * the caller can then store through the returned pointer
+ *
+ * if `inserted` is not null it is set to 1 if a new entry was inserted
+ * and to 0 if the key was already present
+ *
+ * for SH_BACKEND_CHAINING the returned pointer remains valid until `key`
+ * is deleted or the table is destroyed, the open addressing backends move
+ * entries around so it is only valid until the table is next modified
+ *
+ * this may grow the table, see sh_set_load_factors
+ *
+ * returns a pointer to the data slot on success
+ * returns 0 on failure
+ */
+void ** sh_get_or_insert(struct sh_table *table, const char *key, unsigned int *inserted){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_get_or_insert: key undef");
+        return 0;
+    }
+
+    return sh_get_or_insert_n(table, key, strlen(key), inserted);
+}
+
+/* get a pointer to the data slot for `key` of `key_len` bytes,
+ * inserting it if needed
+ *
+ * see sh_get_or_insert
+ *
+ * returns a pointer to the data slot on success
+ * returns 0 on failure
+ */
+void ** sh_get_or_insert_n(struct sh_table *table, const void *key, size_t key_len, unsigned int *inserted){
+    /* our key handle */
+    struct sh_key handle;
+
+    if( ! sh_key_init_for(&handle, table, key, key_len) ){
+        sh_trace("sh_get_or_insert_n: call to sh_key_init_for failed");
+        return 0;
+    }
+
+    return sh_get_or_insert_k(table, &handle, inserted);
+}
+
+/* get a pointer to the data slot for the pre-hashed key in `handle`,
+ * inserting it if needed
+ *
+ * see sh_get_or_insert
+ *
+ * returns a pointer to the data slot on success
+ * returns 0 on failure
+ */
+void ** sh_get_or_insert_k(struct sh_table *table, const struct sh_key *handle, unsigned int *inserted){
+    /* when we started, for telemetry */
+    uint64_t started = SH_CLOCK();
+    /* our existing or new entry */
+    struct sh_entry *entry = 0;
+
+    /* hash for this table */
+    unsigned long int hash = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_get_or_insert_k: table undef");
+        return 0;
+    }
+
+    if( ! handle ){
+        sh_fail(SH_ERR_INVALID, "sh_get_or_insert_k: handle undef");
+        return 0;
+    }
+
+    /* move some more of any incremental resize across */
+    if( ! sh_rehash_step(table, table->migrate_step) ){
+        sh_trace("sh_get_or_insert_k: call to sh_rehash_step failed");
+        return 0;
+    }
+
+    /* the handle may have been hashed for a different table */
+    hash = sh_key_hash(table, handle);
+
+    entry = sh_find(table, handle->key, handle->key_len, hash);
+    if( entry ){
+        SH_RECORD(table, SH_OP_GET, 1, started);
+        if( inserted ){
+            *inserted = 0;
+        }
+        return &(entry->data);
+    }
+
+    entry = sh_add(table, handle->key, handle->key_len, hash, 0);
+    if( ! entry ){
+        sh_trace("sh_get_or_insert_k: call to sh_add failed");
+        return 0;
+    }
+    SH_RECORD(table, SH_OP_INSERT, 1, started);
+
+    if( inserted ){
+        *inserted = 1;
+    }
+
+    return &(entry->data);
+}
+
+/* delete entry stored under `key`
+ *
+ * this may shrink the table, see sh_set_load_factors
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_delete(struct sh_table *table, const char *key){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_delete: key undef");
+        return 0;
+    }
+
+    return sh_delete_n(table, key, strlen(key));
+}
+
+/* delete entry stored under `key` of `key_len` bytes
+ *
+ * this may shrink the table, see sh_set_load_factors
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_delete_n(struct sh_table *table, const void *key, size_t key_len){
+    /* our key handle */
+    struct sh_key handle;
+
+    if( ! sh_key_init_for(&handle, table, key, key_len) ){
+        sh_trace("sh_delete_n: call to sh_key_init_for failed");
+        return 0;
+    }
+
+    return sh_delete_k(table, &handle);
+}
+
+/* delete entry stored under the pre-hashed key in `handle`, see sh_key_init
+ *
+ * this may shrink the table, see sh_set_load_factors
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_delete_k(struct sh_table *table, const struct sh_key *handle){
+    /* when we started, for telemetry */
+    uint64_t started = SH_CLOCK();
+    /* our old data */
+    void *old_data = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_delete_k: table undef");
+        return 0;
+    }
+
+    if( ! handle ){
+        sh_fail(SH_ERR_INVALID, "sh_delete_k: handle undef");
+        return 0;
+    }
+
+    /* move some more of any incremental resize across */
+    if( ! sh_rehash_step(table, table->migrate_step) ){
+        sh_trace("sh_delete_k: call to sh_rehash_step failed");
+        return 0;
+    }
+
+    if( ! sh_remove(table, handle->key, handle->key_len, sh_key_hash(table, handle), &old_data) ){
+        /* failed to find element */
+        SH_RECORD(table, SH_OP_DELETE, 0, started);
+        sh_fail(SH_ERR_NOT_FOUND, "sh_delete_k: failed to find key");
+        return 0;
+    }
+    SH_RECORD(table, SH_OP_DELETE, 1, started);
+
+    /* shrink if we are now too sparse
+     * the delete has already succeeded so failure here is only a warning
+     */
+    if( ! sh_shrink_check(table) ){
+        sh_trace("sh_delete_k: warning, call to sh_shrink_check failed, continuing...");
+    }
+
+    /* return old data */
+    return old_data;
+}
+
+/* check for the existence of each of the `n` keys in `keys`
+ *
+ * the keys are looked up SH_BATCH at a time with their memory accesses
+ * overlapped, which is considerably faster than calling sh_exists_n in a
+ * loop once the table no longer fits in cache
+ *
+ * `lens` holds the length of each key, or may be 0 if every key
+ * is null terminated
+ *
+ * if `out_found` is non-zero then out_found[i] is set to 1 if keys[i]
+ * exists and 0 otherwise
+ *
+ * returns the number of keys found on success
+ * returns 0 on failure
+ */
+size_t sh_exists_many(const struct sh_table *table, const void * const *keys, const size_t *lens, size_t n, unsigned int *out_found){
+    /* length and hash of each key in the current batch */
+    size_t key_lens[SH_BATCH];
+    unsigned long int hashes[SH_BATCH];
+    /* start of current batch, and iterator within it */
+    size_t start = 0;
+    size_t i = 0;
+    /* number of keys in current batch */
+    size_t count = 0;
+    /* whether the current key was found */
+    unsigned int found = 0;
+    /* number of keys found */
+    size_t n_found = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_exists_many: table undef");
+        return 0;
+    }
+
+    if( ! keys ){
+        sh_fail(SH_ERR_INVALID, "sh_exists_many: keys undef");
+        return 0;
+    }
+
+    for( start=0; start<n; start += count ){
+        count = n - start < SH_BATCH ? n - start : SH_BATCH;
+
+        if( ! sh_batch_prepare(table, keys + start, lens ? lens + start : 0, count, key_lens, hashes) ){
+            sh_trace("sh_exists_many: call to sh_batch_prepare failed");
+            return 0;
+        }
+
+        for( i=0; i<count; ++i ){
+            found = sh_find(table, keys[start + i], key_lens[i], hashes[i]) ? 1 : 0;
+            SH_RECORD(table, SH_OP_GET, found, 0);
+            n_found += found;
+
+            if( out_found ){
+                out_found[start + i] = found;
+            }
+        }
+    }
+
+    return n_found;
+}
+
+/* get the data stored under each of the `n` keys in `keys`
+ *
+ * see sh_exists_many for how the keys are looked up
+ *
+ * `lens` holds the length of each key, or may be 0 if every key
+ * is null terminated
+ *
+ * out_values[i] is set to the data stored under keys[i],
+ * or 0 if keys[i] does not exist
+ *
+ * if `out_found` is non-zero then out_found[i] is set to 1 if keys[i]
+ * exists and 0 otherwise, this is only needed if 0 is stored as data
+ *
+ * returns the number of keys found on success
+ * returns 0 on failure
+ */
+size_t sh_get_many(const struct sh_table *table, const void * const *keys, const size_t *lens, size_t n, void **out_values, unsigned int *out_found){
+    /* length and hash of each key in the current batch */
+    size_t key_lens[SH_BATCH];
+    unsigned long int hashes[SH_BATCH];
+    /* start of current batch, and iterator within it */
+    size_t start = 0;
+    size_t i = 0;
+    /* number of keys in current batch */
+    size_t count = 0;
+    /* our entry */
+    struct sh_entry *entry = 0;
+    /* number of keys found */
+    size_t n_found = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_get_many: table undef");
+        return 0;
+    }
+
+    if( ! keys ){
+        sh_fail(SH_ERR_INVALID, "sh_get_many: keys undef");
+        return 0;
+    }
+
+    if( ! out_values ){
+        sh_fail(SH_ERR_INVALID, "sh_get_many: out_values undef");
+        return 0;
+    }
+
+    for( start=0; start<n; start += count ){
+        count = n - start < SH_BATCH ? n - start : SH_BATCH;
+
+        if( ! sh_batch_prepare(table, keys + start, lens ? lens + start : 0, count, key_lens, hashes) ){
+            sh_trace("sh_get_many: call to sh_batch_prepare failed");
+            return 0;
+        }
+
+        for( i=0; i<count; ++i ){
+            entry = sh_find(table, keys[start + i], key_lens[i], hashes[i]);
+            SH_RECORD(table, SH_OP_GET, entry != 0, 0);
+            out_values[start + i] = entry ? entry->data : 0;
+
+            if( entry ){
+                ++n_found;
+            }
+
+            if( out_found ){
+                out_found[start + i] = entry ? 1 : 0;
+            }
+        }
+    }
+
+    return n_found;
+}
+
+/* delete the entries stored under each of the `n` keys in `keys`
+ *
+ * see sh_exists_many for how the keys are looked up,
+ * keys that do not exist are skipped
+ *
+ * `lens` holds the length of each key, or may be 0 if every key
+ * is null terminated
+ *
+ * if `out_values` is non-zero then out_values[i] is set to the data that
+ * was stored under keys[i], or 0 if keys[i] did not exist
+ *
+ * if `out_found` is non-zero then out_found[i] is set to 1 if keys[i]
+ * was deleted and 0 otherwise
+ *
+ * this may shrink the table, see sh_set_load_factors
+ *
+ * returns the number of keys deleted on success
+ * returns 0 on failure, keys before the failure may have been deleted
+ */
+size_t sh_delete_many(struct sh_table *table, const void * const *keys, const size_t *lens, size_t n, void **out_values, unsigned int *out_found){
+    /* length and hash of each key in the current batch */
+    size_t key_lens[SH_BATCH];
+    unsigned long int hashes[SH_BATCH];
+    /* start of current batch, and iterator within it */
+    size_t start = 0;
+    size_t i = 0;
+    /* number of keys in current batch */
+    size_t count = 0;
+    /* the data of the entry we removed */
+    void *old_data = 0;
+    /* whether the current key was deleted */
+    unsigned int found = 0;
+    /* number of keys deleted */
+    size_t n_found = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_delete_many: table undef");
+        return 0;
+    }
+
+    if( ! keys ){
+        sh_fail(SH_ERR_INVALID, "sh_delete_many: keys undef");
+        return 0;
+    }
+
+    for( start=0; start<n; start += count ){
+        count = n - start < SH_BATCH ? n - start : SH_BATCH;
+
+        if( ! sh_batch_prepare(table, keys + start, lens ? lens + start : 0, count, key_lens, hashes) ){
+            sh_trace("sh_delete_many: call to sh_batch_prepare failed");
+            return 0;
+        }
+
+        for( i=0; i<count; ++i ){
+            /* move some more of any incremental resize across */
+            if( ! sh_rehash_step(table, table->migrate_step) ){
+                sh_trace("sh_delete_many: call to sh_rehash_step failed");
+                return 0;
+            }
+
+            old_data = 0;
+            found = sh_remove(table, keys[start + i], key_lens[i], hashes[i], &old_data);
+            SH_RECORD(table, SH_OP_DELETE, found, 0);
+            n_found += found;
+
+            if( out_values ){
+                out_values[start + i] = old_data;
+            }
+
+            if( out_found ){
+                out_found[start + i] = found;
+            }
+
+            /* shrink if we are now too sparse
+             * the delete has already succeeded so failure here is only a warning
+             */
+            if( found && ! sh_shrink_check(table) ){
+                sh_trace("sh_delete_many: warning, call to sh_shrink_check failed, continuing...");
+            }
+        }
+    }
+
+    return n_found;
+}
+
+/* insert the `n` keys in `keys` with the data in `values`
+ *
+ * intended for loading a large number of keys at once, this presizes the
+ * table for the new keys (if the load policy allows it to grow) and then
+ * hashes and links them across `n_threads` threads, see the bulk build
+ * section above for the details
+ *
+ * `lens` holds the length of each key, or may be 0 if every key
+ * is null terminated
+ *
+ * `values` may be 0 in which case every key is inserted with 0 data
+ *
+ * if `check_duplicates` is non-zero then any key already in the table, or
+ * appearing earlier in `keys`, is skipped just as sh_insert would,
+ * otherwise the caller guarantees every key is new and unique
+ *
+ * this needs two temporary words of memory per key
+ *
+ * returns the number of keys inserted on success
+ * returns 0 on failure, some of the keys may have been inserted
+ */
+size_t sh_build(struct sh_table *table, const void * const *keys, const size_t *lens, void * const *values, size_t n, unsigned int n_threads, unsigned int check_duplicates){
+    /* one per thread */
+    struct sh_build_worker *workers = 0;
+    /* shared state for every worker */
+    unsigned long int *hashes = 0;
+    size_t *order = 0;
+    size_t *counts = 0;
+    /* number of workers and partitions */
+    size_t n_workers = n_threads ? n_threads : 1;
+    size_t n_parts = 1;
+    /* iterator through workers */
+    size_t w = 0;
+    /* the load we presize for */
+    double load = 0;
+    /* number of keys inserted */
+    size_t n_inserted = 0;
+    /* set if anything failed */
+    unsigned int failed = 0;
+    /* and why */
+    enum sh_error error = SH_OK;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_build: table undef");
+        return 0;
+    }
+
+    if( ! keys ){
+        sh_fail(SH_ERR_INVALID, "sh_build: keys undef");
+        return 0;
+    }
+
+    if( ! n ){
+        return 0;
+    }
+
+#ifdef SH_NO_THREADS
+    n_workers = 1;
+#endif
+    if( n_workers > n ){
+        n_workers = n;
+    }
+
+    /* finish any incremental resize so there is a single bucket array */
+    if( ! sh_rehash_step(table, table->old_size) ){
+        sh_trace("sh_build: call to sh_rehash_step failed");
+        return 0;
+    }
+
+    /* presize so we do not have to grow while linking */
+    load = sh_grow_load(table, table->max_load);
+    if( load > 0 && (table->n_elems + n) / load >= table->size ){
+        if( n_workers > 1 && table->n_elems ){
+            if( ! sh_resize_parallel(table, (table->n_elems + n) / load + 1, n_workers) ){
+                sh_trace("sh_build: call to sh_resize_parallel failed");
+                return 0;
+            }
+        } else if( ! sh_resize(table, (table->n_elems + n) / load + 1) ){
+            sh_trace("sh_build: call to sh_resize failed");
+            return 0;
+        }
+    }
+
+    /* buckets are only partitioned when chaining */
+    if( table->backend == SH_BACKEND_CHAINING ){
+        n_parts = n_workers < table->size ? n_workers : table->size;
+    }
+
+    workers = calloc(n_workers, sizeof(struct sh_build_worker));
+    hashes = malloc(n * sizeof(unsigned long int));
+    counts = calloc(n_workers * n_parts, sizeof(size_t));
+    if( n_parts > 1 ){
+        order = malloc(n * sizeof(size_t));
+    }
+
+    if( ! workers || ! hashes || ! counts || (n_parts > 1 && ! order) ){
+        sh_fail(SH_ERR_NOMEM, "sh_build: allocation failed");
+        failed = 1;
+        error = SH_ERR_NOMEM;
+    }
+
+    for( w=0; ! failed && w<n_workers; ++w ){
+        workers[w].table = table;
+        workers[w].keys = keys;
+        workers[w].lens = lens;
+        workers[w].values = values;
+        workers[w].check_duplicates = check_duplicates;
+        workers[w].hashes = hashes;
+        workers[w].order = order;
+        workers[w].n_parts = n_parts;
+        workers[w].part_size = (table->size + n_parts - 1) / n_parts;
+        workers[w].counts = counts;
+        workers[w].id = w;
+        workers[w].lo = n / n_workers * w;
+        workers[w].hi = w + 1 == n_workers ? n : n / n_workers * (w + 1);
+    }
+
+    if( ! failed ){
+        sh_build_run(workers, sizeof(struct sh_build_worker), n_workers, sh_build_hash);
+        for( w=0; w<n_workers; ++w ){
+            if( workers[w].failed ){
+                failed = 1;
+                error = workers[w].error;
+            }
+        }
+    }
+
+    if( ! failed ){
+        if( table->backend == SH_BACKEND_CHAINING ){
+            n_inserted = sh_build_chains(workers, n_workers, n);
+        } else {
+            n_inserted = sh_build_place(&(workers[0]), n);
+        }
+        failed = workers[0].failed;
+        error = workers[0].error;
+    }
+
+    free(workers);
+    free(hashes);
+    free(counts);
+    free(order);
+
+    if( failed ){
+        sh_fail(error, "sh_build: failed");
+        return 0;
+    }
+
+    return n_inserted;
+}
+
+/* iterate through all key/value pairs in this hash table
+ * calling the provided function on each pair.
+ *
+ * the function is allowed to modify the value but cannot modify the key.
+ * the function should not access the hash table in anyway including:
+ *  modifying the hash table other than through the value pointer given
+ *  calling any other hash table functions
+ *
+ * the function will be given the value of the `state` pointer for each call,
+ * this is useful for passing state between calls to the function as well as
+ * for returning results
+ *
+ * the function should return
+ *  1 if it wants the iteration to continue
+ *  0 if it wants the iteration to stop
+ *
+ * returns 1 on success
+ * returns 0 on success
+ */
+unsigned int sh_iterate(struct sh_table *table, void *state, unsigned int (*each)(void *state, const char *key, void **data)){
+    /* bundle of the callers state and function */
+    struct sh_iterate_adapter adapter;
+
+    if( ! each ){
+        sh_fail(SH_ERR_INVALID, "sh_iterate: each undef");
+        return 0;
+    }
+
+    adapter.state = state;
+    adapter.each = each;
+
+    return sh_iterate_n(table, &adapter, sh_iterate_adapt);
+}
+
+/* iterate through all key/value pairs in this hash table
+ * calling the provided function on each pair.
+ *
+ * identical to sh_iterate except that the function is also given the
+ * length of each key, which is required for keys containing null bytes
+ *
+ * returns 1 on success
+ * returns 0 on success
+ */
+unsigned int sh_iterate_n(struct sh_table *table, void *state, unsigned int (*each)(void *state, const void *key, size_t key_len, void **data)){
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_iterate_n: table undef");
+        return 0;
+    }
+
+    if( ! each ){
+        sh_fail(SH_ERR_INVALID, "sh_iterate_n: each undef");
+        return 0;
+    }
+
+    if( table->backend != SH_BACKEND_CHAINING ){
+        sh_oa_iterate(table, 0, table->size, state, each);
+        return 1;
+    }
+
+    /* go through each entry in table */
+    if( ! sh_iterate_buckets(table->entries, 0, table->size, state, each) ){
+        /* user function signalled to stop, returning */
+        return 1;
+    }
+
+    /* and any not yet moved by an incremental resize */
+    if( table->old_entries ){
+        sh_iterate_buckets(table->old_entries, table->migrate_pos, table->old_size, state, each);
+    }
+
+    return 1;
+}
+
+/* the number of buckets sh_iterate_range divides a table into
+ *
+ * for SH_BACKEND_CHAINING this includes the buckets not yet moved by an
+ * incremental resize, for the open addressing backends it is the number
+ * of slots
+ *
+ * returns the number of buckets on success
+ * returns 0 on failure
+ */
+size_t sh_nbuckets(const struct sh_table *table){
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_nbuckets: table undef");
+        return 0;
+    }
+
+    if( table->backend != SH_BACKEND_CHAINING ){
+        return table->size;
+    }
+
+    return table->size + (table->old_entries ? table->old_size : 0);
+}
+
+/* iterate through the key/value pairs in buckets [start, end) of the
+ * buckets counted by sh_nbuckets, calling the provided function on each
+ * pair as for sh_iterate_n
+ *
+ * every entry lives in exactly one bucket, so ranges covering
+ * [0, sh_nbuckets(table)) between them visit every entry exactly once
+ *
+ * disjoint ranges may be iterated at the same time by different threads,
+ * as long as nothing modifies the table meanwhile, so this can be used
+ * to spread iteration over a thread pool of your own
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_iterate_range(struct sh_table *table, size_t start, size_t end, void *state, unsigned int (*each)(void *state, const void *key, size_t key_len, void **data)){
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_iterate_range: table undef");
+        return 0;
+    }
+
+    if( ! each ){
+        sh_fail(SH_ERR_INVALID, "sh_iterate_range: each undef");
+        return 0;
+    }
+
+    if( start > end || end > sh_nbuckets(table) ){
+        sh_fail(SH_ERR_INVALID, "sh_iterate_range: range outside of table");
+        return 0;
+    }
+
+    if( table->backend != SH_BACKEND_CHAINING ){
+        sh_oa_iterate(table, start, end, state, each);
+        return 1;
+    }
+
+    /* the part within our current buckets */
+    if( start < table->size &&
+        ! sh_iterate_buckets(table->entries, start, end < table->size ? end : table->size, state, each) ){
+        /* user function signalled to stop, returning */
+        return 1;
+    }
+
+    /* and the part within those not yet moved by an incremental resize */
+    if( end > table->size ){
+        sh_iterate_buckets(table->old_entries, start > table->size ? start - table->size : 0, end - table->size, state, each);
+    }
+
+    return 1;
+}
+
+/* iterate through all key/value pairs in this hash table
+ * across `n_threads` threads, each visiting a range of buckets
+ *
+ * each thread first calls `state_init(state, thread)` for a state of its
+ * own, `thread` counting up from 0, and then `each` on every pair in its
+ * range with that state as for sh_iterate_n, `each` returning 0 only stops
+ * the thread that called it
+ *
+ * once every thread has finished `reduce(state, thread_state)` is called
+ * for each thread in turn on the calling thread, which is the place to
+ * combine results into `state` and free the thread's state
+ *
+ * `state_init` and `reduce` may be 0, in which case every thread is given
+ * `state` itself and must then only modify it with care
+ *
+ * every entry is visited exactly once, the functions must not modify the
+ * table other than through the value pointers given, and the table must
+ * not be modified by any other thread during the iteration
+ *
+ * with SH_NO_THREADS the ranges are visited one after another on the
+ * calling thread
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_iterate_parallel(struct sh_table *table, unsigned int n_threads, void *state, void * (*state_init)(void *state, size_t thread), unsigned int (*each)(void *state, const void *key, size_t key_len, void **data), void (*reduce)(void *state, void *thread_state)){
+    /* one per thread */
+    struct sh_iterate_worker *workers = 0;
+    /* number of workers, and of buckets to divide between them */
+    size_t n_workers = n_threads ? n_threads : 1;
+    size_t n_buckets = 0;
+    /* iterator through workers */
+    size_t w = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_iterate_parallel: table undef");
+        return 0;
+    }
+
+    if( ! each ){
+        sh_fail(SH_ERR_INVALID, "sh_iterate_parallel: each undef");
+        return 0;
+    }
+
+    n_buckets = sh_nbuckets(table);
+    if( n_workers > n_buckets ){
+        n_workers = n_buckets;
+    }
+
+    workers = calloc(n_workers, sizeof(struct sh_iterate_worker));
+    if( ! workers ){
+        sh_fail(SH_ERR_NOMEM, "sh_iterate_parallel: call to calloc failed");
+        return 0;
+    }
+
+    for( w=0; w<n_workers; ++w ){
+        workers[w].table = table;
+        workers[w].each = each;
+        workers[w].start = n_buckets / n_workers * w;
+        workers[w].end = w + 1 == n_workers ? n_buckets : n_buckets / n_workers * (w + 1);
+        workers[w].state = state_init ? state_init(state, w) : state;
+    }
+
+    sh_build_run(workers, sizeof(struct sh_iterate_worker), n_workers, sh_iterate_work);
+
+    for( w=0; reduce && w<n_workers; ++w ){
+        reduce(state, workers[w].state);
+    }
+
+    free(workers);
+
+    return 1;
+}
+
+/* the reason for the most recent failure on the calling thread
+ *
+ * like errno this is only set on failure and never cleared by a successful
+ * call, so it is only meaningful straight after a call has failed,
+ * see sh_clear_error
+ *
+ * with SH_NO_THREADS the error is shared by every thread
+ *
+ * returns the last error, or SH_OK if none
+ */
+enum sh_error sh_last_error(void){
+    return sh_error_last;
+}
+
+/* reset the last error of the calling thread to SH_OK */
+void sh_clear_error(void){
+    sh_error_last = SH_OK;
+}
+
+/* a short description of `error`
+ *
+ * returns a static string, never null
+ */
+const char * sh_strerror(enum sh_error error){
+    switch( error ){
+        case SH_OK:
+            return "no error";
+        case SH_ERR_INVALID:
+            return "invalid argument";
+        case SH_ERR_NOMEM:
+            return "out of memory";
+        case SH_ERR_NOT_FOUND:
+            return "key not found";
+        case SH_ERR_EXISTS:
+            return "key already exists";
+        case SH_ERR_FULL:
+            return "table is full";
+        case SH_ERR_UNSUPPORTED:
+            return "not supported";
+        default:
+            return "unknown error";
+    }
+}
+
+/* install a function to be called with a diagnostic message for every
+ * failure, including failures in internal helpers as they propagate up
+ *
+ * `error` is the failure being reported, `message` names the function and
+ * what went wrong, and `data` is the value given here
+ *
+ * the log is global to the process and is called on whichever thread failed,
+ * it should be set before tables are used from multiple threads
+ *
+ * there is no log by default, pass a null `log` to remove it again
+ */
+void sh_set_log(void (*log)(enum sh_error error, const char *message, void *data), void *data){
+    sh_error_log = log;
+    sh_error_log_data = data;
+}
+
+/* create a new sharded table of `n_shards` shards holding `size`
+ * elements between them, each shard configured by `opts`
+ *
+ * `n_shards` is rounded up to a power of two, at most SH_SHARDS_MAX
+ * a null `opts` gives the defaults, as for sh_new
+ *
+ * returns pointer on success
+ * returns 0 on failure
+ */
+struct sh_sharded * sh_sharded_new(size_t n_shards, size_t size, const struct sh_opts *opts){
+    /* our new sharded table */
+    struct sh_sharded *sharded = 0;
+    /* rounded number of shards */
+    size_t rounded = 1;
+    /* iterator through shards */
+    size_t i = 0;
+
+    if( n_shards == 0 || n_shards > SH_SHARDS_MAX ){
+        sh_fail(SH_ERR_INVALID, "sh_sharded_new: n_shards must be between 1 and SH_SHARDS_MAX");
+        return 0;
+    }
+
+    if( size == 0 ){
+        sh_fail(SH_ERR_INVALID, "sh_sharded_new: specified size of 0, impossible");
+        return 0;
+    }
+
+    while( rounded < n_shards ){
+        rounded <<= 1;
+    }
+
+    sharded = calloc(1, sizeof(struct sh_sharded));
+    if( ! sharded ){
+        sh_fail(SH_ERR_NOMEM, "sh_sharded_new: call to calloc failed");
+        return 0;
+    }
+
+    sharded->n_shards = rounded;
+    sharded->shards = calloc(rounded, sizeof(struct sh_shard));
+    if( ! sharded->shards ){
+        sh_fail(SH_ERR_NOMEM, "sh_sharded_new: call to calloc failed");
+        free(sharded);
+        return 0;
+    }
+
+    /* each shard starts with its share of `size`, and grows by itself */
+    size = size / rounded ? size / rounded : 1;
+
+    for( i=0; i<rounded; ++i ){
+        if( ! sh_init_opts(&(sharded->shards[i].table), size, opts) ){
+            sh_trace("sh_sharded_new: call to sh_init_opts failed");
+            sh_sharded_free(sharded, i, 0);
+            return 0;
+        }
+
+#ifndef SH_NO_THREADS
+        if( pthread_rwlock_init(&(sharded->shards[i].lock), 0) ){
+            sh_fail(SH_ERR_NOMEM, "sh_sharded_new: call to pthread_rwlock_init failed");
+            sh_destroy(&(sharded->shards[i].table), 0, 0);
+            sh_sharded_free(sharded, i, 0);
+            return 0;
+        }
+#endif
+    }
+
+    return sharded;
+}
+
+/* free all resources used by a sharded table
+ * if `free_data` is set then each stored value is also freed
+ *
+ * no other thread may be using the table
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_sharded_destroy(struct sh_sharded *sharded, unsigned int free_data){
+    if( ! sharded ){
+        sh_fail(SH_ERR_INVALID, "sh_sharded_destroy: sharded undef");
+        return 0;
+    }
+
+    return sh_sharded_free(sharded, sharded->n_shards, free_data);
+}
+
+/* returns number of elements across every shard
+ *
+ * each shard is counted under its own lock, so with concurrent writers
+ * the total is not a snapshot of any single moment
+ *
+ * returns 0 on failure
+ */
+size_t sh_sharded_nelems(const struct sh_sharded *sharded){
+    /* iterator through shards */
+    size_t i = 0;
+    /* running total */
+    size_t n_elems = 0;
+
+    if( ! sharded ){
+        sh_fail(SH_ERR_INVALID, "sh_sharded_nelems: sharded undef");
+        return 0;
+    }
+
+    for( i=0; i<sharded->n_shards; ++i ){
+        sh_shard_read(&(sharded->shards[i]));
+        n_elems += sharded->shards[i].table.n_elems;
+        sh_shard_unlock(&(sharded->shards[i]));
+    }
+
+    return n_elems;
+}
+
+/* check if key exists in sharded table
+ *
+ * returns 1 if key exists
+ * returns 0 if key does not exist or on failure
+ */
+unsigned int sh_sharded_exists(const struct sh_sharded *sharded, const char *key){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_sharded_exists: key undef");
+        return 0;
+    }
+
+    return sh_sharded_exists_n(sharded, key, strlen(key));
+}
+
+/* check if `key` of `key_len` bytes exists in sharded table
+ *
+ * returns 1 if key exists
+ * returns 0 if key does not exist or on failure
+ */
+unsigned int sh_sharded_exists_n(const struct sh_sharded *sharded, const void *key, size_t key_len){
+    /* handle for key, hashed once to pick both the shard and its bucket */
+    struct sh_key handle;
+    /* the shard holding key */
+    struct sh_shard *shard = 0;
+    /* our result */
+    unsigned int result = 0;
+
+    if( ! sharded ){
+        sh_fail(SH_ERR_INVALID, "sh_sharded_exists_n: sharded undef");
+        return 0;
+    }
+
+    /* every shard hashes alike, and never changes how */
+    if( ! sh_key_init_for(&handle, &(sharded->shards[0].table), key, key_len) ){
+        sh_trace("sh_sharded_exists_n: call to sh_key_init_for failed");
+        return 0;
+    }
+
+    shard = sh_sharded_shard(sharded, handle.hash);
+    sh_shard_read(shard);
+    result = sh_exists_k(&(shard->table), &handle);
+    sh_shard_unlock(shard);
+
+    return result;
+}
+
+/* insert `data` under `key` into the sharded table
+ *
+ * returns 1 on success
+ * returns 0 on failure, including if key already exists
+ */
+unsigned int sh_sharded_insert(struct sh_sharded *sharded, const char *key, void *data){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_sharded_insert: key undef");
+        return 0;
+    }
+
+    return sh_sharded_insert_n(sharded, key, strlen(key), data);
+}
+
+/* insert `data` under `key` of `key_len` bytes into the sharded table
+ *
+ * returns 1 on success
+ * returns 0 on failure, including if key already exists
+ */
+unsigned int sh_sharded_insert_n(struct sh_sharded *sharded, const void *key, size_t key_len, void *data){
+    /* handle for key, hashed once to pick both the shard and its bucket */
+    struct sh_key handle;
+    /* the shard holding key */
+    struct sh_shard *shard = 0;
+    /* our result */
+    unsigned int result = 0;
+
+    if( ! sharded ){
+        sh_fail(SH_ERR_INVALID, "sh_sharded_insert_n: sharded undef");
+        return 0;
+    }
+
+    /* every shard hashes alike, and never changes how */
+    if( ! sh_key_init_for(&handle, &(sharded->shards[0].table), key, key_len) ){
+        sh_trace("sh_sharded_insert_n: call to sh_key_init_for failed");
+        return 0;
+    }
+
+    shard = sh_sharded_shard(sharded, handle.hash);
+    sh_shard_write(shard);
+    result = sh_insert_k(&(shard->table), &handle, data);
+    sh_shard_unlock(shard);
+
+    return result;
+}
+
+/* set `key` to `data` in the sharded table, inserting it if absent
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_sharded_set(struct sh_sharded *sharded, const char *key, void *data){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_sharded_set: key undef");
+        return 0;
+    }
+
+    return sh_sharded_set_n(sharded, key, strlen(key), data);
+}
+
+/* set `key` of `key_len` bytes to `data`, inserting it if absent
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_sharded_set_n(struct sh_sharded *sharded, const void *key, size_t key_len, void *data){
+    /* handle for key, hashed once to pick both the shard and its bucket */
+    struct sh_key handle;
+    /* the shard holding key */
+    struct sh_shard *shard = 0;
+    /* our result */
+    unsigned int result = 0;
+
+    if( ! sharded ){
+        sh_fail(SH_ERR_INVALID, "sh_sharded_set_n: sharded undef");
+        return 0;
+    }
+
+    /* every shard hashes alike, and never changes how */
+    if( ! sh_key_init_for(&handle, &(sharded->shards[0].table), key, key_len) ){
+        sh_trace("sh_sharded_set_n: call to sh_key_init_for failed");
+        return 0;
+    }
+
+    shard = sh_sharded_shard(sharded, handle.hash);
+    sh_shard_write(shard);
+    result = sh_set_k(&(shard->table), &handle, data);
+    sh_shard_unlock(shard);
+
+    return result;
+}
+
+/* get `data` stored under `key`
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_sharded_get(const struct sh_sharded *sharded, const char *key){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_sharded_get: key undef");
+        return 0;
+    }
+
+    return sh_sharded_get_n(sharded, key, strlen(key));
+}
+
+/* get `data` stored under `key` of `key_len` bytes
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_sharded_get_n(const struct sh_sharded *sharded, const void *key, size_t key_len){
+    /* handle for key, hashed once to pick both the shard and its bucket */
+    struct sh_key handle;
+    /* the shard holding key */
+    struct sh_shard *shard = 0;
+    /* our result */
+    void *result = 0;
+
+    if( ! sharded ){
+        sh_fail(SH_ERR_INVALID, "sh_sharded_get_n: sharded undef");
+        return 0;
+    }
+
+    /* every shard hashes alike, and never changes how */
+    if( ! sh_key_init_for(&handle, &(sharded->shards[0].table), key, key_len) ){
+        sh_trace("sh_sharded_get_n: call to sh_key_init_for failed");
+        return 0;
+    }
+
+    shard = sh_sharded_shard(sharded, handle.hash);
+    sh_shard_read(shard);
+    result = sh_get_k(&(shard->table), &handle);
+    sh_shard_unlock(shard);
+
+    return result;
+}
+
+/* delete entry stored under `key`
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_sharded_delete(struct sh_sharded *sharded, const char *key){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_sharded_delete: key undef");
+        return 0;
+    }
+
+    return sh_sharded_delete_n(sharded, key, strlen(key));
+}
+
+/* delete entry stored under `key` of `key_len` bytes
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_sharded_delete_n(struct sh_sharded *sharded, const void *key, size_t key_len){
+    /* handle for key, hashed once to pick both the shard and its bucket */
+    struct sh_key handle;
+    /* the shard holding key */
+    struct sh_shard *shard = 0;
+    /* our result */
+    void *result = 0;
+
+    if( ! sharded ){
+        sh_fail(SH_ERR_INVALID, "sh_sharded_delete_n: sharded undef");
+        return 0;
+    }
+
+    /* every shard hashes alike, and never changes how */
+    if( ! sh_key_init_for(&handle, &(sharded->shards[0].table), key, key_len) ){
+        sh_trace("sh_sharded_delete_n: call to sh_key_init_for failed");
+        return 0;
+    }
+
+    shard = sh_sharded_shard(sharded, handle.hash);
+    sh_shard_write(shard);
+    result = sh_delete_k(&(shard->table), &handle);
+    sh_shard_unlock(shard);
+
+    return result;
+}
+
+/* iterate through all key/value pairs in the sharded table
+ * calling the provided function on each pair, as for sh_iterate_n
+ *
+ * each shard is locked for writing while it is visited, so `each` may
+ * modify values, other shards remain available to other threads
+ * and may change before or after they are visited
+ *
+ * the function must not call any sh_sharded function on this table
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_sharded_iterate(struct sh_sharded *sharded, void *state, unsigned int (*each)(void *state, const void *key, size_t key_len, void **data)){
+    /* our state for sh_sharded_each */
+    struct sh_sharded_iteration iteration;
+    /* iterator through shards */
+    size_t i = 0;
+
+    if( ! sharded ){
+        sh_fail(SH_ERR_INVALID, "sh_sharded_iterate: sharded undef");
+        return 0;
+    }
+
+    if( ! each ){
+        sh_fail(SH_ERR_INVALID, "sh_sharded_iterate: each undef");
+        return 0;
+    }
+
+    iteration.state = state;
+    iteration.each = each;
+    iteration.stopped = 0;
+
+    for( i=0; ! iteration.stopped && i<sharded->n_shards; ++i ){
+        sh_shard_write(&(sharded->shards[i]));
+        sh_iterate_n(&(sharded->shards[i].table), &iteration, sh_sharded_each);
+        sh_shard_unlock(&(sharded->shards[i]));
+    }
+
+    return 1;
+}
+
+/* create a new table of `size` buckets whose readers take no locks,
+ * configured by `opts`
+ *
+ * `n_slots` is the number of readers that may be inside a call at once
+ * without having to look for a free slot, 0 for SH_EPOCH_SLOTS, and is
+ * rounded up to a power of two
+ *
+ * only opts.hash_fn, opts.seed and opts.borrow_keys are used, the table
+ * is always chained and the other backends and opts.slab are not supported
+ * a null `opts` gives the defaults, as for sh_new
+ *
+ * returns pointer on success
+ * returns 0 on failure
+ */
+struct sh_rcu * sh_rcu_new(size_t size, size_t n_slots, const struct sh_opts *opts){
+    /* our new table */
+    struct sh_rcu *table = 0;
+    /* rounded size */
+    size_t rounded = 1;
+
+    if( size == 0 ){
+        sh_fail(SH_ERR_INVALID, "sh_rcu_new: specified size of 0, impossible");
+        return 0;
+    }
+
+    if( opts && (opts->backend != SH_BACKEND_CHAINING || opts->slab) ){
+        sh_fail(SH_ERR_UNSUPPORTED, "sh_rcu_new: only SH_BACKEND_CHAINING without a slab is supported");
+        return 0;
+    }
+
+    if( size > SIZE_MAX / 2 ){
+        sh_fail(SH_ERR_INVALID, "sh_rcu_new: specified size too large to round to a power of two");
+        return 0;
+    }
+
+    while( rounded < size ){
+        rounded <<= 1;
+    }
+
+    table = calloc(1, sizeof(struct sh_rcu));
+    if( ! table ){
+        sh_fail(SH_ERR_NOMEM, "sh_rcu_new: call to calloc failed");
+        return 0;
+    }
+
+    table->max_load = SH_DEFAULT_MAX_LOAD;
+    table->hash_fn = sh_hash_djb2;
+    if( opts ){
+        if( opts->hash_fn ){
+            table->hash_fn = opts->hash_fn;
+        }
+        table->seed[0] = opts->seed[0];
+        table->seed[1] = opts->seed[1];
+        table->borrow_keys = opts->borrow_keys;
+    }
+
+    if( ! sh_epochs_init(&(table->epochs), n_slots) ){
+        sh_trace("sh_rcu_new: call to sh_epochs_init failed");
+        free(table);
+        return 0;
+    }
+
+    table->buckets = sh_rcu_buckets_new(rounded);
+    if( ! table->buckets ){
+        sh_trace("sh_rcu_new: call to sh_rcu_buckets_new failed");
+        free(table->epochs.slots);
+        free(table);
+        return 0;
+    }
+
+#ifndef SH_NO_THREADS
+    if( pthread_mutex_init(&(table->lock), 0) ){
+        sh_fail(SH_ERR_NOMEM, "sh_rcu_new: call to pthread_mutex_init failed");
+        free(table->epochs.slots);
+        free(table->buckets);
+        free(table);
+        return 0;
+    }
+#endif
+
+    return table;
+}
+
+/* free all resources used by a table made by sh_rcu_new
+ * if `free_data` is set then each stored value is also freed
+ *
+ * no other thread may be using the table
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_rcu_destroy(struct sh_rcu *table, unsigned int free_data){
+    /* iterator through retired items */
+    struct sh_rcu_retired *retired = 0;
+    struct sh_rcu_retired *next = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_rcu_destroy: table undef");
+        return 0;
+    }
+
+    for( retired=table->retired; retired; retired=next ){
+        next = retired->next;
+        sh_rcu_free(table, retired);
+        free(retired);
+    }
+
+    sh_rcu_buckets_destroy(table, table->buckets, free_data);
+
+#ifndef SH_NO_THREADS
+    pthread_mutex_destroy(&(table->lock));
+#endif
+
+    free(table->epochs.slots);
+    free(table);
+
+    return 1;
+}
+
+/* returns number of elements in table
+ *
+ * returns 0 on failure
+ */
+size_t sh_rcu_nelems(const struct sh_rcu *table){
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_rcu_nelems: table undef");
+        return 0;
+    }
+
+    return SH_ACQUIRE(&(table->n_elems));
+}
+
+/* check if `key` exists in table, without taking any lock
+ *
+ * returns 1 if key exists
+ * returns 0 if key does not exist or on failure
+ */
+unsigned int sh_rcu_exists(const struct sh_rcu *table, const char *key){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_rcu_exists: key undef");
+        return 0;
+    }
+
+    return sh_rcu_exists_n(table, key, strlen(key));
+}
+
+/* check if `key` of `key_len` bytes exists in table, without taking any lock
+ *
+ * returns 1 if key exists
+ * returns 0 if key does not exist or on failure
+ */
+unsigned int sh_rcu_exists_n(const struct sh_rcu *table, const void *key, size_t key_len){
+    /* hash of key */
+    unsigned long int hash = 0;
+    /* our reader slot */
+    struct sh_epoch_slot *slot = 0;
+    /* our result */
+    unsigned int result = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_rcu_exists_n: table undef");
+        return 0;
+    }
+
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_rcu_exists_n: key undef");
+        return 0;
+    }
+
+    hash = table->hash_fn(key, key_len, table->seed);
+
+    slot = sh_epoch_enter(&(table->epochs));
+    result = sh_rcu_find(SH_ACQUIRE(&(table->buckets)), key, key_len, hash) != 0;
+    sh_epoch_exit(slot);
+
+    return result;
+}
+
+/* get `data` stored under `key`, without taking any lock
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_rcu_get(const struct sh_rcu *table, const char *key){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_rcu_get: key undef");
+        return 0;
+    }
+
+    return sh_rcu_get_n(table, key, strlen(key));
+}
+
+/* get `data` stored under `key` of `key_len` bytes, without taking any lock
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_rcu_get_n(const struct sh_rcu *table, const void *key, size_t key_len){
+    /* hash of key */
+    unsigned long int hash = 0;
+    /* our reader slot */
+    struct sh_epoch_slot *slot = 0;
+    /* the entry for key */
+    struct sh_entry *entry = 0;
+    /* our result */
+    void *result = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_rcu_get_n: table undef");
+        return 0;
+    }
+
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_rcu_get_n: key undef");
+        return 0;
+    }
+
+    hash = table->hash_fn(key, key_len, table->seed);
+
+    slot = sh_epoch_enter(&(table->epochs));
+    entry = sh_rcu_find(SH_ACQUIRE(&(table->buckets)), key, key_len, hash);
+    if( entry ){
+        result = SH_ACQUIRE(&(entry->data));
+    }
+    sh_epoch_exit(slot);
 
-    /* overwrite */
-    she->data = data;
+    if( ! entry ){
+        sh_fail(SH_ERR_NOT_FOUND, "sh_rcu_get_n: failed to find key");
+        return 0;
+    }
+
+    return result;
+}
+
+/* insert `data` under `key` into table, taking the writer lock
+ *
+ * returns 1 on success
+ * returns 0 on failure, including if key already exists
+ */
+unsigned int sh_rcu_insert(struct sh_rcu *table, const char *key, void *data){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_rcu_insert: key undef");
+        return 0;
+    }
+
+    return sh_rcu_insert_n(table, key, strlen(key), data);
+}
+
+/* insert `data` under `key` of `key_len` bytes into table, taking the writer lock
+ *
+ * returns 1 on success
+ * returns 0 on failure, including if key already exists
+ */
+unsigned int sh_rcu_insert_n(struct sh_rcu *table, const void *key, size_t key_len, void *data){
+    /* hash of key */
+    unsigned long int hash = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_rcu_insert_n: table undef");
+        return 0;
+    }
+
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_rcu_insert_n: key undef");
+        return 0;
+    }
+
+    hash = table->hash_fn(key, key_len, table->seed);
+
+    sh_rcu_lock(table);
+
+    if( sh_rcu_find(table->buckets, key, key_len, hash) ){
+        sh_rcu_unlock(table);
+        sh_fail(SH_ERR_EXISTS, "sh_rcu_insert_n: key already exists in table");
+        return 0;
+    }
+
+    if( ! sh_rcu_add(table, key, key_len, hash, data) ){
+        sh_rcu_unlock(table);
+        sh_trace("sh_rcu_insert_n: call to sh_rcu_add failed");
+        return 0;
+    }
+
+    sh_rcu_unlock(table);
+
+    return 1;
+}
+
+/* set `key` to `data` in table, inserting it if absent,
+ * taking the writer lock
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_rcu_set(struct sh_rcu *table, const char *key, void *data){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_rcu_set: key undef");
+        return 0;
+    }
+
+    return sh_rcu_set_n(table, key, strlen(key), data);
+}
+
+/* set `key` of `key_len` bytes to `data` in table, inserting it if absent,
+ * taking the writer lock
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_rcu_set_n(struct sh_rcu *table, const void *key, size_t key_len, void *data){
+    /* hash of key */
+    unsigned long int hash = 0;
+    /* the existing entry */
+    struct sh_entry *entry = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_rcu_set_n: table undef");
+        return 0;
+    }
+
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_rcu_set_n: key undef");
+        return 0;
+    }
+
+    hash = table->hash_fn(key, key_len, table->seed);
+
+    sh_rcu_lock(table);
+
+    entry = sh_rcu_find(table->buckets, key, key_len, hash);
+    if( entry ){
+        SH_RELEASE(&(entry->data), data);
+    } else if( ! sh_rcu_add(table, key, key_len, hash, data) ){
+        sh_rcu_unlock(table);
+        sh_trace("sh_rcu_set_n: call to sh_rcu_add failed");
+        return 0;
+    }
+
+    sh_rcu_unlock(table);
+
+    return 1;
+}
+
+/* delete entry stored under `key`, taking the writer lock
+ *
+ * the entry itself is freed once no reader can still be looking at it
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_rcu_delete(struct sh_rcu *table, const char *key){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_rcu_delete: key undef");
+        return 0;
+    }
+
+    return sh_rcu_delete_n(table, key, strlen(key));
+}
+
+/* delete entry stored under `key` of `key_len` bytes, taking the writer lock
+ *
+ * the entry itself is freed once no reader can still be looking at it
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_rcu_delete_n(struct sh_rcu *table, const void *key, size_t key_len){
+    /* hash of key */
+    unsigned long int hash = 0;
+    /* link to the entry for key */
+    struct sh_entry **link = 0;
+    /* the entry for key */
+    struct sh_entry *entry = 0;
+    /* data to return */
+    void *data = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_rcu_delete_n: table undef");
+        return 0;
+    }
+
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_rcu_delete_n: key undef");
+        return 0;
+    }
+
+    hash = table->hash_fn(key, key_len, table->seed);
+
+    sh_rcu_lock(table);
+
+    link = &(table->buckets->heads[sh_pos_pow2(hash, table->buckets->size)]);
+    for( ; *link; link = &((*link)->next) ){
+        entry = *link;
+        if( entry->hash == hash &&
+            entry->key_len == key_len &&
+            ! memcmp(entry->key, key, key_len) ){
+            break;
+        }
+    }
+
+    if( ! *link ){
+        sh_rcu_unlock(table);
+        sh_fail(SH_ERR_NOT_FOUND, "sh_rcu_delete_n: failed to find key");
+        return 0;
+    }
+
+    /* readers already on the entry may carry on past it */
+    SH_RELEASE(link, entry->next);
+    SH_RELEASE(&(table->n_elems), table->n_elems - 1);
+    data = entry->data;
+    sh_rcu_retire(table, entry, 0);
+
+    sh_rcu_unlock(table);
+
+    return data;
+}
+
+/* create a new lock free table starting with `size` buckets,
+ * configured by `opts`
+ *
+ * `n_slots` is the number of threads that may be inside a call at once
+ * without having to look for a free slot, 0 for SH_EPOCH_SLOTS, and is
+ * rounded up to a power of two
+ *
+ * only opts.hash_fn and opts.seed are used, keys are always copied and
+ * the other backends, opts.slab and opts.borrow_keys are not supported
+ * a null `opts` gives the defaults, as for sh_new
+ *
+ * returns pointer on success
+ * returns 0 on failure
+ */
+struct sh_lf * sh_lf_new(size_t size, size_t n_slots, const struct sh_opts *opts){
+    /* our new table */
+    struct sh_lf *table = 0;
+    /* rounded size */
+    size_t rounded = 1;
+
+    if( size == 0 ){
+        sh_fail(SH_ERR_INVALID, "sh_lf_new: specified size of 0, impossible");
+        return 0;
+    }
+
+    if( opts && (opts->backend != SH_BACKEND_CHAINING || opts->slab || opts->borrow_keys) ){
+        sh_fail(SH_ERR_UNSUPPORTED, "sh_lf_new: only SH_BACKEND_CHAINING with owned keys is supported");
+        return 0;
+    }
+
+    if( size > ((size_t) SH_LF_SEGMENT << (SH_LF_SEGMENTS - 1)) ){
+        sh_fail(SH_ERR_INVALID, "sh_lf_new: specified size too large");
+        return 0;
+    }
+
+    while( rounded < size ){
+        rounded <<= 1;
+    }
+
+    table = calloc(1, sizeof(struct sh_lf));
+    if( ! table ){
+        sh_fail(SH_ERR_NOMEM, "sh_lf_new: call to calloc failed");
+        return 0;
+    }
+
+    table->size = rounded;
+    table->max_load = SH_DEFAULT_MAX_LOAD;
+    table->hash_fn = sh_hash_djb2;
+    if( opts ){
+        if( opts->hash_fn ){
+            table->hash_fn = opts->hash_fn;
+        }
+        table->seed[0] = opts->seed[0];
+        table->seed[1] = opts->seed[1];
+    }
+
+    if( ! sh_epochs_init(&(table->epochs), n_slots) ){
+        sh_trace("sh_lf_new: call to sh_epochs_init failed");
+        free(table);
+        return 0;
+    }
+
+    /* bucket 0 heads the whole list, every other bucket is split from it */
+    table->segments[0] = calloc(SH_LF_SEGMENT, sizeof(struct sh_lf_node *));
+    if( table->segments[0] ){
+        table->segments[0][0] = sh_lf_node_new(0, 0, 0, 0);
+    }
+    if( ! table->segments[0] || ! table->segments[0][0] ){
+        sh_fail(SH_ERR_NOMEM, "sh_lf_new: allocation of first bucket failed");
+        free(table->segments[0]);
+        free(table->epochs.slots);
+        free(table);
+        return 0;
+    }
+
+    return table;
+}
+
+/* free all resources used by a table made by sh_lf_new
+ * if `free_data` is set then each stored value is also freed
+ *
+ * no other thread may be using the table
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_lf_destroy(struct sh_lf *table, unsigned int free_data){
+    /* iterators through nodes and segments */
+    struct sh_lf_node *node = 0;
+    struct sh_lf_node *next = 0;
+    size_t i = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_lf_destroy: table undef");
+        return 0;
+    }
+
+    /* deleted nodes may still be linked, but are not counted as values */
+    for( node=table->segments[0][0]; node; node=next ){
+        next = (struct sh_lf_node *) (node->next & ~(uintptr_t) 1);
+        if( free_data && (node->so_key & 1) && ! (node->next & 1) ){
+            free(node->data);
+        }
+        free(node);
+    }
+
+    for( node=table->retired; node; node=next ){
+        next = node->retired;
+        free(node);
+    }
+
+    for( i=0; i<SH_LF_SEGMENTS; ++i ){
+        free(table->segments[i]);
+    }
+
+    free(table->epochs.slots);
+    free(table);
+
+    return 1;
+}
+
+/* returns number of elements in table
+ *
+ * returns 0 on failure
+ */
+size_t sh_lf_nelems(const struct sh_lf *table){
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_lf_nelems: table undef");
+        return 0;
+    }
+
+    return SH_ACQUIRE(&(table->n_elems));
+}
+
+/* check if `key` exists in table
+ *
+ * returns 1 if key exists
+ * returns 0 if key does not exist or on failure
+ */
+unsigned int sh_lf_exists(struct sh_lf *table, const char *key){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_lf_exists: key undef");
+        return 0;
+    }
+
+    return sh_lf_exists_n(table, key, strlen(key));
+}
+
+/* check if `key` of `key_len` bytes exists in table
+ *
+ * returns 1 if key exists
+ * returns 0 if key does not exist or on failure
+ */
+unsigned int sh_lf_exists_n(struct sh_lf *table, const void *key, size_t key_len){
+    /* our epoch slot */
+    struct sh_epoch_slot *slot = 0;
+    /* our result */
+    unsigned int result = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_lf_exists_n: table undef");
+        return 0;
+    }
+
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_lf_exists_n: key undef");
+        return 0;
+    }
+
+    slot = sh_epoch_enter(&(table->epochs));
+    result = sh_lf_lookup(table, key, key_len) != 0;
+    sh_epoch_exit(slot);
+
+    return result;
+}
+
+/* get `data` stored under `key`
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_lf_get(struct sh_lf *table, const char *key){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_lf_get: key undef");
+        return 0;
+    }
+
+    return sh_lf_get_n(table, key, strlen(key));
+}
+
+/* get `data` stored under `key` of `key_len` bytes
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_lf_get_n(struct sh_lf *table, const void *key, size_t key_len){
+    /* our epoch slot */
+    struct sh_epoch_slot *slot = 0;
+    /* the node for key */
+    struct sh_lf_node *node = 0;
+    /* our result */
+    void *result = 0;
+
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_lf_get_n: table undef");
+        return 0;
+    }
+
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_lf_get_n: key undef");
+        return 0;
+    }
+
+    slot = sh_epoch_enter(&(table->epochs));
+    node = sh_lf_lookup(table, key, key_len);
+    if( node ){
+        result = SH_ACQUIRE(&(node->data));
+        if( result == (void *) node ){
+            /* deleted since we found it */
+            node = 0;
+            result = 0;
+        }
+    }
+    sh_epoch_exit(slot);
+
+    if( ! node ){
+        sh_fail(SH_ERR_NOT_FOUND, "sh_lf_get_n: failed to find key");
+        return 0;
+    }
+
+    return result;
+}
+
+/* insert `data` under `key` into table
+ *
+ * returns 1 on success
+ * returns 0 on failure, including if key already exists
+ */
+unsigned int sh_lf_insert(struct sh_lf *table, const char *key, void *data){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_lf_insert: key undef");
+        return 0;
+    }
+
+    return sh_lf_insert_n(table, key, strlen(key), data);
+}
+
+/* insert `data` under `key` of `key_len` bytes into table
+ *
+ * returns 1 on success
+ * returns 0 on failure, including if key already exists
+ */
+unsigned int sh_lf_insert_n(struct sh_lf *table, const void *key, size_t key_len, void *data){
+    if( ! table ){
+        sh_fail(SH_ERR_INVALID, "sh_lf_insert_n: table undef");
+        return 0;
+    }
+
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_lf_insert_n: key undef");
+        return 0;
+    }
+
+    if( ! sh_lf_put(table, key, key_len, data, 0) ){
+        sh_trace("sh_lf_insert_n: call to sh_lf_put failed");
+        return 0;
+    }
 
-    /* return old data */
-    return old_data;
+    return 1;
 }
 
-/* set `data` under `key`
+/* set `key` to `data` in table, inserting it if absent
  *
- * this will perform either an insert or an update
- * depending on if the key already exists
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_lf_set(struct sh_lf *table, const char *key, void *data){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_lf_set: key undef");
+        return 0;
+    }
+
+    return sh_lf_set_n(table, key, strlen(key), data);
+}
+
+/* set `key` of `key_len` bytes to `data` in table, inserting it if absent
  *
  * returns 1 on success
  * returns 0 on failure
  */
-unsigned int sh_set(struct sh_table *table, const char *key, void *data){
+unsigned int sh_lf_set_n(struct sh_lf *table, const void *key, size_t key_len, void *data){
     if( ! table ){
-        puts("sh_set: table undef");
+        sh_fail(SH_ERR_INVALID, "sh_lf_set_n: table undef");
         return 0;
     }
 
     if( ! key ){
-        puts("sh_set: key undef");
+        sh_fail(SH_ERR_INVALID, "sh_lf_set_n: key undef");
         return 0;
     }
 
-    /* minor technical debt here:
-     * sh_exists calls sh_find_entry
-     * sh_update calls sh_find_entry
-     * sh_insert calls find sh_exists, which then calls sh_find_entry
-     *
-     * so we either end up with either:
-     *   1 call to sh_exists, 2 calls to sh_find_entry
-     *   2 calls to sh_exists, 2 calls to sh_find_entry
-     */
-    if( sh_exists(table, key) ){
-        if( ! sh_update(table, key, data) ){
-            puts("sh_set: call to sh_update failed");
-            return 0;
-        }
-    } else {
-        if( ! sh_insert(table, key, data) ){
-            puts("sh_set: call to sh_insert failed");
-            return 0;
-        }
+    if( ! sh_lf_put(table, key, key_len, data, 1) ){
+        sh_trace("sh_lf_set_n: call to sh_lf_put failed");
+        return 0;
     }
 
     return 1;
 }
 
-/* get `data` stored under `key`
+/* delete entry stored under `key`
+ *
+ * the entry itself is freed once no thread can still be looking at it
  *
  * returns data on success
  * returns 0 on failure
  */
-void * sh_get(const struct sh_table *table, const char *key){
-    struct sh_entry *she = 0;
+void * sh_lf_delete(struct sh_lf *table, const char *key){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_lf_delete: key undef");
+        return 0;
+    }
+
+    return sh_lf_delete_n(table, key, strlen(key));
+}
+
+/* delete entry stored under `key` of `key_len` bytes
+ *
+ * the entry itself is freed once no thread can still be looking at it
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_lf_delete_n(struct sh_lf *table, const void *key, size_t key_len){
+    /* mixed hash of key */
+    uint64_t mixed = 0;
+    /* our epoch slot */
+    struct sh_epoch_slot *slot = 0;
+    /* the dummy of our bucket */
+    struct sh_lf_node *head = 0;
+    /* position in the list */
+    uintptr_t *prev = 0;
+    struct sh_lf_node *cur = 0;
+    /* the node after cur */
+    uintptr_t next = 0;
+    /* value expected by a compare and swap */
+    uintptr_t expected = 0;
+    /* data to return */
+    void *data = 0;
 
     if( ! table ){
-        puts("sh_get: table undef");
+        sh_fail(SH_ERR_INVALID, "sh_lf_delete_n: table undef");
         return 0;
     }
 
     if( ! key ){
-        puts("sh_get: key undef");
+        sh_fail(SH_ERR_INVALID, "sh_lf_delete_n: key undef");
         return 0;
     }
 
-    /* find entry */
-    she = sh_find_entry(table, key);
-    if( ! she ){
-        /* not found */
+    mixed = sh_mix(table->hash_fn(key, key_len, table->seed));
+
+    slot = sh_epoch_enter(&(table->epochs));
+
+    head = sh_lf_head(table, mixed);
+    if( ! head ){
+        sh_epoch_exit(slot);
+        sh_trace("sh_lf_delete_n: call to sh_lf_head failed");
         return 0;
     }
 
-    /* found */
-    return she->data;
+    for( ;; ){
+        if( ! sh_lf_find(table, head, sh_lf_so_key(mixed), key, key_len, &prev, &cur) ){
+            sh_epoch_exit(slot);
+            sh_fail(SH_ERR_NOT_FOUND, "sh_lf_delete_n: failed to find key");
+            return 0;
+        }
+
+        /* marking the node deletes it, whoever marks it first wins */
+        next = SH_ACQUIRE(&(cur->next));
+        if( next & 1 ){
+            continue;
+        }
+        expected = next;
+        if( SH_CAS(&(cur->next), expected, next | 1) ){
+            break;
+        }
+    }
+
+    /* take the value, a set racing with us either lands before this
+     * and is returned here or sees the node is gone and inserts anew
+     */
+    data = SH_ACQUIRE(&(cur->data));
+    while( ! SH_CAS(&(cur->data), data, (void *) cur) ){
+    }
+    (void) SH_FETCH_ADD(&(table->n_elems), (size_t) -1);
+
+    /* unlink it now if we can, otherwise leave it to the next find */
+    expected = (uintptr_t) cur;
+    if( SH_CAS(prev, expected, next) ){
+        sh_lf_retire(table, cur);
+    } else {
+        (void) sh_lf_find(table, head, sh_lf_so_key(mixed), key, key_len, &prev, &cur);
+    }
+
+    sh_epoch_exit(slot);
+
+    return data;
 }
 
-/* delete entry stored under `key`
+/* create a new table of `size` buckets shared between threads by flat
+ * combining, configured by `opts` as for sh_new_opts
  *
- * returns data on success
+ * `n_slots` is the number of threads that may have a request published at
+ * once without having to look for a free slot, 0 for SH_FC_SLOTS, and is
+ * rounded up to a power of two
+ *
+ * returns pointer on success
  * returns 0 on failure
  */
-void * sh_delete(struct sh_table *table, const char *key){
-    /* our cur entry */
-    struct sh_entry *cur = 0;
-    /* the pointer where we store our next
-     * this will either be:
-     *      &( table->entries[pos] )
-     *      &( previous->next )
-     *
-     * where previous was the previous sh_entry we considered
-     */
-    struct sh_entry **prev = 0;
+struct sh_fc * sh_fc_new(size_t size, size_t n_slots, const struct sh_opts *opts){
+    /* our new table */
+    struct sh_fc *fc = 0;
+    /* rounded number of slots */
+    size_t rounded = 1;
+
+    if( ! n_slots ){
+        n_slots = SH_FC_SLOTS;
+    }
 
-    /* hash */
-    unsigned long int hash = 0;
-    /* position in hash table */
-    size_t pos = 0;
-    /* cached strlen */
-    size_t key_len = 0;
+    if( n_slots > SIZE_MAX / 2 ){
+        sh_fail(SH_ERR_INVALID, "sh_fc_new: n_slots too large to round to a power of two");
+        return 0;
+    }
 
-    /* our old data */
-    void *old_data = 0;
+    while( rounded < n_slots ){
+        rounded <<= 1;
+    }
 
-    if( ! table ){
-        puts("sh_delete: table undef");
+    fc = calloc(1, sizeof(struct sh_fc));
+    if( ! fc ){
+        sh_fail(SH_ERR_NOMEM, "sh_fc_new: call to calloc failed");
         return 0;
     }
 
-    if( ! key ){
-        puts("sh_delete: key undef");
+    if( ! sh_init_opts(&(fc->table), size, opts) ){
+        sh_trace("sh_fc_new: call to sh_init_opts failed");
+        free(fc);
         return 0;
     }
 
-    /* cache strlen */
-    key_len = strlen(key);
+    fc->n_slots = rounded;
+    fc->slots = calloc(rounded, sizeof(struct sh_fc_slot));
+    if( ! fc->slots ){
+        sh_fail(SH_ERR_NOMEM, "sh_fc_new: call to calloc failed for slots");
+        sh_destroy(&(fc->table), 0, 0);
+        free(fc);
+        return 0;
+    }
 
-    /* calculate hash */
-    hash = sh_hash(key, key_len);
+#ifndef SH_NO_THREADS
+    if( pthread_mutex_init(&(fc->lock), 0) ){
+        sh_fail(SH_ERR_NOMEM, "sh_fc_new: call to pthread_mutex_init failed");
+        free(fc->slots);
+        sh_destroy(&(fc->table), 0, 0);
+        free(fc);
+        return 0;
+    }
+#endif
 
-    /* calculate pos
-     * we know table is defined here
-     * so sh_pos cannot fail
-     */
-    pos = sh_pos(hash, table->size);
+    return fc;
+}
 
+/* free all resources used by a table made by sh_fc_new
+ * if `free_data` is set then each stored value is also freed
+ *
+ * no other thread may be using the table
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_fc_destroy(struct sh_fc *fc, unsigned int free_data){
+    /* result of destroying the table */
+    unsigned int result = 0;
 
-    /* iterate through bucket considering each entry
-     * the only tricky part here is the prev pointer
-     * which is the position where we save our next
-     * to ensure the linked list of entries remains intact
-     */
-    prev = &( table->entries[pos] );
-    for( cur = table->entries[pos];
-         cur;
-         prev = &(cur->next), cur = cur->next ){
+    if( ! fc ){
+        sh_fail(SH_ERR_INVALID, "sh_fc_destroy: fc undef");
+        return 0;
+    }
 
-        if( cur->hash != hash ){
-            continue;
-        }
+    result = sh_destroy(&(fc->table), 0, free_data);
+    if( ! result ){
+        sh_trace("sh_fc_destroy: call to sh_destroy failed");
+    }
 
-        if( cur->key_len != key_len ){
-            continue;
-        }
+#ifndef SH_NO_THREADS
+    pthread_mutex_destroy(&(fc->lock));
+#endif
 
-        if( strncmp(key, cur->key, key_len) ){
-            continue;
-        }
+    free(fc->slots);
+    free(fc);
+
+    return result;
+}
+
+/* the sh_table underneath `fc`, for use with the plain sh_ functions
+ * while no other thread is using `fc`
+ *
+ * sh_fc_nelems only catches up with changes made this way once the next
+ * request through `fc` has been applied
+ *
+ * returns pointer on success
+ * returns 0 on failure
+ */
+struct sh_table * sh_fc_table(struct sh_fc *fc){
+    if( ! fc ){
+        sh_fail(SH_ERR_INVALID, "sh_fc_table: fc undef");
+        return 0;
+    }
 
-        /* save old data pointer */
-        old_data = cur->data;
+    return &(fc->table);
+}
 
-        /* decrement number of elements */
-        --table->n_elems;
+/* returns number of elements in table
+ *
+ * returns 0 on failure
+ */
+size_t sh_fc_nelems(const struct sh_fc *fc){
+    if( ! fc ){
+        sh_fail(SH_ERR_INVALID, "sh_fc_nelems: fc undef");
+        return 0;
+    }
 
-        /* capture next
-         * to ensure continuation of linked list
-         */
-        *prev = cur->next;
+    return SH_ACQUIRE(&(fc->n_elems));
+}
 
-        /* free element and contents
-         * do NOT free data, leave that up to caller
-         */
-        if( ! sh_entry_destroy(cur, 1, 0) ){
-            puts("sh_delete: warning, call to sh_entry_destroy failed, continuing...");
-        }
+/* check if `key` exists in table
+ *
+ * returns 1 if key exists
+ * returns 0 if key does not exist or on failure
+ */
+unsigned int sh_fc_exists(struct sh_fc *fc, const char *key){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_fc_exists: key undef");
+        return 0;
+    }
+
+    return sh_fc_exists_n(fc, key, strlen(key));
+}
 
-        /* return old data */
-        return old_data;
+/* check if `key` of `key_len` bytes exists in table
+ *
+ * returns 1 if key exists
+ * returns 0 if key does not exist or on failure
+ */
+unsigned int sh_fc_exists_n(struct sh_fc *fc, const void *key, size_t key_len){
+    if( ! fc ){
+        sh_fail(SH_ERR_INVALID, "sh_fc_exists_n: fc undef");
+        return 0;
     }
 
-    /* failed to find element */
-    puts("sh_delete: failed to find key");
-    return 0;
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_fc_exists_n: key undef");
+        return 0;
+    }
+
+    return sh_fc_call(fc, SH_FC_EXISTS, key, key_len, 0) != 0;
 }
 
-/* iterate through all key/value pairs in this hash table
- * calling the provided function on each pair.
+/* get `data` stored under `key`
  *
- * the function is allowed to modify the value but cannot modify the key.
- * the function should not access the hash table in anyway including:
- *  modifying the hash table other than through the value pointer given
- *  calling any other hash table functions
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_fc_get(struct sh_fc *fc, const char *key){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_fc_get: key undef");
+        return 0;
+    }
+
+    return sh_fc_get_n(fc, key, strlen(key));
+}
+
+/* get `data` stored under `key` of `key_len` bytes
  *
- * the function will be given the value of the `state` pointer for each call,
- * this is useful for passing state between calls to the function as well as
- * for returning results
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_fc_get_n(struct sh_fc *fc, const void *key, size_t key_len){
+    if( ! fc ){
+        sh_fail(SH_ERR_INVALID, "sh_fc_get_n: fc undef");
+        return 0;
+    }
+
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_fc_get_n: key undef");
+        return 0;
+    }
+
+    return sh_fc_call(fc, SH_FC_GET, key, key_len, 0);
+}
+
+/* insert `data` under `key` into table
  *
- * the function should return
- *  1 if it wants the iteration to continue
- *  0 if it wants the iteration to stop
+ * returns 1 on success
+ * returns 0 on failure, including if key already exists
+ */
+unsigned int sh_fc_insert(struct sh_fc *fc, const char *key, void *data){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_fc_insert: key undef");
+        return 0;
+    }
+
+    return sh_fc_insert_n(fc, key, strlen(key), data);
+}
+
+/* insert `data` under `key` of `key_len` bytes into table
  *
  * returns 1 on success
- * returns 0 on success
+ * returns 0 on failure, including if key already exists
  */
-unsigned int sh_iterate(struct sh_table *table, void *state, unsigned int (*each)(void *state, const char *key, void **data)){
-    /* current index into table we are considering */
-    unsigned int i = 0;
-    unsigned int len = 0;
-    /* current entry within bucket we are considering */
-    struct sh_entry *entry = 0;
-    /* return value from user supplied function */
-    unsigned int ret = 0;
+unsigned int sh_fc_insert_n(struct sh_fc *fc, const void *key, size_t key_len, void *data){
+    if( ! fc ){
+        sh_fail(SH_ERR_INVALID, "sh_fc_insert_n: fc undef");
+        return 0;
+    }
 
-    if( ! table ){
-        puts("sh_iterate: table undef");
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_fc_insert_n: key undef");
         return 0;
     }
 
-    if( ! each ){
-        puts("sh_iterate: each undef");
+    return sh_fc_call(fc, SH_FC_INSERT, key, key_len, data) != 0;
+}
+
+/* set `key` to `data` in table, inserting it if absent
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_fc_set(struct sh_fc *fc, const char *key, void *data){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_fc_set: key undef");
         return 0;
     }
 
-    len = table->size;
-    /* go through each entry in table */
-    for( i=0; i<len; ++i ){
-        entry = table->entries[i];
+    return sh_fc_set_n(fc, key, strlen(key), data);
+}
 
-        /* go through each entry within bucket calling user supplied function */
-        while( entry ){
-            ret = each(state, entry->key, &(entry->data));
+/* set `key` of `key_len` bytes to `data` in table, inserting it if absent
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_fc_set_n(struct sh_fc *fc, const void *key, size_t key_len, void *data){
+    if( ! fc ){
+        sh_fail(SH_ERR_INVALID, "sh_fc_set_n: fc undef");
+        return 0;
+    }
 
-            if( ret == 0 ){
-                /* user function signalled to stop, returning */
-                return 1;
-            }
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_fc_set_n: key undef");
+        return 0;
+    }
 
-            entry = entry->next;
-        }
+    return sh_fc_call(fc, SH_FC_SET, key, key_len, data) != 0;
+}
+
+/* delete entry stored under `key`
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_fc_delete(struct sh_fc *fc, const char *key){
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_fc_delete: key undef");
+        return 0;
     }
 
-    return 1;
+    return sh_fc_delete_n(fc, key, strlen(key));
 }
 
+/* delete entry stored under `key` of `key_len` bytes
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_fc_delete_n(struct sh_fc *fc, const void *key, size_t key_len){
+    if( ! fc ){
+        sh_fail(SH_ERR_INVALID, "sh_fc_delete_n: fc undef");
+        return 0;
+    }
+
+    if( ! key ){
+        sh_fail(SH_ERR_INVALID, "sh_fc_delete_n: key undef");
+        return 0;
+    }
+
+    return sh_fc_call(fc, SH_FC_DELETE, key, key_len, 0);
+}
@@ -27,13 +27,88 @@
 #define SIMPLE_HASH_H
 
 #include <stddef.h> /* size_t */
+#include <stdint.h> /* uint64_t */
+
+/* default load factor policy applied by sh_init
+ *
+ * a table grows (doubling its size) once it holds more than
+ * SH_DEFAULT_MAX_LOAD elements per bucket,
+ * automatic shrinking is disabled by default (min load of 0)
+ *
+ * see sh_set_load_factors
+ */
+#define SH_DEFAULT_MAX_LOAD 0.75
+#define SH_DEFAULT_MIN_LOAD 0.0
+
+/* open addressing backends must always keep some slots free
+ * so they grow once more than this fraction of slots are in use
+ * regardless of the max_load given to sh_set_load_factors
+ */
+#define SH_ROBIN_HOOD_MAX_LOAD 0.9
+#define SH_SWISS_MAX_LOAD 0.875
+
+/* the storage used by a table, chosen at sh_init_opts time
+ *
+ * every backend supports the full sh_* api
+ */
+enum sh_backend {
+    /* an array of buckets each holding a linked list of entries (the default)
+     * every entry is a separate allocation
+     */
+    SH_BACKEND_CHAINING = 0,
+    /* a flat array of entries using robin hood linear probing
+     * with backward shift deletion
+     * lookups touch neighbouring slots rather than chasing pointers,
+     * the table size is always a power of two
+     */
+    SH_BACKEND_ROBIN_HOOD,
+    /* a flat array of entries in groups of 16, alongside an array of one
+     * control byte per slot holding 7 bits of its hash,
+     * lookups compare a whole group of control bytes at once (using SSE2
+     * where available) and only touch the slots that match
+     * the table size is always a power of two, and at least 16
+     */
+    SH_BACKEND_SWISS
+};
+
+/* why a call failed, see sh_last_error
+ *
+ * the library never prints, failures are recorded per thread and
+ * optionally passed to a logging callback, see sh_set_log
+ */
+enum sh_error {
+    /* no failure recorded */
+    SH_OK = 0,
+    /* an argument was null or out of range */
+    SH_ERR_INVALID,
+    /* a memory allocation failed */
+    SH_ERR_NOMEM,
+    /* the key was not in the table */
+    SH_ERR_NOT_FOUND,
+    /* the key was already in the table */
+    SH_ERR_EXISTS,
+    /* an open addressing table had no free slots and could not grow */
+    SH_ERR_FULL,
+    /* the feature was not compiled in or not enabled for this table */
+    SH_ERR_UNSUPPORTED,
+    SH_ERR_COUNT
+};
 
 struct sh_entry {
     /* hash value for this entry, output of sh_hash(key) */
     unsigned long int hash;
-    /* string copied using sh_strdup (defined in simple_hash.c) */
+    /* copy of the key, always null terminated, but may also contain
+     * null bytes if inserted via one of the _n functions
+     *
+     * for SH_BACKEND_CHAINING the copy is stored inline directly after the
+     * entry within the same allocation, for the open addressing backends
+     * it is a separate allocation made by sh_strdupn (defined in simple_hash.c)
+     *
+     * if the table borrows keys (see opts.borrow_keys) this is instead
+     * the caller's pointer and is only null terminated if theirs was
+     */
     char *key;
-    /* strlen of key, simple cache */
+    /* length of key in bytes, not including the null terminator */
     size_t key_len;
     /* data pointer */
     void *data;
@@ -43,13 +118,262 @@ struct sh_entry {
     struct sh_entry *next;
 };
 
+/* number of keys the batch operations (sh_get_many and friends)
+ * work on at a time, each batch keeps this many hashes on the stack
+ */
+#define SH_BATCH 16
+
+/* number of chunk sizes kept by a slab, see opts.slab
+ * each is a multiple of 16 bytes, so allocations of up to 256 bytes
+ * come from the slab and anything larger from malloc
+ */
+#define SH_SLAB_CLASSES 16
+
+/* a pool of fixed size chunks carved from large blocks
+ * used to allocate entries and keys when opts.slab is set
+ */
+struct sh_slab {
+    /* every block allocated so far, linked through their first bytes */
+    void *blocks;
+    /* the unused remainder of the newest block */
+    char *cursor;
+    size_t remaining;
+    /* chunks freed for reuse, one list per size class,
+     * linked through their first bytes
+     */
+    void *free_chunks[SH_SLAB_CLASSES];
+    /* number of live allocations too large for the slab */
+    size_t n_large;
+};
+
+/* a key along with its pre-computed hash
+ * see sh_key_init and the _k functions
+ */
+struct sh_key {
+    /* the key, not owned by the handle */
+    const void *key;
+    /* length of key in bytes */
+    size_t key_len;
+    /* hash function and seed used to compute `hash`
+     * if these do not match the table the key is used with
+     * then the table will rehash the key itself
+     */
+    unsigned long int (*hash_fn)(const void *key, size_t key_len, const uint64_t seed[2]);
+    uint64_t seed[2];
+    /* output of hash_fn(key, key_len, seed) */
+    unsigned long int hash;
+};
+
+/* options for sh_new_opts and sh_init_opts
+ *
+ * zero initialise this and then set the fields you care about,
+ * any field left as 0 gives the default
+ */
+struct sh_opts {
+    /* hash function for the table, one of
+     *  sh_hash_djb2    (the default) simple, not resistant to attack
+     *  sh_hash_xxh64   fast word at a time hash with well mixed output
+     *  sh_hash_siphash keyed hash, resistant to attack given a secret seed
+     * or any function with the same signature
+     */
+    unsigned long int (*hash_fn)(const void *key, size_t key_len, const uint64_t seed[2]);
+    /* seed passed to hash_fn
+     * to resist attackers this should be random and kept secret
+     */
+    uint64_t seed[2];
+    /* if non-zero the number of buckets is always a power of two
+     * any requested size is rounded up to the next power of two
+     * and buckets are chosen by sh_pos_pow2 (a mask) rather than sh_pos (a modulo)
+     */
+    unsigned int pow2;
+    /* the storage used by the table, see enum sh_backend */
+    enum sh_backend backend;
+    /* if non-zero entries and keys are allocated from a per table slab
+     * rather than by individual calls to malloc, freed entries are reused
+     * by later inserts and sh_destroy releases the whole slab at once
+     */
+    unsigned int slab;
+    /* if non-zero the table stores the caller's key pointers as is rather
+     * than copying them, and never frees them
+     *
+     * the caller must keep every key valid and unmodified until it has been
+     * deleted from the table or the table destroyed, a key changed while in
+     * the table will no longer be found and may corrupt the table
+     *
+     * sh_iterate will hand back the caller's pointers, keys inserted with a
+     * length (the _n functions) are not null terminated unless they were
+     */
+    unsigned int borrow_keys;
+};
+
+/* a bucket in the array used by SH_BACKEND_CHAINING
+ *
+ * alongside the chain itself we keep a small bloom filter of the hashes
+ * within it, one bit per entry chosen by sh_fingerprint, so a lookup for a
+ * key that is not present can usually be turned away without touching any
+ * of the entries in the chain
+ */
+struct sh_bucket {
+    /* first entry in this bucket, 0 if empty */
+    struct sh_entry *head;
+    /* fingerprint bits of every entry in the chain
+     * may have extra bits set, never has bits missing
+     */
+    uint64_t filter;
+};
+
+/* number of chain lengths counted separately by sh_stats,
+ * longer chains are counted in the last entry of the histogram
+ */
+#define SH_STATS_HISTOGRAM 16
+
+/* a description of a table filled in by sh_stats
+ *
+ * for SH_BACKEND_CHAINING a chain is the list of entries in one bucket
+ *
+ * the open addressing backends have no chains, instead every slot is
+ * counted as a bucket and the chain for each entry is the number of slots
+ * (robin hood) or groups (swiss) a lookup has to probe to find it
+ */
+struct sh_stats {
+    /* number of buckets, including those of an incremental resize
+     * not yet moved across
+     */
+    size_t n_buckets;
+    /* number of elements, as sh_nelems */
+    size_t n_elems;
+    /* elements per bucket, ignoring any incremental resize */
+    double load;
+    /* number of empty buckets */
+    size_t n_empty;
+    /* the longest chain, and the mean length of chains that are not empty */
+    size_t max_chain;
+    double mean_chain;
+    /* histogram[i] is the number of chains of length i
+     * the last entry also counts every longer chain
+     */
+    size_t histogram[SH_STATS_HISTOGRAM];
+    /* bytes allocated for the bucket array (or slots and control bytes),
+     * for entries outside of the bucket array, and for copies of keys
+     *
+     * this is what was asked of the allocator, it does not include the
+     * allocator's own overhead or the rounding and free chunks of a slab
+     */
+    size_t bucket_bytes;
+    size_t entry_bytes;
+    size_t key_bytes;
+};
+
+/* the kinds of operation counted by telemetry, see struct sh_telemetry */
+enum sh_op {
+    /* sh_get, sh_lookup, sh_exists, and sh_get_or_insert of an existing key */
+    SH_OP_GET = 0,
+    /* sh_insert, and sh_set or sh_get_or_insert of a new key */
+    SH_OP_INSERT,
+    /* sh_update, and sh_set of an existing key */
+    SH_OP_UPDATE,
+    /* sh_delete */
+    SH_OP_DELETE,
+    /* the number of kinds above */
+    SH_OP_COUNT
+};
+
+/* number of buckets in each latency histogram of struct sh_telemetry */
+#define SH_LATENCY_BUCKETS 32
+
+/* operational counters for a table, see sh_telemetry_snapshot
+ *
+ * these are only kept when simple_hash.c is built with SH_TELEMETRY
+ * defined, otherwise the counting is compiled out entirely
+ *
+ * the batch operations (sh_get_many and friends) count each key
+ * but do not record latencies
+ */
+struct sh_telemetry {
+    /* operations of each kind, see enum sh_op, that found their key
+     * (for SH_OP_INSERT that succeeded) and that did not
+     */
+    uint64_t hits[SH_OP_COUNT];
+    uint64_t misses[SH_OP_COUNT];
+    /* entries (or slots) whose key was compared against while searching */
+    uint64_t nodes_visited;
+    /* number of calls to sh_resize, including automatic resizes,
+     * and nanoseconds spent within them
+     */
+    uint64_t resizes;
+    uint64_t resize_ns;
+    /* latency[op][i] counts operations of kind `op` that took
+     * [2^i, 2^(i+1)) nanoseconds, the last bucket also counts longer ones
+     */
+    uint64_t latency[SH_OP_COUNT][SH_LATENCY_BUCKETS];
+};
+
 struct sh_table {
     /* number of slots in hash */
     size_t size;
     /* number of elements stored in hash */
     size_t n_elems;
-    /* array of pointers to the first bucket in each slot */
-    struct sh_entry **entries;
+    /* array of `size` buckets
+     * only used by SH_BACKEND_CHAINING
+     */
+    struct sh_bucket *entries;
+    /* array of `size` entries, a slot is empty if its key is 0
+     * only used by the open addressing backends
+     */
+    struct sh_entry *slots;
+    /* one control byte per slot, only used by SH_BACKEND_SWISS */
+    unsigned char *ctrl;
+    /* number of slots marked deleted, only used by SH_BACKEND_SWISS
+     * these count towards the load cap until the table is next resized
+     */
+    size_t n_deleted;
+    /* which of the above is in use */
+    enum sh_backend backend;
+    /* allocator for entries and keys, 0 to use malloc, see opts.slab */
+    struct sh_slab *slab;
+    /* keys are the caller's pointers, see opts.borrow_keys */
+    unsigned int borrow_keys;
+    /* operational counters, 0 unless built with SH_TELEMETRY */
+    struct sh_telemetry *telemetry;
+
+    /* load factor policy, see sh_set_load_factors
+     * a value of 0 disables that direction of automatic resizing
+     */
+    double max_load;
+    double min_load;
+    /* thresholds derived from the policy and the current size
+     * so the insert and delete paths only compare integers
+     *
+     * we grow once n_elems > grow_at
+     * we shrink once n_elems < shrink_at
+     */
+    size_t grow_at;
+    size_t shrink_at;
+    /* automatic shrinking will never take us below this size
+     * set to the size given to sh_init
+     */
+    size_t min_size;
+
+    /* incremental resizing, see sh_set_incremental
+     *
+     * while a resize is in progress `old_entries` holds the buckets we are
+     * moving away from, every old bucket below `migrate_pos` has already been
+     * moved into `entries`
+     *
+     * old_entries is 0 when no resize is in progress
+     */
+    struct sh_bucket *old_entries;
+    size_t old_size;
+    size_t migrate_pos;
+    /* number of old buckets moved per modification, 0 if not incremental */
+    size_t migrate_step;
+
+    /* hash function and seed chosen at sh_init_opts time */
+    unsigned long int (*hash_fn)(const void *key, size_t key_len, const uint64_t seed[2]);
+    uint64_t seed[2];
+
+    /* size is always a power of two and buckets are found via sh_pos_pow2 */
+    unsigned int pow2;
 };
 
 /* function to return number of elements
@@ -59,6 +383,35 @@ struct sh_table {
  */
 unsigned int sh_nelems(const struct sh_table *table);
 
+/* fill `stats` with a description of `table`, see struct sh_stats
+ *
+ * this visits every bucket and entry once
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_stats(const struct sh_table *table, struct sh_stats *stats);
+
+/* copy the telemetry counters of `table` into `snapshot`
+ *
+ * this may be called from another thread while the table is in use,
+ * each counter is read atomically but they are not read all at once
+ *
+ * returns 1 on success
+ * returns 0 on failure (including when built without SH_TELEMETRY)
+ */
+unsigned int sh_telemetry_snapshot(const struct sh_table *table, struct sh_telemetry *snapshot);
+
+/* set every telemetry counter of `table` back to 0
+ *
+ * unlike sh_telemetry_snapshot this must be called from the thread using
+ * the table, otherwise updates made at the same time may be lost
+ *
+ * returns 1 on success
+ * returns 0 on failure (including when built without SH_TELEMETRY)
+ */
+unsigned int sh_telemetry_reset(struct sh_table *table);
+
 /* takes a char* representing a string
  * and a key_len of it's size
  *
@@ -69,6 +422,78 @@ unsigned int sh_nelems(const struct sh_table *table);
  */
 unsigned long int sh_hash(const char *key, size_t key_len);
 
+/* takes a key of exactly `key_len` bytes, which may contain null bytes
+ *
+ * unlike sh_hash a `key_len` of 0 is the empty key
+ *
+ * this is sh_hash_djb2 with a seed of 0, the default hash for tables
+ *
+ * returns an unsigned long integer hash value
+ */
+unsigned long int sh_hash_n(const void *key, size_t key_len);
+
+/* djb2, one byte per step
+ * http://www.cse.yorku.ca/~oz/hash.html
+ *
+ * the starting value is seed[0] (0 by default, which is what sh_hash
+ * has always used) so seeding does not prevent collisions,
+ * use sh_hash_siphash if keys may be chosen by an attacker
+ *
+ * returns an unsigned long integer hash value
+ */
+unsigned long int sh_hash_djb2(const void *key, size_t key_len, const uint64_t seed[2]);
+
+/* xxh64, seeded by seed[0]
+ * https://github.com/Cyan4973/xxHash
+ *
+ * consumes 8 bytes per step, and for keys of 32 bytes or more runs
+ * 4 independent accumulators so the multiplies overlap
+ *
+ * the output is well mixed in every bit,
+ * but it is not keyed so should not be relied on against an attacker
+ *
+ * returns an unsigned long integer hash value
+ * (truncated on platforms where unsigned long is 32 bits)
+ */
+unsigned long int sh_hash_xxh64(const void *key, size_t key_len, const uint64_t seed[2]);
+
+/* siphash-2-4 keyed by the 128 bits of seed[0] and seed[1]
+ * https://131002.net/siphash/
+ *
+ * slower than sh_hash_xxh64, but with a secret random seed an attacker
+ * cannot choose keys which collide, which would otherwise let them turn
+ * a bucket into one long chain
+ *
+ * returns an unsigned long integer hash value
+ * (truncated on platforms where unsigned long is 32 bits)
+ */
+unsigned long int sh_hash_siphash(const void *key, size_t key_len, const uint64_t seed[2]);
+
+/* initialise a pre-hashed key handle for `key` of `key_len` bytes
+ * using the default hash (sh_hash_djb2 with a seed of 0)
+ *
+ * the handle does not copy the key, so `key` must remain valid
+ * for as long as the handle is in use
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_key_init(struct sh_key *handle, const void *key, size_t key_len);
+
+/* initialise a pre-hashed key handle for `key` of `key_len` bytes
+ * using the hash function and seed of `table`
+ *
+ * the handle can be used with any table sharing that hash function and seed
+ * without being rehashed
+ *
+ * the handle does not copy the key, so `key` must remain valid
+ * for as long as the handle is in use
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_key_init_for(struct sh_key *handle, const struct sh_table *table, const void *key, size_t key_len);
+
 /* takes a table and a hash value
  *
  * returns the index into the table for this hash
@@ -80,6 +505,17 @@ unsigned long int sh_hash(const char *key, size_t key_len);
  */
 size_t sh_pos(unsigned long int hash, size_t table_size);
 
+/* takes a hash value and a power of two table size
+ *
+ * the hash is first mixed by a multiplication with 2^64 / phi (fibonacci
+ * hashing) so that weak hashes such as djb2, which differ mostly in their
+ * low bits, still spread across the table, and then masked
+ *
+ * returns the index into the table for this hash
+ * the result is meaningless if table_size is not a power of two
+ */
+size_t sh_pos_pow2(unsigned long int hash, size_t table_size);
+
 /* allocate and initialise a new sh_table of size size
  *
  * returns pointer on success
@@ -87,6 +523,16 @@ size_t sh_pos(unsigned long int hash, size_t table_size);
  */
 struct sh_table * sh_new(size_t size);
 
+/* allocate and initialise a new sh_table of size size
+ * configured by `opts`, see struct sh_opts
+ *
+ * a null `opts` gives the defaults, as for sh_new
+ *
+ * returns pointer on success
+ * returns 0 on failure
+ */
+struct sh_table * sh_new_opts(size_t size, const struct sh_opts *opts);
+
 /* free an existing sh_table
  * this will free all the sh entries stored
  * this will free all the keys (as they are strdup-ed)
@@ -106,16 +552,122 @@ unsigned int sh_destroy(struct sh_table *table, unsigned int free_table, unsigne
  */
 unsigned int sh_init(struct sh_table *table, size_t size);
 
+/* initialise an already allocated sh_table to size size
+ * configured by `opts`, see struct sh_opts
+ *
+ * a null `opts` gives the defaults, as for sh_init
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_init_opts(struct sh_table *table, size_t size, const struct sh_opts *opts);
+
 /* resize an existing table to new_size
  * this will reshuffle all the buckets around
  *
  * you can use this to make a hash larger or smaller
  *
+ * if the table was created with opts.pow2 then new_size is rounded up
+ * to the next power of two
+ *
+ * if incremental resizing is enabled (see sh_set_incremental)
+ * this will only begin moving entries across, the remainder are moved
+ * by subsequent modifications or calls to sh_rehash_step
+ *
  * returns 1 on success
  * returns 0 on failure
  */
 unsigned int sh_resize(struct sh_table *table, size_t new_size);
 
+/* resize an existing table to new_size as sh_resize does, spreading the
+ * work across `n_threads` threads
+ *
+ * intended for growing a large table as quickly as possible while it is
+ * otherwise idle, the whole resize is completed before returning
+ * regardless of sh_set_incremental
+ *
+ * only SH_BACKEND_CHAINING resizes in parallel, the open addressing
+ * backends and an `n_threads` of 0 or 1 resize on the calling thread
+ * via sh_resize
+ *
+ * the table must not be used by any other thread during the resize,
+ * with SH_NO_THREADS `n_threads` is ignored
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_resize_parallel(struct sh_table *table, size_t new_size, unsigned int n_threads);
+
+/* enable or disable incremental resizing for this table
+ *
+ * when enabled, sh_resize (including automatic resizes) allocates the new
+ * bucket array but leaves the entries in the old one, then each
+ * sh_insert, sh_update, sh_set and sh_delete moves `step` old buckets across
+ *
+ * lookups (sh_get, sh_exists) never move entries as they do not modify
+ * the table, a read-only workload should drive sh_rehash_step instead
+ *
+ * a `step` of 0 disables incremental resizing,
+ * completing any migration currently in progress
+ *
+ * only SH_BACKEND_CHAINING resizes incrementally,
+ * the open addressing backends always resize in one go
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_set_incremental(struct sh_table *table, size_t step);
+
+/* move up to `n_buckets` old buckets across if an incremental resize is in
+ * progress, does nothing if there is no resize in progress
+ *
+ * this is intended to be driven from an idle loop so that
+ * the resize is complete before the next burst of work
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_rehash_step(struct sh_table *table, size_t n_buckets);
+
+/* check if an incremental resize is currently in progress
+ *
+ * returns 1 if a resize is in progress
+ * returns 0 if no resize is in progress or on failure
+ */
+unsigned int sh_rehashing(const struct sh_table *table);
+
+/* set the load factor policy for this table
+ *
+ * after an insert, if the table holds more than `max_load` elements
+ * per bucket it will double in size
+ *
+ * after a delete, if the table holds fewer than `min_load` elements
+ * per bucket it will halve in size (but never below the size given to sh_init)
+ *
+ * a `max_load` of 0, or one too large to ever reach, disables automatic growth
+ * a `min_load` of 0 disables automatic shrinking
+ *
+ * to prevent alternating inserts and deletes near a threshold from
+ * repeatedly resizing the table, `min_load` must be at most `max_load / 4`
+ * (when growth is enabled), this leaves a table that has just grown or
+ * shrunk comfortably between the two thresholds
+ *
+ * open addressing tables grow at SH_ROBIN_HOOD_MAX_LOAD or SH_SWISS_MAX_LOAD
+ * when `max_load` is 0 or above it, and `min_load` is checked against that
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_set_load_factors(struct sh_table *table, double max_load, double min_load);
+
+/* read the current load factor policy for this table
+ * either of `max_load` or `min_load` may be null
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_get_load_factors(const struct sh_table *table, double *max_load, double *min_load);
+
 /* check if the supplied key already exists in this hash
  *
  * returns 1 on success (key exists)
@@ -123,14 +675,50 @@ unsigned int sh_resize(struct sh_table *table, size_t new_size);
  */
 unsigned int sh_exists(const struct sh_table *table, const char *key);
 
+/* check if the supplied key of `key_len` bytes already exists in this hash
+ *
+ * returns 1 on success (key exists)
+ * returns 0 if key doesn't exist or on failure
+ */
+unsigned int sh_exists_n(const struct sh_table *table, const void *key, size_t key_len);
+
+/* check if the pre-hashed key in `handle` already exists in this hash
+ *
+ * returns 1 on success (key exists)
+ * returns 0 if key doesn't exist or on failure
+ */
+unsigned int sh_exists_k(const struct sh_table *table, const struct sh_key *handle);
+
 /* insert `data` under `key`
  * this will only success if !sh_exists(table, key)
  *
+ * this may grow the table, see sh_set_load_factors
+ *
  * returns 1 on success
  * returns 0 on failure
  */
 unsigned int sh_insert(struct sh_table *table, const char *key, void *data);
 
+/* insert `data` under `key` of `key_len` bytes
+ * this will only success if !sh_exists_n(table, key, key_len)
+ *
+ * this may grow the table, see sh_set_load_factors
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_insert_n(struct sh_table *table, const void *key, size_t key_len, void *data);
+
+/* insert `data` under the pre-hashed key in `handle`, see sh_key_init
+ * this will only success if !sh_exists_k(table, handle)
+ *
+ * this may grow the table, see sh_set_load_factors
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_insert_k(struct sh_table *table, const struct sh_key *handle, void *data);
+
 /* update `data` under `key`
  *
  * this will only succeed if sh_exists(table, key)
@@ -140,16 +728,60 @@ unsigned int sh_insert(struct sh_table *table, const char *key, void *data);
  */
 void * sh_update(struct sh_table *table, const char *key, void *data);
 
+/* update `data` under `key` of `key_len` bytes
+ *
+ * this will only succeed if sh_exists_n(table, key, key_len)
+ *
+ * returns old data on success
+ * returns 0 on failure
+ */
+void * sh_update_n(struct sh_table *table, const void *key, size_t key_len, void *data);
+
+/* update `data` under the pre-hashed key in `handle`, see sh_key_init
+ *
+ * this will only succeed if sh_exists_k(table, handle)
+ *
+ * returns old data on success
+ * returns 0 on failure
+ */
+void * sh_update_k(struct sh_table *table, const struct sh_key *handle, void *data);
+
 /* set `data` under `key`
  *
  * this will perform either an insert or an update
  * depending on if the key already exists
  *
+ * this may grow the table, see sh_set_load_factors
+ *
  * returns 1 on success
  * returns 0 on failure
  */
 unsigned int sh_set(struct sh_table *table, const char *key, void *data);
 
+/* set `data` under `key` of `key_len` bytes
+ *
+ * this will perform either an insert or an update
+ * depending on if the key already exists
+ *
+ * this may grow the table, see sh_set_load_factors
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_set_n(struct sh_table *table, const void *key, size_t key_len, void *data);
+
+/* set `data` under the pre-hashed key in `handle`, see sh_key_init
+ *
+ * this will perform either an insert or an update
+ * depending on if the key already exists
+ *
+ * this may grow the table, see sh_set_load_factors
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_set_k(struct sh_table *table, const struct sh_key *handle, void *data);
+
 /* get `data` stored under `key`
  *
  * returns data on success
@@ -157,23 +789,211 @@ unsigned int sh_set(struct sh_table *table, const char *key, void *data);
  */
 void * sh_get(const struct sh_table *table, const char *key);
 
-/* delete entry stored under `key`
+/* get `data` stored under `key` of `key_len` bytes
  *
  * returns data on success
  * returns 0 on failure
  */
-void * sh_delete(struct sh_table *table, const char *key);
+void * sh_get_n(const struct sh_table *table, const void *key, size_t key_len);
 
-/* iterate through all key/value pairs in this hash table
- * calling the provided function on each pair.
+/* get `data` stored under the pre-hashed key in `handle`, see sh_key_init
  *
- * the function is allowed to modify the value but cannot modify the key.
- * the function should not access the hash table in anyway including:
- *  modifying the hash table other than through the value pointer given
- *  calling any other hash table functions
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_get_k(const struct sh_table *table, const struct sh_key *handle);
+
+/* lookup the `data` stored under `key`
  *
- * the function will be given the value of the `state` pointer for each call,
- * this is useful for passing state between calls to the function as well as
+ * unlike sh_get this can distinguish a missing key from a key
+ * storing 0 as its data
+ *
+ * if `data` is not null then the stored data is written to it
+ * when the key is found, it is not modified otherwise
+ *
+ * returns 1 if the key was found
+ * returns 0 if the key was not found or on failure
+ */
+unsigned int sh_lookup(const struct sh_table *table, const char *key, void **data);
+
+/* lookup the `data` stored under `key` of `key_len` bytes
+ *
+ * see sh_lookup
+ *
+ * returns 1 if the key was found
+ * returns 0 if the key was not found or on failure
+ */
+unsigned int sh_lookup_n(const struct sh_table *table, const void *key, size_t key_len, void **data);
+
+/* lookup the `data` stored under the pre-hashed key in `handle`, see sh_key_init
+ *
+ * see sh_lookup
+ *
+ * returns 1 if the key was found
+ * returns 0 if the key was not found or on failure
+ */
+unsigned int sh_lookup_k(const struct sh_table *table, const struct sh_key *handle, void **data);
+
+/* get a pointer to the data slot for `key`, inserting it if needed
+ *
+ * if the key is not present a new entry is inserted with data of 0
+ * the caller can then store through the returned pointer
+ *
+ * if `inserted` is not null it is set to 1 if a new entry was inserted
+ * and to 0 if the key was already present
+ *
+ * for SH_BACKEND_CHAINING the returned pointer remains valid until `key`
+ * is deleted or the table is destroyed, the open addressing backends move
+ * entries around so it is only valid until the table is next modified
+ *
+ * this may grow the table, see sh_set_load_factors
+ *
+ * returns a pointer to the data slot on success
+ * returns 0 on failure
+ */
+void ** sh_get_or_insert(struct sh_table *table, const char *key, unsigned int *inserted);
+
+/* get a pointer to the data slot for `key` of `key_len` bytes,
+ * inserting it if needed
+ *
+ * see sh_get_or_insert
+ *
+ * returns a pointer to the data slot on success
+ * returns 0 on failure
+ */
+void ** sh_get_or_insert_n(struct sh_table *table, const void *key, size_t key_len, unsigned int *inserted);
+
+/* get a pointer to the data slot for the pre-hashed key in `handle`,
+ * inserting it if needed
+ *
+ * see sh_get_or_insert
+ *
+ * returns a pointer to the data slot on success
+ * returns 0 on failure
+ */
+void ** sh_get_or_insert_k(struct sh_table *table, const struct sh_key *handle, unsigned int *inserted);
+
+/* delete entry stored under `key`
+ *
+ * this may shrink the table, see sh_set_load_factors
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_delete(struct sh_table *table, const char *key);
+
+/* delete entry stored under `key` of `key_len` bytes
+ *
+ * this may shrink the table, see sh_set_load_factors
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_delete_n(struct sh_table *table, const void *key, size_t key_len);
+
+/* delete entry stored under the pre-hashed key in `handle`, see sh_key_init
+ *
+ * this may shrink the table, see sh_set_load_factors
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_delete_k(struct sh_table *table, const struct sh_key *handle);
+
+/* check for the existence of each of the `n` keys in `keys`
+ *
+ * the keys are looked up SH_BATCH at a time with their memory accesses
+ * overlapped, which is considerably faster than calling sh_exists_n in a
+ * loop once the table no longer fits in cache
+ *
+ * `lens` holds the length of each key, or may be 0 if every key
+ * is null terminated
+ *
+ * if `out_found` is non-zero then out_found[i] is set to 1 if keys[i]
+ * exists and 0 otherwise
+ *
+ * returns the number of keys found on success
+ * returns 0 on failure
+ */
+size_t sh_exists_many(const struct sh_table *table, const void * const *keys, const size_t *lens, size_t n, unsigned int *out_found);
+
+/* get the data stored under each of the `n` keys in `keys`
+ *
+ * see sh_exists_many for how the keys are looked up
+ *
+ * out_values[i] is set to the data stored under keys[i],
+ * or 0 if keys[i] does not exist
+ *
+ * if `out_found` is non-zero then out_found[i] is set to 1 if keys[i]
+ * exists and 0 otherwise, this is only needed if 0 is stored as data
+ *
+ * returns the number of keys found on success
+ * returns 0 on failure
+ */
+size_t sh_get_many(const struct sh_table *table, const void * const *keys, const size_t *lens, size_t n, void **out_values, unsigned int *out_found);
+
+/* delete the entries stored under each of the `n` keys in `keys`
+ *
+ * see sh_exists_many for how the keys are looked up,
+ * keys that do not exist are skipped
+ *
+ * if `out_values` is non-zero then out_values[i] is set to the data that
+ * was stored under keys[i], or 0 if keys[i] did not exist
+ *
+ * if `out_found` is non-zero then out_found[i] is set to 1 if keys[i]
+ * was deleted and 0 otherwise
+ *
+ * this may shrink the table, see sh_set_load_factors
+ *
+ * returns the number of keys deleted on success
+ * returns 0 on failure, keys before the failure may have been deleted
+ */
+size_t sh_delete_many(struct sh_table *table, const void * const *keys, const size_t *lens, size_t n, void **out_values, unsigned int *out_found);
+
+/* insert the `n` keys in `keys` with the data in `values`
+ *
+ * intended for loading a large number of keys at once, this presizes the
+ * table for the new keys (if the load policy allows it to grow) and then
+ * hashes and links them across `n_threads` threads, each owning a disjoint
+ * range of buckets
+ *
+ * only SH_BACKEND_CHAINING links in parallel, the open addressing backends
+ * hash in parallel and then place keys one at a time
+ *
+ * `lens` holds the length of each key, or may be 0 if every key
+ * is null terminated
+ *
+ * `values` may be 0 in which case every key is inserted with 0 data
+ *
+ * if `check_duplicates` is non-zero then any key already in the table, or
+ * appearing earlier in `keys`, is skipped just as sh_insert would,
+ * otherwise the caller guarantees every key is new and unique
+ *
+ * this needs two temporary words of memory per key
+ *
+ * the table must not be used by any other thread during the build,
+ * define SH_NO_THREADS to build without pthreads, in which case
+ * `n_threads` is ignored
+ *
+ * returns the number of keys inserted on success
+ * returns 0 on failure, some of the keys may have been inserted
+ */
+size_t sh_build(struct sh_table *table, const void * const *keys, const size_t *lens, void * const *values, size_t n, unsigned int n_threads, unsigned int check_duplicates);
+
+/* iterate through all key/value pairs in this hash table
+ * calling the provided function on each pair.
+ *
+ * the key is null terminated unless the table borrows keys (see
+ * opts.borrow_keys) and it was inserted unterminated via one of the
+ * _n functions, use sh_iterate_n to be given its length
+ *
+ * the function is allowed to modify the value but cannot modify the key.
+ * the function should not access the hash table in anyway including:
+ *  modifying the hash table other than through the value pointer given
+ *  calling any other hash table functions
+ *
+ * the function will be given the value of the `state` pointer for each call,
+ * this is useful for passing state between calls to the function as well as
  * for returning results
  *
  * the function should return
@@ -185,4 +1005,589 @@ void * sh_delete(struct sh_table *table, const char *key);
  */
 unsigned int sh_iterate(struct sh_table *table, void *state, unsigned int (*each)(void *state, const char *key, void **data));
 
+/* iterate through all key/value pairs in this hash table
+ * calling the provided function on each pair.
+ *
+ * identical to sh_iterate except that the function is also given the
+ * length of each key, which is required for keys containing null bytes
+ *
+ * returns 1 on success
+ * returns 0 on success
+ */
+unsigned int sh_iterate_n(struct sh_table *table, void *state, unsigned int (*each)(void *state, const void *key, size_t key_len, void **data));
+
+/* the number of buckets sh_iterate_range divides a table into
+ *
+ * for SH_BACKEND_CHAINING this includes the buckets not yet moved by an
+ * incremental resize, for the open addressing backends it is the number
+ * of slots
+ *
+ * returns the number of buckets on success
+ * returns 0 on failure
+ */
+size_t sh_nbuckets(const struct sh_table *table);
+
+/* iterate through the key/value pairs in buckets [start, end) of the
+ * buckets counted by sh_nbuckets, calling the provided function on each
+ * pair as for sh_iterate_n
+ *
+ * every entry lives in exactly one bucket, so ranges covering
+ * [0, sh_nbuckets(table)) between them visit every entry exactly once
+ *
+ * disjoint ranges may be iterated at the same time by different threads,
+ * as long as nothing modifies the table meanwhile, so this can be used
+ * to spread iteration over a thread pool of your own
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_iterate_range(struct sh_table *table, size_t start, size_t end, void *state, unsigned int (*each)(void *state, const void *key, size_t key_len, void **data));
+
+/* iterate through all key/value pairs in this hash table
+ * across `n_threads` threads, each visiting a range of buckets
+ *
+ * each thread first calls `state_init(state, thread)` for a state of its
+ * own, `thread` counting up from 0, and then `each` on every pair in its
+ * range with that state as for sh_iterate_n, `each` returning 0 only stops
+ * the thread that called it
+ *
+ * once every thread has finished `reduce(state, thread_state)` is called
+ * for each thread in turn on the calling thread, which is the place to
+ * combine results into `state` and free the thread's state
+ *
+ * `state_init` and `reduce` may be 0, in which case every thread is given
+ * `state` itself and must then only modify it with care
+ *
+ * every entry is visited exactly once, the functions must not modify the
+ * table other than through the value pointers given, and the table must
+ * not be modified by any other thread during the iteration
+ *
+ * with SH_NO_THREADS the ranges are visited one after another on the
+ * calling thread
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_iterate_parallel(struct sh_table *table, unsigned int n_threads, void *state, void * (*state_init)(void *state, size_t thread), unsigned int (*each)(void *state, const void *key, size_t key_len, void **data), void (*reduce)(void *state, void *thread_state));
+
+/* the reason for the most recent failure on the calling thread
+ *
+ * like errno this is only set on failure and never cleared by a successful
+ * call, so it is only meaningful straight after a call has failed,
+ * see sh_clear_error
+ *
+ * with SH_NO_THREADS the error is shared by every thread
+ *
+ * returns the last error, or SH_OK if none
+ */
+enum sh_error sh_last_error(void);
+
+/* reset the last error of the calling thread to SH_OK */
+void sh_clear_error(void);
+
+/* a short description of `error`
+ *
+ * returns a static string, never null
+ */
+const char * sh_strerror(enum sh_error error);
+
+/* install a function to be called with a diagnostic message for every
+ * failure, including failures in internal helpers as they propagate up
+ *
+ * `error` is the failure being reported, `message` names the function and
+ * what went wrong, and `data` is the value given here
+ *
+ * the log is global to the process and is called on whichever thread failed,
+ * it should be set before tables are used from multiple threads
+ *
+ * there is no log by default, pass a null `log` to remove it again
+ */
+void sh_set_log(void (*log)(enum sh_error error, const char *message, void *data), void *data);
+
+
+/* a table split into independent shards by the hash of each key,
+ * each shard with its own reader/writer lock and resized independently,
+ * so any number of threads may share it
+ *
+ * readers of one shard proceed in parallel, writers take only the lock of
+ * the shard they modify
+ *
+ * with SH_NO_THREADS there are no locks and the table is not thread safe
+ */
+struct sh_sharded;
+
+/* create a new sharded table of `n_shards` shards holding `size`
+ * elements between them, each shard configured by `opts`
+ *
+ * `n_shards` is rounded up to a power of two, at most SH_SHARDS_MAX
+ * a null `opts` gives the defaults, as for sh_new
+ *
+ * returns pointer on success
+ * returns 0 on failure
+ */
+struct sh_sharded * sh_sharded_new(size_t n_shards, size_t size, const struct sh_opts *opts);
+
+/* free all resources used by a sharded table
+ * if `free_data` is set then each stored value is also freed
+ *
+ * no other thread may be using the table
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_sharded_destroy(struct sh_sharded *sharded, unsigned int free_data);
+
+/* returns number of elements across every shard
+ *
+ * each shard is counted under its own lock, so with concurrent writers
+ * the total is not a snapshot of any single moment
+ *
+ * returns 0 on failure
+ */
+size_t sh_sharded_nelems(const struct sh_sharded *sharded);
+
+/* check if key exists in sharded table
+ *
+ * returns 1 if key exists
+ * returns 0 if key does not exist or on failure
+ */
+unsigned int sh_sharded_exists(const struct sh_sharded *sharded, const char *key);
+
+/* check if `key` of `key_len` bytes exists in sharded table
+ *
+ * returns 1 if key exists
+ * returns 0 if key does not exist or on failure
+ */
+unsigned int sh_sharded_exists_n(const struct sh_sharded *sharded, const void *key, size_t key_len);
+
+/* insert `data` under `key` into the sharded table
+ *
+ * returns 1 on success
+ * returns 0 on failure, including if key already exists
+ */
+unsigned int sh_sharded_insert(struct sh_sharded *sharded, const char *key, void *data);
+
+/* insert `data` under `key` of `key_len` bytes into the sharded table
+ *
+ * returns 1 on success
+ * returns 0 on failure, including if key already exists
+ */
+unsigned int sh_sharded_insert_n(struct sh_sharded *sharded, const void *key, size_t key_len, void *data);
+
+/* set `key` to `data` in the sharded table, inserting it if absent
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_sharded_set(struct sh_sharded *sharded, const char *key, void *data);
+
+/* set `key` of `key_len` bytes to `data`, inserting it if absent
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_sharded_set_n(struct sh_sharded *sharded, const void *key, size_t key_len, void *data);
+
+/* get `data` stored under `key`
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_sharded_get(const struct sh_sharded *sharded, const char *key);
+
+/* get `data` stored under `key` of `key_len` bytes
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_sharded_get_n(const struct sh_sharded *sharded, const void *key, size_t key_len);
+
+/* delete entry stored under `key`
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_sharded_delete(struct sh_sharded *sharded, const char *key);
+
+/* delete entry stored under `key` of `key_len` bytes
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_sharded_delete_n(struct sh_sharded *sharded, const void *key, size_t key_len);
+
+/* iterate through all key/value pairs in the sharded table
+ * calling the provided function on each pair, as for sh_iterate_n
+ *
+ * each shard is locked for writing while it is visited, so `each` may
+ * modify values, other shards remain available to other threads
+ * and may change before or after they are visited
+ *
+ * the function must not call any sh_sharded function on this table
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_sharded_iterate(struct sh_sharded *sharded, void *state, unsigned int (*each)(void *state, const void *key, size_t key_len, void **data));
+
+
+/* a chained table for read mostly use by many threads, whose readers never
+ * take a lock or wait, even while the table is resized
+ *
+ * writers take a lock between themselves, anything they remove is freed only
+ * once every reader that might still be looking at it has finished
+ *
+ * with SH_NO_THREADS there are no locks and the table is not thread safe
+ */
+struct sh_rcu;
+
+/* create a new table of `size` buckets whose readers take no locks,
+ * configured by `opts`
+ *
+ * `n_slots` is the number of readers that may be inside a call at once
+ * without having to look for a free slot, 0 for 64, and is
+ * rounded up to a power of two
+ *
+ * only opts.hash_fn, opts.seed and opts.borrow_keys are used, the table
+ * is always chained and the other backends and opts.slab are not supported
+ * a null `opts` gives the defaults, as for sh_new
+ *
+ * returns pointer on success
+ * returns 0 on failure
+ */
+struct sh_rcu * sh_rcu_new(size_t size, size_t n_slots, const struct sh_opts *opts);
+
+/* free all resources used by a table made by sh_rcu_new
+ * if `free_data` is set then each stored value is also freed
+ *
+ * no other thread may be using the table
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_rcu_destroy(struct sh_rcu *table, unsigned int free_data);
+
+/* returns number of elements in table
+ *
+ * returns 0 on failure
+ */
+size_t sh_rcu_nelems(const struct sh_rcu *table);
+
+/* check if `key` exists in table, without taking any lock
+ *
+ * returns 1 if key exists
+ * returns 0 if key does not exist or on failure
+ */
+unsigned int sh_rcu_exists(const struct sh_rcu *table, const char *key);
+
+/* check if `key` of `key_len` bytes exists in table, without taking any lock
+ *
+ * returns 1 if key exists
+ * returns 0 if key does not exist or on failure
+ */
+unsigned int sh_rcu_exists_n(const struct sh_rcu *table, const void *key, size_t key_len);
+
+/* get `data` stored under `key`, without taking any lock
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_rcu_get(const struct sh_rcu *table, const char *key);
+
+/* get `data` stored under `key` of `key_len` bytes, without taking any lock
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_rcu_get_n(const struct sh_rcu *table, const void *key, size_t key_len);
+
+/* insert `data` under `key` into table, taking the writer lock
+ *
+ * returns 1 on success
+ * returns 0 on failure, including if key already exists
+ */
+unsigned int sh_rcu_insert(struct sh_rcu *table, const char *key, void *data);
+
+/* insert `data` under `key` of `key_len` bytes into table, taking the writer lock
+ *
+ * returns 1 on success
+ * returns 0 on failure, including if key already exists
+ */
+unsigned int sh_rcu_insert_n(struct sh_rcu *table, const void *key, size_t key_len, void *data);
+
+/* set `key` to `data` in table, inserting it if absent,
+ * taking the writer lock
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_rcu_set(struct sh_rcu *table, const char *key, void *data);
+
+/* set `key` of `key_len` bytes to `data` in table, inserting it if absent,
+ * taking the writer lock
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_rcu_set_n(struct sh_rcu *table, const void *key, size_t key_len, void *data);
+
+/* delete entry stored under `key`, taking the writer lock
+ *
+ * the entry itself is freed once no reader can still be looking at it
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_rcu_delete(struct sh_rcu *table, const char *key);
+
+/* delete entry stored under `key` of `key_len` bytes, taking the writer lock
+ *
+ * the entry itself is freed once no reader can still be looking at it
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_rcu_delete_n(struct sh_rcu *table, const void *key, size_t key_len);
+
+
+/* a table for use by many threads without any locks at all, every
+ * operation completes regardless of what other threads are doing
+ *
+ * the table grows as needed without moving any entry or stopping other
+ * threads, removed entries are freed once no thread can still be looking
+ * at them
+ *
+ * with SH_NO_THREADS the table is not thread safe
+ */
+struct sh_lf;
+
+/* create a new lock free table starting with `size` buckets,
+ * configured by `opts`
+ *
+ * `n_slots` is the number of threads that may be inside a call at once
+ * without having to look for a free slot, 0 for 64, and is
+ * rounded up to a power of two
+ *
+ * only opts.hash_fn and opts.seed are used, keys are always copied and
+ * the other backends, opts.slab and opts.borrow_keys are not supported
+ * a null `opts` gives the defaults, as for sh_new
+ *
+ * returns pointer on success
+ * returns 0 on failure
+ */
+struct sh_lf * sh_lf_new(size_t size, size_t n_slots, const struct sh_opts *opts);
+
+/* free all resources used by a table made by sh_lf_new
+ * if `free_data` is set then each stored value is also freed
+ *
+ * no other thread may be using the table
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_lf_destroy(struct sh_lf *table, unsigned int free_data);
+
+/* returns number of elements in table
+ *
+ * returns 0 on failure
+ */
+size_t sh_lf_nelems(const struct sh_lf *table);
+
+/* check if `key` exists in table
+ *
+ * returns 1 if key exists
+ * returns 0 if key does not exist or on failure
+ */
+unsigned int sh_lf_exists(struct sh_lf *table, const char *key);
+
+/* check if `key` of `key_len` bytes exists in table
+ *
+ * returns 1 if key exists
+ * returns 0 if key does not exist or on failure
+ */
+unsigned int sh_lf_exists_n(struct sh_lf *table, const void *key, size_t key_len);
+
+/* get `data` stored under `key`
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_lf_get(struct sh_lf *table, const char *key);
+
+/* get `data` stored under `key` of `key_len` bytes
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_lf_get_n(struct sh_lf *table, const void *key, size_t key_len);
+
+/* insert `data` under `key` into table
+ *
+ * returns 1 on success
+ * returns 0 on failure, including if key already exists
+ */
+unsigned int sh_lf_insert(struct sh_lf *table, const char *key, void *data);
+
+/* insert `data` under `key` of `key_len` bytes into table
+ *
+ * returns 1 on success
+ * returns 0 on failure, including if key already exists
+ */
+unsigned int sh_lf_insert_n(struct sh_lf *table, const void *key, size_t key_len, void *data);
+
+/* set `key` to `data` in table, inserting it if absent
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_lf_set(struct sh_lf *table, const char *key, void *data);
+
+/* set `key` of `key_len` bytes to `data` in table, inserting it if absent
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_lf_set_n(struct sh_lf *table, const void *key, size_t key_len, void *data);
+
+/* delete entry stored under `key`
+ *
+ * the entry itself is freed once no thread can still be looking at it
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_lf_delete(struct sh_lf *table, const char *key);
+
+/* delete entry stored under `key` of `key_len` bytes
+ *
+ * the entry itself is freed once no thread can still be looking at it
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_lf_delete_n(struct sh_lf *table, const void *key, size_t key_len);
+
+
+/* a sh_table shared between threads by flat combining, for heavily
+ * contended updates
+ *
+ * each call publishes its request and waits, one thread at a time applies
+ * every published request to the table in a single pass
+ *
+ * any sh_opts may be used, errors of a request are recorded for the thread
+ * that made it, though sh_set_log is called from whichever thread applied it
+ *
+ * with SH_NO_THREADS there are no locks and the table is not thread safe
+ */
+struct sh_fc;
+
+/* create a new table of `size` buckets shared between threads by flat
+ * combining, configured by `opts` as for sh_new_opts
+ *
+ * `n_slots` is the number of threads that may have a request published at
+ * once without having to look for a free slot, 0 for 64, and is
+ * rounded up to a power of two
+ *
+ * returns pointer on success
+ * returns 0 on failure
+ */
+struct sh_fc * sh_fc_new(size_t size, size_t n_slots, const struct sh_opts *opts);
+
+/* free all resources used by a table made by sh_fc_new
+ * if `free_data` is set then each stored value is also freed
+ *
+ * no other thread may be using the table
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_fc_destroy(struct sh_fc *fc, unsigned int free_data);
+
+/* the sh_table underneath `fc`, for use with the plain sh_ functions
+ * while no other thread is using `fc`
+ *
+ * sh_fc_nelems only catches up with changes made this way once the next
+ * request through `fc` has been applied
+ *
+ * returns pointer on success
+ * returns 0 on failure
+ */
+struct sh_table * sh_fc_table(struct sh_fc *fc);
+
+/* returns number of elements in table
+ *
+ * returns 0 on failure
+ */
+size_t sh_fc_nelems(const struct sh_fc *fc);
+
+/* check if `key` exists in table
+ *
+ * returns 1 if key exists
+ * returns 0 if key does not exist or on failure
+ */
+unsigned int sh_fc_exists(struct sh_fc *fc, const char *key);
+
+/* check if `key` of `key_len` bytes exists in table
+ *
+ * returns 1 if key exists
+ * returns 0 if key does not exist or on failure
+ */
+unsigned int sh_fc_exists_n(struct sh_fc *fc, const void *key, size_t key_len);
+
+/* get `data` stored under `key`
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_fc_get(struct sh_fc *fc, const char *key);
+
+/* get `data` stored under `key` of `key_len` bytes
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_fc_get_n(struct sh_fc *fc, const void *key, size_t key_len);
+
+/* insert `data` under `key` into table
+ *
+ * returns 1 on success
+ * returns 0 on failure, including if key already exists
+ */
+unsigned int sh_fc_insert(struct sh_fc *fc, const char *key, void *data);
+
+/* insert `data` under `key` of `key_len` bytes into table
+ *
+ * returns 1 on success
+ * returns 0 on failure, including if key already exists
+ */
+unsigned int sh_fc_insert_n(struct sh_fc *fc, const void *key, size_t key_len, void *data);
+
+/* set `key` to `data` in table, inserting it if absent
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_fc_set(struct sh_fc *fc, const char *key, void *data);
+
+/* set `key` of `key_len` bytes to `data` in table, inserting it if absent
+ *
+ * returns 1 on success
+ * returns 0 on failure
+ */
+unsigned int sh_fc_set_n(struct sh_fc *fc, const void *key, size_t key_len, void *data);
+
+/* delete entry stored under `key`
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_fc_delete(struct sh_fc *fc, const char *key);
+
+/* delete entry stored under `key` of `key_len` bytes
+ *
+ * returns data on success
+ * returns 0 on failure
+ */
+void * sh_fc_delete_n(struct sh_fc *fc, const void *key, size_t key_len);
+
 #endif /* ifndef SIMPLE_HASH_H */
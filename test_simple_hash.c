@@ -2,21 +2,38 @@
  * ./test_sh
  */
 #include <assert.h> /* assert */
+#include <math.h> /* HUGE_VAL */
 #include <stdio.h> /* puts */
 #include <stdlib.h> /* calloc */
 #include <string.h> /* strlen */
 
+#ifndef SH_NO_THREADS
+#include <pthread.h> /* pthread_create, pthread_join */
+#endif
+
 #include "simple_hash.h"
 
 /* headers for internal functions within simple_hash.c
  * that are not exposed via the header
  * these would be static but we want to be able to test them
  */
-char * sh_strdupn(char *str, size_t len);
-unsigned int sh_entry_init(struct sh_entry *entry, unsigned long int hash, char *key, size_t key_len, void *data, struct sh_entry *next);
-struct sh_entry * sh_entry_new(unsigned long int hash, char *key, size_t key_len, void *data, struct sh_entry *next);
-unsigned int sh_entry_destroy(struct sh_entry *entry, unsigned int free_entry, unsigned int free_data);
+struct sh_slab * sh_slab_new(void);
+void * sh_slab_alloc(struct sh_slab *slab, size_t size);
+void sh_slab_free(struct sh_slab *slab, void *ptr, size_t size);
+void sh_slab_destroy(struct sh_slab *slab);
+char * sh_strdupn(struct sh_slab *slab, char *str, size_t len);
+unsigned int sh_entry_init(struct sh_slab *slab, struct sh_entry *entry, unsigned long int hash, char *key, size_t key_len, void *data, struct sh_entry *next, unsigned int borrow_key);
+struct sh_entry * sh_entry_new(struct sh_slab *slab, unsigned long int hash, char *key, size_t key_len, void *data, struct sh_entry *next, unsigned int borrow_key);
+unsigned int sh_entry_destroy(struct sh_slab *slab, struct sh_entry *entry, unsigned int free_entry, unsigned int free_data, unsigned int free_key);
+unsigned int sh_entry_key_inline(const struct sh_entry *entry);
+uint64_t sh_fingerprint(unsigned long int hash);
 struct sh_entry * sh_find_entry(struct sh_table *table, char *key);
+size_t sh_round_size(const struct sh_table *table, size_t size);
+size_t sh_rh_distance(const struct sh_entry *slots, size_t size, size_t pos);
+unsigned char sh_sw_h2(unsigned long int hash);
+unsigned int sh_sw_match(const unsigned char *ctrl, unsigned char byte);
+unsigned int sh_sw_match_free(const unsigned char *ctrl);
+uint64_t sh_lf_reverse(uint64_t n);
 
 
 void new_insert_get_destroy(void){
@@ -58,6 +75,9 @@ void new_insert_get_destroy(void){
     assert(data);
     assert( data_1 == *data );
 
+    /* the key is stored directly after its entry */
+    assert( sh_entry_key_inline(sh_find_entry(table, key_1)) );
+
 
     puts("two insert");
     assert( sh_insert(table, key_2, &data_2) );
@@ -377,6 +397,478 @@ void delete(void){
     puts("success!");
 }
 
+void lookup(void){
+    /* our simple hash table */
+    struct sh_table *table = 0;
+
+    /* some keys */
+    char *key_1 = "apple";
+    char *key_2 = "banana";
+    char *key_3 = "cherry";
+
+    /* some data */
+    int data_1 = 1;
+
+    /* data returned from lookup */
+    void *data = 0;
+    /* slot returned from get_or_insert */
+    void **slot = 0;
+    void **slot_again = 0;
+    /* did get_or_insert insert */
+    unsigned int inserted = 0;
+
+    puts("\ntesting lookup and get_or_insert");
+
+    puts("creating table");
+    table = sh_new(32);
+    assert(table);
+
+    puts("testing lookup distinguishes missing from null data");
+    assert( sh_insert(table, key_1, 0) );
+    data = &data_1;
+    assert( sh_lookup(table, key_1, &data) );
+    assert( 0 == data );
+    assert( 0 == sh_lookup(table, key_2, &data) );
+    /* out param is optional */
+    assert( sh_lookup(table, key_1, 0) );
+
+    puts("testing set over null data");
+    assert( sh_set(table, key_1, &data_1) );
+    assert( sh_lookup(table, key_1, &data) );
+    assert( &data_1 == data );
+    assert( sh_set(table, key_1, 0) );
+    assert( sh_lookup(table, key_1, &data) );
+    assert( 0 == data );
+    assert( 1 == sh_nelems(table) );
+
+    puts("testing get_or_insert on a new key");
+    slot = sh_get_or_insert(table, key_2, &inserted);
+    assert( slot );
+    assert( 1 == inserted );
+    assert( 0 == *slot );
+    assert( 2 == sh_nelems(table) );
+    *slot = &data_1;
+    assert( &data_1 == sh_get(table, key_2) );
+
+    puts("testing get_or_insert on an existing key");
+    slot_again = sh_get_or_insert(table, key_2, &inserted);
+    assert( slot == slot_again );
+    assert( 0 == inserted );
+    assert( &data_1 == *slot_again );
+    assert( 2 == sh_nelems(table) );
+
+    /* inserted is optional */
+    slot = sh_get_or_insert(table, key_3, 0);
+    assert( slot );
+    assert( 0 == *slot );
+    assert( 3 == sh_nelems(table) );
+
+    assert( sh_destroy(table, 1, 0) );
+    puts("success!");
+}
+
+/* function used by our binary_keys test below */
+unsigned int iterate_sum_n(void *state, const void *key, size_t key_len, void **data){
+    size_t *sums = state;
+
+    assert(sums);
+    assert(key);
+    assert(data);
+
+    sums[0] += key_len;
+    sums[1] += 1;
+
+    return 1;
+}
+
+void binary_keys(void){
+    /* our simple hash table */
+    struct sh_table *table = 0;
+
+    /* some keys which only differ after an embedded null */
+    const char key_1[] = { 'a', '\0', 'b' };
+    const char key_2[] = { 'a', '\0', 'c' };
+    /* a key which is a prefix of the above */
+    const char *key_3 = "a";
+    /* and the empty key */
+    const char *key_4 = "";
+
+    /* some data */
+    int data_1 = 1;
+    int data_2 = 2;
+    int data_3 = 3;
+    int data_4 = 4;
+
+    /* data returned from lookup */
+    void *data = 0;
+    /* slot returned from get_or_insert */
+    void **slot = 0;
+    /* did get_or_insert insert */
+    unsigned int inserted = 0;
+
+    /* the value we pass to our iterate_sum_n function
+     * the first element [0] is used for summing the length of keys
+     * the second element [1] is used to count the number of times called
+     */
+    size_t sums[] = { 0, 0 };
+
+    puts("\ntesting length explicit binary keys");
+
+    puts("creating table");
+    table = sh_new(32);
+    assert(table);
+
+    puts("testing insert_n and get_n");
+    assert( sh_insert_n(table, key_1, sizeof key_1, &data_1) );
+    assert( sh_insert_n(table, key_2, sizeof key_2, &data_2) );
+    assert( sh_insert_n(table, key_3, 1, &data_3) );
+    assert( sh_insert_n(table, key_4, 0, &data_4) );
+    assert( 4 == sh_nelems(table) );
+
+    /* no duplicates */
+    assert( 0 == sh_insert_n(table, key_1, sizeof key_1, &data_1) );
+    assert( 0 == sh_insert_n(table, key_4, 0, &data_4) );
+
+    assert( &data_1 == sh_get_n(table, key_1, sizeof key_1) );
+    assert( &data_2 == sh_get_n(table, key_2, sizeof key_2) );
+    assert( &data_3 == sh_get_n(table, key_3, 1) );
+    assert( &data_4 == sh_get_n(table, key_4, 0) );
+
+    puts("testing the char* api sees the same keys");
+    assert( &data_3 == sh_get(table, key_3) );
+    assert( &data_4 == sh_get(table, key_4) );
+    /* a prefix of a stored key is a different key */
+    assert( 0 == sh_get_n(table, "a\0", 2) );
+    assert( sh_exists_n(table, "ab", 1) );
+    assert( 0 == sh_exists_n(table, "ab", 2) );
+
+    puts("testing lookup_n");
+    assert( sh_lookup_n(table, key_2, sizeof key_2, &data) );
+    assert( &data_2 == data );
+    assert( 0 == sh_lookup_n(table, "b", 1, &data) );
+
+    puts("testing update_n and set_n");
+    assert( &data_1 == sh_update_n(table, key_1, sizeof key_1, &data_2) );
+    assert( &data_2 == sh_get_n(table, key_1, sizeof key_1) );
+    assert( sh_set_n(table, key_1, sizeof key_1, &data_1) );
+    assert( &data_1 == sh_get_n(table, key_1, sizeof key_1) );
+    assert( sh_set_n(table, "b\0", 2, &data_1) );
+    assert( 5 == sh_nelems(table) );
+
+    puts("testing get_or_insert_n");
+    slot = sh_get_or_insert_n(table, key_2, sizeof key_2, &inserted);
+    assert( slot );
+    assert( 0 == inserted );
+    assert( &data_2 == *slot );
+
+    puts("testing iterate_n");
+    assert( sh_iterate_n(table, sums, iterate_sum_n) );
+    assert( 3 + 3 + 1 + 0 + 2 == sums[0] );
+    assert( 5 == sums[1] );
+
+    puts("testing delete_n");
+    assert( &data_1 == sh_delete_n(table, key_1, sizeof key_1) );
+    assert( 0 == sh_get_n(table, key_1, sizeof key_1) );
+    assert( &data_2 == sh_get_n(table, key_2, sizeof key_2) );
+    assert( &data_4 == sh_delete_n(table, key_4, 0) );
+    assert( 0 == sh_delete_n(table, key_4, 0) );
+    assert( 3 == sh_nelems(table) );
+
+    assert( sh_destroy(table, 1, 0) );
+    puts("success!");
+}
+
+void prehashed(void){
+    /* a table per tenant */
+    struct sh_table *table_1 = 0;
+    struct sh_table *table_2 = 0;
+
+    /* our key handles */
+    struct sh_key handle_1;
+    struct sh_key handle_2;
+
+    /* some keys */
+    char *key_1 = "shared";
+    char *key_2 = "other";
+
+    /* some data */
+    int data_1 = 1;
+    int data_2 = 2;
+
+    /* data returned from lookup */
+    void *data = 0;
+    /* slot returned from get_or_insert */
+    void **slot = 0;
+    /* did get_or_insert insert */
+    unsigned int inserted = 0;
+
+    puts("\ntesting pre-hashed key handles");
+
+    puts("creating tables");
+    table_1 = sh_new(32);
+    assert(table_1);
+    table_2 = sh_new(7);
+    assert(table_2);
+
+    puts("testing sh_key_init");
+    assert( sh_key_init(&handle_1, key_1, strlen(key_1)) );
+    assert( handle_1.key == key_1 );
+    assert( handle_1.key_len == strlen(key_1) );
+    assert( handle_1.hash == sh_hash(key_1, strlen(key_1)) );
+    assert( sh_key_init(&handle_2, key_2, strlen(key_2)) );
+
+    puts("testing one handle across several tables");
+    assert( sh_insert_k(table_1, &handle_1, &data_1) );
+    assert( sh_insert_k(table_2, &handle_1, &data_2) );
+    assert( 0 == sh_insert_k(table_1, &handle_1, &data_1) );
+    assert( sh_exists_k(table_1, &handle_1) );
+    assert( sh_exists_k(table_2, &handle_1) );
+    assert( 0 == sh_exists_k(table_1, &handle_2) );
+    assert( &data_1 == sh_get_k(table_1, &handle_1) );
+    assert( &data_2 == sh_get_k(table_2, &handle_1) );
+
+    puts("testing handles and plain keys find the same entries");
+    assert( &data_1 == sh_get(table_1, key_1) );
+    assert( sh_insert(table_2, key_2, &data_1) );
+    assert( &data_1 == sh_get_k(table_2, &handle_2) );
+
+    puts("testing modification through handles");
+    assert( &data_1 == sh_update_k(table_1, &handle_1, &data_2) );
+    assert( sh_lookup_k(table_1, &handle_1, &data) );
+    assert( &data_2 == data );
+    assert( sh_set_k(table_1, &handle_2, &data_1) );
+    assert( 2 == sh_nelems(table_1) );
+
+    slot = sh_get_or_insert_k(table_1, &handle_2, &inserted);
+    assert( slot );
+    assert( 0 == inserted );
+    assert( &data_1 == *slot );
+
+    assert( &data_2 == sh_delete_k(table_1, &handle_1) );
+    assert( 0 == sh_delete_k(table_1, &handle_1) );
+    assert( 0 == sh_lookup_k(table_1, &handle_1, &data) );
+    assert( &data_2 == sh_get_k(table_2, &handle_1) );
+
+    assert( sh_destroy(table_1, 1, 0) );
+    assert( sh_destroy(table_2, 1, 0) );
+    puts("success!");
+}
+
+void hash_functions(void){
+    /* our tables, one per hash function */
+    struct sh_table *table = 0;
+    struct sh_table *other = 0;
+    /* options to create them with */
+    struct sh_opts opts;
+    /* the functions under test */
+    unsigned long int (*fns[])(const void *key, size_t key_len, const uint64_t seed[2]) = {
+        sh_hash_djb2,
+        sh_hash_xxh64,
+        sh_hash_siphash,
+    };
+    /* iterator through fns */
+    unsigned int f = 0;
+
+    /* the seed used by the siphash reference test vectors, bytes 00..0f */
+    uint64_t sip_seed[2] = {
+        UINT64_C(0x0706050403020100),
+        UINT64_C(0x0f0e0d0c0b0a0908),
+    };
+    uint64_t zero_seed[2] = { 0, 0 };
+    /* message bytes 00..3e */
+    unsigned char msg[63];
+
+    /* some keys, long enough to use every path through xxh64 */
+    char *keys[] = {
+        "",
+        "a",
+        "abcd",
+        "abcdefgh",
+        "abcdefghijklm",
+        "Nobody inspects the spammish repetition",
+        "a somewhat longer key which spans more than one 32 byte stripe of input",
+    };
+    /* iterator through keys */
+    unsigned int i = 0;
+    /* some data */
+    int data = 1;
+
+    /* our key handle */
+    struct sh_key handle;
+
+    puts("\ntesting hash functions");
+
+    for( i=0; i<sizeof msg; ++i ){
+        msg[i] = i;
+    }
+
+    puts("testing sh_hash_djb2 matches sh_hash");
+    assert( sh_hash("hello", 5) == sh_hash_djb2("hello", 5, zero_seed) );
+    assert( sh_hash_n("hello", 5) == sh_hash_djb2("hello", 5, zero_seed) );
+
+    if( sizeof(unsigned long int) >= 8 ){
+        puts("testing sh_hash_xxh64 against reference values");
+        assert( UINT64_C(0xef46db3751d8e999) == sh_hash_xxh64("", 0, zero_seed) );
+        assert( UINT64_C(0x44bc2cf5ad770999) == sh_hash_xxh64("abc", 3, zero_seed) );
+        assert( UINT64_C(0xfbcea83c8a378bf1) == sh_hash_xxh64(keys[5], strlen(keys[5]), zero_seed) );
+
+        puts("testing sh_hash_siphash against reference values");
+        assert( UINT64_C(0x726fdb47dd0e0e31) == sh_hash_siphash(msg, 0, sip_seed) );
+        assert( UINT64_C(0xa129ca6149be45e5) == sh_hash_siphash(msg, 15, sip_seed) );
+        assert( UINT64_C(0x958a324ceb064572) == sh_hash_siphash(msg, 63, sip_seed) );
+    }
+
+    puts("testing seeds change the hash");
+    assert( sh_hash_xxh64("hello", 5, zero_seed) != sh_hash_xxh64("hello", 5, sip_seed) );
+    assert( sh_hash_siphash("hello", 5, zero_seed) != sh_hash_siphash("hello", 5, sip_seed) );
+
+    puts("testing tables using each hash function");
+    for( f=0; f<sizeof fns / sizeof fns[0]; ++f ){
+        memset(&opts, 0, sizeof opts);
+        opts.hash_fn = fns[f];
+        opts.seed[0] = 1234;
+        opts.seed[1] = 5678;
+
+        table = sh_new_opts(4, &opts);
+        assert(table);
+        assert( fns[f] == table->hash_fn );
+
+        for( i=0; i<sizeof keys / sizeof keys[0]; ++i ){
+            assert( sh_insert(table, keys[i], &data) );
+        }
+        assert( sizeof keys / sizeof keys[0] == sh_nelems(table) );
+
+        /* growth rehashes with the stored hashes */
+        assert( table->size > 4 );
+
+        for( i=0; i<sizeof keys / sizeof keys[0]; ++i ){
+            assert( &data == sh_get(table, keys[i]) );
+            assert( &data == sh_get_n(table, keys[i], strlen(keys[i])) );
+        }
+
+        puts("testing handles hashed for a table with a different seed");
+        opts.seed[0] = 4321;
+        other = sh_new_opts(4, &opts);
+        assert(other);
+        assert( sh_key_init_for(&handle, other, keys[5], strlen(keys[5])) );
+        assert( &data == sh_get_k(table, &handle) );
+        assert( 0 == sh_get_k(other, &handle) );
+        assert( sh_insert_k(other, &handle, &data) );
+        assert( &data == sh_get(other, keys[5]) );
+
+        /* and the default hash */
+        assert( sh_key_init(&handle, keys[6], strlen(keys[6])) );
+        assert( &data == sh_delete_k(table, &handle) );
+        assert( 0 == sh_get(table, keys[6]) );
+
+        assert( sh_destroy(other, 1, 0) );
+        assert( sh_destroy(table, 1, 0) );
+    }
+
+    puts("testing a null opts gives the defaults");
+    table = sh_new_opts(4, 0);
+    assert(table);
+    assert( sh_hash_djb2 == table->hash_fn );
+    assert( sh_destroy(table, 1, 0) );
+
+    puts("success!");
+}
+
+void power_of_two(void){
+    /* our simple hash table */
+    struct sh_table *table = 0;
+    /* options to create it with */
+    struct sh_opts opts;
+
+    /* buffer for generated keys */
+    char key[32];
+    /* iterator through keys */
+    unsigned int i = 0;
+    /* some data */
+    int data = 1;
+
+    /* a histogram of buckets used by sequential hashes */
+    unsigned int used[64];
+    /* number of distinct buckets seen */
+    unsigned int n_used = 0;
+    /* a bucket position */
+    size_t pos = 0;
+
+    puts("\ntesting power of two tables");
+
+    puts("testing sh_pos_pow2 spreads sequential hashes");
+    memset(used, 0, sizeof used);
+    for( i=0; i<64; ++i ){
+        /* sequential hashes differing only in their high bits */
+        pos = sh_pos_pow2(((unsigned long int) i) << 20, 64);
+        assert( pos < 64 );
+        if( ! used[pos] ){
+            ++n_used;
+        }
+        used[pos] = 1;
+    }
+    /* a plain mask would put every one of these in bucket 0 */
+    assert( n_used > 32 );
+
+    puts("testing sizes are rounded up");
+    memset(&opts, 0, sizeof opts);
+    opts.pow2 = 1;
+    table = sh_new_opts(100, &opts);
+    assert(table);
+    assert( 128 == table->size );
+    assert( 128 == table->min_size );
+
+    assert( 1 == sh_round_size(table, 1) );
+    assert( 64 == sh_round_size(table, 64) );
+    assert( 128 == sh_round_size(table, 65) );
+    assert( 0 == sh_round_size(table, SIZE_MAX) );
+
+    puts("testing growth keeps a power of two");
+    for( i=0; i<200; ++i ){
+        sprintf(key, "key%u", i);
+        assert( sh_insert(table, key, &data) );
+    }
+    assert( 200 == sh_nelems(table) );
+    assert( 512 == table->size );
+
+    for( i=0; i<200; ++i ){
+        sprintf(key, "key%u", i);
+        assert( &data == sh_get(table, key) );
+    }
+
+    puts("testing resize rounds up");
+    assert( sh_resize(table, 1000) );
+    assert( 1024 == table->size );
+    assert( 0 == sh_resize(table, SIZE_MAX) );
+    assert( 1024 == table->size );
+
+    puts("testing incremental resizing and shrinking");
+    assert( sh_set_incremental(table, 4) );
+    assert( sh_set_load_factors(table, 0.75, 0.1) );
+    for( i=0; i<190; ++i ){
+        sprintf(key, "key%u", i);
+        assert( &data == sh_delete(table, key) );
+    }
+    assert( 10 == sh_nelems(table) );
+    assert( 128 == table->size );
+
+    for( i=190; i<200; ++i ){
+        sprintf(key, "key%u", i);
+        assert( &data == sh_get(table, key) );
+    }
+
+    assert( sh_destroy(table, 1, 0) );
+
+    puts("testing the default is not a power of two");
+    table = sh_new(100);
+    assert(table);
+    assert( 100 == table->size );
+    assert( 100 == sh_round_size(table, 100) );
+    assert( sh_destroy(table, 1, 0) );
+
+    puts("success!");
+}
+
 void collision(void){
     /* our simple hash table */
     struct sh_table *table = 0;
@@ -649,152 +1141,2555 @@ void resize(void){
     puts("success!");
 }
 
-void destroy(void){
-    /* specifically test sh_destroy with free_data = 1 */
-
+void load_factor(void){
     /* our simple hash table */
     struct sh_table *table = 0;
 
     /* some keys */
-    char *key_1 = "bbbbb";
-    char *key_2 = "aaaaa";
-    char *key_3 = "ccccc";
+    char *keys[] = {
+        "one", "two", "three", "four", "five",
+        "six", "seven", "eight", "nine", "ten",
+    };
+    /* iterator through keys */
+    unsigned int i = 0;
 
     /* some data */
-    int *data_1 = 0;
-    int *data_2 = 0;
-    int *data_3 = 0;
+    int data = 1;
 
-    /* temporary data pointer used for testing get */
-    int *data = 0;
+    /* load factors read back from the table */
+    double max_load = 0;
+    double min_load = 0;
 
-    data_1 = calloc(1, sizeof(int));
-    assert( data_1 );
-    *data_1 = 1;
+    /* open addressing tables, their backend, keys and sizes */
+    struct sh_opts opts;
+    int backend = 0;
+    char key[16];
+    size_t size = 0;
 
-    data_2 = calloc(1, sizeof(int));
-    assert( data_2 );
-    *data_2 = 2;
+    puts("\ntesting load factor driven resizing");
 
-    data_3 = calloc(1, sizeof(int));
-    assert( data_3 );
-    *data_3 = 3;
+    puts("creating table");
+    table = sh_new(4);
+    assert(table);
+    assert( 4 == table->size );
+
+    puts("testing default policy");
+    assert( sh_get_load_factors(table, &max_load, &min_load) );
+    assert( SH_DEFAULT_MAX_LOAD == max_load );
+    assert( SH_DEFAULT_MIN_LOAD == min_load );
+    /* either out param may be null */
+    assert( sh_get_load_factors(table, 0, 0) );
+
+    puts("testing automatic growth");
+    /* 0.75 * 4 = 3, so we can hold 3 elements before growing */
+    for( i=0; i<3; ++i ){
+        assert( sh_insert(table, keys[i], &data) );
+        assert( 4 == table->size );
+    }
+    assert( sh_insert(table, keys[3], &data) );
+    assert( 8 == table->size );
+    assert( 4 == sh_nelems(table) );
 
+    /* set also grows */
+    for( i=4; i<7; ++i ){
+        assert( sh_set(table, keys[i], &data) );
+    }
+    assert( 16 == table->size );
+    assert( 7 == sh_nelems(table) );
 
-    puts("\ntesting destroy");
+    for( i=0; i<7; ++i ){
+        assert( &data == sh_get(table, keys[i]) );
+    }
 
-    puts("creating table");
-    table = sh_new(32);
-    assert(table);
-    assert( 32 == table->size );
-    assert( 0 == sh_nelems(table) );
+    puts("testing invalid policies are rejected");
+    assert( 0 == sh_set_load_factors(table, -1, 0) );
+    assert( 0 == sh_set_load_factors(table, 0.75, -1) );
+    /* min must be at most max / 4 */
+    assert( 0 == sh_set_load_factors(table, 0.75, 0.5) );
+    assert( sh_get_load_factors(table, &max_load, &min_load) );
+    assert( SH_DEFAULT_MAX_LOAD == max_load );
+    assert( SH_DEFAULT_MIN_LOAD == min_load );
+
+    puts("testing automatic shrinking");
+    assert( sh_set_load_factors(table, 1, 0.25) );
+    assert( sh_get_load_factors(table, &max_load, &min_load) );
+    assert( 1 == max_load );
+    assert( 0.25 == min_load );
+
+    /* 0.25 * 16 = 4, deleting down to 3 halves us */
+    for( i=0; i<4; ++i ){
+        assert( &data == sh_delete(table, keys[i]) );
+    }
+    assert( 8 == table->size );
+    assert( 3 == sh_nelems(table) );
 
+    puts("testing hysteresis near a threshold");
+    /* 1 * 8 = 8 grows, 0.25 * 8 = 2 shrinks
+     * alternating around either should not resize
+     */
+    for( i=0; i<10; ++i ){
+        assert( sh_insert(table, keys[0], &data) );
+        assert( &data == sh_delete(table, keys[0]) );
+    }
+    assert( 8 == table->size );
 
-    puts("populating");
-    assert( sh_insert(table, key_1, data_1) );
-    assert( 1 == sh_nelems(table) );
-    assert( 0 == sh_get(table, key_2) );
-    assert( 0 == sh_get(table, key_3) );
-    data = sh_get(table, key_1);
-    assert(data);
-    assert( *data_1 == *data );
+    /* never shrink below the size we were created with */
+    for( i=4; i<7; ++i ){
+        assert( &data == sh_delete(table, keys[i]) );
+    }
+    assert( 4 == table->size );
+    assert( 0 == sh_nelems(table) );
 
+    puts("testing huge load factors never grow");
+    assert( sh_set_load_factors(table, 1e30, 0) );
+    assert( SIZE_MAX == table->grow_at );
+    assert( sh_set_load_factors(table, HUGE_VAL, 0) );
+    assert( SIZE_MAX == table->grow_at );
+    assert( 0 == table->shrink_at );
+
+    puts("testing disabling automatic resizing");
+    assert( sh_set_load_factors(table, 0, 0) );
+    for( i=0; i<10; ++i ){
+        assert( sh_insert(table, keys[i], &data) );
+    }
+    assert( 4 == table->size );
+    assert( 10 == sh_nelems(table) );
+    for( i=0; i<10; ++i ){
+        assert( &data == sh_get(table, keys[i]) );
+    }
 
-    assert( sh_insert(table, key_2, data_2) );
-    assert( 2 == sh_nelems(table) );
-    assert( 0 == sh_get(table, key_3) );
-    data = sh_get(table, key_2);
-    assert(data);
-    assert( *data_2 == *data );
+    assert( sh_destroy(table, 1, 0) );
+    puts("testing open addressing checks min_load against its cap");
+    for( backend=SH_BACKEND_ROBIN_HOOD; backend<=SH_BACKEND_SWISS; ++backend ){
+        memset(&opts, 0, sizeof opts);
+        opts.backend = backend;
+        table = sh_new_opts(8, &opts);
+        assert(table);
+
+        /* these grow at the cap, not at max_load */
+        assert( 0 == sh_set_load_factors(table, 4.0, 1.0) );
+        assert( 0 == sh_set_load_factors(table, 0, 0.25) );
+        assert( sh_set_load_factors(table, 4.0, 0.2) );
+
+        /* alternating near the grow threshold does not resize */
+        for( i=0; i<28; ++i ){
+            sprintf(key, "key%u", i);
+            assert( sh_insert(table, key, &data) );
+        }
+        size = table->size;
+        assert( 32 == size );
+        for( i=0; i<1000; ++i ){
+            assert( &data == sh_delete(table, "key0") );
+            assert( sh_insert(table, "key0", &data) );
+            assert( size == table->size );
+        }
+
+        /* nor does alternating just after a shrink */
+        for( i=27; size == table->size; --i ){
+            sprintf(key, "key%u", i);
+            assert( &data == sh_delete(table, key) );
+        }
+        size = table->size;
+        for( i=0; i<1000; ++i ){
+            assert( sh_insert(table, "extra", &data) );
+            assert( &data == sh_delete(table, "extra") );
+            assert( size == table->size );
+        }
+
+        assert( sh_destroy(table, 1, 0) );
+    }
+
+    puts("success!");
+}
 
+/* function used by our incremental test below */
+unsigned int iterate_count(void *state, const char *key, void **data){
+    unsigned int *count = state;
 
-    assert( sh_insert(table, key_3, data_3) );
-    assert( 3 == sh_nelems(table) );
-    data = sh_get(table, key_3);
+    assert(count);
+    assert(key);
     assert(data);
-    assert( *data_3 == *data );
 
+    ++(*count);
 
-    /* destroy including all data */
-    assert( sh_destroy(table, 1, 1) );
-    puts("success!");
+    return 1;
 }
 
-void error_handling(void){
+void incremental(void){
     /* our simple hash table */
     struct sh_table *table = 0;
-    struct sh_table *not_table = 0;
-    struct sh_table static_table;
 
     /* some keys */
-    char *key_1 = "bbbbb";
-    char *key_2 = "aaaaa";
-    char *key_3 = "ccccc";
+    char *keys[] = {
+        "one", "two", "three", "four", "five", "six",
+    };
+    /* iterator through keys */
+    unsigned int i = 0;
 
     /* some data */
-    int data_1 = 1;
-    int data_2 = 2;
-    int data_3 = 3;
-
-    /* temporary data pointer used for testing get */
-    int *data = 0;
-
-
-    puts("\ntesting handling of error cases");
+    int data = 1;
+    int new_data = 2;
 
-    puts("testing sh_nelems");
-    assert( 0 == sh_nelems(0) );
+    /* number of entries seen by sh_iterate */
+    unsigned int count = 0;
 
-    puts("setting up...");
+    puts("\ntesting incremental resizing");
 
     puts("creating table");
-    table = sh_new(3);
+    table = sh_new(8);
     assert(table);
-    assert( 3 == table->size );
-    assert( 0 == sh_nelems(table) );
+    assert( 0 == sh_rehashing(table) );
+    assert( sh_set_incremental(table, 1) );
 
     puts("inserting some data");
-    assert( sh_insert(table, key_1, &data_1) );
-    assert( 1 == sh_nelems(table) );
-    assert( 0 == sh_get(table, key_2) );
-    assert( 0 == sh_get(table, key_3) );
-    data = sh_get(table, key_1);
-    assert(data);
-    assert( data_1 == *data );
+    for( i=0; i<6; ++i ){
+        assert( sh_insert(table, keys[i], &data) );
+    }
+    assert( 8 == table->size );
+    assert( 0 == sh_rehashing(table) );
 
+    puts("testing resize only begins migration");
+    assert( sh_resize(table, 16) );
+    assert( 16 == table->size );
+    assert( sh_rehashing(table) );
+    assert( 6 == sh_nelems(table) );
 
-    assert( sh_insert(table, key_2, &data_2) );
-    assert( 2 == sh_nelems(table) );
-    assert( 0 == sh_get(table, key_3) );
-    data = sh_get(table, key_2);
-    assert(data);
-    assert( data_2 == *data );
+    puts("testing everything is reachable mid migration");
+    for( i=0; i<6; ++i ){
+        assert( sh_exists(table, keys[i]) );
+        assert( &data == sh_get(table, keys[i]) );
+    }
 
+    count = 0;
+    assert( sh_iterate(table, &count, iterate_count) );
+    assert( 6 == count );
 
-    puts("beginning actual testing, cue wall of errors");
-    /* sh_hash */
-    puts("testing sh_hash");
-    assert( 0 == sh_hash(0, 0) );
-    assert( sh_hash(key_1, 0) );
+    puts("testing modification mid migration");
+    assert( &data == sh_update(table, keys[0], &new_data) );
+    assert( &new_data == sh_get(table, keys[0]) );
+    assert( &data == sh_delete(table, keys[5]) );
+    assert( 0 == sh_get(table, keys[5]) );
+    assert( 0 == sh_delete(table, keys[5]) );
+    assert( 5 == sh_nelems(table) );
+    assert( sh_insert(table, keys[5], &data) );
+    assert( 0 == sh_insert(table, keys[4], &data) );
+    assert( sh_set(table, keys[4], &new_data) );
+    assert( &new_data == sh_get(table, keys[4]) );
+    assert( 6 == sh_nelems(table) );
 
-    /* sh_new and sh_init */
-    puts("testing sh_new and sh_init");
-    assert( 0 == sh_new(0) );
-    assert( 0 == sh_init(0, 100) );
-    assert( 0 == sh_init(&static_table, 0) );
+    puts("testing resize while a migration is already in progress");
+    assert( sh_rehashing(table) );
+    assert( sh_resize(table, 32) );
+    assert( 32 == table->size );
+    assert( sh_rehashing(table) );
+    for( i=0; i<6; ++i ){
+        assert( sh_get(table, keys[i]) );
+    }
 
-    /* sh_resize */
-    puts("testing sh_resize");
-    assert( 0 == sh_resize(0, 100) );
-    assert( 0 == sh_resize(table, 0) );
+    puts("testing explicitly driving the migration");
+    assert( sh_rehash_step(table, 2) );
+    assert( sh_rehashing(table) );
+    assert( sh_rehash_step(table, 100) );
+    assert( 0 == sh_rehashing(table) );
+    /* nothing left to do */
+    assert( sh_rehash_step(table, 100) );
+
+    count = 0;
+    assert( sh_iterate(table, &count, iterate_count) );
+    assert( 6 == count );
+    for( i=0; i<6; ++i ){
+        assert( sh_get(table, keys[i]) );
+    }
 
-    /* sh_exists */
-    puts("testing sh_exists");
-    assert( 0 == sh_exists(0, key_1) );
-    assert( 0 == sh_exists(table, 0) );
-    assert( 0 == sh_exists(table, key_3) );
+    puts("testing disabling incremental resizing completes the migration");
+    assert( sh_resize(table, 4) );
+    assert( sh_rehashing(table) );
+    assert( sh_set_incremental(table, 0) );
+    assert( 0 == sh_rehashing(table) );
+    assert( 4 == table->size );
+    for( i=0; i<6; ++i ){
+        assert( sh_get(table, keys[i]) );
+    }
 
-    /* sh_insert */
+    puts("testing destroy mid migration");
+    assert( sh_set_incremental(table, 1) );
+    assert( sh_resize(table, 64) );
+    assert( sh_rehashing(table) );
+
+    assert( sh_destroy(table, 1, 0) );
+    puts("success!");
+}
+
+/* drive `table` and a chaining table through the same `n_ops` random
+ * operations checking they always agree, calling `check` on `table`
+ * every so often
+ *
+ * leaves `table` with shrinking enabled
+ */
+void random_operations(struct sh_table *table, unsigned int n_ops, void (*check)(struct sh_table *table)){
+    /* our reference table */
+    struct sh_table *reference = 0;
+
+    /* buffer for generated keys */
+    char key[32];
+    /* iterator through operations and keys */
+    unsigned int i = 0;
+    /* a simple lcg to drive random operations */
+    unsigned long int rng = 12345;
+    /* some data */
+    int data[64];
+
+    /* number of entries seen by sh_iterate */
+    unsigned int count = 0;
+
+    reference = sh_new(1);
+    assert(reference);
+    assert( sh_set_load_factors(table, 0.75, 0.1) );
+    assert( sh_set_load_factors(reference, 0.75, 0.1) );
+
+    for( i=0; i<n_ops; ++i ){
+        rng = (rng * 1103515245 + 12345) & 0x7fffffff;
+        sprintf(key, "key%lu", (rng >> 8) % 500);
+
+        switch( (rng >> 4) % 4 ){
+            case 0:
+                assert( sh_insert(table, key, &data[i % 64]) == sh_insert(reference, key, &data[i % 64]) );
+                break;
+            case 1:
+                assert( sh_set(table, key, &data[i % 64]) );
+                assert( sh_set(reference, key, &data[i % 64]) );
+                break;
+            case 2:
+                assert( sh_delete(table, key) == sh_delete(reference, key) );
+                break;
+            default:
+                assert( sh_get(table, key) == sh_get(reference, key) );
+                break;
+        }
+
+        assert( sh_nelems(table) == sh_nelems(reference) );
+
+        if( 0 == i % 1000 ){
+            check(table);
+        }
+    }
+    check(table);
+
+    for( i=0; i<500; ++i ){
+        sprintf(key, "key%u", i);
+        assert( sh_get(table, key) == sh_get(reference, key) );
+    }
+
+    count = 0;
+    assert( sh_iterate(table, &count, iterate_count) );
+    assert( sh_nelems(table) == count );
+
+    assert( sh_destroy(reference, 1, 0) );
+}
+
+/* check every bucket filter in `buckets` [start, end) holds
+ * exactly the fingerprints of the entries in its chain
+ *
+ * returns the number of entries seen
+ */
+size_t fingerprint_check_buckets(const struct sh_bucket *buckets, size_t start, size_t end){
+    /* iterator through buckets */
+    size_t i = 0;
+    /* current entry within bucket */
+    struct sh_entry *cur = 0;
+    /* filter rebuilt from the chain */
+    uint64_t filter = 0;
+    /* number of entries seen */
+    size_t count = 0;
+
+    for( i=start; i<end; ++i ){
+        filter = 0;
+        for( cur = buckets[i].head; cur; cur = cur->next ){
+            filter |= sh_fingerprint(cur->hash);
+            ++count;
+        }
+        assert( filter == buckets[i].filter );
+    }
+
+    return count;
+}
+
+void fingerprint_check(struct sh_table *table){
+    /* number of entries seen */
+    size_t count = 0;
+
+    assert(table);
+    assert(table->entries);
+
+    count = fingerprint_check_buckets(table->entries, 0, table->size);
+    if( table->old_entries ){
+        count += fingerprint_check_buckets(table->old_entries, table->migrate_pos, table->old_size);
+    }
+
+    assert( count == sh_nelems(table) );
+}
+
+void fingerprints(void){
+    /* our simple hash table */
+    struct sh_table *table = 0;
+
+    /* buffer for generated keys */
+    char key[32];
+    /* iterator through keys */
+    unsigned int i = 0;
+    /* some data */
+    int data = 1;
+
+    puts("\ntesting bucket fingerprints");
+
+    puts("fingerprints are a single bit");
+    for( i=0; i<64; ++i ){
+        assert( sh_fingerprint(i) );
+        assert( 0 == (sh_fingerprint(i) & (sh_fingerprint(i) - 1)) );
+    }
+
+    puts("misses within a single crowded bucket");
+    table = sh_new(1);
+    assert(table);
+    assert( sh_set_load_factors(table, 0, 0) );
+    for( i=0; i<100; ++i ){
+        sprintf(key, "key%u", i);
+        assert( sh_insert(table, key, &data) );
+    }
+    fingerprint_check(table);
+    for( i=100; i<200; ++i ){
+        sprintf(key, "key%u", i);
+        assert( 0 == sh_exists(table, key) );
+    }
+
+    puts("deleting clears bits no other entry needs");
+    for( i=0; i<100; ++i ){
+        sprintf(key, "key%u", i);
+        assert( &data == sh_delete(table, key) );
+        fingerprint_check(table);
+    }
+    assert( 0 == table->entries[0].head );
+    assert( 0 == table->entries[0].filter );
+    assert( sh_destroy(table, 1, 0) );
+
+    puts("filters follow entries through an incremental resize");
+    table = sh_new(1);
+    assert(table);
+    assert( sh_set_incremental(table, 1) );
+    random_operations(table, 20000, fingerprint_check);
+    assert( sh_destroy(table, 1, 0) );
+
+    puts("success!");
+}
+
+/* check the robin hood invariant holds for every slot in `table`
+ * an entry is never more than one slot further from home than the entry before it
+ */
+void robin_hood_check(struct sh_table *table){
+    /* iterator through slots */
+    size_t i = 0;
+    /* the slot before i */
+    size_t prev = 0;
+    /* number of occupied slots */
+    size_t count = 0;
+
+    assert(table);
+    assert(table->slots);
+
+    for( i=0; i<table->size; ++i ){
+        if( ! table->slots[i].key ){
+            continue;
+        }
+        ++count;
+
+        prev = (i + table->size - 1) % table->size;
+        if( table->slots[prev].key ){
+            assert( sh_rh_distance(table->slots, table->size, i) <= sh_rh_distance(table->slots, table->size, prev) + 1 );
+        } else {
+            assert( 0 == sh_rh_distance(table->slots, table->size, i) );
+        }
+    }
+
+    assert( count == sh_nelems(table) );
+    assert( count < table->size );
+}
+
+void robin_hood(void){
+    /* our simple hash table */
+    struct sh_table *table = 0;
+    /* options to create it with */
+    struct sh_opts opts;
+
+    /* buffer for generated keys */
+    char key[32];
+    /* iterator through keys */
+    unsigned int i = 0;
+    /* some data */
+    int data[8];
+    /* slot returned from sh_get_or_insert */
+    void **slot = 0;
+    /* set by sh_get_or_insert */
+    unsigned int inserted = 0;
+
+    /* number of entries seen by sh_iterate */
+    unsigned int count = 0;
+
+    puts("\ntesting robin hood backend");
+
+    memset(&opts, 0, sizeof opts);
+    opts.backend = SH_BACKEND_ROBIN_HOOD;
+
+    puts("creating table");
+    table = sh_new_opts(5, &opts);
+    assert(table);
+    assert( SH_BACKEND_ROBIN_HOOD == table->backend );
+    assert( 8 == table->size );
+    assert( table->slots );
+    assert( 0 == table->entries );
+
+    puts("testing basic operations");
+    assert( sh_insert(table, "hello", &data[0]) );
+    assert( 0 == sh_insert(table, "hello", &data[1]) );
+    assert( sh_exists(table, "hello") );
+    assert( 0 == sh_exists(table, "world") );
+    assert( &data[0] == sh_get(table, "hello") );
+    assert( &data[0] == sh_update(table, "hello", &data[1]) );
+    assert( &data[1] == sh_get(table, "hello") );
+    assert( 0 == sh_update(table, "world", &data[1]) );
+    assert( sh_set(table, "world", &data[2]) );
+    assert( &data[2] == sh_get(table, "world") );
+    assert( sh_set(table, "world", &data[3]) );
+    assert( &data[3] == sh_get(table, "world") );
+    assert( sh_insert_n(table, "a\0b", 3, &data[4]) );
+    assert( 0 == sh_get(table, "a") );
+    assert( &data[4] == sh_get_n(table, "a\0b", 3) );
+    assert( sh_insert(table, "", &data[5]) );
+    assert( &data[5] == sh_get(table, "") );
+    assert( 4 == sh_nelems(table) );
+
+    /* slots move around so keys cannot be stored inline */
+    assert( 0 == sh_entry_key_inline(sh_find_entry(table, "world")) );
+
+    slot = sh_get_or_insert(table, "counter", &inserted);
+    assert(slot);
+    assert( 1 == inserted );
+    assert( 0 == *slot );
+    *slot = &data[6];
+    assert( &data[6] == sh_get(table, "counter") );
+    slot = sh_get_or_insert(table, "counter", &inserted);
+    assert( 0 == inserted );
+    assert( &data[6] == *slot );
+
+    assert( &data[1] == sh_delete(table, "hello") );
+    assert( 0 == sh_delete(table, "hello") );
+    assert( 0 == sh_exists(table, "hello") );
+    assert( 4 == sh_nelems(table) );
+    robin_hood_check(table);
+
+    count = 0;
+    assert( sh_iterate(table, &count, iterate_count) );
+    assert( 4 == count );
+
+    puts("testing explicit resizing");
+    assert( sh_resize(table, 100) );
+    assert( 128 == table->size );
+    robin_hood_check(table);
+    assert( &data[3] == sh_get(table, "world") );
+    /* 4 entries cannot fit in 4 slots while keeping one free */
+    assert( 0 == sh_resize(table, 4) );
+    assert( 128 == table->size );
+    assert( sh_resize(table, 8) );
+    assert( 8 == table->size );
+    robin_hood_check(table);
+    assert( &data[4] == sh_get_n(table, "a\0b", 3) );
+
+    assert( sh_destroy(table, 1, 0) );
+
+    puts("testing against a chaining table under random operations");
+    table = sh_new_opts(1, &opts);
+    assert(table);
+    random_operations(table, 20000, robin_hood_check);
+    assert( sh_destroy(table, 1, 0) );
+
+    puts("testing a max_load of 0 still grows before filling");
+    table = sh_new_opts(2, &opts);
+    assert(table);
+    assert( sh_set_load_factors(table, 0, 0) );
+    for( i=0; i<100; ++i ){
+        sprintf(key, "key%u", i);
+        assert( sh_insert(table, key, &data[0]) );
+    }
+    assert( table->size >= 128 );
+    robin_hood_check(table);
+
+    puts("testing destroy frees data");
+    for( i=0; i<10; ++i ){
+        sprintf(key, "data%u", i);
+        assert( sh_insert(table, key, calloc(1, sizeof(int))) );
+    }
+    /* free the data we own, but not that inserted from `data` */
+    for( i=0; i<100; ++i ){
+        sprintf(key, "key%u", i);
+        assert( &data[0] == sh_delete(table, key) );
+    }
+    assert( sh_destroy(table, 1, 1) );
+
+    puts("success!");
+}
+
+/* check the control bytes of `table` agree with its slots */
+void swiss_check(struct sh_table *table){
+    /* iterator through slots */
+    size_t i = 0;
+    /* number of full and deleted slots */
+    size_t full = 0;
+    size_t deleted = 0;
+
+    assert(table);
+    assert(table->slots);
+    assert(table->ctrl);
+
+    for( i=0; i<table->size; ++i ){
+        if( table->ctrl[i] == 0x80 ){
+            assert( 0 == table->slots[i].key );
+        } else if( table->ctrl[i] == 0xfe ){
+            assert( 0 == table->slots[i].key );
+            ++deleted;
+        } else {
+            assert( table->slots[i].key );
+            assert( sh_sw_h2(table->slots[i].hash) == table->ctrl[i] );
+            ++full;
+        }
+    }
+
+    assert( full == sh_nelems(table) );
+    assert( deleted == table->n_deleted );
+    assert( full + deleted < table->size );
+}
+
+void swiss(void){
+    /* our simple hash table */
+    struct sh_table *table = 0;
+    /* options to create it with */
+    struct sh_opts opts;
+
+    /* a group of control bytes */
+    unsigned char ctrl[16];
+    /* buffer for generated keys */
+    char key[32];
+    /* iterator through keys */
+    unsigned int i = 0;
+    /* some data */
+    int data[8];
+    /* slot returned from sh_get_or_insert */
+    void **slot = 0;
+
+    /* number of entries seen by sh_iterate */
+    unsigned int count = 0;
+
+    puts("\ntesting swiss backend");
+
+    puts("testing control byte matching");
+    memset(ctrl, 0x80, sizeof ctrl);
+    ctrl[0] = 5;
+    ctrl[3] = 5;
+    ctrl[15] = 5;
+    ctrl[7] = 0xfe;
+    ctrl[8] = 0x7f;
+    assert( 0x8009 == sh_sw_match(ctrl, 5) );
+    assert( 0x0100 == sh_sw_match(ctrl, 0x7f) );
+    assert( 0x0080 == sh_sw_match(ctrl, 0xfe) );
+    assert( 0x7e76 == sh_sw_match(ctrl, 0x80) );
+    assert( 0 == sh_sw_match(ctrl, 6) );
+    assert( 0x7ef6 == sh_sw_match_free(ctrl) );
+
+    memset(&opts, 0, sizeof opts);
+    opts.backend = SH_BACKEND_SWISS;
+
+    puts("creating table");
+    table = sh_new_opts(1, &opts);
+    assert(table);
+    assert( SH_BACKEND_SWISS == table->backend );
+    /* never smaller than one group */
+    assert( 16 == table->size );
+    swiss_check(table);
+
+    puts("testing basic operations");
+    assert( sh_insert(table, "hello", &data[0]) );
+    assert( 0 == sh_insert(table, "hello", &data[1]) );
+    assert( sh_exists(table, "hello") );
+    assert( 0 == sh_exists(table, "world") );
+    assert( &data[0] == sh_update(table, "hello", &data[1]) );
+    assert( &data[1] == sh_get(table, "hello") );
+    assert( sh_set(table, "world", &data[2]) );
+    assert( &data[2] == sh_get(table, "world") );
+    assert( sh_insert_n(table, "a\0b", 3, &data[3]) );
+    assert( &data[3] == sh_get_n(table, "a\0b", 3) );
+    assert( 0 == sh_get(table, "a") );
+
+    slot = sh_get_or_insert(table, "counter", 0);
+    assert(slot);
+    *slot = &data[4];
+    assert( &data[4] == sh_get(table, "counter") );
+    assert( 4 == sh_nelems(table) );
+    swiss_check(table);
+
+    puts("testing deletion empties a slot while its group has room");
+    assert( &data[1] == sh_delete(table, "hello") );
+    assert( 0 == sh_delete(table, "hello") );
+    assert( 0 == table->n_deleted );
+    swiss_check(table);
+
+    count = 0;
+    assert( sh_iterate(table, &count, iterate_count) );
+    assert( 3 == count );
+
+    puts("testing deleted slots are cleaned up by a rebuild");
+    /* a max_load of 0 still grows at SH_SWISS_MAX_LOAD
+     * so this fills 1024 slots to just below the cap
+     */
+    assert( sh_set_load_factors(table, 0, 0) );
+    for( i=0; i<890; ++i ){
+        sprintf(key, "key%u", i);
+        assert( sh_insert(table, key, &data[5]) );
+    }
+    assert( 1024 == table->size );
+    swiss_check(table);
+
+    /* with most groups full this must leave deleted slots behind */
+    for( i=0; i<890; i+=2 ){
+        sprintf(key, "key%u", i);
+        assert( &data[5] == sh_delete(table, key) );
+    }
+    assert( table->n_deleted );
+    swiss_check(table);
+
+    /* refilling rebuilds the table in place once deleted slots reach the cap */
+    for( i=0; i<440; ++i ){
+        sprintf(key, "new%u", i);
+        assert( sh_insert(table, key, &data[6]) );
+        swiss_check(table);
+    }
+    assert( 1024 == table->size );
+
+    assert( sh_resize(table, table->size) );
+    assert( 0 == table->n_deleted );
+    swiss_check(table);
+    for( i=1; i<890; i+=2 ){
+        sprintf(key, "key%u", i);
+        assert( &data[5] == sh_get(table, key) );
+    }
+    for( i=0; i<440; ++i ){
+        sprintf(key, "new%u", i);
+        assert( &data[6] == sh_get(table, key) );
+    }
+    assert( 0 == sh_resize(table, 16) );
+    assert( sh_destroy(table, 1, 0) );
+
+    puts("testing against a chaining table under random operations");
+    table = sh_new_opts(1, &opts);
+    assert(table);
+    random_operations(table, 20000, swiss_check);
+    assert( sh_destroy(table, 1, 0) );
+
+    puts("success!");
+}
+
+/* check `table` is allocating from a slab */
+void slab_check(struct sh_table *table){
+    assert(table);
+    assert(table->slab);
+    /* every key used is small enough for the slab */
+    assert( 0 == table->slab->n_large );
+}
+
+void slab(void){
+    /* our simple hash table */
+    struct sh_table *table = 0;
+    /* options to create it with */
+    struct sh_opts opts;
+    /* a standalone slab */
+    struct sh_slab *slab = 0;
+
+    /* some chunks */
+    char *chunk_1 = 0;
+    char *chunk_2 = 0;
+    char *chunk_3 = 0;
+    /* an entry */
+    struct sh_entry *entry = 0;
+
+    /* a key too large for the slab */
+    char large_key[300];
+    /* buffer for generated keys */
+    char key[32];
+    /* iterator through keys */
+    unsigned int i = 0;
+    /* some data */
+    int data = 1;
+
+    puts("\ntesting slab allocation");
+
+    puts("testing sh_slab_alloc and sh_slab_free");
+    slab = sh_slab_new();
+    assert(slab);
+    chunk_1 = sh_slab_alloc(slab, 10);
+    chunk_2 = sh_slab_alloc(slab, 16);
+    assert(chunk_1);
+    assert(chunk_2);
+    /* both in the same size class, carved one after the other */
+    assert( chunk_1 + 16 == chunk_2 );
+    memset(chunk_1, 'a', 10);
+    memset(chunk_2, 'b', 16);
+    assert( 0 == slab->n_large );
+
+    /* freed chunks are reused by the same size class */
+    sh_slab_free(slab, chunk_1, 10);
+    chunk_3 = sh_slab_alloc(slab, 40);
+    assert( chunk_3 != chunk_1 );
+    assert( chunk_1 == sh_slab_alloc(slab, 1) );
+
+    /* too large for the slab */
+    chunk_3 = sh_slab_alloc(slab, 1000);
+    assert(chunk_3);
+    assert( 1 == slab->n_large );
+    sh_slab_free(slab, chunk_3, 1000);
+    assert( 0 == slab->n_large );
+
+    /* enough to need more than one block */
+    for( i=0; i<10000; ++i ){
+        assert( sh_slab_alloc(slab, 32) );
+    }
+    sh_slab_destroy(slab);
+
+    /* a null slab is just malloc and free */
+    chunk_1 = sh_slab_alloc(0, 10);
+    assert(chunk_1);
+    sh_slab_free(0, chunk_1, 10);
+
+    memset(&opts, 0, sizeof opts);
+    opts.slab = 1;
+
+    puts("testing deleted entries are reused");
+    table = sh_new_opts(32, &opts);
+    assert(table);
+    assert(table->slab);
+    assert( sh_insert(table, "hello", &data) );
+    entry = sh_find_entry(table, "hello");
+    assert(entry);
+    assert( &data == sh_delete(table, "hello") );
+    assert( sh_insert(table, "world", &data) );
+    assert( entry == sh_find_entry(table, "world") );
+    assert( 0 == strcmp("world", sh_find_entry(table, "world")->key) );
+
+    puts("testing keys too large for the slab");
+    memset(large_key, 'x', sizeof large_key);
+    large_key[sizeof large_key - 1] = '\0';
+    assert( sh_insert(table, large_key, &data) );
+    assert( 1 == table->slab->n_large );
+    assert( &data == sh_get(table, large_key) );
+    assert( &data == sh_delete(table, large_key) );
+    assert( 0 == table->slab->n_large );
+    assert( sh_insert(table, large_key, &data) );
+
+    for( i=0; i<5000; ++i ){
+        sprintf(key, "key%u", i);
+        assert( sh_insert(table, key, &data) );
+    }
+    for( i=0; i<5000; ++i ){
+        sprintf(key, "key%u", i);
+        assert( &data == sh_get(table, key) );
+    }
+    assert( sh_destroy(table, 1, 0) );
+
+    puts("testing destroy with and without data to free");
+    table = sh_new_opts(32, &opts);
+    assert(table);
+    for( i=0; i<100; ++i ){
+        sprintf(key, "key%u", i);
+        assert( sh_insert(table, key, calloc(1, sizeof(int))) );
+    }
+    assert( sh_destroy(table, 1, 1) );
+
+    puts("testing each backend against a chaining table");
+    table = sh_new_opts(1, &opts);
+    assert(table);
+    random_operations(table, 20000, slab_check);
+    assert( sh_destroy(table, 1, 0) );
+
+    opts.backend = SH_BACKEND_ROBIN_HOOD;
+    table = sh_new_opts(1, &opts);
+    assert(table);
+    random_operations(table, 20000, robin_hood_check);
+    slab_check(table);
+    assert( sh_destroy(table, 1, 0) );
+
+    opts.backend = SH_BACKEND_SWISS;
+    table = sh_new_opts(1, &opts);
+    assert(table);
+    random_operations(table, 20000, swiss_check);
+    slab_check(table);
+    assert( sh_destroy(table, 1, 0) );
+
+    puts("success!");
+}
+
+/* check every key sh_iterate_n gives us lies within the buffer in `state` */
+unsigned int iterate_borrowed(void *state, const void *key, size_t key_len, void **data){
+    const char *buffer = state;
+
+    assert(key);
+    assert(data);
+    assert( (const char *) key >= buffer );
+    assert( (const char *) key + key_len <= buffer + 1000 * 8 );
+
+    return 1;
+}
+
+void borrowed_keys(void){
+    /* our simple hash table */
+    struct sh_table *table = 0;
+    /* options to create it with */
+    struct sh_opts opts;
+    /* the backends to try */
+    enum sh_backend backends[] = {
+        SH_BACKEND_CHAINING,
+        SH_BACKEND_ROBIN_HOOD,
+        SH_BACKEND_SWISS,
+    };
+    /* iterator through backends, and through with and without slab */
+    unsigned int b = 0;
+    unsigned int slab = 0;
+
+    /* our keys, 8 bytes each (including a null terminator),
+     * owned by us and outliving the table
+     */
+    char *buffer = 0;
+    /* a key outside of buffer */
+    char key[8];
+    /* iterator through keys */
+    unsigned int i = 0;
+    /* some data */
+    int data = 1;
+
+    puts("\ntesting borrowed keys");
+
+    buffer = malloc(1000 * 8);
+    assert(buffer);
+    for( i=0; i<1000; ++i ){
+        sprintf(key, "k%06u", i);
+        memcpy(buffer + i * 8, key, 8);
+    }
+
+    for( slab=0; slab<2; ++slab ){
+        for( b=0; b<sizeof backends / sizeof backends[0]; ++b ){
+            memset(&opts, 0, sizeof opts);
+            opts.borrow_keys = 1;
+            opts.slab = slab;
+            opts.backend = backends[b];
+
+            table = sh_new_opts(4, &opts);
+            assert(table);
+            assert( table->borrow_keys );
+
+            for( i=0; i<1000; ++i ){
+                assert( sh_insert_n(table, buffer + i * 8, 8, &data) );
+            }
+
+            /* lookups may use any copy of the key */
+            for( i=0; i<1000; ++i ){
+                memcpy(key, buffer + i * 8, 8);
+                assert( &data == sh_get_n(table, key, 8) );
+            }
+
+            /* the length is part of the key */
+            assert( 0 == sh_get(table, buffer + 10 * 8) );
+            assert( sh_set_n(table, buffer + 10 * 8, 8, &data) );
+
+            assert( sh_iterate_n(table, buffer, iterate_borrowed) );
+
+            for( i=0; i<1000; i+=2 ){
+                assert( &data == sh_delete_n(table, buffer + i * 8, 8) );
+            }
+            assert( 500 == sh_nelems(table) );
+
+            /* nothing in buffer is freed by the table */
+            assert( sh_destroy(table, 1, 0) );
+        }
+    }
+
+    puts("testing a borrowed key is visible through the table");
+    memset(&opts, 0, sizeof opts);
+    opts.borrow_keys = 1;
+    table = sh_new_opts(4, &opts);
+    assert(table);
+    assert( sh_insert(table, buffer, &data) );
+    assert( buffer == sh_find_entry(table, buffer)->key );
+    assert( sh_destroy(table, 1, 0) );
+
+    free(buffer);
+
+    puts("success!");
+}
+
+void batch(void){
+    /* our simple hash table */
+    struct sh_table *table = 0;
+    /* options to create it with */
+    struct sh_opts opts;
+    /* the backends to try */
+    enum sh_backend backends[] = {
+        SH_BACKEND_CHAINING,
+        SH_BACKEND_ROBIN_HOOD,
+        SH_BACKEND_SWISS,
+    };
+    /* iterator through backends */
+    unsigned int b = 0;
+
+    /* 100 keys are inserted, the batch asks for 200 of them
+     * every fourth key also has a null byte in the middle
+     */
+    char buffer[200][16];
+    const void *keys[200];
+    size_t lens[200];
+    /* every other key, to delete */
+    const void *del_keys[100];
+    size_t del_lens[100];
+    /* results of batch operations */
+    void *values[200];
+    unsigned int found[200];
+    /* iterator through keys */
+    unsigned int i = 0;
+    /* some data */
+    int data[100];
+
+    puts("\ntesting batch operations");
+
+    for( i=0; i<200; ++i ){
+        sprintf(buffer[i], "batch%u", i);
+        lens[i] = strlen(buffer[i]);
+        if( 0 == i % 4 ){
+            buffer[i][2] = '\0';
+        }
+        keys[i] = buffer[i];
+    }
+
+    for( b=0; b<sizeof backends / sizeof backends[0]; ++b ){
+        printf("backend %u\n", b);
+        memset(&opts, 0, sizeof opts);
+        opts.backend = backends[b];
+        table = sh_new_opts(8, &opts);
+        assert(table);
+
+        for( i=0; i<100; ++i ){
+            assert( sh_insert_n(table, keys[i], lens[i], &data[i]) );
+        }
+
+        puts("sh_get_many agrees with sh_get_n");
+        memset(found, 9, sizeof found);
+        assert( 100 == sh_get_many(table, keys, lens, 200, values, found) );
+        for( i=0; i<200; ++i ){
+            assert( values[i] == sh_get_n(table, keys[i], lens[i]) );
+            assert( found[i] == (i < 100) );
+        }
+
+        puts("out_found is optional");
+        assert( 100 == sh_get_many(table, keys, lens, 200, values, 0) );
+        assert( 0 == sh_get_many(table, keys, lens, 0, values, found) );
+
+        puts("sh_exists_many");
+        assert( 100 == sh_exists_many(table, keys, lens, 200, found) );
+        for( i=0; i<200; ++i ){
+            assert( found[i] == (i < 100) );
+        }
+
+        puts("null terminated keys without lens");
+        assert( 75 == sh_exists_many(table, keys + 1, 0, 199, found) );
+        for( i=1; i<200; ++i ){
+            /* keys cut short by their null byte are not found */
+            assert( found[i - 1] == (i < 100 && 0 != i % 4) );
+        }
+
+        puts("sh_delete_many deletes every other key");
+        for( i=0; i<100; ++i ){
+            del_keys[i] = keys[i * 2];
+            del_lens[i] = lens[i * 2];
+        }
+        assert( 50 == sh_delete_many(table, del_keys, del_lens, 100, values, found) );
+        for( i=0; i<100; ++i ){
+            assert( found[i] == (i < 50) );
+            assert( values[i] == (i < 50 ? (void *) &data[i * 2] : 0) );
+        }
+        assert( 50 == sh_nelems(table) );
+        assert( 0 == sh_delete_many(table, del_keys, del_lens, 100, 0, 0) );
+        assert( 50 == sh_exists_many(table, keys, lens, 100, 0) );
+
+        assert( sh_destroy(table, 1, 0) );
+    }
+
+    puts("success!");
+}
+
+void build(void){
+    /* our simple hash table */
+    struct sh_table *table = 0;
+    /* options to create it with */
+    struct sh_opts opts;
+    /* the backends to try */
+    enum sh_backend backends[] = {
+        SH_BACKEND_CHAINING,
+        SH_BACKEND_ROBIN_HOOD,
+        SH_BACKEND_SWISS,
+    };
+    /* iterator through backends, with and without slab, and thread counts */
+    unsigned int b = 0;
+    unsigned int slab = 0;
+    unsigned int threads = 0;
+
+    /* 5000 keys, the second half repeating the first */
+    char (*buffer)[16] = 0;
+    const void **keys = 0;
+    void **values = 0;
+    /* iterator through keys */
+    unsigned int i = 0;
+    /* just the first 5 bytes of a key */
+    size_t lens[1] = { 5 };
+    /* some data */
+    int data[5000];
+
+    puts("\ntesting bulk build");
+
+    buffer = malloc(5000 * sizeof *buffer);
+    keys = malloc(5000 * sizeof *keys);
+    values = malloc(5000 * sizeof *values);
+    assert(buffer);
+    assert(keys);
+    assert(values);
+    for( i=0; i<5000; ++i ){
+        sprintf(buffer[i], "build%u", i % 2500);
+        keys[i] = buffer[i];
+        values[i] = &data[i];
+    }
+
+    for( slab=0; slab<2; ++slab ){
+        for( b=0; b<sizeof backends / sizeof backends[0]; ++b ){
+            for( threads=1; threads<=4; threads+=3 ){
+                printf("backend %u slab %u threads %u\n", b, slab, threads);
+                memset(&opts, 0, sizeof opts);
+                opts.backend = backends[b];
+                opts.slab = slab;
+
+                puts("unique keys");
+                table = sh_new_opts(4, &opts);
+                assert(table);
+                assert( 2500 == sh_build(table, keys, 0, values, 2500, threads, 0) );
+                assert( 2500 == sh_nelems(table) );
+                assert( table->size * 0.75 >= 2500 );
+                for( i=0; i<2500; ++i ){
+                    assert( &data[i] == sh_get(table, buffer[i]) );
+                }
+                if( backends[b] == SH_BACKEND_CHAINING ){
+                    fingerprint_check(table);
+                }
+                /* the table is still usable as normal */
+                assert( &data[7] == sh_delete(table, buffer[7]) );
+                assert( sh_insert(table, buffer[7], &data[7]) );
+                assert( sh_destroy(table, 1, 0) );
+
+                puts("duplicates are skipped when asked, the first wins");
+                table = sh_new_opts(4, &opts);
+                assert(table);
+                assert( sh_insert(table, buffer[42], &data[4999]) );
+                assert( 2499 == sh_build(table, keys, 0, values, 5000, threads, 1) );
+                assert( 2500 == sh_nelems(table) );
+                assert( &data[4999] == sh_get(table, buffer[42]) );
+                for( i=0; i<2500; ++i ){
+                    if( i != 42 ){
+                        assert( &data[i] == sh_get(table, buffer[i]) );
+                    }
+                }
+                assert( sh_destroy(table, 1, 0) );
+            }
+        }
+    }
+
+    puts("values are optional and lens may be given");
+    table = sh_new(1);
+    assert(table);
+    assert( sh_set_load_factors(table, 0, 0) );
+    assert( 1 == sh_build(table, keys, lens, 0, 1, 4, 0) );
+    assert( 1 == table->size );
+    assert( sh_exists_n(table, "build", 5) );
+    assert( 0 == sh_get_n(table, "build", 5) );
+    assert( sh_destroy(table, 1, 0) );
+
+    free(buffer);
+    free(keys);
+    free(values);
+
+    puts("success!");
+}
+
+/* check the parts of `stats` that must agree with each other
+ * and with `table`
+ */
+void stats_check(struct sh_table *table, struct sh_stats *stats){
+    /* iterator through histogram */
+    size_t i = 0;
+    /* sum of histogram */
+    size_t sum = 0;
+
+    assert( sh_stats(table, stats) );
+    assert( stats->n_elems == sh_nelems(table) );
+    assert( stats->n_buckets >= table->size );
+    assert( stats->n_empty <= stats->n_buckets );
+
+    for( i=0; i<SH_STATS_HISTOGRAM; ++i ){
+        sum += stats->histogram[i];
+    }
+
+    if( table->backend == SH_BACKEND_CHAINING ){
+        /* one chain per bucket */
+        assert( sum == stats->n_buckets );
+        assert( stats->histogram[0] == stats->n_empty );
+        assert( stats->entry_bytes == stats->n_elems * sizeof(struct sh_entry) );
+    } else {
+        /* one chain per entry, each at least one long */
+        assert( sum == stats->n_elems );
+        assert( 0 == stats->histogram[0] );
+        assert( stats->n_empty == table->size - stats->n_elems );
+        assert( 0 == stats->entry_bytes );
+    }
+
+    if( stats->n_elems ){
+        assert( stats->mean_chain >= 1 );
+        assert( stats->mean_chain <= stats->max_chain );
+    }
+}
+
+void parallel_resize(void){
+    /* our simple hash table */
+    struct sh_table *table = 0;
+    /* options to create it with */
+    struct sh_opts opts;
+    /* the backends to try */
+    enum sh_backend backends[] = {
+        SH_BACKEND_CHAINING,
+        SH_BACKEND_ROBIN_HOOD,
+        SH_BACKEND_SWISS,
+    };
+    /* sizes to resize through, growing and shrinking */
+    size_t sizes[] = { 4096, 5, 1, 2048, 3000, 16 };
+    /* iterators through backends, power of two, thread counts and sizes */
+    unsigned int b = 0;
+    unsigned int pow2 = 0;
+    unsigned int threads = 0;
+    unsigned int s = 0;
+    /* iterator through keys */
+    int i = 0;
+    /* a key */
+    char key[16];
+    /* some data */
+    int data[3000];
+    /* keys and values for sh_build */
+    char names[2000][16];
+    const void *keys[2000];
+    void *values[2000];
+
+    puts("\ntesting parallel resize");
+
+    for( b=0; b<3; ++b ){
+        for( pow2=0; pow2<2; ++pow2 ){
+            for( threads=0; threads<8; threads+=3 ){
+                memset(&opts, 0, sizeof opts);
+                opts.backend = backends[b];
+                opts.pow2 = pow2;
+                table = sh_new_opts(64, &opts);
+                assert(table);
+                /* sizes below are below the load cap */
+                assert( sh_set_load_factors(table, 0, 0) );
+
+                for( i=0; i<3000; ++i ){
+                    sprintf(key, "resize%d", i);
+                    assert( sh_insert(table, key, &data[i]) );
+                }
+
+                for( s=0; s<sizeof sizes / sizeof sizes[0]; ++s ){
+                    if( b != 0 && sizes[s] < 4096 ){
+                        continue;
+                    }
+                    assert( sh_resize_parallel(table, sizes[s], threads) );
+                    assert( table->size >= sizes[s] );
+                    assert( 0 == sh_rehashing(table) );
+                    assert( 3000 == sh_nelems(table) );
+                    for( i=0; i<3000; ++i ){
+                        sprintf(key, "resize%d", i);
+                        assert( &data[i] == sh_get(table, key) );
+                    }
+                    assert( 0 == sh_get(table, "resize3000") );
+                }
+
+                /* filters are rebuilt, so deletes and misses still work */
+                for( i=0; i<3000; i+=2 ){
+                    sprintf(key, "resize%d", i);
+                    assert( &data[i] == sh_delete(table, key) );
+                    assert( 0 == sh_exists(table, key) );
+                }
+                assert( 1500 == sh_nelems(table) );
+
+                assert( sh_destroy(table, 1, 0) );
+            }
+        }
+    }
+
+    /* an incremental resize in progress is completed first */
+    table = sh_new(8);
+    assert(table);
+    assert( sh_set_incremental(table, 1) );
+    for( i=0; i<1000; ++i ){
+        sprintf(key, "resize%d", i);
+        assert( sh_insert(table, key, &data[i]) );
+    }
+    assert( sh_resize(table, 4096) );
+    assert( sh_rehashing(table) );
+    assert( sh_resize_parallel(table, 8192, 4) );
+    assert( 0 == sh_rehashing(table) );
+    assert( 8192 == table->size );
+    assert( 1000 == sh_nelems(table) );
+    for( i=0; i<1000; ++i ){
+        sprintf(key, "resize%d", i);
+        assert( &data[i] == sh_get(table, key) );
+    }
+
+    /* more threads than buckets */
+    assert( sh_resize_parallel(table, 2, 16) );
+    assert( 2 == table->size );
+    assert( &data[999] == sh_get(table, "resize999") );
+
+    /* sh_build into a table that already holds entries grows it in parallel */
+    assert( sh_set_load_factors(table, 2, 0) );
+    for( i=1000; i<3000; ++i ){
+        sprintf(names[i - 1000], "resize%d", i);
+        keys[i - 1000] = names[i - 1000];
+        values[i - 1000] = &data[i];
+    }
+    assert( 2000 == sh_build(table, keys, 0, values, 2000, 4, 0) );
+    assert( 3000 == sh_nelems(table) );
+    assert( table->size >= 1500 );
+    for( i=0; i<3000; ++i ){
+        sprintf(key, "resize%d", i);
+        assert( &data[i] == sh_get(table, key) );
+    }
+
+    /* error handling */
+    assert( 0 == sh_resize_parallel(0, 8, 4) );
+    assert( 0 == sh_resize_parallel(table, 0, 4) );
+    assert( SH_ERR_INVALID == sh_last_error() );
+    assert( 0 == sh_resize_parallel(table, 0, 1) );
+    assert( sh_destroy(table, 1, 0) );
+}
+
+void statistics(void){
+    /* our simple hash table */
+    struct sh_table *table = 0;
+    /* options to create it with */
+    struct sh_opts opts;
+    /* the backends to try */
+    enum sh_backend backends[] = {
+        SH_BACKEND_CHAINING,
+        SH_BACKEND_ROBIN_HOOD,
+        SH_BACKEND_SWISS,
+    };
+    /* iterator through backends */
+    unsigned int b = 0;
+    /* our stats */
+    struct sh_stats stats;
+
+    /* buffer for generated keys */
+    char key[32];
+    /* iterator through keys */
+    unsigned int i = 0;
+    /* some data */
+    int data = 1;
+
+    puts("\ntesting sh_stats");
+
+    puts("a single bucket");
+    table = sh_new(1);
+    assert(table);
+    assert( sh_set_load_factors(table, 0, 0) );
+    assert( sh_insert(table, "a", &data) );
+    assert( sh_insert(table, "bb", &data) );
+    assert( sh_insert(table, "ccc", &data) );
+    stats_check(table, &stats);
+    assert( 1 == stats.n_buckets );
+    assert( 3 == stats.n_elems );
+    assert( 3.0 == stats.load );
+    assert( 0 == stats.n_empty );
+    assert( 3 == stats.max_chain );
+    assert( 3.0 == stats.mean_chain );
+    assert( 1 == stats.histogram[3] );
+    assert( sizeof(struct sh_bucket) == stats.bucket_bytes );
+    assert( 3 * sizeof(struct sh_entry) == stats.entry_bytes );
+    assert( 2 + 3 + 4 == stats.key_bytes );
+
+    puts("chains longer than the histogram");
+    for( i=0; i<20; ++i ){
+        sprintf(key, "key%u", i);
+        assert( sh_insert(table, key, &data) );
+    }
+    stats_check(table, &stats);
+    assert( 23 == stats.max_chain );
+    assert( 23.0 == stats.mean_chain );
+    assert( 1 == stats.histogram[SH_STATS_HISTOGRAM - 1] );
+    assert( sh_destroy(table, 1, 0) );
+
+    for( b=0; b<sizeof backends / sizeof backends[0]; ++b ){
+        printf("backend %u\n", b);
+        memset(&opts, 0, sizeof opts);
+        opts.backend = backends[b];
+        table = sh_new_opts(8, &opts);
+        assert(table);
+
+        stats_check(table, &stats);
+        assert( 0 == stats.max_chain );
+        assert( 0.0 == stats.mean_chain );
+
+        for( i=0; i<1000; ++i ){
+            sprintf(key, "key%u", i);
+            assert( sh_insert(table, key, &data) );
+        }
+        for( i=0; i<1000; i+=3 ){
+            sprintf(key, "key%u", i);
+            assert( sh_delete(table, key) );
+        }
+        stats_check(table, &stats);
+        assert( stats.load > 0 );
+        assert( stats.load <= 0.9 );
+        assert( stats.max_chain >= 1 );
+        assert( stats.bucket_bytes >= table->size * sizeof(struct sh_bucket) );
+        assert( stats.key_bytes > stats.n_elems * 4 );
+
+        assert( sh_destroy(table, 1, 0) );
+    }
+
+    puts("during an incremental resize");
+    table = sh_new(8);
+    assert(table);
+    assert( sh_set_incremental(table, 1) );
+    for( i=0; i<100 && ! sh_rehashing(table); ++i ){
+        sprintf(key, "key%u", i);
+        assert( sh_insert(table, key, &data) );
+    }
+    assert( sh_rehashing(table) );
+    stats_check(table, &stats);
+    assert( stats.n_buckets == table->size + table->old_size - table->migrate_pos );
+    assert( stats.bucket_bytes == (table->size + table->old_size) * sizeof(struct sh_bucket) );
+    assert( sh_destroy(table, 1, 0) );
+
+    puts("borrowed keys are not counted");
+    memset(&opts, 0, sizeof opts);
+    opts.borrow_keys = 1;
+    table = sh_new_opts(8, &opts);
+    assert(table);
+    assert( sh_insert(table, "bacon", &data) );
+    stats_check(table, &stats);
+    assert( 0 == stats.key_bytes );
+    assert( sh_destroy(table, 1, 0) );
+
+    puts("success!");
+}
+
+/* sums the values of a sharded table, stopping once `limit` are seen */
+struct sharded_sum {
+    size_t count;
+    size_t limit;
+    long total;
+};
+
+unsigned int sharded_each(void *state, const void *key, size_t key_len, void **data){
+    struct sharded_sum *sum = state;
+
+    assert(key);
+    assert(key_len);
+
+    sum->count += 1;
+    sum->total += *(int *) *data;
+
+    return sum->count != sum->limit;
+}
+
+#ifndef SH_NO_THREADS
+/* state of one thread working on a struct sh_sharded */
+struct sharded_worker {
+    struct sh_sharded *sharded;
+    /* keys of our own are prefixed with this */
+    int id;
+    /* our successes on the keys shared by every thread */
+    size_t inserted;
+    size_t deleted;
+    /* data stored under every key */
+    int *data;
+};
+
+void * sharded_work(void *arg){
+    struct sharded_worker *worker = arg;
+    /* iterator through keys */
+    int i = 0;
+    /* a key */
+    char key[32];
+
+    for( i=0; i<1000; ++i ){
+        sprintf(key, "own%d-%d", worker->id, i);
+        assert( sh_sharded_insert(worker->sharded, key, &worker->data[i]) );
+        assert( &worker->data[i] == sh_sharded_get(worker->sharded, key) );
+        if( i % 2 ){
+            assert( sh_sharded_set(worker->sharded, key, &worker->data[i - 1]) );
+            assert( &worker->data[i - 1] == sh_sharded_delete(worker->sharded, key) );
+            assert( 0 == sh_sharded_exists(worker->sharded, key) );
+        }
+
+        sprintf(key, "shared%d", (i * 7 + worker->id) % 50);
+        if( sh_sharded_insert(worker->sharded, key, &worker->data[0]) ){
+            ++worker->inserted;
+        }
+        sprintf(key, "shared%d", (i * 3 + worker->id) % 50);
+        if( sh_sharded_delete(worker->sharded, key) ){
+            ++worker->deleted;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+void sharded(void){
+    /* our sharded tables */
+    struct sh_sharded *sharded = 0;
+    struct sh_opts opts;
+    /* iterators through keys and backends */
+    int i = 0;
+    int backend = 0;
+    /* our keys, and data stored under them */
+    char key[16];
+    int data[1000];
+    /* results of iteration */
+    struct sharded_sum sum;
+#ifndef SH_NO_THREADS
+    /* our threads */
+    pthread_t threads[4];
+    struct sharded_worker workers[4];
+    /* shared keys left behind, and those found */
+    size_t shared = 0;
+    size_t found = 0;
+#endif
+
+    puts("\ntesting sharded tables");
+
+    for( i=0; i<1000; ++i ){
+        data[i] = i;
+    }
+
+    for( backend=SH_BACKEND_CHAINING; backend<=SH_BACKEND_SWISS; ++backend ){
+        memset(&opts, 0, sizeof opts);
+        opts.backend = backend;
+
+        /* rounded up to 8 shards, far smaller than needed so each must grow */
+        sharded = sh_sharded_new(5, 16, &opts);
+        assert(sharded);
+        assert( 0 == sh_sharded_nelems(sharded) );
+
+        for( i=0; i<1000; ++i ){
+            sprintf(key, "key%d", i);
+            assert( sh_sharded_insert(sharded, key, &data[i]) );
+        }
+        assert( 1000 == sh_sharded_nelems(sharded) );
+        assert( 0 == sh_sharded_insert(sharded, "key10", &data[0]) );
+
+        for( i=0; i<1000; ++i ){
+            sprintf(key, "key%d", i);
+            assert( sh_sharded_exists(sharded, key) );
+            assert( &data[i] == sh_sharded_get(sharded, key) );
+            assert( &data[i] == sh_sharded_get_n(sharded, key, strlen(key)) );
+        }
+        assert( 0 == sh_sharded_exists(sharded, "key1000") );
+        assert( 0 == sh_sharded_get(sharded, "key1000") );
+
+        /* set both updates and inserts */
+        assert( sh_sharded_set(sharded, "key0", &data[1]) );
+        assert( &data[1] == sh_sharded_get(sharded, "key0") );
+        assert( sh_sharded_set_n(sharded, "key1000", 7, &data[0]) );
+        assert( 1001 == sh_sharded_nelems(sharded) );
+
+        /* delete every odd key */
+        for( i=1; i<1000; i+=2 ){
+            sprintf(key, "key%d", i);
+            assert( &data[i] == sh_sharded_delete(sharded, key) );
+            assert( 0 == sh_sharded_delete_n(sharded, key, strlen(key)) );
+        }
+        assert( 501 == sh_sharded_nelems(sharded) );
+
+        /* iteration visits every shard, and stops when asked */
+        memset(&sum, 0, sizeof sum);
+        assert( sh_sharded_iterate(sharded, &sum, sharded_each) );
+        assert( 501 == sum.count );
+        /* 0..998 even, with key0 holding 1 and key1000 holding 0 */
+        assert( 249500 + 1 == sum.total );
+
+        memset(&sum, 0, sizeof sum);
+        sum.limit = 10;
+        assert( sh_sharded_iterate(sharded, &sum, sharded_each) );
+        assert( 10 == sum.count );
+
+        assert( sh_sharded_destroy(sharded, 0) );
+    }
+
+    /* a single shard works as a plain table */
+    sharded = sh_sharded_new(1, 1, 0);
+    assert(sharded);
+    assert( sh_sharded_insert(sharded, "a", &data[0]) );
+    assert( &data[0] == sh_sharded_get(sharded, "a") );
+    assert( sh_sharded_destroy(sharded, 0) );
+
+#ifndef SH_NO_THREADS
+    /* many threads at once, each shard growing under its writers */
+    sharded = sh_sharded_new(4, 2, 0);
+    assert(sharded);
+
+    for( i=0; i<4; ++i ){
+        workers[i].sharded = sharded;
+        workers[i].id = i;
+        workers[i].inserted = 0;
+        workers[i].deleted = 0;
+        workers[i].data = data;
+        assert( 0 == pthread_create(&threads[i], 0, sharded_work, &workers[i]) );
+    }
+
+    for( i=0; i<4; ++i ){
+        assert( 0 == pthread_join(threads[i], 0) );
+        shared += workers[i].inserted - workers[i].deleted;
+    }
+
+    for( i=0; i<50; ++i ){
+        sprintf(key, "shared%d", i);
+        if( sh_sharded_exists(sharded, key) ){
+            ++found;
+        }
+    }
+    assert( shared == found );
+
+    for( i=0; i<4 * 1000; ++i ){
+        sprintf(key, "own%d-%d", i / 1000, i % 1000);
+        assert( (i % 2 ? 0 : &data[i % 1000]) == sh_sharded_get(sharded, key) );
+    }
+    assert( 4 * 500 + found == sh_sharded_nelems(sharded) );
+
+    assert( sh_sharded_destroy(sharded, 0) );
+#endif
+
+    /* error handling */
+    assert( 0 == sh_sharded_new(0, 16, 0) );
+    assert( 0 == sh_sharded_new(65537, 16, 0) );
+    assert( 0 == sh_sharded_new(4, 0, 0) );
+    assert( 0 == sh_sharded_destroy(0, 0) );
+    assert( 0 == sh_sharded_nelems(0) );
+    assert( 0 == sh_sharded_get(0, "a") );
+    assert( 0 == sh_sharded_insert(0, "a", 0) );
+    assert( 0 == sh_sharded_iterate(0, 0, sharded_each) );
+
+    sharded = sh_sharded_new(4, 16, 0);
+    assert(sharded);
+    assert( 0 == sh_sharded_get(sharded, 0) );
+    assert( 0 == sh_sharded_exists_n(sharded, 0, 0) );
+    assert( 0 == sh_sharded_set(sharded, 0, 0) );
+    assert( 0 == sh_sharded_iterate(sharded, 0, 0) );
+    assert( sh_sharded_destroy(sharded, 0) );
+}
+
+#ifndef SH_NO_THREADS
+/* state shared by the threads reading a struct sh_rcu */
+struct rcu_readers {
+    struct sh_rcu *table;
+    /* data stored under every key */
+    int *data;
+    /* set by the writer once it is finished */
+    pthread_mutex_t lock;
+    unsigned int done;
+};
+
+/* read stable keys until the writer is done, their values never change
+ * however the table grows and whatever is deleted around them
+ */
+void * rcu_read(void *arg){
+    struct rcu_readers *readers = arg;
+    /* iterator through keys */
+    int i = 0;
+    /* a key */
+    char key[32];
+    /* a value found under a key the writer is changing */
+    int *value = 0;
+    /* whether the writer is done */
+    unsigned int done = 0;
+
+    while( ! done ){
+        for( i=0; i<100; ++i ){
+            sprintf(key, "stable%d", i);
+            assert( &readers->data[i] == sh_rcu_get(readers->table, key) );
+            assert( sh_rcu_exists(readers->table, key) );
+
+            sprintf(key, "churn%d", i * 37 % 2000);
+            value = sh_rcu_get(readers->table, key);
+            assert( ! value || &readers->data[i * 37 % 1000] == value );
+        }
+
+        assert( 0 == pthread_mutex_lock(&(readers->lock)) );
+        done = readers->done;
+        assert( 0 == pthread_mutex_unlock(&(readers->lock)) );
+    }
+
+    return 0;
+}
+#endif
+
+void rcu(void){
+    /* our tables */
+    struct sh_rcu *table = 0;
+    struct sh_opts opts;
+    /* iterator through keys */
+    int i = 0;
+    /* our keys, and data stored under them */
+    char key[16];
+    int data[1000];
+    /* a key of our own for borrowing */
+    char borrowed[] = "borrowed";
+#ifndef SH_NO_THREADS
+    /* our reader threads */
+    pthread_t threads[3];
+    struct rcu_readers readers;
+    /* iterator through rounds */
+    int round = 0;
+#endif
+
+    puts("\ntesting lock free readers");
+
+    for( i=0; i<1000; ++i ){
+        data[i] = i;
+    }
+
+    /* small enough to grow several times, each retiring the old buckets */
+    table = sh_rcu_new(4, 0, 0);
+    assert(table);
+    assert( 0 == sh_rcu_nelems(table) );
+
+    for( i=0; i<1000; ++i ){
+        sprintf(key, "key%d", i);
+        assert( sh_rcu_insert(table, key, &data[i]) );
+    }
+    assert( 1000 == sh_rcu_nelems(table) );
+    assert( 0 == sh_rcu_insert(table, "key10", &data[0]) );
+    assert( SH_ERR_EXISTS == sh_last_error() );
+
+    for( i=0; i<1000; ++i ){
+        sprintf(key, "key%d", i);
+        assert( sh_rcu_exists(table, key) );
+        assert( &data[i] == sh_rcu_get(table, key) );
+        assert( &data[i] == sh_rcu_get_n(table, key, strlen(key)) );
+    }
+    assert( 0 == sh_rcu_exists(table, "key1000") );
+    assert( 0 == sh_rcu_get(table, "key1000") );
+    assert( SH_ERR_NOT_FOUND == sh_last_error() );
+
+    /* set both updates and inserts */
+    assert( sh_rcu_set(table, "key0", &data[1]) );
+    assert( &data[1] == sh_rcu_get(table, "key0") );
+    assert( sh_rcu_set_n(table, "key1000", 7, &data[0]) );
+    assert( &data[0] == sh_rcu_get(table, "key1000") );
+    assert( 1001 == sh_rcu_nelems(table) );
+
+    /* deleted entries are retired, and with no readers freed at once */
+    for( i=1; i<1000; i+=2 ){
+        sprintf(key, "key%d", i);
+        assert( &data[i] == sh_rcu_delete(table, key) );
+        assert( 0 == sh_rcu_exists(table, key) );
+        assert( 0 == sh_rcu_delete_n(table, key, strlen(key)) );
+        assert( SH_ERR_NOT_FOUND == sh_last_error() );
+    }
+    assert( 501 == sh_rcu_nelems(table) );
+
+    for( i=0; i<1000; i+=2 ){
+        sprintf(key, "key%d", i);
+        assert( sh_rcu_exists_n(table, key, strlen(key)) );
+    }
+
+    assert( sh_rcu_destroy(table, 0) );
+
+    /* borrowed keys, with keys containing null bytes */
+    memset(&opts, 0, sizeof opts);
+    opts.borrow_keys = 1;
+    opts.hash_fn = sh_hash_xxh64;
+    table = sh_rcu_new(1, 1, &opts);
+    assert(table);
+    assert( sh_rcu_insert(table, borrowed, &data[3]) );
+    assert( sh_rcu_insert_n(table, "a\0b", 3, &data[4]) );
+    assert( sh_rcu_insert_n(table, "a\0c", 3, &data[5]) );
+    assert( &data[3] == sh_rcu_get(table, "borrowed") );
+    assert( &data[4] == sh_rcu_get_n(table, "a\0b", 3) );
+    assert( &data[5] == sh_rcu_delete_n(table, "a\0c", 3) );
+    assert( 2 == sh_rcu_nelems(table) );
+    assert( sh_rcu_destroy(table, 0) );
+
+    /* destroying frees the data if asked */
+    table = sh_rcu_new(8, 0, 0);
+    assert(table);
+    assert( sh_rcu_insert(table, "a", calloc(1, 8)) );
+    assert( sh_rcu_destroy(table, 1) );
+
+#ifndef SH_NO_THREADS
+    /* readers racing a writer that grows the table many times over,
+     * retiring old bucket arrays and deleted entries while they read
+     */
+    table = sh_rcu_new(1, 4, 0);
+    assert(table);
+
+    for( i=0; i<100; ++i ){
+        sprintf(key, "stable%d", i);
+        assert( sh_rcu_insert(table, key, &data[i]) );
+    }
+
+    readers.table = table;
+    readers.data = data;
+    readers.done = 0;
+    assert( 0 == pthread_mutex_init(&(readers.lock), 0) );
+
+    for( i=0; i<3; ++i ){
+        assert( 0 == pthread_create(&threads[i], 0, rcu_read, &readers) );
+    }
+
+    for( round=0; round<4; ++round ){
+        for( i=0; i<2000; ++i ){
+            sprintf(key, "churn%d", i);
+            assert( sh_rcu_insert(table, key, &data[i % 1000]) );
+        }
+        for( i=0; i<100; ++i ){
+            sprintf(key, "stable%d", i);
+            assert( sh_rcu_set(table, key, &data[i]) );
+        }
+        for( i=0; i<2000; ++i ){
+            sprintf(key, "churn%d", i);
+            assert( &data[i % 1000] == sh_rcu_delete(table, key) );
+        }
+    }
+
+    assert( 0 == pthread_mutex_lock(&(readers.lock)) );
+    readers.done = 1;
+    assert( 0 == pthread_mutex_unlock(&(readers.lock)) );
+
+    for( i=0; i<3; ++i ){
+        assert( 0 == pthread_join(threads[i], 0) );
+    }
+    assert( 0 == pthread_mutex_destroy(&(readers.lock)) );
+
+    assert( 100 == sh_rcu_nelems(table) );
+    assert( sh_rcu_destroy(table, 0) );
+#endif
+
+    /* error handling */
+    assert( 0 == sh_rcu_new(0, 0, 0) );
+    memset(&opts, 0, sizeof opts);
+    opts.backend = SH_BACKEND_SWISS;
+    assert( 0 == sh_rcu_new(8, 0, &opts) );
+    assert( SH_ERR_UNSUPPORTED == sh_last_error() );
+    assert( 0 == sh_rcu_destroy(0, 0) );
+    assert( 0 == sh_rcu_nelems(0) );
+    assert( 0 == sh_rcu_get(0, "a") );
+    assert( 0 == sh_rcu_exists_n(0, "a", 1) );
+    assert( 0 == sh_rcu_insert(0, "a", 0) );
+    assert( 0 == sh_rcu_set(0, "a", 0) );
+    assert( 0 == sh_rcu_delete(0, "a") );
+
+    table = sh_rcu_new(8, 0, 0);
+    assert(table);
+    assert( 0 == sh_rcu_get(table, 0) );
+    assert( 0 == sh_rcu_insert_n(table, 0, 0, 0) );
+    assert( 0 == sh_rcu_set_n(table, 0, 0, 0) );
+    assert( 0 == sh_rcu_delete_n(table, 0, 0) );
+    assert( sh_rcu_destroy(table, 0) );
+}
+
+#ifndef SH_NO_THREADS
+/* state of one thread hammering a struct sh_lf */
+struct lockfree_worker {
+    struct sh_lf *table;
+    /* keys of our own are prefixed with this */
+    int id;
+    /* our successes on the keys shared by every thread */
+    size_t inserted;
+    size_t deleted;
+    /* data stored under every key */
+    int *data;
+};
+
+void * lockfree_work(void *arg){
+    struct lockfree_worker *worker = arg;
+    /* iterators through rounds and keys */
+    int round = 0;
+    int i = 0;
+    /* a key */
+    char key[32];
+    /* a value found under a contended key */
+    int *value = 0;
+
+    for( round=0; round<4; ++round ){
+        /* keys of our own, left with only the even ones present */
+        for( i=0; i<2000; ++i ){
+            sprintf(key, "own%d-%d", worker->id, i);
+            assert( sh_lf_insert(worker->table, key, &worker->data[i]) );
+            assert( &worker->data[i] == sh_lf_get(worker->table, key) );
+        }
+        for( i=0; i<2000; ++i ){
+            sprintf(key, "own%d-%d", worker->id, i);
+            if( i % 2 ){
+                assert( &worker->data[i] == sh_lf_delete(worker->table, key) );
+            } else if( round < 3 ){
+                assert( sh_lf_set(worker->table, key, &worker->data[i + 1]) );
+                assert( &worker->data[i + 1] == sh_lf_delete(worker->table, key) );
+            }
+        }
+
+        /* keys every thread fights over */
+        for( i=0; i<500; ++i ){
+            sprintf(key, "shared%d", (i * 7 + worker->id) % 100);
+            if( sh_lf_insert(worker->table, key, &worker->data[0]) ){
+                ++worker->inserted;
+            }
+            sprintf(key, "shared%d", (i * 3 + worker->id) % 100);
+            if( sh_lf_delete(worker->table, key) ){
+                ++worker->deleted;
+            }
+            sh_lf_exists(worker->table, key);
+        }
+
+        /* keys every thread sets and deletes, racing sets with deletes
+         * of the same node; whatever is found must be one of our values
+         */
+        for( i=0; i<500; ++i ){
+            sprintf(key, "contended%d", (i * 5 + worker->id) % 20);
+            assert( sh_lf_set(worker->table, key, &worker->data[worker->id + 1]) );
+            value = sh_lf_get(worker->table, key);
+            assert( ! value || (value >= &worker->data[1] && value <= &worker->data[4]) );
+            sprintf(key, "contended%d", (i * 11 + worker->id) % 20);
+            value = sh_lf_delete(worker->table, key);
+            assert( ! value || (value >= &worker->data[1] && value <= &worker->data[4]) );
+        }
+    }
+
+    return 0;
+}
+#endif
+
+void lockfree(void){
+    /* our tables */
+    struct sh_lf *table = 0;
+    struct sh_opts opts;
+    /* iterator through keys */
+    int i = 0;
+    /* our keys, and data stored under them */
+    char key[32];
+    int data[2001];
+#ifndef SH_NO_THREADS
+    /* our threads */
+    pthread_t threads[4];
+    struct lockfree_worker workers[4];
+    /* shared keys left behind, and those found */
+    size_t shared = 0;
+    size_t found = 0;
+#endif
+
+    puts("\ntesting lock free tables");
+
+    for( i=0; i<2001; ++i ){
+        data[i] = i;
+    }
+
+    /* split ordering reverses the bits */
+    assert( 0 == sh_lf_reverse(0) );
+    assert( (UINT64_C(1) << 63) == sh_lf_reverse(1) );
+    assert( 1 == sh_lf_reverse(UINT64_C(1) << 63) );
+    assert( UINT64_C(0x0f00000000000000) == sh_lf_reverse(0xf0) );
+
+    /* small enough to split buckets many times over */
+    table = sh_lf_new(2, 0, 0);
+    assert(table);
+    assert( 0 == sh_lf_nelems(table) );
+
+    for( i=0; i<2000; ++i ){
+        sprintf(key, "key%d", i);
+        assert( sh_lf_insert(table, key, &data[i]) );
+    }
+    assert( 2000 == sh_lf_nelems(table) );
+    assert( 0 == sh_lf_insert(table, "key10", &data[0]) );
+    assert( SH_ERR_EXISTS == sh_last_error() );
+
+    for( i=0; i<2000; ++i ){
+        sprintf(key, "key%d", i);
+        assert( sh_lf_exists(table, key) );
+        assert( &data[i] == sh_lf_get(table, key) );
+        assert( &data[i] == sh_lf_get_n(table, key, strlen(key)) );
+    }
+    assert( 0 == sh_lf_exists(table, "key2000") );
+    assert( 0 == sh_lf_get(table, "key2000") );
+    assert( SH_ERR_NOT_FOUND == sh_last_error() );
+
+    /* set both updates and inserts */
+    assert( sh_lf_set(table, "key0", &data[1]) );
+    assert( &data[1] == sh_lf_get(table, "key0") );
+    assert( sh_lf_set_n(table, "key2000", 7, &data[2000]) );
+    assert( &data[2000] == sh_lf_get(table, "key2000") );
+    assert( 2001 == sh_lf_nelems(table) );
+
+    /* deleted nodes are retired, enough of them to be reclaimed */
+    for( i=1; i<2000; i+=2 ){
+        sprintf(key, "key%d", i);
+        assert( &data[i] == sh_lf_delete(table, key) );
+        assert( 0 == sh_lf_exists(table, key) );
+        assert( 0 == sh_lf_delete_n(table, key, strlen(key)) );
+        assert( SH_ERR_NOT_FOUND == sh_last_error() );
+    }
+    assert( 1001 == sh_lf_nelems(table) );
+
+    for( i=0; i<2000; i+=2 ){
+        sprintf(key, "key%d", i);
+        assert( sh_lf_exists_n(table, key, strlen(key)) );
+    }
+
+    /* and deleted keys may come back */
+    assert( sh_lf_insert(table, "key1", &data[1]) );
+    assert( &data[1] == sh_lf_get(table, "key1") );
+
+    assert( sh_lf_destroy(table, 0) );
+
+    /* keys containing null bytes, and the empty key */
+    memset(&opts, 0, sizeof opts);
+    opts.hash_fn = sh_hash_xxh64;
+    table = sh_lf_new(1, 1, &opts);
+    assert(table);
+    assert( sh_lf_insert_n(table, "a\0b", 3, &data[4]) );
+    assert( sh_lf_insert_n(table, "a\0c", 3, &data[5]) );
+    assert( sh_lf_insert(table, "", &data[6]) );
+    assert( &data[4] == sh_lf_get_n(table, "a\0b", 3) );
+    assert( &data[6] == sh_lf_get(table, "") );
+    assert( &data[5] == sh_lf_delete_n(table, "a\0c", 3) );
+    assert( 2 == sh_lf_nelems(table) );
+    assert( sh_lf_destroy(table, 0) );
+
+    /* destroying frees the data if asked */
+    table = sh_lf_new(8, 0, 0);
+    assert(table);
+    assert( sh_lf_insert(table, "a", calloc(1, 8)) );
+    assert( sh_lf_destroy(table, 1) );
+
+#ifndef SH_NO_THREADS
+    /* many threads at once, growing from a single bucket */
+    table = sh_lf_new(1, 2, 0);
+    assert(table);
+
+    for( i=0; i<4; ++i ){
+        workers[i].table = table;
+        workers[i].id = i;
+        workers[i].inserted = 0;
+        workers[i].deleted = 0;
+        workers[i].data = data;
+        assert( 0 == pthread_create(&threads[i], 0, lockfree_work, &workers[i]) );
+    }
+
+    for( i=0; i<4; ++i ){
+        assert( 0 == pthread_join(threads[i], 0) );
+        shared += workers[i].inserted - workers[i].deleted;
+    }
+
+    for( i=0; i<100; ++i ){
+        sprintf(key, "shared%d", i);
+        if( sh_lf_exists(table, key) ){
+            ++found;
+        }
+    }
+    assert( shared == found );
+
+    for( i=0; i<20; ++i ){
+        sprintf(key, "contended%d", i);
+        if( sh_lf_exists(table, key) ){
+            ++found;
+        }
+    }
+
+    for( i=0; i<2000; ++i ){
+        sprintf(key, "own3-%d", i);
+        assert( (i % 2 ? 0 : &data[i]) == sh_lf_get(table, key) );
+    }
+    assert( 4 * 1000 + found == sh_lf_nelems(table) );
+
+    assert( sh_lf_destroy(table, 0) );
+#endif
+
+    /* error handling */
+    assert( 0 == sh_lf_new(0, 0, 0) );
+    memset(&opts, 0, sizeof opts);
+    opts.borrow_keys = 1;
+    assert( 0 == sh_lf_new(8, 0, &opts) );
+    assert( SH_ERR_UNSUPPORTED == sh_last_error() );
+    assert( 0 == sh_lf_destroy(0, 0) );
+    assert( 0 == sh_lf_nelems(0) );
+    assert( 0 == sh_lf_get(0, "a") );
+    assert( 0 == sh_lf_exists_n(0, "a", 1) );
+    assert( 0 == sh_lf_insert(0, "a", 0) );
+    assert( 0 == sh_lf_set(0, "a", 0) );
+    assert( 0 == sh_lf_delete(0, "a") );
+
+    table = sh_lf_new(8, 0, 0);
+    assert(table);
+    assert( 0 == sh_lf_get(table, 0) );
+    assert( 0 == sh_lf_insert_n(table, 0, 0, 0) );
+    assert( 0 == sh_lf_set_n(table, 0, 0, 0) );
+    assert( 0 == sh_lf_delete_n(table, 0, 0) );
+    assert( sh_lf_destroy(table, 0) );
+}
+
+#ifndef SH_NO_THREADS
+/* state of one thread publishing requests to a struct sh_fc */
+struct combining_worker {
+    struct sh_fc *fc;
+    /* keys of our own are prefixed with this */
+    int id;
+    /* our successes on the keys shared by every thread */
+    size_t inserted;
+    size_t deleted;
+    /* data stored under every key */
+    int *data;
+};
+
+void * combining_work(void *arg){
+    struct combining_worker *worker = arg;
+    /* iterator through keys */
+    int i = 0;
+    /* a key */
+    char key[32];
+
+    for( i=0; i<1000; ++i ){
+        sprintf(key, "own%d-%d", worker->id, i);
+        assert( sh_fc_insert(worker->fc, key, &worker->data[i]) );
+        assert( 0 == sh_fc_insert(worker->fc, key, &worker->data[i]) );
+        assert( SH_ERR_EXISTS == sh_last_error() );
+        assert( &worker->data[i] == sh_fc_get(worker->fc, key) );
+        if( i % 2 ){
+            assert( sh_fc_set(worker->fc, key, &worker->data[i - 1]) );
+            assert( &worker->data[i - 1] == sh_fc_delete(worker->fc, key) );
+        }
+
+        sprintf(key, "shared%d", (i * 7 + worker->id) % 50);
+        if( sh_fc_insert(worker->fc, key, &worker->data[0]) ){
+            ++worker->inserted;
+        }
+        sprintf(key, "shared%d", (i * 3 + worker->id) % 50);
+        if( sh_fc_delete(worker->fc, key) ){
+            ++worker->deleted;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+void combining(void){
+    /* our table */
+    struct sh_fc *fc = 0;
+    struct sh_opts opts;
+    /* iterator through keys */
+    int i = 0;
+    /* our keys, and data stored under them */
+    char key[32];
+    int data[1000];
+#ifndef SH_NO_THREADS
+    /* our threads */
+    pthread_t threads[4];
+    struct combining_worker workers[4];
+    /* shared keys left behind, and those found */
+    size_t shared = 0;
+    size_t found = 0;
+#endif
+
+    puts("\ntesting flat combining");
+
+    for( i=0; i<1000; ++i ){
+        data[i] = i;
+    }
+
+    fc = sh_fc_new(4, 0, 0);
+    assert(fc);
+    assert( 0 == sh_fc_nelems(fc) );
+
+    for( i=0; i<1000; ++i ){
+        sprintf(key, "key%d", i);
+        assert( sh_fc_insert(fc, key, &data[i]) );
+    }
+    assert( 1000 == sh_fc_nelems(fc) );
+
+    /* errors come back to the thread that made the request */
+    sh_clear_error();
+    assert( 0 == sh_fc_insert(fc, "key10", &data[0]) );
+    assert( SH_ERR_EXISTS == sh_last_error() );
+    assert( sh_fc_exists(fc, "key10") );
+    assert( SH_ERR_EXISTS == sh_last_error() );
+    assert( 0 == sh_fc_delete(fc, "key1000") );
+    assert( SH_ERR_NOT_FOUND == sh_last_error() );
+
+    for( i=0; i<1000; ++i ){
+        sprintf(key, "key%d", i);
+        assert( sh_fc_exists_n(fc, key, strlen(key)) );
+        assert( &data[i] == sh_fc_get_n(fc, key, strlen(key)) );
+    }
+
+    assert( sh_fc_set(fc, "key0", &data[1]) );
+    assert( &data[1] == sh_fc_get(fc, "key0") );
+    assert( sh_fc_set_n(fc, "key1000", 7, &data[0]) );
+    assert( 1001 == sh_fc_nelems(fc) );
+    assert( &data[0] == sh_fc_delete(fc, "key1000") );
+    assert( 0 == sh_fc_delete_n(fc, "key1000", 7) );
+    assert( 1000 == sh_fc_nelems(fc) );
+
+    /* the table underneath works with the plain api */
+    assert( sh_fc_table(fc) );
+    assert( 1000 == sh_nelems(sh_fc_table(fc)) );
+    assert( &data[5] == sh_get(sh_fc_table(fc), "key5") );
+    assert( &data[5] == sh_fc_delete(fc, "key5") );
+    assert( 999 == sh_nelems(sh_fc_table(fc)) );
+
+    assert( sh_fc_destroy(fc, 0) );
+
+    /* any backend may be used */
+    memset(&opts, 0, sizeof opts);
+    opts.backend = SH_BACKEND_SWISS;
+    fc = sh_fc_new(8, 1, &opts);
+    assert(fc);
+    assert( sh_fc_insert(fc, "a", calloc(1, 8)) );
+    assert( sh_fc_insert_n(fc, "a\0b", 3, calloc(1, 8)) );
+    assert( 2 == sh_fc_nelems(fc) );
+    assert( sh_fc_destroy(fc, 1) );
+
+#ifndef SH_NO_THREADS
+    fc = sh_fc_new(1, 2, 0);
+    assert(fc);
+
+    for( i=0; i<4; ++i ){
+        workers[i].fc = fc;
+        workers[i].id = i;
+        workers[i].inserted = 0;
+        workers[i].deleted = 0;
+        workers[i].data = data;
+        assert( 0 == pthread_create(&threads[i], 0, combining_work, &workers[i]) );
+    }
+
+    for( i=0; i<4; ++i ){
+        assert( 0 == pthread_join(threads[i], 0) );
+        shared += workers[i].inserted - workers[i].deleted;
+    }
+
+    for( i=0; i<50; ++i ){
+        sprintf(key, "shared%d", i);
+        if( sh_fc_exists(fc, key) ){
+            ++found;
+        }
+    }
+    assert( shared == found );
+
+    for( i=0; i<1000; ++i ){
+        sprintf(key, "own2-%d", i);
+        assert( (i % 2 ? 0 : &data[i]) == sh_fc_get(fc, key) );
+    }
+    assert( 4 * 500 + found == sh_fc_nelems(fc) );
+
+    assert( sh_fc_destroy(fc, 0) );
+#endif
+
+    /* error handling */
+    assert( 0 == sh_fc_new(0, 0, 0) );
+    assert( 0 == sh_fc_destroy(0, 0) );
+    assert( 0 == sh_fc_table(0) );
+    assert( 0 == sh_fc_nelems(0) );
+    assert( 0 == sh_fc_get(0, "a") );
+    assert( 0 == sh_fc_exists_n(0, "a", 1) );
+    assert( 0 == sh_fc_insert(0, "a", 0) );
+    assert( 0 == sh_fc_set(0, "a", 0) );
+    assert( 0 == sh_fc_delete(0, "a") );
+
+    fc = sh_fc_new(8, 0, 0);
+    assert(fc);
+    assert( 0 == sh_fc_get(fc, 0) );
+    assert( 0 == sh_fc_exists(fc, 0) );
+    assert( 0 == sh_fc_insert_n(fc, 0, 0, 0) );
+    assert( 0 == sh_fc_set_n(fc, 0, 0, 0) );
+    assert( 0 == sh_fc_delete_n(fc, 0, 0) );
+    assert( SH_ERR_INVALID == sh_last_error() );
+    assert( sh_fc_destroy(fc, 0) );
+}
+
+void telemetry(void){
+    /* our simple hash table */
+    struct sh_table *table = 0;
+    /* our counters */
+    struct sh_telemetry snapshot;
+    /* iterators through operations and latency buckets */
+    size_t op = 0;
+    size_t i = 0;
+    /* total of a latency histogram */
+    uint64_t total = 0;
+
+    /* keys for the batch operations */
+    const void *keys[2] = { "a", "z" };
+    void *values[2];
+    /* some data */
+    int data = 1;
+
+    puts("\ntesting telemetry");
+
+    table = sh_new(4);
+    assert(table);
+
+    assert( sh_insert(table, "a", &data) );
+    assert( sh_insert(table, "b", &data) );
+    assert( 0 == sh_insert(table, "a", &data) );
+    assert( sh_get(table, "a") );
+    assert( 0 == sh_get(table, "z") );
+    assert( sh_exists(table, "b") );
+    assert( 0 == sh_lookup(table, "z", 0) );
+    assert( sh_update(table, "a", &data) );
+    assert( 0 == sh_update(table, "z", &data) );
+    assert( sh_set(table, "a", &data) );
+    assert( sh_set(table, "c", &data) );
+    assert( sh_get_or_insert(table, "b", 0) );
+    assert( sh_get_or_insert(table, "d", 0) );
+    assert( sh_delete(table, "c") );
+    assert( 0 == sh_delete(table, "c") );
+    assert( 1 == sh_get_many(table, keys, 0, 2, values, 0) );
+    assert( sh_resize(table, 64) );
+
+    if( ! table->telemetry ){
+        puts("built without SH_TELEMETRY");
+        assert( 0 == sh_telemetry_snapshot(table, &snapshot) );
+        assert( 0 == sh_telemetry_reset(table) );
+        assert( sh_destroy(table, 1, 0) );
+        puts("success!");
+        return;
+    }
+
+    puts("counting hits and misses");
+    assert( sh_telemetry_snapshot(table, &snapshot) );
+    /* get, exists, get_or_insert and get_many of "a" */
+    assert( 4 == snapshot.hits[SH_OP_GET] );
+    /* get, lookup and get_many of "z" */
+    assert( 3 == snapshot.misses[SH_OP_GET] );
+    /* a, b, set of c, get_or_insert of d */
+    assert( 4 == snapshot.hits[SH_OP_INSERT] );
+    assert( 1 == snapshot.misses[SH_OP_INSERT] );
+    assert( 2 == snapshot.hits[SH_OP_UPDATE] );
+    assert( 1 == snapshot.misses[SH_OP_UPDATE] );
+    assert( 1 == snapshot.hits[SH_OP_DELETE] );
+    assert( 1 == snapshot.misses[SH_OP_DELETE] );
+    assert( snapshot.nodes_visited >= 6 );
+    /* growing for d, and the explicit resize */
+    assert( 2 == snapshot.resizes );
+
+    puts("every timed operation has a latency");
+    for( op=0; op<SH_OP_COUNT; ++op ){
+        total = 0;
+        for( i=0; i<SH_LATENCY_BUCKETS; ++i ){
+            total += snapshot.latency[op][i];
+        }
+        /* the batch operations are not timed */
+        assert( total == snapshot.hits[op] + snapshot.misses[op] - (op == SH_OP_GET ? 2 : 0) );
+    }
+
+    puts("resetting");
+    assert( sh_telemetry_reset(table) );
+    assert( sh_telemetry_snapshot(table, &snapshot) );
+    assert( 0 == snapshot.hits[SH_OP_GET] );
+    assert( 0 == snapshot.nodes_visited );
+    assert( 0 == snapshot.resizes );
+    assert( 0 == snapshot.latency[SH_OP_GET][0] );
+
+    assert( 0 == sh_telemetry_snapshot(0, &snapshot) );
+    assert( 0 == sh_telemetry_snapshot(table, 0) );
+    assert( 0 == sh_telemetry_reset(0) );
+
+    assert( sh_destroy(table, 1, 0) );
+    puts("success!");
+}
+
+void destroy(void){
+    /* specifically test sh_destroy with free_data = 1 */
+
+    /* our simple hash table */
+    struct sh_table *table = 0;
+
+    /* some keys */
+    char *key_1 = "bbbbb";
+    char *key_2 = "aaaaa";
+    char *key_3 = "ccccc";
+
+    /* some data */
+    int *data_1 = 0;
+    int *data_2 = 0;
+    int *data_3 = 0;
+
+    /* temporary data pointer used for testing get */
+    int *data = 0;
+
+    data_1 = calloc(1, sizeof(int));
+    assert( data_1 );
+    *data_1 = 1;
+
+    data_2 = calloc(1, sizeof(int));
+    assert( data_2 );
+    *data_2 = 2;
+
+    data_3 = calloc(1, sizeof(int));
+    assert( data_3 );
+    *data_3 = 3;
+
+
+    puts("\ntesting destroy");
+
+    puts("creating table");
+    table = sh_new(32);
+    assert(table);
+    assert( 32 == table->size );
+    assert( 0 == sh_nelems(table) );
+
+
+    puts("populating");
+    assert( sh_insert(table, key_1, data_1) );
+    assert( 1 == sh_nelems(table) );
+    assert( 0 == sh_get(table, key_2) );
+    assert( 0 == sh_get(table, key_3) );
+    data = sh_get(table, key_1);
+    assert(data);
+    assert( *data_1 == *data );
+
+
+    assert( sh_insert(table, key_2, data_2) );
+    assert( 2 == sh_nelems(table) );
+    assert( 0 == sh_get(table, key_3) );
+    data = sh_get(table, key_2);
+    assert(data);
+    assert( *data_2 == *data );
+
+
+    assert( sh_insert(table, key_3, data_3) );
+    assert( 3 == sh_nelems(table) );
+    data = sh_get(table, key_3);
+    assert(data);
+    assert( *data_3 == *data );
+
+
+    /* destroy including all data */
+    assert( sh_destroy(table, 1, 1) );
+    puts("success!");
+}
+
+void error_handling(void){
+    /* our simple hash table */
+    struct sh_table *table = 0;
+    struct sh_table *not_table = 0;
+    struct sh_table static_table;
+    struct sh_key handle;
+    struct sh_opts opts;
+
+    /* some keys */
+    const void *keys[1] = { "bbbbb" };
+    void *values[1];
+    struct sh_stats stats;
+    char *key_1 = "bbbbb";
+    char *key_2 = "aaaaa";
+    char *key_3 = "ccccc";
+
+    /* some data */
+    int data_1 = 1;
+    int data_2 = 2;
+    int data_3 = 3;
+
+    /* temporary data pointer used for testing get */
+    int *data = 0;
+
+
+    puts("\ntesting handling of error cases");
+
+    puts("testing sh_nelems");
+    assert( 0 == sh_nelems(0) );
+
+    puts("setting up...");
+
+    puts("creating table");
+    table = sh_new(3);
+    assert(table);
+    assert( 3 == table->size );
+    assert( 0 == sh_nelems(table) );
+
+    puts("inserting some data");
+    assert( sh_insert(table, key_1, &data_1) );
+    assert( 1 == sh_nelems(table) );
+    assert( 0 == sh_get(table, key_2) );
+    assert( 0 == sh_get(table, key_3) );
+    data = sh_get(table, key_1);
+    assert(data);
+    assert( data_1 == *data );
+
+
+    assert( sh_insert(table, key_2, &data_2) );
+    assert( 2 == sh_nelems(table) );
+    assert( 0 == sh_get(table, key_3) );
+    data = sh_get(table, key_2);
+    assert(data);
+    assert( data_2 == *data );
+
+
+    puts("beginning actual testing");
+    /* sh_hash */
+    puts("testing sh_hash");
+    assert( 0 == sh_hash(0, 0) );
+    assert( sh_hash(key_1, 0) );
+
+    /* sh_new and sh_init */
+    puts("testing sh_new and sh_init");
+    assert( 0 == sh_new(0) );
+    assert( 0 == sh_init(0, 100) );
+    assert( 0 == sh_init(&static_table, 0) );
+    assert( 0 == sh_new_opts(0, 0) );
+    assert( 0 == sh_init_opts(0, 100, 0) );
+    memset(&opts, 0, sizeof opts);
+    opts.backend = 99;
+    assert( 0 == sh_new_opts(100, &opts) );
+
+    /* sh_resize */
+    puts("testing sh_resize");
+    assert( 0 == sh_resize(0, 100) );
+    assert( 0 == sh_resize(table, 0) );
+
+    /* sh_set_load_factors and sh_get_load_factors */
+    puts("testing sh_set_load_factors and sh_get_load_factors");
+    assert( 0 == sh_set_load_factors(0, 0.75, 0) );
+    assert( 0 == sh_get_load_factors(0, 0, 0) );
+
+    /* incremental resizing */
+    puts("testing sh_set_incremental, sh_rehash_step and sh_rehashing");
+    assert( 0 == sh_set_incremental(0, 1) );
+    assert( 0 == sh_rehash_step(0, 1) );
+    assert( 0 == sh_rehashing(0) );
+
+    /* sh_exists */
+    puts("testing sh_exists");
+    assert( 0 == sh_exists(0, key_1) );
+    assert( 0 == sh_exists(table, 0) );
+    assert( 0 == sh_exists(table, key_3) );
+
+    /* sh_insert */
     puts("testing sh_insert");
     assert( 0 == sh_insert(0, key_1, &data_1) );
     assert( 0 == sh_insert(table, 0, &data_1) );
@@ -813,6 +3708,17 @@ void error_handling(void){
     assert( 0 == sh_set(0, key_1, &data_1) );
     assert( 0 == sh_set(table, 0, &data_1) );
 
+    /* sh_lookup */
+    puts("testing sh_lookup");
+    assert( 0 == sh_lookup(0, key_1, (void **) &data) );
+    assert( 0 == sh_lookup(table, 0, (void **) &data) );
+    assert( 0 == sh_lookup(table, key_3, (void **) &data) );
+
+    /* sh_get_or_insert */
+    puts("testing sh_get_or_insert");
+    assert( 0 == sh_get_or_insert(0, key_1, 0) );
+    assert( 0 == sh_get_or_insert(table, 0, 0) );
+
     /* sh_get */
     puts("testing sh_get");
     assert( 0 == sh_get(0, key_1) );
@@ -826,6 +3732,72 @@ void error_handling(void){
     /* cannot delete a non-existent key */
     assert( 0 == sh_delete(table, key_3) );
 
+    /* length explicit api */
+    puts("testing _n functions");
+    assert( 0 == sh_exists_n(0, key_1, 5) );
+    assert( 0 == sh_exists_n(table, 0, 5) );
+    assert( 0 == sh_insert_n(0, key_1, 5, &data_1) );
+    assert( 0 == sh_insert_n(table, 0, 5, &data_1) );
+    assert( 0 == sh_update_n(0, key_1, 5, &data_1) );
+    assert( 0 == sh_update_n(table, 0, 5, &data_1) );
+    assert( 0 == sh_set_n(0, key_1, 5, &data_1) );
+    assert( 0 == sh_set_n(table, 0, 5, &data_1) );
+    assert( 0 == sh_get_n(0, key_1, 5) );
+    assert( 0 == sh_get_n(table, 0, 5) );
+    assert( 0 == sh_lookup_n(0, key_1, 5, 0) );
+    assert( 0 == sh_lookup_n(table, 0, 5, 0) );
+    assert( 0 == sh_get_or_insert_n(0, key_1, 5, 0) );
+    assert( 0 == sh_get_or_insert_n(table, 0, 5, 0) );
+    assert( 0 == sh_delete_n(0, key_1, 5) );
+    assert( 0 == sh_delete_n(table, 0, 5) );
+    assert( 0 == sh_iterate_n(0, 0, 0) );
+    assert( 0 == sh_iterate_n(table, 0, 0) );
+
+    /* pre-hashed api */
+    puts("testing sh_key_init and _k functions");
+    assert( 0 == sh_key_init(0, key_1, 5) );
+    assert( 0 == sh_key_init(&handle, 0, 5) );
+    assert( sh_key_init(&handle, key_1, 5) );
+    assert( 0 == sh_key_init_for(0, table, key_1, 5) );
+    assert( 0 == sh_key_init_for(&handle, 0, key_1, 5) );
+    assert( 0 == sh_key_init_for(&handle, table, 0, 5) );
+    assert( 0 == sh_exists_k(0, &handle) );
+    assert( 0 == sh_exists_k(table, 0) );
+    assert( 0 == sh_insert_k(0, &handle, &data_1) );
+    assert( 0 == sh_insert_k(table, 0, &data_1) );
+    assert( 0 == sh_update_k(0, &handle, &data_1) );
+    assert( 0 == sh_update_k(table, 0, &data_1) );
+    assert( 0 == sh_set_k(0, &handle, &data_1) );
+    assert( 0 == sh_set_k(table, 0, &data_1) );
+    assert( 0 == sh_get_k(0, &handle) );
+    assert( 0 == sh_get_k(table, 0) );
+    assert( 0 == sh_lookup_k(0, &handle, 0) );
+    assert( 0 == sh_lookup_k(table, 0, 0) );
+    assert( 0 == sh_get_or_insert_k(0, &handle, 0) );
+    assert( 0 == sh_get_or_insert_k(table, 0, 0) );
+    assert( 0 == sh_delete_k(0, &handle) );
+    assert( 0 == sh_delete_k(table, 0) );
+
+    /* batch operations */
+    puts("testing batch operations");
+    assert( 0 == sh_get_many(0, keys, 0, 1, values, 0) );
+    assert( 0 == sh_get_many(table, 0, 0, 1, values, 0) );
+    assert( 0 == sh_get_many(table, keys, 0, 1, 0, 0) );
+    assert( 0 == sh_exists_many(0, keys, 0, 1, 0) );
+    assert( 0 == sh_exists_many(table, 0, 0, 1, 0) );
+    assert( 0 == sh_delete_many(0, keys, 0, 1, 0, 0) );
+    assert( 0 == sh_delete_many(table, 0, 0, 1, 0, 0) );
+    assert( 0 == sh_stats(0, &stats) );
+    assert( 0 == sh_stats(table, 0) );
+    assert( 0 == sh_build(0, keys, 0, 0, 1, 1, 0) );
+    assert( 0 == sh_build(table, 0, 0, 0, 1, 1, 0) );
+    assert( 0 == sh_build(table, keys, 0, 0, 0, 1, 0) );
+    keys[0] = 0;
+    assert( 0 == sh_build(table, keys, 0, 0, 1, 1, 0) );
+    assert( 0 == sh_get_many(table, keys, 0, 1, values, 0) );
+    assert( 0 == sh_exists_many(table, keys, 0, 1, 0) );
+    assert( 0 == sh_delete_many(table, keys, 0, 1, 0, 0) );
+
     /* sh_iterate */
     puts("testing sh_iterate");
     /* fail on table undef */
@@ -851,26 +3823,42 @@ int internal(void){
 
     /* sh_strdupn */
     puts("testing sh_strdupn");
-    assert( 0 == sh_strdupn(0, 6) );
-    str = sh_strdupn("hello", 0);
+    assert( 0 == sh_strdupn(0, 0, 6) );
+    str = sh_strdupn(0, "hello", 0);
     assert(str);
     free(str);
 
     /* sh_entry_new and sh_entry_init */
     puts("testing sh_entry_new and sh_entry_init");
-    assert( 0 == sh_entry_init(0, 0, 0, 0, 0, 0) );
-    assert( 0 == sh_entry_init(&she, 0, 0, 0, 0, 0) );
-    assert( 0 == sh_entry_new(0, 0, 0, 0, 0) );
-    new_she = sh_entry_new(0, "hello", 0, 0, 0);
+    assert( 0 == sh_entry_init(0, 0, 0, 0, 0, 0, 0, 0) );
+    assert( 0 == sh_entry_init(0, &she, 0, 0, 0, 0, 0, 0) );
+    assert( 0 == sh_entry_new(0, 0, 0, 0, 0, 0, 0) );
+    new_she = sh_entry_new(0, 0, "hello", 5, 0, 0, 0);
     assert(new_she);
-    assert( sh_entry_init(&she, 0, "hello", 0, 0, 0) );
+    assert( sh_entry_key_inline(new_she) );
+    assert( 5 == new_she->key_len );
+    assert( 0 == strcmp("hello", new_she->key) );
+    assert( sh_entry_init(0, &she, 0, "hello", 0, 0, 0, 0) );
+    assert( 0 == sh_entry_key_inline(&she) );
 
     /* sh_entry_destroy */
     puts("testing sh_entry_destroy");
-    assert( 0 == sh_entry_destroy(0, 0, 0) );
+    assert( 0 == sh_entry_destroy(0, 0, 0, 0, 1) );
     new_she->data = calloc(1, sizeof(int));
     assert(new_she->data);
-    assert(  sh_entry_destroy(new_she, 1, 1) );
+    assert(  sh_entry_destroy(0, new_she, 1, 1, 1) );
+    assert(  sh_entry_destroy(0, &she, 0, 0, 1) );
+
+    /* borrowed keys are stored as is and never freed */
+    str = "hello";
+    new_she = sh_entry_new(0, 0, str, 5, 0, 0, 1);
+    assert(new_she);
+    assert( str == new_she->key );
+    assert( 0 == sh_entry_key_inline(new_she) );
+    assert(  sh_entry_destroy(0, new_she, 1, 0, 0) );
+    assert( sh_entry_init(0, &she, 0, str, 5, 0, 0, 1) );
+    assert( str == she.key );
+    assert(  sh_entry_destroy(0, &she, 0, 0, 0) );
 
     /* sh_find_entry */
     puts("testing sh_find_entry");
@@ -1056,6 +4044,277 @@ void iteration(void){
     puts("success!");
 }
 
+/* state for error_log */
+struct error_log_state {
+    /* number of messages logged */
+    size_t count;
+    /* the last error and message logged */
+    enum sh_error error;
+    const char *message;
+};
+
+void error_log(enum sh_error error, const char *message, void *data){
+    struct error_log_state *state = data;
+
+    state->count += 1;
+    state->error = error;
+    state->message = message;
+}
+
+void error_reporting(void){
+    /* our simple hash table */
+    struct sh_table *table = 0;
+    /* what our log has seen */
+    struct error_log_state state;
+    /* iterator through errors */
+    int i = 0;
+
+    /* keys for sh_build, one of which is invalid */
+    const void *keys[4] = { "a", "b", 0, "d" };
+    /* some data */
+    int data = 1;
+
+    puts("\ntesting error reporting");
+
+    memset(&state, 0, sizeof state);
+
+    /* nothing is logged until a log is installed */
+    sh_clear_error();
+    assert( SH_OK == sh_last_error() );
+    assert( 0 == sh_get(0, "a") );
+    assert( SH_ERR_INVALID == sh_last_error() );
+
+    sh_set_log(error_log, &state);
+
+    table = sh_new(4);
+    assert(table);
+
+    /* failures record why and are logged */
+    sh_clear_error();
+    assert( sh_insert(table, "a", &data) );
+    assert( SH_OK == sh_last_error() );
+    assert( 0 == state.count );
+
+    assert( 0 == sh_delete(table, "b") );
+    assert( SH_ERR_NOT_FOUND == sh_last_error() );
+    assert( 1 == state.count );
+    assert( SH_ERR_NOT_FOUND == state.error );
+    assert( 0 == strcmp("sh_delete_k: failed to find key", state.message) );
+
+    assert( 0 == sh_insert(table, "a", &data) );
+    assert( SH_ERR_EXISTS == sh_last_error() );
+    assert( 2 == state.count );
+
+    /* like errno, success leaves the last error in place */
+    assert( sh_get(table, "a") );
+    assert( SH_ERR_EXISTS == sh_last_error() );
+
+    /* a miss records why, telling it apart from a stored 0 */
+    assert( sh_set(table, "null", 0) );
+    sh_clear_error();
+    assert( 0 == sh_get(table, "null") );
+    assert( SH_OK == sh_last_error() );
+    assert( 0 == sh_get(table, "b") );
+    assert( SH_ERR_NOT_FOUND == sh_last_error() );
+    sh_clear_error();
+    assert( 0 == sh_update(table, "b", &data) );
+    assert( SH_ERR_NOT_FOUND == sh_last_error() );
+    sh_clear_error();
+    assert( 0 == sh_lookup(table, "b", 0) );
+    assert( SH_ERR_NOT_FOUND == sh_last_error() );
+    assert( 5 == state.count );
+    assert( 0 == strcmp("sh_lookup_k: failed to find key", state.message) );
+
+    /* propagating through callers logs again with the original error */
+    assert( 0 == sh_new(0) );
+    assert( SH_ERR_INVALID == sh_last_error() );
+    assert( 7 == state.count );
+    assert( SH_ERR_INVALID == state.error );
+    assert( 0 == strcmp("sh_new_opts: call to sh_init_opts failed", state.message) );
+
+    /* telemetry is only available when built with SH_TELEMETRY */
+    if( ! sh_telemetry_reset(table) ){
+        assert( SH_ERR_UNSUPPORTED == sh_last_error() );
+    }
+
+    /* failures on worker threads are reported by sh_build itself */
+    sh_clear_error();
+    assert( 0 == sh_build(table, keys, 0, 0, 4, 2, 1) );
+    assert( SH_ERR_INVALID == sh_last_error() );
+    assert( SH_ERR_INVALID == state.error );
+    assert( 0 == strcmp("sh_build: failed", state.message) );
+
+    /* every error has a distinct description */
+    for( i=0; i<SH_ERR_COUNT; ++i ){
+        assert( sh_strerror(i) );
+        assert( strcmp(sh_strerror(i), sh_strerror(SH_ERR_COUNT)) );
+        if( i ){
+            assert( strcmp(sh_strerror(i), sh_strerror(i - 1)) );
+        }
+    }
+
+    /* removing the log */
+    sh_set_log(0, 0);
+    state.count = 0;
+    assert( 0 == sh_delete(table, "b") );
+    assert( 0 == state.count );
+    assert( SH_ERR_NOT_FOUND == sh_last_error() );
+
+    assert( sh_destroy(table, 1, 0) );
+}
+
+/* per thread state of our parallel iteration test below */
+struct parallel_sum {
+    /* times each value was seen, shared */
+    unsigned int *seen;
+    /* this thread's total and number of pairs */
+    size_t sum;
+    size_t count;
+};
+
+/* state_init used by our parallel iteration test below */
+void * parallel_sum_init(void *state, size_t thread){
+    struct parallel_sum *total = state;
+    struct parallel_sum *sum = calloc(1, sizeof(struct parallel_sum));
+
+    (void) thread;
+    assert(sum);
+    sum->seen = total->seen;
+
+    return sum;
+}
+
+/* function used by our parallel iteration test below */
+unsigned int parallel_sum_each(void *state, const void *key, size_t key_len, void **data){
+    struct parallel_sum *sum = state;
+    int value = *(int *) *data;
+
+    assert(key);
+    (void) key_len;
+
+    ++sum->seen[value];
+    sum->sum += value;
+    ++sum->count;
+
+    return 1;
+}
+
+/* reduce used by our parallel iteration test below */
+void parallel_sum_reduce(void *state, void *thread_state){
+    struct parallel_sum *total = state;
+    struct parallel_sum *sum = thread_state;
+
+    total->sum += sum->sum;
+    total->count += sum->count;
+    free(sum);
+}
+
+void parallel_iteration(void){
+    /* our simple hash table */
+    struct sh_table *table = 0;
+    /* options to create it with */
+    struct sh_opts opts;
+    /* the backends to try */
+    enum sh_backend backends[] = {
+        SH_BACKEND_CHAINING,
+        SH_BACKEND_ROBIN_HOOD,
+        SH_BACKEND_SWISS,
+    };
+    /* thread counts to try */
+    unsigned int threads[] = { 0, 1, 3, 8, 100000 };
+    /* iterators through backends, incremental resizes, thread counts and keys */
+    unsigned int b = 0;
+    unsigned int incremental = 0;
+    unsigned int t = 0;
+    int i = 0;
+    /* our totals */
+    struct parallel_sum total;
+    /* a range of buckets */
+    size_t start = 0;
+    size_t n_buckets = 0;
+    /* a key */
+    char key[16];
+    /* some data, and how often each was seen */
+    int data[5000];
+    unsigned int seen[5000];
+
+    puts("\ntesting parallel iteration");
+
+    for( i=0; i<5000; ++i ){
+        data[i] = i;
+    }
+
+    for( b=0; b<3; ++b ){
+        for( incremental=0; incremental<2; ++incremental ){
+            if( b && incremental ){
+                continue;
+            }
+
+            memset(&opts, 0, sizeof opts);
+            opts.backend = backends[b];
+            table = sh_new_opts(16, &opts);
+            assert(table);
+            if( incremental ){
+                assert( sh_set_incremental(table, 1) );
+            }
+
+            for( i=0; i<5000; ++i ){
+                sprintf(key, "iter%d", i);
+                assert( sh_insert(table, key, &data[i]) );
+            }
+            assert( incremental == sh_rehashing(table) );
+
+            n_buckets = sh_nbuckets(table);
+            assert( n_buckets >= table->size );
+
+            for( t=0; t<sizeof threads / sizeof threads[0]; ++t ){
+                memset(seen, 0, sizeof seen);
+                memset(&total, 0, sizeof total);
+                total.seen = seen;
+                assert( sh_iterate_parallel(table, threads[t], &total, parallel_sum_init, parallel_sum_each, parallel_sum_reduce) );
+                assert( 5000 == total.count );
+                assert( 5000 * 4999 / 2 == total.sum );
+                for( i=0; i<5000; ++i ){
+                    assert( 1 == seen[i] );
+                }
+            }
+
+            /* ranges of our own, of uneven sizes */
+            memset(seen, 0, sizeof seen);
+            memset(&total, 0, sizeof total);
+            total.seen = seen;
+            for( start=0; start<n_buckets; start+=i ){
+                i = 1 + start % 37;
+                assert( sh_iterate_range(table, start, start + i < n_buckets ? start + i : n_buckets, &total, parallel_sum_each) );
+            }
+            assert( sh_iterate_range(table, n_buckets, n_buckets, &total, parallel_sum_each) );
+            assert( 5000 == total.count );
+            for( i=0; i<5000; ++i ){
+                assert( 1 == seen[i] );
+            }
+
+            /* without per thread state every thread shares ours */
+            memset(seen, 0, sizeof seen);
+            memset(&total, 0, sizeof total);
+            total.seen = seen;
+            assert( sh_iterate_parallel(table, 1, &total, 0, parallel_sum_each, 0) );
+            assert( 5000 == total.count );
+
+            assert( 0 == sh_iterate_range(table, 0, n_buckets + 1, &total, parallel_sum_each) );
+            assert( SH_ERR_INVALID == sh_last_error() );
+            assert( 0 == sh_iterate_range(table, 2, 1, &total, parallel_sum_each) );
+            assert( 0 == sh_iterate_range(table, 0, 1, &total, 0) );
+            assert( 0 == sh_iterate_parallel(table, 2, &total, 0, 0, 0) );
+
+            assert( sh_destroy(table, 1, 0) );
+        }
+    }
+
+    assert( 0 == sh_nbuckets(0) );
+    assert( 0 == sh_iterate_range(0, 0, 0, 0, parallel_sum_each) );
+    assert( 0 == sh_iterate_parallel(0, 2, 0, 0, parallel_sum_each, 0) );
+}
+
 int main(void){
     new_insert_get_destroy();
 
@@ -1065,18 +4324,64 @@ int main(void){
 
     delete();
 
+    lookup();
+
+    binary_keys();
+
+    prehashed();
+
+    hash_functions();
+
+    power_of_two();
+
     collision();
 
     resize();
 
+    load_factor();
+
+    incremental();
+
+    fingerprints();
+
+    robin_hood();
+
+    swiss();
+
+    slab();
+
+    borrowed_keys();
+
+    batch();
+
+    build();
+
+    parallel_resize();
+
+    statistics();
+
+    telemetry();
+
+    sharded();
+
+    rcu();
+
+    lockfree();
+
+    combining();
+
     destroy();
 
     error_handling();
 
+    error_reporting();
+
     internal();
 
     iteration();
 
+    parallel_iteration();
+
     puts("\noverall testing success!");
 
     return 0;